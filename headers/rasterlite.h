@@ -180,6 +180,147 @@ extern "C"
 						    sqlite3_stmt ** stmt,
 						    int *use_rtree);
 
+/*
+/ statistics of the last raster request
+*/
+#define RASTERLITE_STRATEGY_RTREE	1
+#define RASTERLITE_STRATEGY_PLAIN	2
+
+    typedef struct rasterlite_stats
+    {
+/* counters collected by the last rasterliteGetRaster*() or rasterliteGetRawImage*() call */
+	int level;		/* pyramid level used [as in rasterliteGetResolution]; -1 if none */
+	double pixel_x_size;	/* the pyramid level resolution */
+	double pixel_y_size;
+	int strategy;		/* RASTERLITE_STRATEGY_RTREE or RASTERLITE_STRATEGY_PLAIN */
+	int rows;		/* result set rows stepped */
+	int jpeg_tiles;		/* tiles decoded, by codec */
+	int png_tiles;
+	int gif_tiles;
+	int tiff_tiles;
+	sqlite3_int64 bytes;	/* tile BLOB bytes fetched */
+	int resized_tiles;	/* tiles resampled to the requested resolution */
+	int gray_rectangles;	/* tiles too small to be drawn */
+	double sql_time;	/* wall-clock seconds spent by each phase */
+	double decode_time;
+	double resample_time;	/* drawing resized tiles onto the output */
+	double composite_time;	/* background fill and 1:1 tiles drawing */
+	double encode_time;
+    } rasterliteStats;
+    typedef rasterliteStats *rasterliteStatsPtr;
+
+    RASTERLITE_DECLARE int rasterliteGetLastStats (void *handle,
+						   rasterliteStatsPtr stats);
+
+/*
+/ access strategy: by default the cheapest one is estimated for each request,
+/ using per-tile costs [in seconds] timed by the first request needing them;
+/ costs seeded by rasterliteSetAccessCosts are never timed again
+*/
+#define RASTERLITE_STRATEGY_AUTO	0
+
+    RASTERLITE_DECLARE void rasterliteSetAccessStrategy (void *handle,
+							 int strategy);
+    RASTERLITE_DECLARE int rasterliteGetAccessCosts (void *handle,
+						     double *scan_cost,
+						     double *rtree_cost);
+    RASTERLITE_DECLARE int rasterliteSetAccessCosts (void *handle,
+						     double scan_cost,
+						     double rtree_cost);
+
+/*
+/ JPEG codec profiles: SPEED trades a little quality for throughput [fast
+/ integer DCT, no fancy upsampling nor block smoothing, no COM marker],
+/ SIZE produces smaller files [optimized Huffman tables, progressive scans]
+*/
+#define RASTERLITE_JPEG_PROFILE_DEFAULT	0
+#define RASTERLITE_JPEG_PROFILE_SPEED	1
+#define RASTERLITE_JPEG_PROFILE_SIZE	2
+
+    RASTERLITE_DECLARE void rasterliteSetJpegProfile (void *handle,
+						      int profile);
+
+/*
+/ PNG compression options: packed into the quality_factor argument whenever
+/ the output is PNG; any value lacking RASTERLITE_PNG_OPTIONS [e.g. the
+/ usual 75] selects the zlib/libpng defaults
+*/
+#define RASTERLITE_PNG_OPTIONS	0x10000
+#define RASTERLITE_PNG_LEVEL_MASK	0x0f
+#define RASTERLITE_PNG_FILTER_NONE	0x10
+#define RASTERLITE_PNG_FILTER_SUB	0x20
+#define RASTERLITE_PNG_FILTER_UP	0x40
+#define RASTERLITE_PNG_FILTER_AVG	0x80
+#define RASTERLITE_PNG_FILTER_PAETH	0x100
+#define RASTERLITE_PNG_FILTER_ALL	0x1f0
+#define RASTERLITE_PNG_STRATEGY_DEFAULT	0x200
+#define RASTERLITE_PNG_STRATEGY_FILTERED	0x400
+#define RASTERLITE_PNG_STRATEGY_HUFFMAN	0x600
+#define RASTERLITE_PNG_STRATEGY_RLE	0x800
+#define RASTERLITE_PNG_STRATEGY_FIXED	0xa00
+#define RASTERLITE_PNG_STRATEGY_MASK	0xe00
+/* level: 0 - 9, or -1 for the zlib default; filters/strategy: 0 for the default */
+#define RASTERLITE_PNG_QUALITY(level, filters, strategy) \
+	(RASTERLITE_PNG_OPTIONS | (((level) + 1) & RASTERLITE_PNG_LEVEL_MASK) \
+	| (filters) | (strategy))
+
+/*
+/ TIFF compression options: packed into the quality_factor argument whenever
+/ the output is TIFF; any value lacking RASTERLITE_TIFF_OPTIONS stores
+/ uncompressed strips [ZSTD falls back to Deflate if libtiff lacks it]
+*/
+#define RASTERLITE_TIFF_OPTIONS	0x20000
+#define RASTERLITE_TIFF_COMPRESSION_MASK	0x0f
+#define RASTERLITE_TIFF_NONE	0x01
+#define RASTERLITE_TIFF_DEFLATE	0x02
+#define RASTERLITE_TIFF_LZW	0x03
+#define RASTERLITE_TIFF_ZSTD	0x04
+#define RASTERLITE_TIFF_PREDICTOR	0x10
+/* predictor: horizontal differencing [not applied to palette images] */
+#define RASTERLITE_TIFF_QUALITY(compression, predictor) \
+	(RASTERLITE_TIFF_OPTIONS | (compression) \
+	| ((predictor) ? RASTERLITE_TIFF_PREDICTOR : 0))
+
+/*
+/ building Pyramid levels
+*/
+#define RASTERLITE_PYRAMID_LEVELS	1
+#define RASTERLITE_PYRAMID_TOPMOST	2
+#define RASTERLITE_PYRAMID_ALL	3
+
+    typedef struct rasterlite_pyramid_options
+    {
+/* options controlling rasterliteBuildPyramids() */
+	int mode;		/* RASTERLITE_PYRAMID_LEVELS/TOPMOST/ALL */
+	int image_type;		/* GAIA_JPEG_BLOB, GAIA_PNG_BLOB or GAIA_TIFF_BLOB */
+	int quality_factor;	/* JPEG quality [10 - 90], RASTERLITE_PNG_QUALITY()
+				   or RASTERLITE_TIFF_QUALITY() */
+	int tile_size;		/* topmost tiles preferred size [128 - 8192] */
+	int threads;		/* worker threads; 0 means one per CPU */
+	int memory_limit;	/* max MB of tiles buffered at once; 0 = unlimited */
+	int test_mode;		/* only reporting the work to be done */
+    } rasterlitePyramidOptions;
+    typedef rasterlitePyramidOptions *rasterlitePyramidOptionsPtr;
+
+/*
+/ progress callback: source_name is NULL for topmost levels; returning
+/ any non-zero value cancels the build [the current level is rolled back]
+*/
+    typedef int (*rasterlitePyramidProgress) (const char *source_name,
+					      int level, int tiles_done,
+					      int tiles_total,
+					      void *user_data);
+
+    RASTERLITE_DECLARE void rasterliteInitPyramidOptions (rasterlitePyramidOptionsPtr
+							  options);
+    RASTERLITE_DECLARE int rasterliteBuildPyramids (void *handle,
+						    const
+						    rasterlitePyramidOptions *
+						    options,
+						    rasterlitePyramidProgress
+						    progress_cb,
+						    void *user_data);
+
 /*
 / utility functions returning a Raw image
 */
@@ -216,6 +357,11 @@ extern "C"
 							int raw_format,
 							int width, int height,
 							const char *path);
+    RASTERLITE_DECLARE int rasterliteRawImageToPngFile2 (const void *raw,
+							 int raw_format,
+							 int width, int height,
+							 const char *path,
+							 int quality);
     RASTERLITE_DECLARE int rasterliteRawImageToGifFile (const void *raw,
 							int raw_format,
 							int width, int height,
@@ -252,6 +398,16 @@ extern "C"
 								     int width,
 								     int height,
 								     int *size);
+    RASTERLITE_DECLARE unsigned char *rasterliteRawImageToPngMemBuf2 (const void
+								      *raw,
+								      int
+								      raw_format,
+								      int width,
+								      int
+								      height,
+								      int *size,
+								      int
+								      quality);
     RASTERLITE_DECLARE unsigned char *rasterliteRawImageToGifMemBuf (const void
 								     *raw,
 								     int
@@ -269,6 +425,20 @@ extern "C"
 								      int
 								      *size);
 
+/*
+/ hands back a buffer returned by rasterliteGetRaster* or by the
+/ rasterliteRawImageTo*MemBuf functions, so that the calling thread
+/ may recycle it for its next image; plain free() remains valid
+*/
+    RASTERLITE_DECLARE void rasterliteReleaseBuffer (void *buffer, int size);
+
+/*
+/ large PNG and JPEG images are encoded by one thread per CPU by default;
+/ THREADS caps them process-wide [1: always serial; 0: one per CPU], e.g.
+/ when the caller already runs many workers itself
+*/
+    RASTERLITE_DECLARE void rasterliteSetEncoderThreads (int threads);
+
 #ifdef __cplusplus
 }
 #endif
@@ -62,12 +62,33 @@
 
 #define NTILES	8192
 
+#define STRATEGY_AUTO	0
 #define STRATEGY_RTREE	1
 #define STRATEGY_PLAIN	2
 
+/* access cost model defaults, in seconds: used when calibration isn't possible */
+#define DEFAULT_SCAN_COST	0.000001
+#define DEFAULT_RTREE_COST	0.000004
+
 #define RASTERLITE_TRUE	-1
 #define RASTERLITE_FALSE	-2
 
+#ifdef RASTERLITE_USDT
+/* USDT probes [--enable-usdt]: provider "rasterlite" */
+#include <sys/sdt.h>
+#define RASTERLITE_PROBE2(name, a, b) \
+	DTRACE_PROBE2(rasterlite, name, a, b)
+#define RASTERLITE_PROBE3(name, a, b, c) \
+	DTRACE_PROBE3(rasterlite, name, a, b, c)
+#define RASTERLITE_PROBE4(name, a, b, c, d) \
+	DTRACE_PROBE4(rasterlite, name, a, b, c, d)
+#else
+/* default build: probes compile to nothing, arguments aren't evaluated */
+#define RASTERLITE_PROBE2(name, a, b)
+#define RASTERLITE_PROBE3(name, a, b, c)
+#define RASTERLITE_PROBE4(name, a, b, c, d)
+#endif
+
 #define true_color(r, g, b) (((r) << 16) + ((g) << 8) + (b))
 #define image_set_pixel(img, x, y, color) 	img->pixels[y][x] = color
 #define true_color_get_red(c) (((c) & 0xFF0000) >> 16)
@@ -113,6 +134,7 @@ struct geo_info
     const char *table;		/* the DB table name */
     int image_type;		/* the preferred image type [to be used for tiles] */
     int quality_factor;		/* the quality factor for JPEG compression */
+    int jpeg_profile;		/* RASTERLITE_JPEG_PROFILE_xx */
     struct tile_info tiles[NTILES];
 };
 
@@ -167,6 +189,32 @@ struct thumbnail_tile
     gaiaGeomCollPtr geometry;	/* geometry corresponding to this raster */
 };
 
+/* the phases of a raster request, as timed on the handle */
+#define RASTERLITE_PHASE_SQL		0
+#define RASTERLITE_PHASE_DECODE		1
+#define RASTERLITE_PHASE_RESAMPLE	2
+#define RASTERLITE_PHASE_COMPOSITE	3
+#define RASTERLITE_PHASE_ENCODE		4
+#define RASTERLITE_PHASES			5
+
+struct request_stats
+{
+/* counters collected by the last raster request */
+    int level;			/* the pyramid level used; -1 if none */
+    double pixel_x_size;
+    double pixel_y_size;
+    int strategy;		/* STRATEGY_RTREE or STRATEGY_PLAIN */
+    int rows;			/* result set rows stepped */
+    int jpeg_tiles;		/* tiles decoded, by codec */
+    int png_tiles;
+    int gif_tiles;
+    int tiff_tiles;
+    sqlite3_int64 bytes;	/* tile BLOB bytes fetched */
+    int resized_tiles;
+    int gray_rectangles;
+    double phase_time[RASTERLITE_PHASES];	/* seconds spent by each phase */
+};
+
 typedef struct raster_lite
 {
 /* the RasterLite HANDLE struct */
@@ -190,6 +238,18 @@ typedef struct raster_lite
     int levels;
     int transparent_color;
     int background_color;
+    int access_strategy;	/* STRATEGY_AUTO (cost model) or a forced strategy */
+    double scan_cost;		/* seconds per tile visited by a plain table scan */
+    double rtree_cost;		/* seconds per tile candidate from the R*Tree */
+    int jpeg_profile;		/* RASTERLITE_JPEG_PROFILE_xx */
+    int cost_model_ready;	/* the extent [and maybe the costs] have been probed */
+    int costs_seeded;		/* the costs were set by rasterliteSetAccessCosts */
+    int has_extent;		/* the full extent below is known */
+    double min_x;
+    double min_y;
+    double max_x;
+    double max_y;
+    struct request_stats stats;
 } rasterlite;
 
 typedef rasterlite *rasterlitePtr;
@@ -205,6 +265,55 @@ typedef struct raster_lite_image
 
 typedef rasterliteImage *rasterliteImagePtr;
 
+#define TILE_SINK_PENDING	0
+#define TILE_SINK_DRAW		1
+#define TILE_SINK_GRAY		2
+#define TILE_SINK_ERROR		3
+
+typedef struct raster_lite_tile_sink
+{
+/*
+/ a canvas region receiving the scanlines of a tile straight from the decoder
+/ a NULL canvas simply builds a new image having the tile's own dims
+*/
+    rasterliteImagePtr canvas;
+    int own_canvas;		/* the canvas was built by the sink itself */
+    double origin_x;		/* tile upper left corner, in canvas pixels */
+    double origin_y;
+    double tile_pixel_x_size;	/* tile resolution */
+    double tile_pixel_y_size;
+    double canvas_pixel_x_size;	/* canvas resolution */
+    double canvas_pixel_y_size;
+    int transparent_color;	/* pixels of this color are never drawn */
+    int status;			/* TILE_SINK_xx */
+    int color_space;		/* as reported by the decoder */
+    int resized;
+    int src_width;		/* tile dims, as decoded */
+    int src_height;
+    int base_x;			/* tile position and dims on the canvas */
+    int base_y;
+    int width;
+    int height;
+    int x_delta;		/* nearest neighbour steps [16.16 fixed point] */
+    int y_delta;
+    int x_factor;		/* integral shrink factors [box filter] */
+    int y_factor;
+    int dst_row;
+    int run_first;
+    int run_last;
+    int *scanline;
+    unsigned int *sums;
+    double resample_time;	/* seconds spent drawing resized scanlines */
+    double composite_time;	/* seconds spent drawing 1:1 scanlines */
+} rasterliteTileSink;
+
+typedef rasterliteTileSink *rasterliteTileSinkPtr;
+
+extern double phase_clock ();
+extern void reset_error (rasterlitePtr handle);
+extern void set_error (rasterlitePtr handle, const char *error);
+extern void fetch_resolutions (rasterlitePtr handle);
+
 extern rasterliteImagePtr image_create (int sx, int sy);
 extern void image_destroy (rasterliteImagePtr img);
 extern void image_fill (const rasterliteImagePtr img, int color);
@@ -213,18 +322,33 @@ extern void make_thumbnail (const rasterliteImagePtr thumbnail,
 extern void image_resize (const rasterliteImagePtr dst,
 			  const rasterliteImagePtr src);
 
+extern void tile_sink_init (rasterliteTileSinkPtr sink,
+			    rasterliteImagePtr canvas);
+extern int tile_sink_begin (rasterliteTileSinkPtr sink, int width,
+			    int height, int color_space);
+extern int *tile_sink_scanline (rasterliteTileSinkPtr sink, int y);
+extern void tile_sink_commit (rasterliteTileSinkPtr sink, int y);
+extern rasterliteImagePtr tile_sink_release (rasterliteTileSinkPtr sink,
+					     int ret);
+
 extern void *image_to_jpeg (const rasterliteImagePtr img, int *size,
-			    int quality);
+			    int quality, int profile);
 extern void *image_to_jpeg_grayscale (const rasterliteImagePtr img, int *size,
-				      int quality);
-extern void *image_to_png_palette (const rasterliteImagePtr img, int *size);
-extern void *image_to_png_grayscale (const rasterliteImagePtr img, int *size);
-extern void *image_to_png_rgb (const rasterliteImagePtr img, int *size);
+				      int quality, int profile);
+extern void *image_to_png_palette (const rasterliteImagePtr img, int *size,
+				     int quality);
+extern void *image_to_png_grayscale (const rasterliteImagePtr img, int *size,
+				     int quality);
+extern void *image_to_png_rgb (const rasterliteImagePtr img, int *size,
+				     int quality);
 extern void *image_to_gif (const rasterliteImagePtr img, int *size);
 extern void *image_to_tiff_fax4 (const rasterliteImagePtr img, int *size);
-extern void *image_to_tiff_palette (const rasterliteImagePtr img, int *size);
-extern void *image_to_tiff_grayscale (const rasterliteImagePtr img, int *size);
-extern void *image_to_tiff_rgb (const rasterliteImagePtr img, int *size);
+extern void *image_to_tiff_palette (const rasterliteImagePtr img, int *size,
+				    int quality);
+extern void *image_to_tiff_grayscale (const rasterliteImagePtr img,
+				      int *size, int quality);
+extern void *image_to_tiff_rgb (const rasterliteImagePtr img, int *size,
+				int quality);
 
 extern void *image_to_rgb_array (const rasterliteImagePtr img, int *size);
 extern void *image_to_rgba_array (int transparent_color,
@@ -246,10 +370,19 @@ extern rasterliteImagePtr image_from_bgr_array (const void *raw, int width,
 extern rasterliteImagePtr image_from_bgra_array (const void *raw, int width,
 						 int height);
 
-extern rasterliteImagePtr image_from_jpeg (int size, const void *data);
+extern rasterliteImagePtr image_from_jpeg (int size, const void *data,
+					   int profile);
 extern rasterliteImagePtr image_from_png (int size, const void *data);
 extern rasterliteImagePtr image_from_gif (int size, const void *data);
 extern rasterliteImagePtr image_from_tiff (int size, const void *data);
+extern int image_from_jpeg_sink (int size, const void *data, int profile,
+				 rasterliteTileSinkPtr sink);
+extern int image_from_png_sink (int size, const void *data,
+				rasterliteTileSinkPtr sink);
+extern int image_from_gif_sink (int size, const void *data,
+				rasterliteTileSinkPtr sink);
+extern int image_from_tiff_sink (int size, const void *data,
+				 rasterliteTileSinkPtr sink);
 
 extern int is_image_monochrome (const rasterliteImagePtr img);
 extern int is_image_grayscale (const rasterliteImagePtr img);
@@ -307,6 +440,38 @@ extern void *xgdDPExtractData (struct xgdIOCtx *ctx, int *size);
 extern xgdIOCtx *xgdNewDynamicCtx (int initialSize, const void *data);
 extern xgdIOCtx *xgdNewDynamicCtxEx (int initialSize, const void *data,
 				     int freeOKFlag);
-extern int palette_set (int *mapping, int color);
+
+#define BUFFER_POOL_MIN_CLASS	12	/* 4 KB */
+#define BUFFER_POOL_MAX_CLASS	26	/* 64 MB */
+#define BUFFER_POOL_DEPTH	4	/* idle buffers per size class */
+#define BUFFER_POOL_MAX_BYTES	(128 * 1024 * 1024)	/* per thread */
+
+extern void *buffer_pool_acquire (int size, int *capacity);
+extern void buffer_pool_release (void *buffer, int capacity);
+
+#define PALETTE_HASH_SIZE	512
+
+struct palette_map
+{
+/* an open-addressing color to palette index map, up to 256 colors */
+    int colors[256];		/* the palette, in first-seen order; -1 if unused */
+    int count;
+    int keys[PALETTE_HASH_SIZE];	/* hashed colors; -1 marks an empty slot */
+    unsigned char index[PALETTE_HASH_SIZE];
+    int last_color;		/* one-entry cache, for runs of the same color */
+    int last_index;
+};
+
+extern void palette_init (struct palette_map *map);
+extern int palette_lookup (struct palette_map *map, int color);
+extern int palette_set (struct palette_map *map, int color);
+
+/* images this big are encoded by many threads, when more CPUs are available */
+#define PARALLEL_ENCODER_MIN_PIXELS	(2048 * 2048)
+
+extern void set_encoder_threads (int threads);
+extern void set_thread_encoder_threads (int threads);
+extern int parallel_encoder_threads (const rasterliteImagePtr img);
+
 extern int xgdPutBuf (const void *buf, int size, xgdIOCtx * ctx);
 extern int xgdGetBuf (void *, int, xgdIOCtx *);
@@ -53,6 +53,12 @@
 #include <float.h>
 #include <math.h>
 
+#if defined(_WIN32) && !defined(__MINGW32__)
+#include <time.h>
+#else
+#include <sys/time.h>
+#endif
+
 #include "rasterlite_tiff_hdrs.h"
 #include <tiffio.h>
 
@@ -73,7 +79,7 @@
 #define strcasecmp	_stricmp
 #endif /* not WIN32 */
 
-static void
+extern void
 reset_error (rasterlitePtr handle)
 {
 /* resetting the last error description */
@@ -83,7 +89,7 @@ reset_error (rasterlitePtr handle)
     handle->error = RASTERLITE_OK;
 }
 
-static void
+extern void
 set_error (rasterlitePtr handle, const char *error)
 {
 /* setting up the last error description */
@@ -159,7 +165,7 @@ get_extent (rasterlitePtr handle, double *min_x, double *min_y, double *max_x,
     return 0;
 }
 
-static void
+extern void
 fetch_resolutions (rasterlitePtr handle)
 {
 /* trying to retrieve the available raster resolutions */
@@ -494,6 +500,223 @@ db_connect (const char *path, const char *table, char *error)
     return NULL;
 }
 
+extern double
+phase_clock ()
+{
+/* a wall-clock timestamp, in seconds */
+#if defined(_WIN32) && !defined(__MINGW32__)
+/* MSVC's clock() measures the elapsed wall-clock time */
+    return (double) clock () / (double) CLOCKS_PER_SEC;
+#else
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (double) tv.tv_sec + ((double) tv.tv_usec / 1000000.0);
+#endif
+}
+
+static double
+time_count_query (sqlite3 * sqlite, const char *sql, const double *params,
+		  int n_params, int *count)
+{
+/* timing some SELECT Count(*) query; the best of three runs, or -1.0 on failure */
+    sqlite3_stmt *stmt;
+    int ret;
+    int i;
+    int run;
+    double t0;
+    double elapsed;
+    double best = -1.0;
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+	return -1.0;
+    for (run = 0; run < 3; run++)
+      {
+	  sqlite3_reset (stmt);
+	  sqlite3_clear_bindings (stmt);
+	  for (i = 0; i < n_params; i++)
+	      sqlite3_bind_double (stmt, i + 1, params[i]);
+	  t0 = phase_clock ();
+	  ret = sqlite3_step (stmt);
+	  elapsed = phase_clock () - t0;
+	  if (ret != SQLITE_ROW)
+	    {
+		sqlite3_finalize (stmt);
+		return -1.0;
+	    }
+	  *count = sqlite3_column_int (stmt, 0);
+	  if (best < 0.0 || elapsed < best)
+	      best = elapsed;
+      }
+    sqlite3_finalize (stmt);
+    return best;
+}
+
+static void
+estimate_tile_size (rasterlitePtr handle, int level, double *tile_w,
+		    double *tile_h)
+{
+/* 
+/ estimating the tile size of some level, assuming tiles square in pixels
+/ and evenly spread over the full extent
+*/
+    double tile_area =
+	((handle->max_x - handle->min_x) * (handle->max_y - handle->min_y)) /
+	(double) (handle->tile_count[level]);
+    *tile_w =
+	sqrt (tile_area * (handle->pixel_x_size[level] /
+			   handle->pixel_y_size[level]));
+    *tile_h = tile_area / *tile_w;
+}
+
+static double
+estimate_tiles (rasterlitePtr handle, int level, double min_x, double min_y,
+		double max_x, double max_y)
+{
+/* estimating how many tiles of some level intersect the given window */
+    double tile_w;
+    double tile_h;
+    double tiles;
+    double n = (double) (handle->tile_count[level]);
+    if (n <= 0.0)
+	return 0.0;
+/* clipping the window against the full extent */
+    if (min_x < handle->min_x)
+	min_x = handle->min_x;
+    if (min_y < handle->min_y)
+	min_y = handle->min_y;
+    if (max_x > handle->max_x)
+	max_x = handle->max_x;
+    if (max_y > handle->max_y)
+	max_y = handle->max_y;
+    if (max_x < min_x || max_y < min_y)
+	return 0.0;
+    estimate_tile_size (handle, level, &tile_w, &tile_h);
+    tiles = (((max_x - min_x) / tile_w) + 1.0) * (((max_y - min_y) / tile_h) +
+						  1.0);
+    if (tiles > n)
+	tiles = n;
+    return tiles;
+}
+
+static void
+load_extent (rasterlitePtr handle)
+{
+/* the full extent, as cheaply reported by the R*Tree */
+    sqlite3_stmt *stmt;
+    int ret;
+    char sql[1024];
+    double params[4];
+    int i;
+    sprintf (sql,
+	     "SELECT Min(xmin), Min(ymin), Max(xmax), Max(ymax) FROM \"idx_%s_metadata_geometry\"",
+	     handle->table_prefix);
+    ret = sqlite3_prepare_v2 (handle->handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+	return;
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+      {
+	  for (i = 0; i < 4; i++)
+	    {
+		if (sqlite3_column_type (stmt, i) == SQLITE_NULL)
+		    break;
+		params[i] = sqlite3_column_double (stmt, i);
+	    }
+	  if (i == 4 && params[2] > params[0] && params[3] > params[1])
+	    {
+		handle->min_x = params[0];
+		handle->min_y = params[1];
+		handle->max_x = params[2];
+		handle->max_y = params[3];
+		handle->has_extent = 1;
+	    }
+      }
+    sqlite3_finalize (stmt);
+}
+
+static void
+calibrate_access (rasterlitePtr handle)
+{
+/* 
+/ timing both access strategies on this data source, so to calibrate
+/ the cost model; the defaults are kept if anything goes wrong
+*/
+    char sql[1024];
+    double params[6];
+    int i;
+    int level = -1;
+    double dist;
+    double min_dist = DBL_MAX;
+    double tile_w;
+    double tile_h;
+    double cx;
+    double cy;
+    double t_scan;
+    double t_rtree;
+    int scanned;
+    int candidates;
+/* calibrating on the level closest to a thousand tiles */
+    for (i = 0; i < handle->levels; i++)
+      {
+	  if (handle->tile_count[i] < 1)
+	      continue;
+	  dist = fabs (log ((double) (handle->tile_count[i])) - log (1024.0));
+	  if (dist < min_dist)
+	    {
+		min_dist = dist;
+		level = i;
+	    }
+      }
+    if (level < 0)
+	return;
+    estimate_tile_size (handle, level, &tile_w, &tile_h);
+/* plain Table Scan: an empty window still visits every tile of the level */
+    sprintf (sql, "SELECT Count(*) FROM \"%s_metadata\" ",
+	     handle->table_prefix);
+    strcat (sql, "WHERE pixel_x_size = ? AND pixel_y_size = ? ");
+    strcat (sql, "AND MbrIntersects(geometry, BuildMbr(?, ?, ?, ?))");
+    params[0] = handle->pixel_x_size[level];
+    params[1] = handle->pixel_y_size[level];
+    params[2] = handle->min_x - (2.0 * tile_w);
+    params[3] = handle->min_y - (2.0 * tile_h);
+    params[4] = handle->min_x - tile_w;
+    params[5] = handle->min_y - tile_h;
+    t_scan = time_count_query (handle->handle, sql, params, 6, &scanned);
+/* R*Tree: a window about 16 x 16 tiles wide, centered on the extent */
+    sprintf (sql, "SELECT Count(*) FROM \"%s_metadata\" ",
+	     handle->table_prefix);
+    strcat (sql, "WHERE ROWID IN (SELECT pkid FROM \"idx_");
+    strcat (sql, handle->table_prefix);
+    strcat (sql, "_metadata_geometry\" ");
+    strcat (sql, "WHERE xmin < ? AND xmax > ? AND ymin < ? AND ymax > ?)");
+    cx = handle->min_x + ((handle->max_x - handle->min_x) / 2.0);
+    cy = handle->min_y + ((handle->max_y - handle->min_y) / 2.0);
+    params[0] = cx + (8.0 * tile_w);
+    params[1] = cx - (8.0 * tile_w);
+    params[2] = cy + (8.0 * tile_h);
+    params[3] = cy - (8.0 * tile_h);
+    t_rtree = time_count_query (handle->handle, sql, params, 4, &candidates);
+    if (t_scan <= 0.0 || t_rtree <= 0.0 || candidates < 1)
+	return;
+    handle->scan_cost = t_scan / (double) (handle->tile_count[level]);
+    handle->rtree_cost = t_rtree / (double) candidates;
+}
+
+static void
+prepare_cost_model (rasterlitePtr handle)
+{
+/* 
+/ lazily preparing the cost model, once for all on the first request
+/ needing it: the access costs are only timed if not already seeded
+*/
+    if (handle->cost_model_ready)
+	return;
+    handle->cost_model_ready = 1;
+    load_extent (handle);
+    if (!(handle->has_extent) || handle->costs_seeded)
+	return;
+    calibrate_access (handle);
+}
+
 RASTERLITE_DECLARE void *
 rasterliteOpen (const char *path, const char *table_prefix)
 {
@@ -530,6 +753,19 @@ rasterliteOpen (const char *path, const char *table_prefix)
     handle->levels = 0;
     handle->transparent_color = -1;
     handle->background_color = true_color (0, 0, 0);
+    handle->access_strategy = STRATEGY_AUTO;
+    handle->scan_cost = DEFAULT_SCAN_COST;
+    handle->rtree_cost = DEFAULT_RTREE_COST;
+    handle->jpeg_profile = RASTERLITE_JPEG_PROFILE_DEFAULT;
+    handle->cost_model_ready = 0;
+    handle->costs_seeded = 0;
+    handle->has_extent = 0;
+    handle->min_x = 0.0;
+    handle->min_y = 0.0;
+    handle->max_x = 0.0;
+    handle->max_y = 0.0;
+    memset (&(handle->stats), 0, sizeof (struct request_stats));
+    handle->stats.level = -1;
 /* initializing SpatiaLite */
     spatialite_init (0);
 /* retrieving the Version Infos */
@@ -575,8 +811,13 @@ rasterliteOpen (const char *path, const char *table_prefix)
 	  set_error (handle, error);
 	  return handle;
       }
-/* preparing the SQL statement [using the R*Tree Spatial Index] */
-    strcpy (sql, "SELECT m.geometry, r.raster FROM \"");
+/* 
+/ preparing the SQL statement [using the R*Tree Spatial Index]
+/ columns #0 and #1 [geometry, raster] are the ones rasterliteGetBestAccess()
+/ always handed out: the tile MBR corners and ID are simply appended
+*/
+    strcpy (sql, "SELECT m.geometry, r.raster, MbrMinX(m.geometry), ");
+    strcat (sql, "MbrMaxY(m.geometry), m.id FROM \"");
     strcat (sql, handle->table_prefix);
     strcat (sql, "_metadata\" AS m, \"");
     strcat (sql, handle->table_prefix);
@@ -597,7 +838,8 @@ rasterliteOpen (const char *path, const char *table_prefix)
 	  return handle;
       }
 /* preparing the SQL statement [plain Table Scan] */
-    strcpy (sql, "SELECT m.geometry, r.raster FROM \"");
+    strcpy (sql, "SELECT m.geometry, r.raster, MbrMinX(m.geometry), ");
+    strcat (sql, "MbrMaxY(m.geometry), m.id FROM \"");
     strcat (sql, handle->table_prefix);
     strcat (sql, "_metadata\" AS m, \"");
     strcat (sql, handle->table_prefix);
@@ -720,18 +962,52 @@ rasterliteGetBackgroundColor (void *ext_handle, unsigned char *red,
     return RASTERLITE_OK;
 }
 
+static int
+choose_strategy (rasterlitePtr handle, int level, double min_x, double min_y,
+		 double max_x, double max_y)
+{
+/* 
+/ comparing the estimated cost of both access strategies:
+/ - a plain Table Scan visits every tile of the level
+/ - the R*Tree indexes all levels together, so each level intersecting
+/   the window contributes its own candidates
+*/
+    int i;
+    double candidates = 0.0;
+    double scan;
+    double rtree;
+    if (handle->access_strategy != STRATEGY_AUTO)
+	return handle->access_strategy;
+    prepare_cost_model (handle);
+    if (!(handle->has_extent))
+      {
+	  /* no extent, no estimate: falling back to a fixed threshold */
+	  if (handle->tile_count[level] > 500)
+	      return STRATEGY_RTREE;
+	  return STRATEGY_PLAIN;
+      }
+    for (i = 0; i < handle->levels; i++)
+	candidates += estimate_tiles (handle, i, min_x, min_y, max_x, max_y);
+    scan = handle->scan_cost * (double) (handle->tile_count[level]);
+    rtree = handle->rtree_cost * candidates;
+    if (rtree < scan)
+	return STRATEGY_RTREE;
+    return STRATEGY_PLAIN;
+}
+
 static int
 best_raster_resolution (rasterlitePtr handle, double requested_ratio_x,
+			double min_x, double min_y, double max_x, double max_y,
 			double *pixel_x_size, double *pixel_y_size,
 			int *strategy)
 {
-/* selects the best available resolution */
+/* selects the best available resolution and access strategy */
     int i;
+    int level = -1;
     double min_dist = DBL_MAX;
     double dist;
     double best_x = DBL_MAX;
     double best_y = DBL_MAX;
-    int tile_count = -1;
     for (i = 0; i < handle->levels; i++)
       {
 	  dist = fabs (requested_ratio_x - handle->pixel_x_size[i]);
@@ -740,23 +1016,18 @@ best_raster_resolution (rasterlitePtr handle, double requested_ratio_x,
 		min_dist = dist;
 		best_x = handle->pixel_x_size[i];
 		best_y = handle->pixel_y_size[i];
-		tile_count = handle->tile_count[i];
+		level = i;
 	    }
       }
     if (best_x == DBL_MAX || best_y == DBL_MAX)
 	return RASTERLITE_ERROR;
     *pixel_x_size = best_x;
     *pixel_y_size = best_y;
-    if (tile_count > 500)
-      {
-	  /* best access strategy: USING R*TRee */
-	  *strategy = STRATEGY_RTREE;
-      }
-    else
-      {
-	  /* best access strategy: TABLE SCAN */
-	  *strategy = STRATEGY_PLAIN;
-      }
+    *strategy = choose_strategy (handle, level, min_x, min_y, max_x, max_y);
+    handle->stats.level = level;
+    handle->stats.pixel_x_size = best_x;
+    handle->stats.pixel_y_size = best_y;
+    handle->stats.strategy = *strategy;
     return RASTERLITE_OK;
 }
 
@@ -793,63 +1064,105 @@ mark_gray_rectangle (rasterliteImagePtr output, int base_x, int base_y,
       }
 }
 
-static void
-copy_rectangle (rasterliteImagePtr output, rasterliteImagePtr input,
-		int transparent_color, int base_x, int base_y)
-{
-/* copying a raster rectangle */
-    int x;
-    int y;
-    int dst_x;
-    int dst_y;
-    int pixel;
-    for (y = 0; y < input->sy; y++)
-      {
-	  dst_y = base_y + y;
-	  if (dst_y < 0)
-	      continue;
-	  if (dst_y >= output->sy)
-	      break;
-	  for (x = 0; x < input->sx; x++)
-	    {
-		dst_x = base_x + x;
-		if (dst_x < 0)
-		    continue;
-		if (dst_x >= output->sx)
-		    break;
-		pixel = input->pixels[y][x];
-		if (pixel == transparent_color)
-		    continue;
-		image_set_pixel (output, dst_x, dst_y, pixel);
-	    }
-      }
-}
-
 static double
-internal_round (double value)
+phase_mark (rasterlitePtr handle, int phase, double since)
 {
-/* replacing the C99 round() function */
-    double min = floor (value);
-    if (fabs (value - min) < 0.5)
-	return min;
-    return min + 1.0;
+/* charging the time elapsed since the last mark to some request phase */
+    double now = phase_clock ();
+    handle->stats.phase_time[phase] += now - since;
+    return now;
 }
 
-static int
-int_round (double value)
+static void
+draw_tile (rasterlitePtr handle, sqlite3_stmt * stmt,
+	   rasterliteTileSinkPtr sink)
 {
-/* replacing the C99 round() function */
-    double min = floor (value);
-    if (fabs (value - min) < 0.5)
-	return (int) min;
-    return (int) (min + 1.0);
+/* decoding the current raster tile, scanlines going straight to the output */
+    const void *blob = sqlite3_column_blob (stmt, 1);
+    int blob_size = sqlite3_column_bytes (stmt, 1);
+    int type = gaiaGuessBlobType (blob, blob_size);
+    int *counter = NULL;
+    int ret = RASTERLITE_ERROR;
+    rasterliteImagePtr output = sink->canvas;
+    RASTERLITE_PROBE3 (tile__fetch, sqlite3_column_int64 (stmt, 4),
+		       blob_size, type);
+    handle->stats.bytes += blob_size;
+    if (type == GAIA_JPEG_BLOB || type == GAIA_EXIF_BLOB
+	|| type == GAIA_EXIF_GPS_BLOB)
+      {
+	  ret =
+	      image_from_jpeg_sink (blob_size, blob, handle->jpeg_profile,
+				    sink);
+	  counter = &(handle->stats.jpeg_tiles);
+      }
+    else if (type == GAIA_PNG_BLOB)
+      {
+	  ret = image_from_png_sink (blob_size, blob, sink);
+	  counter = &(handle->stats.png_tiles);
+      }
+    else if (type == GAIA_GIF_BLOB)
+      {
+	  ret = image_from_gif_sink (blob_size, blob, sink);
+	  counter = &(handle->stats.gif_tiles);
+      }
+    else if (type == GAIA_TIFF_BLOB)
+      {
+	  ret = image_from_tiff_sink (blob_size, blob, sink);
+	  counter = &(handle->stats.tiff_tiles);
+      }
+    tile_sink_release (sink, ret);
+/* 
+/ the caller charges the whole tile to the DECODE phase: the time spent
+/ by the sink drawing the scanlines is moved to its own phases
+*/
+    handle->stats.phase_time[RASTERLITE_PHASE_RESAMPLE] += sink->resample_time;
+    handle->stats.phase_time[RASTERLITE_PHASE_COMPOSITE] +=
+	sink->composite_time;
+    handle->stats.phase_time[RASTERLITE_PHASE_DECODE] -=
+	sink->resample_time + sink->composite_time;
+    if (ret != RASTERLITE_OK || !counter)
+	return;
+    *counter += 1;
+    if (sink->status == TILE_SINK_GRAY)
+      {
+	  /* TOO BIG: drawing a gray rectangle */
+	  double t0 = phase_clock ();
+	  double elapsed;
+	  mark_gray_rectangle (output, sink->base_x, sink->base_y,
+			       sink->width, sink->height);
+	  elapsed = phase_clock () - t0;
+	  handle->stats.phase_time[RASTERLITE_PHASE_COMPOSITE] += elapsed;
+	  handle->stats.phase_time[RASTERLITE_PHASE_DECODE] -= elapsed;
+	  handle->stats.gray_rectangles += 1;
+	  return;
+      }
+    if (sink->status != TILE_SINK_DRAW)
+	return;
+    if (sink->resized)
+	handle->stats.resized_tiles += 1;
+/* adjunsting the required colorspace */
+    if (output->color_space == COLORSPACE_MONOCHROME)
+      {
+	  if (sink->color_space != COLORSPACE_MONOCHROME)
+	      output->color_space = sink->color_space;
+      }
+    if (output->color_space == COLORSPACE_PALETTE)
+      {
+	  if (sink->color_space != COLORSPACE_PALETTE)
+	      output->color_space = COLORSPACE_RGB;
+      }
+    if (output->color_space == COLORSPACE_GRAYSCALE)
+      {
+	  if (sink->color_space != COLORSPACE_GRAYSCALE)
+	      output->color_space = COLORSPACE_RGB;
+      }
 }
 
-RASTERLITE_DECLARE int
-rasterliteGetRaster2 (void *ext_handle, double cx, double cy,
-		      double ext_pixel_x_size, double ext_pixel_y_size,
-		      int width, int height, int image_type, int quality_factor,
-		      void **raster, int *size)
+static int
+get_raster2 (void *ext_handle, double cx, double cy,
+	     double ext_pixel_x_size, double ext_pixel_y_size,
+	     int width, int height, int image_type, int quality_factor,
+	     void **raster, int *size)
 {
 /* trying to build the required raster image */
     rasterlitePtr handle = (rasterlitePtr) ext_handle;
@@ -868,7 +1181,11 @@ rasterliteGetRaster2 (void *ext_handle, double cx, double cy,
     double min_y = cy - (map_height / 2.0);
     double max_y = cy + (map_height / 2.0);
     rasterliteImagePtr output = NULL;
+    double t0;
     reset_error (handle);
+    memset (&(handle->stats), 0, sizeof (struct request_stats));
+    handle->stats.level = -1;
+    t0 = phase_clock ();
     if (handle->handle == NULL || handle->stmt_rtree == NULL
 	|| handle->stmt_plain == NULL)
       {
@@ -887,13 +1204,14 @@ rasterliteGetRaster2 (void *ext_handle, double cx, double cy,
 	  return RASTERLITE_ERROR;
       }
     if (best_raster_resolution
-	(ext_handle, ext_pixel_x_size, &pixel_x_size, &pixel_y_size,
-	 &strategy) != RASTERLITE_OK)
+	(ext_handle, ext_pixel_x_size, min_x, min_y, max_x, max_y,
+	 &pixel_x_size, &pixel_y_size, &strategy) != RASTERLITE_OK)
       {
 	  *raster = NULL;
 	  *size = 0;
 	  return RASTERLITE_ERROR;
       }
+    t0 = phase_mark (handle, RASTERLITE_PHASE_SQL, t0);
     if (strategy == STRATEGY_RTREE)
 	stmt = handle->stmt_rtree;
     else
@@ -923,103 +1241,46 @@ rasterliteGetRaster2 (void *ext_handle, double cx, double cy,
       }
     sqlite3_bind_double (stmt, 5, pixel_x_size);
     sqlite3_bind_double (stmt, 6, pixel_y_size);
+    t0 = phase_mark (handle, RASTERLITE_PHASE_COMPOSITE, t0);
     while (1)
       {
 	  /* scrolling the result set */
 	  ret = sqlite3_step (stmt);
+	  t0 = phase_mark (handle, RASTERLITE_PHASE_SQL, t0);
 	  if (ret == SQLITE_DONE)
 	      break;		/* end of result set */
 	  if (ret == SQLITE_ROW)
 	    {
 		/* retrieving query values */
-		gaiaGeomCollPtr geom = NULL;
-		rasterliteImagePtr img = NULL;
-		if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB)
-		  {
-		      /* fetching Geometry */
-		      const void *blob = sqlite3_column_blob (stmt, 0);
-		      int blob_size = sqlite3_column_bytes (stmt, 0);
-		      geom =
-			  gaiaFromSpatiaLiteBlobWkb ((const unsigned char *)
-						     blob, blob_size);
-		  }
-		if (sqlite3_column_type (stmt, 1) == SQLITE_BLOB)
+		int has_mbr = 0;
+		double tile_min_x = 0.0;
+		double tile_max_y = 0.0;
+		handle->stats.rows += 1;
+		if (sqlite3_column_type (stmt, 2) == SQLITE_FLOAT
+		    && sqlite3_column_type (stmt, 3) == SQLITE_FLOAT)
 		  {
-		      /* fetching Raster Image */
-		      const void *blob = sqlite3_column_blob (stmt, 1);
-		      int blob_size = sqlite3_column_bytes (stmt, 1);
-		      int type = gaiaGuessBlobType (blob, blob_size);
-		      if (type == GAIA_JPEG_BLOB || type == GAIA_EXIF_BLOB
-			  || type == GAIA_EXIF_GPS_BLOB)
-			  img = image_from_jpeg (blob_size, (void *) blob);
-		      else if (type == GAIA_PNG_BLOB)
-			  img = image_from_png (blob_size, (void *) blob);
-		      else if (type == GAIA_GIF_BLOB)
-			  img = image_from_gif (blob_size, (void *) blob);
-		      else if (type == GAIA_TIFF_BLOB)
-			  img = image_from_tiff (blob_size, (void *) blob);
+		      /* fetching the tile MBR */
+		      tile_min_x = sqlite3_column_double (stmt, 2);
+		      tile_max_y = sqlite3_column_double (stmt, 3);
+		      has_mbr = 1;
 		  }
-		if (geom && img)
+		if (has_mbr && sqlite3_column_type (stmt, 1) == SQLITE_BLOB)
 		  {
-		      /* resizing the image [tile] */
-		      double pre_width =
-			  internal_round (((double) (img->sx) * pixel_x_size) /
-					  ext_pixel_x_size);
-		      double pre_height =
-			  internal_round (((double) (img->sy) * pixel_y_size) /
-					  ext_pixel_y_size);
-		      int new_width = (int) pre_width + 1;
-		      int new_height = (int) pre_height + 1;
-		      double x = (geom->MinX - min_x) / ext_pixel_x_size;
-		      double y =
+		      /* decoding the raster tile straight into the output */
+		      rasterliteTileSink sink;
+		      tile_sink_init (&sink, output);
+		      sink.origin_x = (tile_min_x - min_x) / ext_pixel_x_size;
+		      sink.origin_y =
 			  (double) height -
-			  ((geom->MaxY - min_y) / ext_pixel_y_size);
-		      if (new_width > (img->sx * 16)
-			  || new_height > (img->sy * 16))
-			{
-			    /* TOO BIG: drawing a gray rectangle */
-			    mark_gray_rectangle (output, int_round (x),
-						 int_round (y), new_width,
-						 new_height);
-			}
-		      else
-			{
-			    /* resizing the raster tile */
-			    if (new_width == img->sx && new_height == img->sy)
-				;
-			    else
-			      {
-				  rasterliteImagePtr img2 = img;
-				  img = image_create (new_width, new_height);
-				  image_resize (img, img2);
-				  image_destroy (img2);
-			      }
-			    /* drawing the raster tile */
-			    copy_rectangle (output, img,
-					    handle->transparent_color,
-					    int_round (x), int_round (y));
-			    /* adjunsting the required colorspace */
-			    if (output->color_space == COLORSPACE_MONOCHROME)
-			      {
-				  if (img->color_space != COLORSPACE_MONOCHROME)
-				      output->color_space = img->color_space;
-			      }
-			    if (output->color_space == COLORSPACE_PALETTE)
-			      {
-				  if (img->color_space != COLORSPACE_PALETTE)
-				      output->color_space = COLORSPACE_RGB;
-			      }
-			    if (output->color_space == COLORSPACE_GRAYSCALE)
-			      {
-				  if (img->color_space != COLORSPACE_GRAYSCALE)
-				      output->color_space = COLORSPACE_RGB;
-			      }
-			}
+			  ((tile_max_y - min_y) / ext_pixel_y_size);
+		      sink.tile_pixel_x_size = pixel_x_size;
+		      sink.tile_pixel_y_size = pixel_y_size;
+		      sink.canvas_pixel_x_size = ext_pixel_x_size;
+		      sink.canvas_pixel_y_size = ext_pixel_y_size;
+		      sink.transparent_color = handle->transparent_color;
+		      draw_tile (handle, stmt, &sink);
 		  }
-		if (geom)
-		    gaiaFreeGeomColl (geom);
-		if (img)
-		    image_destroy (img);
+		t0 = phase_mark (handle, RASTERLITE_PHASE_DECODE, t0);
 	    }
 	  else
 	    {
@@ -1050,11 +1311,16 @@ rasterliteGetRaster2 (void *ext_handle, double cx, double cy,
 	  if (output->color_space == COLORSPACE_MONOCHROME)
 	      tmp_raster = image_to_tiff_fax4 (output, &raster_size);
 	  else if (output->color_space == COLORSPACE_GRAYSCALE)
-	      tmp_raster = image_to_tiff_grayscale (output, &raster_size);
+	      tmp_raster =
+		  image_to_tiff_grayscale (output, &raster_size,
+					   quality_factor);
 	  else if (output->color_space == COLORSPACE_PALETTE)
-	      tmp_raster = image_to_tiff_palette (output, &raster_size);
+	      tmp_raster =
+		  image_to_tiff_palette (output, &raster_size,
+					 quality_factor);
 	  else
-	      tmp_raster = image_to_tiff_rgb (output, &raster_size);
+	      tmp_raster =
+		  image_to_tiff_rgb (output, &raster_size, quality_factor);
 	  if (!tmp_raster)
 	    {
 		sprintf (error, "TIFF compression error\n");
@@ -1069,11 +1335,14 @@ rasterliteGetRaster2 (void *ext_handle, double cx, double cy,
       {
 	  if (output->color_space == COLORSPACE_GRAYSCALE
 	      || output->color_space == COLORSPACE_MONOCHROME)
-	      tmp_raster = image_to_png_grayscale (output, &raster_size);
+	      tmp_raster = image_to_png_grayscale (output, &raster_size,
+						   quality_factor);
 	  else if (output->color_space == COLORSPACE_PALETTE)
-	      tmp_raster = image_to_png_palette (output, &raster_size);
+	      tmp_raster = image_to_png_palette (output, &raster_size,
+						 quality_factor);
 	  else
-	      tmp_raster = image_to_png_rgb (output, &raster_size);
+	      tmp_raster = image_to_png_rgb (output, &raster_size,
+					     quality_factor);
 	  if (!tmp_raster)
 	    {
 		sprintf (error, "PNG compression error\n");
@@ -1116,9 +1385,12 @@ rasterliteGetRaster2 (void *ext_handle, double cx, double cy,
 	      || output->color_space == COLORSPACE_MONOCHROME)
 	      tmp_raster =
 		  image_to_jpeg_grayscale (output, &raster_size,
-					   quality_factor);
+					   quality_factor,
+					   handle->jpeg_profile);
 	  else
-	      tmp_raster = image_to_jpeg (output, &raster_size, quality_factor);
+	      tmp_raster =
+		  image_to_jpeg (output, &raster_size, quality_factor,
+				 handle->jpeg_profile);
 	  if (!tmp_raster)
 	    {
 		sprintf (error, "JPEG compression error\n");
@@ -1132,9 +1404,28 @@ rasterliteGetRaster2 (void *ext_handle, double cx, double cy,
     *raster = tmp_raster;
     *size = raster_size;
     image_destroy (output);
+    phase_mark (handle, RASTERLITE_PHASE_ENCODE, t0);
     return RASTERLITE_OK;
 }
 
+RASTERLITE_DECLARE int
+rasterliteGetRaster2 (void *ext_handle, double cx, double cy,
+		      double ext_pixel_x_size, double ext_pixel_y_size,
+		      int width, int height, int image_type, int quality_factor,
+		      void **raster, int *size)
+{
+/* trying to build the required raster image */
+    int ret;
+    RASTERLITE_PROBE4 (get_raster__start, ext_handle, width, height,
+		       image_type);
+    ret =
+	get_raster2 (ext_handle, cx, cy, ext_pixel_x_size, ext_pixel_y_size,
+		     width, height, image_type, quality_factor, raster, size);
+    RASTERLITE_PROBE4 (get_raster__done, ext_handle, ret, *size,
+		       ((rasterlitePtr) ext_handle)->stats.rows);
+    return ret;
+}
+
 RASTERLITE_DECLARE int
 rasterliteGetRaster (void *handle, double cx, double cy, double pixel_size,
 		     int width, int height, int image_type, int quality_factor,
@@ -1186,11 +1477,11 @@ rasterliteGetRasterByRect (void *handle, double x1, double y1, double x2,
 				       quality_factor, raster, size);
 }
 
-RASTERLITE_DECLARE int
-rasterliteGetRawImage2 (void *ext_handle, double cx, double cy,
-			double ext_pixel_x_size, double ext_pixel_y_size,
-			int width, int height, int raw_format, void **raster,
-			int *size)
+static int
+get_raw_image2 (void *ext_handle, double cx, double cy,
+		double ext_pixel_x_size, double ext_pixel_y_size,
+		int width, int height, int raw_format, void **raster,
+		int *size)
 {
 /* trying to build the required RAW raster image */
     rasterlitePtr handle = (rasterlitePtr) ext_handle;
@@ -1209,7 +1500,11 @@ rasterliteGetRawImage2 (void *ext_handle, double cx, double cy,
     double min_y = cy - (map_height / 2.0);
     double max_y = cy + (map_height / 2.0);
     rasterliteImagePtr output = NULL;
+    double t0;
     reset_error (handle);
+    memset (&(handle->stats), 0, sizeof (struct request_stats));
+    handle->stats.level = -1;
+    t0 = phase_clock ();
     if (handle->handle == NULL || handle->stmt_rtree == NULL
 	|| handle->stmt_plain == NULL)
       {
@@ -1240,13 +1535,14 @@ rasterliteGetRawImage2 (void *ext_handle, double cx, double cy,
 	  return RASTERLITE_ERROR;
       }
     if (best_raster_resolution
-	(ext_handle, ext_pixel_x_size, &pixel_x_size, &pixel_y_size,
-	 &strategy) != RASTERLITE_OK)
+	(ext_handle, ext_pixel_x_size, min_x, min_y, max_x, max_y,
+	 &pixel_x_size, &pixel_y_size, &strategy) != RASTERLITE_OK)
       {
 	  *raster = NULL;
 	  *size = 0;
 	  return RASTERLITE_ERROR;
       }
+    t0 = phase_mark (handle, RASTERLITE_PHASE_SQL, t0);
     if (strategy == STRATEGY_RTREE)
 	stmt = handle->stmt_rtree;
     else
@@ -1276,103 +1572,46 @@ rasterliteGetRawImage2 (void *ext_handle, double cx, double cy,
       }
     sqlite3_bind_double (stmt, 5, pixel_x_size);
     sqlite3_bind_double (stmt, 6, pixel_y_size);
+    t0 = phase_mark (handle, RASTERLITE_PHASE_COMPOSITE, t0);
     while (1)
       {
 	  /* scrolling the result set */
 	  ret = sqlite3_step (stmt);
+	  t0 = phase_mark (handle, RASTERLITE_PHASE_SQL, t0);
 	  if (ret == SQLITE_DONE)
 	      break;		/* end of result set */
 	  if (ret == SQLITE_ROW)
 	    {
 		/* retrieving query values */
-		gaiaGeomCollPtr geom = NULL;
-		rasterliteImagePtr img = NULL;
-		if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB)
-		  {
-		      /* fetching Geometry */
-		      const void *blob = sqlite3_column_blob (stmt, 0);
-		      int blob_size = sqlite3_column_bytes (stmt, 0);
-		      geom =
-			  gaiaFromSpatiaLiteBlobWkb ((const unsigned char *)
-						     blob, blob_size);
-		  }
-		if (sqlite3_column_type (stmt, 1) == SQLITE_BLOB)
+		int has_mbr = 0;
+		double tile_min_x = 0.0;
+		double tile_max_y = 0.0;
+		handle->stats.rows += 1;
+		if (sqlite3_column_type (stmt, 2) == SQLITE_FLOAT
+		    && sqlite3_column_type (stmt, 3) == SQLITE_FLOAT)
 		  {
-		      /* fetching Raster Image */
-		      const void *blob = sqlite3_column_blob (stmt, 1);
-		      int blob_size = sqlite3_column_bytes (stmt, 1);
-		      int type = gaiaGuessBlobType (blob, blob_size);
-		      if (type == GAIA_JPEG_BLOB || type == GAIA_EXIF_BLOB
-			  || type == GAIA_EXIF_GPS_BLOB)
-			  img = image_from_jpeg (blob_size, (void *) blob);
-		      else if (type == GAIA_PNG_BLOB)
-			  img = image_from_png (blob_size, (void *) blob);
-		      else if (type == GAIA_GIF_BLOB)
-			  img = image_from_gif (blob_size, (void *) blob);
-		      else if (type == GAIA_TIFF_BLOB)
-			  img = image_from_tiff (blob_size, (void *) blob);
+		      /* fetching the tile MBR */
+		      tile_min_x = sqlite3_column_double (stmt, 2);
+		      tile_max_y = sqlite3_column_double (stmt, 3);
+		      has_mbr = 1;
 		  }
-		if (geom && img)
+		if (has_mbr && sqlite3_column_type (stmt, 1) == SQLITE_BLOB)
 		  {
-		      /* resizing the image [tile] */
-		      double pre_width =
-			  internal_round (((double) (img->sx) * pixel_x_size) /
-					  ext_pixel_x_size);
-		      double pre_height =
-			  internal_round (((double) (img->sy) * pixel_y_size) /
-					  ext_pixel_y_size);
-		      int new_width = (int) pre_width + 1;
-		      int new_height = (int) pre_height + 1;
-		      double x = (geom->MinX - min_x) / ext_pixel_x_size;
-		      double y =
+		      /* decoding the raster tile straight into the output */
+		      rasterliteTileSink sink;
+		      tile_sink_init (&sink, output);
+		      sink.origin_x = (tile_min_x - min_x) / ext_pixel_x_size;
+		      sink.origin_y =
 			  (double) height -
-			  ((geom->MaxY - min_y) / ext_pixel_y_size);
-		      if (new_width > (img->sx * 16)
-			  || new_height > (img->sy * 16))
-			{
-			    /* TOO BIG: drawing a gray rectangle */
-			    mark_gray_rectangle (output, int_round (x),
-						 int_round (y), new_width,
-						 new_height);
-			}
-		      else
-			{
-			    /* resizing the raster tile */
-			    if (new_width == img->sx && new_height == img->sy)
-				;
-			    else
-			      {
-				  rasterliteImagePtr img2 = img;
-				  img = image_create (new_width, new_height);
-				  image_resize (img, img2);
-				  image_destroy (img2);
-			      }
-			    /* drawing the raster tile */
-			    copy_rectangle (output, img,
-					    handle->transparent_color,
-					    int_round (x), int_round (y));
-			    /* adjunsting the required colorspace */
-			    if (output->color_space == COLORSPACE_MONOCHROME)
-			      {
-				  if (img->color_space != COLORSPACE_MONOCHROME)
-				      output->color_space = img->color_space;
-			      }
-			    if (output->color_space == COLORSPACE_PALETTE)
-			      {
-				  if (img->color_space != COLORSPACE_PALETTE)
-				      output->color_space = COLORSPACE_RGB;
-			      }
-			    if (output->color_space == COLORSPACE_GRAYSCALE)
-			      {
-				  if (img->color_space != COLORSPACE_GRAYSCALE)
-				      output->color_space = COLORSPACE_RGB;
-			      }
-			}
+			  ((tile_max_y - min_y) / ext_pixel_y_size);
+		      sink.tile_pixel_x_size = pixel_x_size;
+		      sink.tile_pixel_y_size = pixel_y_size;
+		      sink.canvas_pixel_x_size = ext_pixel_x_size;
+		      sink.canvas_pixel_y_size = ext_pixel_y_size;
+		      sink.transparent_color = handle->transparent_color;
+		      draw_tile (handle, stmt, &sink);
 		  }
-		if (geom)
-		    gaiaFreeGeomColl (geom);
-		if (img)
-		    image_destroy (img);
+		t0 = phase_mark (handle, RASTERLITE_PHASE_DECODE, t0);
 	    }
 	  else
 	    {
@@ -1460,9 +1699,29 @@ rasterliteGetRawImage2 (void *ext_handle, double cx, double cy,
     *raster = tmp_raster;
     *size = raster_size;
     image_destroy (output);
+    phase_mark (handle, RASTERLITE_PHASE_ENCODE, t0);
     return RASTERLITE_OK;
 }
 
+RASTERLITE_DECLARE int
+rasterliteGetRawImage2 (void *ext_handle, double cx, double cy,
+			double ext_pixel_x_size, double ext_pixel_y_size,
+			int width, int height, int raw_format, void **raster,
+			int *size)
+{
+/* trying to build the required RAW raster image */
+    int ret;
+    RASTERLITE_PROBE4 (get_raw_image__start, ext_handle, width, height,
+		       raw_format);
+    ret =
+	get_raw_image2 (ext_handle, cx, cy, ext_pixel_x_size,
+			ext_pixel_y_size, width, height, raw_format, raster,
+			size);
+    RASTERLITE_PROBE4 (get_raw_image__done, ext_handle, ret, *size,
+		       ((rasterlitePtr) ext_handle)->stats.rows);
+    return ret;
+}
+
 RASTERLITE_DECLARE int
 rasterliteGetRawImage (void *handle, double cx, double cy, double pixel_size,
 		       int width, int height, int raw_format, void **raster,
@@ -1591,6 +1850,93 @@ rasterliteGetLastError (void *ext_handle)
     return handle->last_error;
 }
 
+RASTERLITE_DECLARE int
+rasterliteGetLastStats (void *ext_handle, rasterliteStatsPtr stats)
+{
+/* reporting the counters collected by the last raster request */
+    rasterlitePtr handle = (rasterlitePtr) ext_handle;
+    struct request_stats *last;
+    if (handle == NULL || stats == NULL)
+	return RASTERLITE_ERROR;
+    last = &(handle->stats);
+    stats->level = last->level;
+    stats->pixel_x_size = last->pixel_x_size;
+    stats->pixel_y_size = last->pixel_y_size;
+    if (last->strategy == STRATEGY_RTREE)
+	stats->strategy = RASTERLITE_STRATEGY_RTREE;
+    else if (last->strategy == STRATEGY_PLAIN)
+	stats->strategy = RASTERLITE_STRATEGY_PLAIN;
+    else
+	stats->strategy = 0;
+    stats->rows = last->rows;
+    stats->jpeg_tiles = last->jpeg_tiles;
+    stats->png_tiles = last->png_tiles;
+    stats->gif_tiles = last->gif_tiles;
+    stats->tiff_tiles = last->tiff_tiles;
+    stats->bytes = last->bytes;
+    stats->resized_tiles = last->resized_tiles;
+    stats->gray_rectangles = last->gray_rectangles;
+    stats->sql_time = last->phase_time[RASTERLITE_PHASE_SQL];
+    stats->decode_time = last->phase_time[RASTERLITE_PHASE_DECODE];
+    stats->resample_time = last->phase_time[RASTERLITE_PHASE_RESAMPLE];
+    stats->composite_time = last->phase_time[RASTERLITE_PHASE_COMPOSITE];
+    stats->encode_time = last->phase_time[RASTERLITE_PHASE_ENCODE];
+    return RASTERLITE_OK;
+}
+
+RASTERLITE_DECLARE void
+rasterliteSetAccessStrategy (void *ext_handle, int strategy)
+{
+/* forcing some access strategy; RASTERLITE_STRATEGY_AUTO restores the cost model */
+    rasterlitePtr handle = (rasterlitePtr) ext_handle;
+    if (strategy == RASTERLITE_STRATEGY_RTREE)
+	handle->access_strategy = STRATEGY_RTREE;
+    else if (strategy == RASTERLITE_STRATEGY_PLAIN)
+	handle->access_strategy = STRATEGY_PLAIN;
+    else
+	handle->access_strategy = STRATEGY_AUTO;
+}
+
+RASTERLITE_DECLARE void
+rasterliteSetJpegProfile (void *ext_handle, int profile)
+{
+/* selecting the JPEG codec profile used to decode tiles and encode rasters */
+    rasterlitePtr handle = (rasterlitePtr) ext_handle;
+    if (profile == RASTERLITE_JPEG_PROFILE_SPEED
+	|| profile == RASTERLITE_JPEG_PROFILE_SIZE)
+	handle->jpeg_profile = profile;
+    else
+	handle->jpeg_profile = RASTERLITE_JPEG_PROFILE_DEFAULT;
+}
+
+RASTERLITE_DECLARE int
+rasterliteGetAccessCosts (void *ext_handle, double *scan_cost,
+			  double *rtree_cost)
+{
+/* reporting the cost model, calibrating it first if still pending */
+    rasterlitePtr handle = (rasterlitePtr) ext_handle;
+    if (handle == NULL)
+	return RASTERLITE_ERROR;
+    prepare_cost_model (handle);
+    *scan_cost = handle->scan_cost;
+    *rtree_cost = handle->rtree_cost;
+    return RASTERLITE_OK;
+}
+
+RASTERLITE_DECLARE int
+rasterliteSetAccessCosts (void *ext_handle, double scan_cost,
+			  double rtree_cost)
+{
+/* replacing the calibrated cost model, e.g. by some stored statistics */
+    rasterlitePtr handle = (rasterlitePtr) ext_handle;
+    if (handle == NULL || scan_cost <= 0.0 || rtree_cost <= 0.0)
+	return RASTERLITE_ERROR;
+    handle->scan_cost = scan_cost;
+    handle->rtree_cost = rtree_cost;
+    handle->costs_seeded = 1;
+    return RASTERLITE_OK;
+}
+
 RASTERLITE_DECLARE const char *
 rasterliteGetSqliteVersion (void *ext_handle)
 {
@@ -1637,12 +1983,19 @@ rasterliteGetBestAccess (void *ext_handle, double pixel_size,
 			 double *pixel_x_size, double *pixel_y_size,
 			 sqlite3_stmt ** stmt, int *use_rtree)
 {
-/* return the Best Access Method */
+/* return the Best Access Method, for a 1024 x 1024 raster centered on the extent */
     int strategy;
     rasterlitePtr handle = (rasterlitePtr) ext_handle;
+    double half = 512.0 * pixel_size;
+    double cx;
+    double cy;
+/* the extent is lazily loaded together with the cost model */
+    prepare_cost_model (handle);
+    cx = handle->min_x + ((handle->max_x - handle->min_x) / 2.0);
+    cy = handle->min_y + ((handle->max_y - handle->min_y) / 2.0);
     if (best_raster_resolution
-	(ext_handle, pixel_size, pixel_x_size, pixel_y_size,
-	 &strategy) != RASTERLITE_OK)
+	(ext_handle, pixel_size, cx - half, cy - half, cx + half, cy + half,
+	 pixel_x_size, pixel_y_size, &strategy) != RASTERLITE_OK)
       {
 	  *stmt = NULL;
 	  return RASTERLITE_ERROR;
@@ -95,7 +95,7 @@ rasterliteJpegBlobToRawImage (const void *blob, int blob_size, int raw_format,
 	  goto error;
       }
 
-    img = image_from_jpeg (blob_size, blob);
+    img = image_from_jpeg (blob_size, blob, RASTERLITE_JPEG_PROFILE_DEFAULT);
     if (!img)
       {
 	  errmsg = "Jpeg decoder error";
@@ -148,10 +148,10 @@ rasterliteJpegBlobToRawImage (const void *blob, int blob_size, int raw_format,
 	    }
       }
 
-    image_destroy (img);
     *raw = raw_array;
     *width = img->sx;
     *height = img->sy;
+    image_destroy (img);
     return RASTERLITE_OK;
 
   error:
@@ -237,10 +237,10 @@ rasterlitePngBlobToRawImage (const void *blob, int blob_size, int raw_format,
 	    }
       }
 
-    image_destroy (img);
     *raw = raw_array;
     *width = img->sx;
     *height = img->sy;
+    image_destroy (img);
     return RASTERLITE_OK;
 
   error:
@@ -326,10 +326,10 @@ rasterliteGifBlobToRawImage (const void *blob, int blob_size, int raw_format,
 	    }
       }
 
-    image_destroy (img);
     *raw = raw_array;
     *width = img->sx;
     *height = img->sy;
+    image_destroy (img);
     return RASTERLITE_OK;
 
   error:
@@ -415,10 +415,10 @@ rasterliteTiffBlobToRawImage (const void *blob, int blob_size, int raw_format,
 	    }
       }
 
-    image_destroy (img);
     *raw = raw_array;
     *width = img->sx;
     *height = img->sy;
+    image_destroy (img);
     return RASTERLITE_OK;
 
   error:
@@ -510,9 +510,13 @@ rasterliteRawImageToJpegFile (const void *raw, int raw_format, int width,
 
 /* compressing as JPEG */
     if (is_image_grayscale (img) == RASTERLITE_TRUE)
-	blob = image_to_jpeg_grayscale (img, &blob_size, quality);
+	blob =
+	    image_to_jpeg_grayscale (img, &blob_size, quality,
+				     RASTERLITE_JPEG_PROFILE_DEFAULT);
     else
-	blob = image_to_jpeg (img, &blob_size, quality);
+	blob =
+	    image_to_jpeg (img, &blob_size, quality,
+			   RASTERLITE_JPEG_PROFILE_DEFAULT);
     if (!blob)
       {
 	  errmsg = "Jpeg encoder error";
@@ -534,7 +538,7 @@ rasterliteRawImageToJpegFile (const void *raw, int raw_format, int width,
 	  unlink (path);
 	  goto error;
       }
-    free (blob);
+    buffer_pool_release (blob, blob_size);
     image_destroy (img);
     return RASTERLITE_OK;
 
@@ -624,9 +628,13 @@ rasterliteRawImageToJpegMemBuf (const void *raw, int raw_format, int width,
 
 /* compressing as JPEG */
     if (is_image_grayscale (img) == RASTERLITE_TRUE)
-	blob = image_to_jpeg_grayscale (img, &blob_size, quality);
+	blob =
+	    image_to_jpeg_grayscale (img, &blob_size, quality,
+				     RASTERLITE_JPEG_PROFILE_DEFAULT);
     else
-	blob = image_to_jpeg (img, &blob_size, quality);
+	blob =
+	    image_to_jpeg (img, &blob_size, quality,
+			   RASTERLITE_JPEG_PROFILE_DEFAULT);
     if (!blob)
       {
 	  errmsg = "Jpeg encoder error";
@@ -652,7 +660,16 @@ RASTERLITE_DECLARE int
 rasterliteRawImageToPngFile (const void *raw, int raw_format, int width,
 			     int height, const char *path)
 {
-/* exports a RAW image into a PNG compressed file */
+/* exports a RAW image into a PNG compressed file [default compression] */
+    return rasterliteRawImageToPngFile2 (raw, raw_format, width, height, path,
+					 -1);
+}
+
+RASTERLITE_DECLARE int
+rasterliteRawImageToPngFile2 (const void *raw, int raw_format, int width,
+			      int height, const char *path, int quality)
+{
+/* exports a RAW image into a PNG compressed file [RASTERLITE_PNG_QUALITY options] */
     rasterliteImagePtr img = NULL;
     void *blob = NULL;
     int blob_size;
@@ -727,11 +744,11 @@ rasterliteRawImageToPngFile (const void *raw, int raw_format, int width,
 
 /* compressing as PNG */
     if (is_image_grayscale (img) == RASTERLITE_TRUE)
-	blob = image_to_png_grayscale (img, &blob_size);
+	blob = image_to_png_grayscale (img, &blob_size, quality);
     else if (is_image_palette256 (img) == RASTERLITE_TRUE)
-	blob = image_to_png_palette (img, &blob_size);
+	blob = image_to_png_palette (img, &blob_size, quality);
     else
-	blob = image_to_png_rgb (img, &blob_size);
+	blob = image_to_png_rgb (img, &blob_size, quality);
     if (!blob)
       {
 	  errmsg = "Png encoder error";
@@ -753,7 +770,7 @@ rasterliteRawImageToPngFile (const void *raw, int raw_format, int width,
 	  unlink (path);
 	  goto error;
       }
-    free (blob);
+    buffer_pool_release (blob, blob_size);
     image_destroy (img);
     return RASTERLITE_OK;
 
@@ -770,7 +787,16 @@ RASTERLITE_DECLARE unsigned char *
 rasterliteRawImageToPngMemBuf (const void *raw, int raw_format, int width,
 			       int height, int *size)
 {
-/* exports a RAW image into a PNG compressed memory buffer */
+/* exports a RAW image into a PNG compressed memory buffer [default compression] */
+    return rasterliteRawImageToPngMemBuf2 (raw, raw_format, width, height,
+					   size, -1);
+}
+
+RASTERLITE_DECLARE unsigned char *
+rasterliteRawImageToPngMemBuf2 (const void *raw, int raw_format, int width,
+				int height, int *size, int quality)
+{
+/* exports a RAW image into a PNG compressed memory buffer [RASTERLITE_PNG_QUALITY options] */
     rasterliteImagePtr img = NULL;
     void *blob = NULL;
     int blob_size;
@@ -843,11 +869,11 @@ rasterliteRawImageToPngMemBuf (const void *raw, int raw_format, int width,
 
 /* compressing as PNG */
     if (is_image_grayscale (img) == RASTERLITE_TRUE)
-	blob = image_to_png_grayscale (img, &blob_size);
+	blob = image_to_png_grayscale (img, &blob_size, quality);
     else if (is_image_palette256 (img) == RASTERLITE_TRUE)
-	blob = image_to_png_palette (img, &blob_size);
+	blob = image_to_png_palette (img, &blob_size, quality);
     else
-	blob = image_to_png_rgb (img, &blob_size);
+	blob = image_to_png_rgb (img, &blob_size, quality);
     if (!blob)
       {
 	  errmsg = "Png encoder error";
@@ -972,7 +998,7 @@ rasterliteRawImageToGifFile (const void *raw, int raw_format, int width,
 	  unlink (path);
 	  goto error;
       }
-    free (blob);
+    buffer_pool_release (blob, blob_size);
     image_destroy (img);
     return RASTERLITE_OK;
 
@@ -1167,11 +1193,11 @@ rasterliteRawImageToGeoTiffFile (const void *raw, int raw_format, int width,
     if (is_image_monochrome (img) == RASTERLITE_TRUE)
 	blob = image_to_tiff_fax4 (img, &blob_size);
     else if (is_image_grayscale (img) == RASTERLITE_TRUE)
-	blob = image_to_tiff_grayscale (img, &blob_size);
+	blob = image_to_tiff_grayscale (img, &blob_size, -1);
     else if (is_image_palette256 (img) == RASTERLITE_TRUE)
-	blob = image_to_tiff_palette (img, &blob_size);
+	blob = image_to_tiff_palette (img, &blob_size, -1);
     else
-	blob = image_to_tiff_rgb (img, &blob_size);
+	blob = image_to_tiff_rgb (img, &blob_size, -1);
     if (!blob)
       {
 	  errmsg = "Tiff encoder error";
@@ -1186,7 +1212,7 @@ rasterliteRawImageToGeoTiffFile (const void *raw, int raw_format, int width,
 	  errmsg = "Unable to create output image";
 	  goto error;
       }
-    free (blob);
+    buffer_pool_release (blob, blob_size);
     image_destroy (img);
     return RASTERLITE_OK;
 
@@ -1278,11 +1304,11 @@ rasterliteRawImageToTiffMemBuf (const void *raw, int raw_format, int width,
     if (is_image_monochrome (img) == RASTERLITE_TRUE)
 	blob = image_to_tiff_fax4 (img, &blob_size);
     else if (is_image_grayscale (img) == RASTERLITE_TRUE)
-	blob = image_to_tiff_grayscale (img, &blob_size);
+	blob = image_to_tiff_grayscale (img, &blob_size, -1);
     else if (is_image_palette256 (img) == RASTERLITE_TRUE)
-	blob = image_to_tiff_palette (img, &blob_size);
+	blob = image_to_tiff_palette (img, &blob_size, -1);
     else
-	blob = image_to_tiff_rgb (img, &blob_size);
+	blob = image_to_tiff_rgb (img, &blob_size, -1);
     if (!blob)
       {
 	  errmsg = "Tiff encoder error";
@@ -1303,3 +1329,17 @@ rasterliteRawImageToTiffMemBuf (const void *raw, int raw_format, int width,
     *size = 0;
     return NULL;
 }
+
+RASTERLITE_DECLARE void
+rasterliteReleaseBuffer (void *buffer, int size)
+{
+/* hands some output buffer back to the calling thread's pool */
+    buffer_pool_release (buffer, size);
+}
+
+RASTERLITE_DECLARE void
+rasterliteSetEncoderThreads (int threads)
+{
+/* capping the threads used by each PNG or JPEG encoder */
+    set_encoder_threads (threads);
+}
@@ -48,6 +48,7 @@
 #endif
 
 #include <stdio.h>
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
@@ -62,6 +63,7 @@
 
 #include <spatialite/gaiageo.h>
 
+#include "rasterlite.h"
 #include "rasterlite_internals.h"
 
 /* 
@@ -93,55 +95,40 @@
 /
 */
 
-typedef int code_int;
+#define LZW_MAX_BITS	12
+#define LZW_MAX_CODES	(1 << LZW_MAX_BITS)
 
-#ifdef SIGNED_COMPARE_SLOW
-typedef unsigned long int count_int;
-typedef unsigned short int count_short;
-#else /*SIGNED_COMPARE_SLOW */
-typedef long int count_int;
-#endif /*SIGNED_COMPARE_SLOW */
+#define HSIZE	5003		/* 80% occupancy */
+#define LZW_MAX_GENERATION	65535
 
-#define GIFBITS    12
+#define GIF_BLOCK_BYTES	254	/* data bytes per sub-block */
+#define GIF_MAX_PRESIZE	(16 * 1024 * 1024)	/* output pre-sizing cap */
 
-#define maxbits GIFBITS
-
-#define maxmaxcode ((code_int)1 << GIFBITS)
-
-#define HSIZE  5003
-#define hsize HSIZE
-
-#ifdef COMPATIBLE
-#define MAXCODE(n_bits)        ((code_int) 1 << (n_bits) - 1)
-#else /*COMPATIBLE*/
-#define MAXCODE(n_bits)        (((code_int) 1 << (n_bits)) - 1)
-#endif /*COMPATIBLE*/
-#define HashTabOf(i)       ctx->htab[i]
-#define CodeTabOf(i)    ctx->codetab[i]
-    typedef struct
+typedef struct
 {
-    int Width, Height;
-    int curx, cury;
-    long CountDown;
-    int Pass;
-    int Interlace;
+/* the LZW encoder state */
+    int init_bits;
     int n_bits;
-    code_int maxcode;
-    count_int htab[HSIZE];
-    unsigned short codetab[HSIZE];
-    code_int free_ent;
+    int maxcode;
+    int free_ent;
     int clear_flg;
-    int offset;
-    long int in_count;
-    long int out_count;
-    int g_init_bits;
-    xgdIOCtx *g_outfile;
     int ClearCode;
     int EOFCode;
-    unsigned long cur_accum;
+/*
+/ the "compress" string table: each slot also holds a generation
+/ stamp, so that resetting the table simply means starting a new
+/ generation, and slots of any older one simply are empty
+*/
+    unsigned short generation;
+    unsigned short slot_generation[HSIZE];
+    int htab[HSIZE];
+    unsigned short codetab[HSIZE];
+/* the bit accumulator and the pending data sub-block */
+    unsigned int cur_accum;
     int cur_bits;
     int a_count;
-    char accum[256];
+    unsigned char block[GIF_BLOCK_BYTES + 1];
+    xgdIOCtx *g_outfile;
 } GifCtx;
 
 #define        MAXCOLORMAPSIZE         256
@@ -162,25 +149,9 @@ typedef long int count_int;
 #define        ReadOK(file,buffer,len) (xgdGetBuf(buffer, len, file) > 0)
 #define LM_to_uint(a,b)                        (((b)<<8)|(a))
 
-#define STACK_SIZE ((1<<(MAX_LWZ_BITS))*2)
-
-typedef struct
-{
-    unsigned char buf[280];
-    int curbit, lastbit, done, last_byte;
-} CODE_STATIC_DATA;
-
-typedef struct
-{
-    int fresh;
-    int code_size, set_code_size;
-    int max_code, max_code_size;
-    int firstcode, oldcode;
-    int clear_code, end_code;
-    int table[2][(1 << MAX_LWZ_BITS)];
-    int stack[STACK_SIZE], *sp;
-    CODE_STATIC_DATA scd;
-} LZW_STATIC_DATA;
+/* interlaced rows: first row and row step of each pass */
+static const int interlace_start[4] = { 0, 4, 2, 1 };
+static const int interlace_step[4] = { 8, 8, 4, 2 };
 
 static int
 GetDataBlock_ (xgdIOCtx * fd, unsigned char *buf, int *ZeroDataBlockP)
@@ -224,189 +195,172 @@ ReadColorMap (xgdIOCtx * fd, int number, unsigned char (*buffer)[256])
     return FALSE;
 }
 
-static int
-GetCode_ (xgdIOCtx * fd, CODE_STATIC_DATA * scd, int code_size, int flag,
-	  int *ZeroDataBlockP)
+static unsigned char *
+ReadImageData (xgdIOCtx * fd, int *size, int *capacity, int *ZeroDataBlockP)
 {
-    int i, j, ret;
-    unsigned char count;
-    if (flag)
-      {
-	  scd->curbit = 0;
-	  scd->lastbit = 0;
-	  scd->last_byte = 0;
-	  scd->done = FALSE;
-	  return 0;
-      }
-    if ((scd->curbit + code_size) >= scd->lastbit)
-      {
-	  if (scd->done)
+/* gathering all the image data sub-blocks into a single buffer */
+    unsigned char *data;
+    unsigned char *grown;
+    int grown_capacity;
+    int count;
+    *size = 0;
+    data = buffer_pool_acquire (64 * 1024, capacity);
+    if (data == NULL)
+	return NULL;
+    while (1)
+      {
+	  if (*size + 255 > *capacity)
 	    {
-		if (scd->curbit >= scd->lastbit)
+		grown = buffer_pool_acquire (*capacity * 2, &grown_capacity);
+		if (grown == NULL)
 		  {
-		      /* Oh well */
+		      buffer_pool_release (data, *capacity);
+		      return NULL;
 		  }
-		return -1;
+		memcpy (grown, data, *size);
+		buffer_pool_release (data, *capacity);
+		data = grown;
+		*capacity = grown_capacity;
 	    }
-	  scd->buf[0] = scd->buf[scd->last_byte - 2];
-	  scd->buf[1] = scd->buf[scd->last_byte - 1];
-	  if ((count = GetDataBlock (fd, &scd->buf[2], ZeroDataBlockP)) <= 0)
-	      scd->done = TRUE;
-	  scd->last_byte = 2 + count;
-	  scd->curbit = (scd->curbit - scd->lastbit) + 16;
-	  scd->lastbit = (2 + count) * 8;
+	  count = GetDataBlock (fd, data + *size, ZeroDataBlockP);
+	  if (count <= 0)
+	      break;
+	  *size += count;
       }
-    ret = 0;
-    for (i = scd->curbit, j = 0; j < code_size; ++i, ++j)
-	ret |= ((scd->buf[i / 8] & (1 << (i % 8))) != 0) << j;
-    scd->curbit += code_size;
-    return ret;
+    return data;
 }
 
 static int
-GetCode (xgdIOCtx * fd, CODE_STATIC_DATA * scd, int code_size, int flag,
-	 int *ZeroDataBlockP)
+LZWDecode (const unsigned char *data, int size, int input_code_size,
+	   unsigned char *out, int out_size)
 {
-    int rv;
-    rv = GetCode_ (fd, scd, code_size, flag, ZeroDataBlockP);
-    return (rv);
-}
-
-static int
-LWZReadByte_ (xgdIOCtx * fd, LZW_STATIC_DATA * sd, char flag,
-	      int input_code_size, int *ZeroDataBlockP)
-{
-    int code, incode, i;
-    if (flag)
-      {
-	  sd->set_code_size = input_code_size;
-	  sd->code_size = sd->set_code_size + 1;
-	  sd->clear_code = 1 << sd->set_code_size;
-	  sd->end_code = sd->clear_code + 1;
-	  sd->max_code_size = 2 * sd->clear_code;
-	  sd->max_code = sd->clear_code + 2;
-	  GetCode (fd, &sd->scd, 0, TRUE, ZeroDataBlockP);
-	  sd->fresh = TRUE;
-	  for (i = 0; i < sd->clear_code; ++i)
-	    {
-		sd->table[0][i] = 0;
-		sd->table[1][i] = i;
-	    }
-	  for (; i < (1 << MAX_LWZ_BITS); ++i)
-	      sd->table[0][i] = sd->table[1][0] = 0;
-	  sd->sp = sd->stack;
-	  return 0;
-      }
-    else if (sd->fresh)
-      {
-	  sd->fresh = FALSE;
-	  do
-	    {
-		sd->firstcode = sd->oldcode =
-		    GetCode (fd, &sd->scd, sd->code_size, FALSE,
-			     ZeroDataBlockP);
-	    }
-	  while (sd->firstcode == sd->clear_code);
-	  return sd->firstcode;
-      }
-    if (sd->sp > sd->stack)
-	return *--sd->sp;
-    while ((code =
-	    GetCode (fd, &sd->scd, sd->code_size, FALSE, ZeroDataBlockP)) >= 0)
-      {
-	  if (code == sd->clear_code)
-	    {
-		for (i = 0; i < sd->clear_code; ++i)
-		  {
-		      sd->table[0][i] = 0;
-		      sd->table[1][i] = i;
-		  }
-		for (; i < (1 << MAX_LWZ_BITS); ++i)
-		    sd->table[0][i] = sd->table[1][i] = 0;
-		sd->code_size = sd->set_code_size + 1;
-		sd->max_code_size = 2 * sd->clear_code;
-		sd->max_code = sd->clear_code + 2;
-		sd->sp = sd->stack;
-		sd->firstcode = sd->oldcode =
-		    GetCode (fd, &sd->scd, sd->code_size, FALSE,
-			     ZeroDataBlockP);
-		return sd->firstcode;
-	    }
-	  else if (code == sd->end_code)
+/*
+/ decoding a whole LZW stream into OUT
+/ returns how many pixels have actually been decoded
+*/
+    unsigned short prefix[LZW_MAX_CODES];
+    unsigned short length[LZW_MAX_CODES];
+    unsigned char suffix[LZW_MAX_CODES];
+    unsigned char first[LZW_MAX_CODES];
+    int clear_code = 1 << input_code_size;
+    int end_code = clear_code + 1;
+    int code_size = input_code_size + 1;
+    int code_mask = (1 << code_size) - 1;
+    int max_code = clear_code + 2;
+    int max_code_size = 2 * clear_code;
+    int oldcode = -1;
+    int code;
+    int len;
+    int k;
+    int in = 0;
+    int out_pos = 0;
+    unsigned int accum = 0;
+    int bits = 0;
+    unsigned char *p;
+    for (k = 0; k < clear_code && k < LZW_MAX_CODES; k++)
+      {
+	  /* out of range pixels are mapped to color #0 */
+	  prefix[k] = 0;
+	  length[k] = 1;
+	  suffix[k] = (k < 256) ? k : 0;
+	  first[k] = suffix[k];
+      }
+    while (out_pos < out_size)
+      {
+	  while (bits < code_size)
 	    {
-		int count;
-		unsigned char buf[260];
-		if (*ZeroDataBlockP)
-		    return -2;
-		while ((count = GetDataBlock (fd, buf, ZeroDataBlockP)) > 0)
-		    ;
-		if (count != 0)
-		    return -2;
+		if (in >= size)
+		    return out_pos;
+		accum |= (unsigned int) data[in++] << bits;
+		bits += 8;
 	    }
-	  incode = code;
-	  if (sd->sp == (sd->stack + STACK_SIZE))
+	  code = accum & code_mask;
+	  accum >>= code_size;
+	  bits -= code_size;
+	  if (code == clear_code)
 	    {
-		return -1;
+		code_size = input_code_size + 1;
+		code_mask = (1 << code_size) - 1;
+		max_code = clear_code + 2;
+		max_code_size = 2 * clear_code;
+		oldcode = -1;
+		continue;
 	    }
-	  if (code >= sd->max_code)
+	  if (code == end_code)
+	      break;
+	  if (oldcode < 0)
 	    {
-		*sd->sp++ = sd->firstcode;
-		code = sd->oldcode;
+		/* the first code following a reset must be a plain pixel */
+		if (code > clear_code)
+		    code = 0;
+		out[out_pos++] = suffix[code];
+		oldcode = code;
+		continue;
 	    }
-	  while (code >= sd->clear_code)
+	  if (code > max_code || (code == max_code && code >= LZW_MAX_CODES))
+	      break;		/* corrupted stream */
+	  if (max_code < LZW_MAX_CODES)
 	    {
-		if (sd->sp == (sd->stack + STACK_SIZE))
-		  {
-		      return -1;
-		  }
-		*sd->sp++ = sd->table[1][code];
-		if (code == sd->table[0][code])
+		/* adding a new string: OLDCODE plus the first pixel of CODE */
+		prefix[max_code] = oldcode;
+		suffix[max_code] =
+		    (code == max_code) ? first[oldcode] : first[code];
+		first[max_code] = first[oldcode];
+		length[max_code] = length[oldcode] + 1;
+		++max_code;
+		if ((max_code >= max_code_size) &&
+		    (max_code_size < LZW_MAX_CODES))
 		  {
-		      /* Oh well */
+		      max_code_size *= 2;
+		      ++code_size;
+		      code_mask = (1 << code_size) - 1;
 		  }
-		code = sd->table[0][code];
 	    }
-	  *sd->sp++ = sd->firstcode = sd->table[1][code];
-	  if ((code = sd->max_code) < (1 << MAX_LWZ_BITS))
+	  oldcode = code;
+	  /* copying the whole string, backwards from its last pixel */
+	  len = length[code];
+	  if (len > out_size - out_pos)
 	    {
-		sd->table[0][code] = sd->oldcode;
-		sd->table[1][code] = sd->firstcode;
-		++sd->max_code;
-		if ((sd->max_code >= sd->max_code_size) &&
-		    (sd->max_code_size < (1 << MAX_LWZ_BITS)))
-		  {
-		      sd->max_code_size *= 2;
-		      ++sd->code_size;
-		  }
+		/* excess pixels are simply discarded */
+		for (k = len - (out_size - out_pos); k > 0; k--)
+		    code = prefix[code];
+		len = out_size - out_pos;
 	    }
-	  sd->oldcode = incode;
-	  if (sd->sp > sd->stack)
-	      return *--sd->sp;
+	  out_pos += len;
+	  p = out + out_pos;
+	  while (len-- > 1)
+	    {
+		*--p = suffix[code];
+		code = prefix[code];
+	    }
+	  *--p = suffix[code];
       }
-    return code;
-}
-
-static int
-LWZReadByte (xgdIOCtx * fd, LZW_STATIC_DATA * sd, char flag,
-	     int input_code_size, int *ZeroDataBlockP)
-{
-    int rv;
-    rv = LWZReadByte_ (fd, sd, flag, input_code_size, ZeroDataBlockP);
-    return (rv);
+    return out_pos;
 }
 
 static void
-ReadImage (rasterliteImagePtr im, xgdIOCtx * fd, int len, int height,
+ReadImage (rasterliteTileSinkPtr sink, xgdIOCtx * fd, int len, int height,
 	   unsigned char (*cmap)[256], int interlace, int *ZeroDataBlockP)
 {
     unsigned char c;
-    int v;
-    int xpos = 0, ypos = 0, pass = 0;
     int i;
+    int xpos;
+    int ypos;
+    int rows;
+    int pass;
+    int step;
+    int data_size;
+    int data_capacity;
+    int decoded;
+    size_t count;
     int red[256];
     int green[256];
     int blue[256];
-    LZW_STATIC_DATA sd;
+    unsigned char *data;
+    unsigned char *indices;
+    int indices_capacity;
+    int *row_of = NULL;
+    int *pixels;
     if (!ReadOK (fd, &c, 1))
       {
 	  return;
@@ -415,74 +369,67 @@ ReadImage (rasterliteImagePtr im, xgdIOCtx * fd, int len, int height,
       {
 	  return;
       }
+    count = (size_t) len * (size_t) height;
+    if (len <= 0 || height <= 0 || count > (size_t) INT_MAX)
+      {
+	  return;
+      }
     for (i = 0; (i < 256); i++)
       {
 	  red[i] = cmap[CM_RED][i];
 	  green[i] = cmap[CM_GREEN][i];
 	  blue[i] = cmap[CM_BLUE][i];
       }
-    if (LWZReadByte (fd, &sd, TRUE, c, ZeroDataBlockP) < 0)
+    data = ReadImageData (fd, &data_size, &data_capacity, ZeroDataBlockP);
+    if (data == NULL)
+	return;
+    indices = buffer_pool_acquire ((int) count, &indices_capacity);
+    if (indices == NULL)
       {
+	  buffer_pool_release (data, data_capacity);
 	  return;
       }
-    while ((v = LWZReadByte (fd, &sd, FALSE, c, ZeroDataBlockP)) >= 0)
+    decoded = LZWDecode (data, data_size, c, indices, (int) count);
+    buffer_pool_release (data, data_capacity);
+    if (interlace)
       {
-	  if (v >= 256)
+	  /* rows come out of order: missing pixels are set to color #0 */
+	  memset (indices + decoded, 0, count - (size_t) decoded);
+	  row_of = malloc (sizeof (int) * height);
+	  if (row_of == NULL)
 	    {
-		v = 0;
+		buffer_pool_release (indices, indices_capacity);
+		return;
 	    }
-	  im->pixels[ypos][xpos] = true_color (red[v], green[v], blue[v]);
-	  ++xpos;
-	  if (xpos == len)
+	  rows = 0;
+	  for (pass = 0; pass < 4; pass++)
 	    {
-		xpos = 0;
-		if (interlace)
-		  {
-		      switch (pass)
-			{
-			case 0:
-			case 1:
-			    ypos += 8;
-			    break;
-			case 2:
-			    ypos += 4;
-			    break;
-			case 3:
-			    ypos += 2;
-			    break;
-			}
-		      if (ypos >= height)
-			{
-			    ++pass;
-			    switch (pass)
-			      {
-			      case 1:
-				  ypos = 4;
-				  break;
-			      case 2:
-				  ypos = 2;
-				  break;
-			      case 3:
-				  ypos = 1;
-				  break;
-			      default:
-				  goto fini;
-			      }
-			}
-		  }
-		else
-		  {
-		      ++ypos;
-		  }
+		step = interlace_step[pass];
+		for (ypos = interlace_start[pass]; ypos < height; ypos += step)
+		    row_of[ypos] = rows++;
 	    }
-	  if (ypos >= height)
-	      break;
+	  rows = height;
       }
-  fini:
-    if (LWZReadByte (fd, &sd, FALSE, c, ZeroDataBlockP) >= 0)
+    else
       {
-	  /* Ignore extra */
+	  /* an incomplete last row is never drawn */
+	  rows = (len > 0) ? decoded / len : 0;
       }
+/* feeding the sink top-down */
+    for (ypos = 0; ypos < rows; ypos++)
+      {
+	  unsigned char *p_in =
+	      indices + ((row_of ? row_of[ypos] : ypos) * len);
+	  pixels = tile_sink_scanline (sink, ypos);
+	  if (pixels == NULL)
+	      continue;
+	  for (xpos = 0; xpos < len; xpos++, p_in++)
+	      pixels[xpos] = true_color (red[*p_in], green[*p_in], blue[*p_in]);
+	  tile_sink_commit (sink, ypos);
+      }
+    if (row_of)
+	free (row_of);
+    buffer_pool_release (indices, indices_capacity);
 }
 
 static int
@@ -506,68 +453,6 @@ DoExtension (xgdIOCtx * fd, int label, int *Transparent, int *ZeroDataBlockP)
     return FALSE;
 }
 
-static void
-BumpPixel (GifCtx * ctx)
-{
-    ++(ctx->curx);
-    if (ctx->curx == ctx->Width)
-      {
-	  ctx->curx = 0;
-	  if (!ctx->Interlace)
-	      ++(ctx->cury);
-	  else
-	    {
-		switch (ctx->Pass)
-		  {
-		  case 0:
-		      ctx->cury += 8;
-		      if (ctx->cury >= ctx->Height)
-			{
-			    ++(ctx->Pass);
-			    ctx->cury = 4;
-			}
-		      break;
-		  case 1:
-		      ctx->cury += 8;
-		      if (ctx->cury >= ctx->Height)
-			{
-			    ++(ctx->Pass);
-			    ctx->cury = 2;
-			}
-		      break;
-		  case 2:
-		      ctx->cury += 4;
-		      if (ctx->cury >= ctx->Height)
-			{
-			    ++(ctx->Pass);
-			    ctx->cury = 1;
-			}
-		      break;
-
-		  case 3:
-		      ctx->cury += 2;
-		      break;
-		  }
-	    }
-      }
-}
-
-static int
-GIFNextPixel (rasterliteImagePtr img, GifCtx * ctx)
-{
-    int r;
-    int **ptpixels = img->pixels;
-    int *pThisRow;
-    if (ctx->CountDown == 0)
-	return EOF;
-    --(ctx->CountDown);
-
-    pThisRow = *(ptpixels + ctx->cury);
-    r = *(pThisRow + ctx->curx);
-    BumpPixel (ctx);
-    return r;
-}
-
 static void
 xgdPutC (const unsigned char c, xgdIOCtx * ctx)
 {
@@ -575,122 +460,80 @@ xgdPutC (const unsigned char c, xgdIOCtx * ctx)
 }
 
 static void
-char_init (GifCtx * ctx)
-{
-    ctx->a_count = 0;
-}
-
-static void
-cl_hash (register count_int chsize, GifCtx * ctx)
-{
-    register count_int *htab_p = ctx->htab + chsize;
-    register long i;
-    register long m1 = -1;
-    i = chsize - 16;
-    do
-      {
-	  *(htab_p - 16) = m1;
-	  *(htab_p - 15) = m1;
-	  *(htab_p - 14) = m1;
-	  *(htab_p - 13) = m1;
-	  *(htab_p - 12) = m1;
-	  *(htab_p - 11) = m1;
-	  *(htab_p - 10) = m1;
-	  *(htab_p - 9) = m1;
-	  *(htab_p - 8) = m1;
-	  *(htab_p - 7) = m1;
-	  *(htab_p - 6) = m1;
-	  *(htab_p - 5) = m1;
-	  *(htab_p - 4) = m1;
-	  *(htab_p - 3) = m1;
-	  *(htab_p - 2) = m1;
-	  *(htab_p - 1) = m1;
-	  htab_p -= 16;
-      }
-    while ((i -= 16) >= 0);
-    for (i += 16; i > 0; --i)
-	*--htab_p = m1;
-}
-
-static void
-flush_char (GifCtx * ctx)
+flush_block (GifCtx * ctx)
 {
+/* writing the pending data sub-block, its byte count included */
     if (ctx->a_count > 0)
       {
-	  xgdPutC (ctx->a_count, ctx->g_outfile);
-	  xgdPutBuf (ctx->accum, ctx->a_count, ctx->g_outfile);
+	  ctx->block[0] = (unsigned char) ctx->a_count;
+	  xgdPutBuf (ctx->block, ctx->a_count + 1, ctx->g_outfile);
 	  ctx->a_count = 0;
       }
 }
 
 static void
-char_out (int c, GifCtx * ctx)
-{
-    ctx->accum[ctx->a_count++] = c;
-    if (ctx->a_count >= 254)
-	flush_char (ctx);
-}
-
-static unsigned long masks[] = { 0x0000, 0x0001, 0x0003, 0x0007, 0x000F,
-    0x001F, 0x003F, 0x007F, 0x00FF,
-    0x01FF, 0x03FF, 0x07FF, 0x0FFF,
-    0x1FFF, 0x3FFF, 0x7FFF, 0xFFFF
-};
-
-static void
-output (code_int code, GifCtx * ctx)
+output (int code, GifCtx * ctx)
 {
-    ctx->cur_accum &= masks[ctx->cur_bits];
-    if (ctx->cur_bits > 0)
-	ctx->cur_accum |= ((long) code << ctx->cur_bits);
-    else
-	ctx->cur_accum = code;
+/* packing a code into the data sub-blocks */
+    ctx->cur_accum |= (unsigned int) code << ctx->cur_bits;
     ctx->cur_bits += ctx->n_bits;
     while (ctx->cur_bits >= 8)
       {
-	  char_out ((unsigned int) (ctx->cur_accum & 0xff), ctx);
+	  ctx->block[++(ctx->a_count)] = (unsigned char) ctx->cur_accum;
+	  if (ctx->a_count == GIF_BLOCK_BYTES)
+	      flush_block (ctx);
 	  ctx->cur_accum >>= 8;
 	  ctx->cur_bits -= 8;
       }
     if (ctx->free_ent > ctx->maxcode || ctx->clear_flg)
       {
-
 	  if (ctx->clear_flg)
 	    {
-
-		ctx->maxcode = MAXCODE (ctx->n_bits = ctx->g_init_bits);
+		ctx->n_bits = ctx->init_bits;
+		ctx->maxcode = (1 << ctx->n_bits) - 1;
 		ctx->clear_flg = 0;
-
 	    }
 	  else
 	    {
-
 		++(ctx->n_bits);
-		if (ctx->n_bits == maxbits)
-		    ctx->maxcode = maxmaxcode;
+		if (ctx->n_bits == LZW_MAX_BITS)
+		    ctx->maxcode = LZW_MAX_CODES;
 		else
-		    ctx->maxcode = MAXCODE (ctx->n_bits);
+		    ctx->maxcode = (1 << ctx->n_bits) - 1;
 	    }
       }
     if (code == ctx->EOFCode)
       {
-	  while (ctx->cur_bits > 0)
+	  if (ctx->cur_bits > 0)
 	    {
-		char_out ((unsigned int) (ctx->cur_accum & 0xff), ctx);
-		ctx->cur_accum >>= 8;
-		ctx->cur_bits -= 8;
+		ctx->block[++(ctx->a_count)] = (unsigned char) ctx->cur_accum;
+		ctx->cur_accum = 0;
+		ctx->cur_bits = 0;
 	    }
-	  flush_char (ctx);
+	  flush_block (ctx);
       }
 }
 
+static void
+cl_table (GifCtx * ctx)
+{
+/* emptying the string table, by simply starting a new generation */
+    if (ctx->generation == LZW_MAX_GENERATION)
+      {
+	  memset (ctx->slot_generation, 0, sizeof (ctx->slot_generation));
+	  ctx->generation = 1;
+      }
+    else
+	ctx->generation += 1;
+}
+
 static void
 cl_block (GifCtx * ctx)
 {
-    cl_hash ((count_int) hsize, ctx);
+    cl_table (ctx);
     ctx->free_ent = ctx->ClearCode + 2;
     ctx->clear_flg = 1;
-    output ((code_int) ctx->ClearCode, ctx);
+    output (ctx->ClearCode, ctx);
 }
 
 static int
@@ -703,99 +546,104 @@ gifPutWord (int w, xgdIOCtx * out)
 
 static void
 GIFcompress (int init_bits, xgdIOCtxPtr outfile, rasterliteImagePtr img,
-	     GifCtx * ctx)
+	     int interlace, GifCtx * ctx)
 {
 /*
- * compress stdin to stdout
- *
- * Algorithm:  use open addressing double hashing (no chaining) on the
- * prefix code / next character combination.  We do a variant of Knuth's
- * algorithm D (vol. 3, sec. 6.4) along with G. Knott's relatively-prime
- * secondary probe.  Here, the modular division first probe is gives way
- * to a faster exclusive-or manipulation.  Also do block compression with
- * an adaptive reset, whereby the code table is cleared when the compression
- * ratio decreases, but after the table fills.  The variable-length output
- * codes are re-sized at this point, and a special CLEAR code is generated
- * for the decompressor.  Late addition:  construct the table according to
- * file size for noticeable speed improvement on small files.  Please direct
- * questions about this implementation to ames!jaw.
- */
-    register long fcode;
-    register code_int i /* = 0 */ ;
-    register int c;
-    register code_int ent;
-    register code_int disp;
-    register code_int hsize_reg;
-    register int hshift;
-    ctx->g_init_bits = init_bits;
+/ LZW compressing the whole image
+/
+/ this strictly is the original "compress" algorithm [open addressing
+/ double hashing on the prefix code / next pixel combination, and an
+/ empty string table restarting once full], so the output is unchanged;
+/ yet the pixels are read row by row, the table is reset in no time,
+/ and the codes are packed straight into the GIF data sub-blocks
+*/
+    int x;
+    int y;
+    int c;
+    int i;
+    int disp;
+    int fcode;
+    int ent = -1;
+    int hshift;
+    int pass;
+    int passes = interlace ? 4 : 1;
+    int *p_row;
+    ctx->init_bits = init_bits;
     ctx->g_outfile = outfile;
-    ctx->offset = 0;
-    ctx->out_count = 0;
     ctx->clear_flg = 0;
-    ctx->in_count = 1;
-    ctx->maxcode = MAXCODE (ctx->n_bits = ctx->g_init_bits);
+    ctx->n_bits = init_bits;
+    ctx->maxcode = (1 << ctx->n_bits) - 1;
     ctx->ClearCode = (1 << (init_bits - 1));
     ctx->EOFCode = ctx->ClearCode + 1;
     ctx->free_ent = ctx->ClearCode + 2;
-    char_init (ctx);
-    ent = GIFNextPixel (img, ctx);
+    ctx->cur_accum = 0;
+    ctx->cur_bits = 0;
+    ctx->a_count = 0;
     hshift = 0;
-    for (fcode = (long) hsize; fcode < 65536L; fcode *= 2L)
+    for (fcode = HSIZE; fcode < 65536; fcode *= 2)
 	++hshift;
     hshift = 8 - hshift;
-    hsize_reg = hsize;
-    cl_hash ((count_int) hsize_reg, ctx);
-    output ((code_int) ctx->ClearCode, ctx);
-#ifdef SIGNED_COMPARE_SLOW
-    while ((c = GIFNextPixel (img)) != (unsigned) EOF)
-      {
-#else /*SIGNED_COMPARE_SLOW */
-    while ((c = GIFNextPixel (img, ctx)) != EOF)
-      {				/* } */
-#endif /*SIGNED_COMPARE_SLOW */
-	  ++(ctx->in_count);
-	  fcode = (long) (((long) c << maxbits) + ent);
-	  i = (((code_int) c << hshift) ^ ent);
-	  if (HashTabOf (i) == fcode)
+    memset (ctx->slot_generation, 0, sizeof (ctx->slot_generation));
+    ctx->generation = 1;
+    output (ctx->ClearCode, ctx);
+    for (pass = 0; pass < passes; pass++)
+      {
+	  int start = interlace ? interlace_start[pass] : 0;
+	  int step = interlace ? interlace_step[pass] : 1;
+	  for (y = start; y < img->sy; y += step)
 	    {
-		ent = CodeTabOf (i);
-		continue;
-	    }
-	  else if ((long) HashTabOf (i) < 0)
-	      goto nomatch;
-	  disp = hsize_reg - i;
-	  if (i == 0)
-	      disp = 1;
-	probe:
-	  if ((i -= disp) < 0)
-	      i += hsize_reg;
-	  if (HashTabOf (i) == fcode)
-	    {
-		ent = CodeTabOf (i);
-		continue;
-	    }
-	  if ((long) HashTabOf (i) > 0)
-	      goto probe;
-	nomatch:
-	  output ((code_int) ent, ctx);
-	  ++(ctx->out_count);
-	  ent = c;
-#ifdef SIGNED_COMPARE_SLOW
-	  if ((unsigned) ctx->free_ent < (unsigned) maxmaxcode)
-	    {
-#else /*SIGNED_COMPARE_SLOW */
-	  if (ctx->free_ent < maxmaxcode)
-	    {
-#endif /*SIGNED_COMPARE_SLOW */
-		CodeTabOf (i) = ctx->free_ent++;
-		HashTabOf (i) = fcode;
+		p_row = img->pixels[y];
+		x = 0;
+		if (ent < 0)
+		    ent = p_row[x++];
+		for (; x < img->sx; x++)
+		  {
+		      c = p_row[x];
+		      fcode = (c << LZW_MAX_BITS) + ent;
+		      i = (c << hshift) ^ ent;
+		      if (ctx->slot_generation[i] == ctx->generation)
+			{
+			    if (ctx->htab[i] == fcode)
+			      {
+				  ent = ctx->codetab[i];
+				  continue;
+			      }
+			    /* secondary probe; an empty or zero slot ends it */
+			    disp = (i == 0) ? 1 : HSIZE - i;
+			    while (1)
+			      {
+				  if ((i -= disp) < 0)
+				      i += HSIZE;
+				  if (ctx->slot_generation[i] != ctx->generation)
+				      break;
+				  if (ctx->htab[i] == fcode)
+				      break;
+				  if (ctx->htab[i] <= 0)
+				      break;
+			      }
+			    if (ctx->slot_generation[i] == ctx->generation
+				&& ctx->htab[i] == fcode)
+			      {
+				  ent = ctx->codetab[i];
+				  continue;
+			      }
+			}
+		      output (ent, ctx);
+		      ent = c;
+		      if (ctx->free_ent < LZW_MAX_CODES)
+			{
+			    ctx->codetab[i] = ctx->free_ent++;
+			    ctx->htab[i] = fcode;
+			    ctx->slot_generation[i] = ctx->generation;
+			}
+		      else
+			  cl_block (ctx);
+		  }
 	    }
-	  else
-	      cl_block (ctx);
       }
-    output ((code_int) ent, ctx);
-    ++(ctx->out_count);
-    output ((code_int) ctx->EOFCode, ctx);
+    if (ent >= 0)
+	output (ent, ctx);
+    output (ctx->EOFCode, ctx);
 }
 
 static void
@@ -804,43 +652,35 @@ GIFEncode (xgdIOCtxPtr fp, int GWidth, int GHeight, int GInterlace,
 	   int *Green, int *Blue, rasterliteImagePtr img)
 {
     int B;
-    int RWidth, RHeight;
-    int LeftOfs, TopOfs;
-    int Resolution;
     int ColorMapSize;
     int InitCodeSize;
     int i;
-    GifCtx ctx;
-    ctx.Interlace = GInterlace;
-    ctx.in_count = 1;
-    memset (&ctx, 0, sizeof (ctx));
+    unsigned char colormap[3 * MAXCOLORMAPSIZE];
+    GifCtx *ctx;
+    ctx = malloc (sizeof (GifCtx));
+    if (ctx == NULL)
+	return;
     ColorMapSize = 1 << BitsPerPixel;
-    RWidth = ctx.Width = GWidth;
-    RHeight = ctx.Height = GHeight;
-    LeftOfs = TopOfs = 0;
-    Resolution = BitsPerPixel;
-    ctx.CountDown = (long) ctx.Width * (long) ctx.Height;
-    ctx.Pass = 0;
     if (BitsPerPixel <= 1)
 	InitCodeSize = 2;
     else
 	InitCodeSize = BitsPerPixel;
-    ctx.curx = ctx.cury = 0;
     xgdPutBuf (Transparent < 0 ? "GIF87a" : "GIF89a", 6, fp);
-    gifPutWord (RWidth, fp);
-    gifPutWord (RHeight, fp);
+    gifPutWord (GWidth, fp);
+    gifPutWord (GHeight, fp);
     B = 0x80;
-    B |= (Resolution - 1) << 5;
+    B |= (BitsPerPixel - 1) << 5;
     B |= (BitsPerPixel - 1);
     xgdPutC (B, fp);
     xgdPutC (Background, fp);
     xgdPutC (0, fp);
     for (i = 0; i < ColorMapSize; ++i)
       {
-	  xgdPutC (Red[i], fp);
-	  xgdPutC (Green[i], fp);
-	  xgdPutC (Blue[i], fp);
+	  colormap[i * 3] = Red[i];
+	  colormap[(i * 3) + 1] = Green[i];
+	  colormap[(i * 3) + 2] = Blue[i];
       }
+    xgdPutBuf (colormap, ColorMapSize * 3, fp);
     if (Transparent >= 0)
       {
 	  xgdPutC ('!', fp);
@@ -853,16 +693,17 @@ GIFEncode (xgdIOCtxPtr fp, int GWidth, int GHeight, int GInterlace,
 	  xgdPutC (0, fp);
       }
     xgdPutC (',', fp);
-    gifPutWord (LeftOfs, fp);
-    gifPutWord (TopOfs, fp);
-    gifPutWord (ctx.Width, fp);
-    gifPutWord (ctx.Height, fp);
-    if (ctx.Interlace)
+    gifPutWord (0, fp);
+    gifPutWord (0, fp);
+    gifPutWord (GWidth, fp);
+    gifPutWord (GHeight, fp);
+    if (GInterlace)
 	xgdPutC (0x40, fp);
     else
 	xgdPutC (0x00, fp);
     xgdPutC (InitCodeSize, fp);
-    GIFcompress (InitCodeSize + 1, fp, img, &ctx);
+    GIFcompress (InitCodeSize + 1, fp, img, GInterlace, ctx);
+    free (ctx);
     xgdPutC (0, fp);
     xgdPutC (';', fp);
 }
@@ -891,8 +732,8 @@ colorstobpp (int colors)
     return bpp;
 }
 
-static rasterliteImagePtr
-xgdImageCreateFromGifCtx (xgdIOCtxPtr fd)
+static int
+xgdImageCreateFromGifCtx (xgdIOCtxPtr fd, rasterliteTileSinkPtr sink)
 {
     int BitPixel;
     int Transparent = (-1);
@@ -905,14 +746,14 @@ xgdImageCreateFromGifCtx (xgdIOCtxPtr fd)
     int bitPixel;
     int ZeroDataBlock = FALSE;
     int haveGlobalColormap;
-    rasterliteImagePtr im = 0;
+    int frames = 0;
     if (!ReadOK (fd, buf, 6))
       {
-	  return 0;
+	  return RASTERLITE_ERROR;
       }
     if (strncmp ((char *) buf, "GIF", 3) != 0)
       {
-	  return 0;
+	  return RASTERLITE_ERROR;
       }
     if (memcmp ((char *) buf + 3, "87a", 3) == 0)
       {
@@ -924,11 +765,11 @@ xgdImageCreateFromGifCtx (xgdIOCtxPtr fd)
       }
     else
       {
-	  return 0;
+	  return RASTERLITE_ERROR;
       }
     if (!ReadOK (fd, buf, 7))
       {
-	  return 0;
+	  return RASTERLITE_ERROR;
       }
     BitPixel = 2 << (buf[4] & 0x07);
     screen_width = imw = LM_to_uint (buf[0], buf[1]);
@@ -938,7 +779,7 @@ xgdImageCreateFromGifCtx (xgdIOCtxPtr fd)
       {
 	  if (ReadColorMap (fd, BitPixel, ColorMap))
 	    {
-		return 0;
+		return RASTERLITE_ERROR;
 	    }
       }
     for (;;)
@@ -947,7 +788,7 @@ xgdImageCreateFromGifCtx (xgdIOCtxPtr fd)
 	  int width, height;
 	  if (!ReadOK (fd, &c, 1))
 	    {
-		return 0;
+		return RASTERLITE_ERROR;
 	    }
 	  if (c == ';')
 	    {
@@ -958,7 +799,7 @@ xgdImageCreateFromGifCtx (xgdIOCtxPtr fd)
 	    {
 		if (!ReadOK (fd, &c, 1))
 		  {
-		      return 0;
+		      return RASTERLITE_ERROR;
 		  }
 		DoExtension (fd, c, &Transparent, &ZeroDataBlock);
 		continue;
@@ -970,7 +811,7 @@ xgdImageCreateFromGifCtx (xgdIOCtxPtr fd)
 	    }
 	  if (!ReadOK (fd, buf, 9))
 	    {
-		return 0;
+		return RASTERLITE_ERROR;
 	    }
 	  useGlobalColormap = !BitSet (buf[8], LOCALCOLORMAP);
 	  bitPixel = 1 << ((buf[8] & 0x07) + 1);
@@ -980,47 +821,53 @@ xgdImageCreateFromGifCtx (xgdIOCtxPtr fd)
 	  height = LM_to_uint (buf[6], buf[7]);
 	  if (left + width > screen_width || top + height > screen_height)
 	    {
-		return 0;
+		return RASTERLITE_ERROR;
+	    }
+	  if ((size_t) width * (size_t) height > (size_t) INT_MAX)
+	    {
+		/* too many pixels to be indexed by an int */
+		return RASTERLITE_ERROR;
 	    }
-	  if (!(im = image_create (width, height)))
+	  frames++;
+	  if (!tile_sink_begin (sink, width, height, COLORSPACE_PALETTE))
 	    {
-		return 0;
+		if (sink->status == TILE_SINK_ERROR)
+		    return RASTERLITE_ERROR;
+		return RASTERLITE_OK;	/* nothing more to decode */
 	    }
 	  if (!useGlobalColormap)
 	    {
 		if (ReadColorMap (fd, bitPixel, localColorMap))
 		  {
-		      image_destroy (im);
-		      return 0;
+		      return RASTERLITE_ERROR;
 		  }
-		ReadImage (im, fd, width, height, localColorMap,
+		ReadImage (sink, fd, width, height, localColorMap,
 			   BitSet (buf[8], INTERLACE), &ZeroDataBlock);
 	    }
 	  else
 	    {
 		if (!haveGlobalColormap)
 		  {
-		      image_destroy (im);
-		      return 0;
+		      return RASTERLITE_ERROR;
 		  }
-		ReadImage (im, fd, width, height,
+		ReadImage (sink, fd, width, height,
 			   ColorMap,
 			   BitSet (buf[8], INTERLACE), &ZeroDataBlock);
 	    }
       }
   terminated:
-    if (!im)
+    if (!frames)
       {
-	  return 0;
+	  return RASTERLITE_ERROR;
       }
-    return im;
+    return RASTERLITE_OK;
 }
 
 static void
 xgdImageGifCtx (rasterliteImagePtr img, xgdIOCtxPtr out)
 {
     int BitsPerPixel;
-    int mapping[256];
+    struct palette_map mapping;
     int Red[256];
     int Green[256];
     int Blue[256];
@@ -1029,7 +876,13 @@ xgdImageGifCtx (rasterliteImagePtr img, xgdIOCtxPtr out)
     int *pThisRow;
     int thisPixel;
     for (i = 0; i < 256; ++i)
-	mapping[i] = -1;
+      {
+	  /* unused palette entries are written as black */
+	  Red[i] = 0;
+	  Green[i] = 0;
+	  Blue[i] = 0;
+      }
+    palette_init (&mapping);
     for (j = 0; j < img->sy; ++j)
       {
 	  pThisRow = *ptpixels++;
@@ -1037,19 +890,16 @@ xgdImageGifCtx (rasterliteImagePtr img, xgdIOCtxPtr out)
 	    {
 		int index;
 		thisPixel = *pThisRow;
-		index = palette_set (mapping, thisPixel);
+		index = palette_set (&mapping, thisPixel);
 		*pThisRow++ = index;
 	    }
       }
-    colors = 0;
-    for (i = 0; i < 256; ++i)
+    colors = mapping.count;
+    for (i = 0; i < colors; ++i)
       {
-	  if (mapping[i] == -1)
-	      break;
-	  Red[i] = true_color_get_red (mapping[i]);
-	  Green[i] = true_color_get_green (mapping[i]);
-	  Blue[i] = true_color_get_blue (mapping[i]);
-	  colors++;
+	  Red[i] = true_color_get_red (mapping.colors[i]);
+	  Green[i] = true_color_get_green (mapping.colors[i]);
+	  Blue[i] = true_color_get_blue (mapping.colors[i]);
       }
     BitsPerPixel = colorstobpp (colors);
     GIFEncode (out, img->sx, img->sy, 0, 0, -1, BitsPerPixel, Red, Green, Blue,
@@ -1061,21 +911,41 @@ image_to_gif (const rasterliteImagePtr img, int *size)
 {
 /* compressing an image as GIF */
     void *rv;
-    xgdIOCtx *out = xgdNewDynamicCtx (2048, NULL);
+    xgdIOCtx *out;
+    double expected = 2048.0 + ((double) img->sx * (double) img->sy) / 4.0;
+/* pre-sizing the output for some typical 4:1 compression ratio */
+    if (expected > (double) GIF_MAX_PRESIZE)
+	expected = (double) GIF_MAX_PRESIZE;
+    out = xgdNewDynamicCtx ((int) expected, NULL);
+    RASTERLITE_PROBE3 (encode__start, "gif", img->sx, img->sy);
     xgdImageGifCtx (img, out);
     rv = xgdDPExtractData (out, size);
     out->xgd_free (out);
+    RASTERLITE_PROBE2 (encode__done, "gif", *size);
     return rv;
 }
 
+extern int
+image_from_gif_sink (int size, const void *data, rasterliteTileSinkPtr sink)
+{
+/* uncompressing a GIF straight into a tile sink */
+    int ret;
+    xgdIOCtx *in = xgdNewDynamicCtxEx (size, data, 0);
+    RASTERLITE_PROBE2 (decode__start, "gif", size);
+    ret = xgdImageCreateFromGifCtx (in, sink);
+    in->xgd_free (in);
+    RASTERLITE_PROBE3 (decode__done, "gif",
+		       ret == RASTERLITE_OK ? sink->src_width : 0,
+		       ret == RASTERLITE_OK ? sink->src_height : 0);
+    return ret;
+}
+
 extern rasterliteImagePtr
 image_from_gif (int size, const void *data)
 {
 /* uncompressing a GIF */
-    rasterliteImagePtr img;
-    xgdIOCtx *in = xgdNewDynamicCtxEx (size, data, 0);
-    img = xgdImageCreateFromGifCtx (in);
-    img->color_space = COLORSPACE_PALETTE;
-    in->xgd_free (in);
-    return img;
+    rasterliteTileSink sink;
+    tile_sink_init (&sink, NULL);
+    return tile_sink_release (&sink,
+			      image_from_gif_sink (size, data, &sink));
 }
@@ -50,6 +50,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <float.h>
 #include <limits.h>
 
@@ -63,6 +64,7 @@
 
 #include <spatialite/gaiageo.h>
 
+#include "rasterlite.h"
 #include "rasterlite_internals.h"
 
 extern rasterliteImagePtr
@@ -162,7 +164,7 @@ shrink_by (const rasterliteImagePtr dst, const rasterliteImagePtr src)
 		unsigned int counter = 0;
 		for (y1 = 0; y1 < yFactor; ++y1)
 		  {
-		      y_offset = (y * yFactor + y1) * src->sx;
+		      y_offset = y * yFactor + y1;
 		      for (x1 = 0; x1 < xFactor; ++x1)
 			{
 			    x_offset = (x * xFactor) + x1;
@@ -196,10 +198,11 @@ image_resize (const rasterliteImagePtr dst, const rasterliteImagePtr src)
     int j;
     int x;
     int i;
+    RASTERLITE_PROBE4 (resize, src->sx, src->sy, dst->sx, dst->sy);
     if ((src->sx % dst->sx) == 0 && src->sx >= dst->sx
 	&& (src->sy % dst->sy) == 0 && src->sy >= dst->sy)
       {
-	  shrink_by (src, dst);
+	  shrink_by (dst, src);
 	  return;
       }
     x = src->sx;
@@ -219,6 +222,278 @@ image_resize (const rasterliteImagePtr dst, const rasterliteImagePtr src)
       }
 }
 
+static int
+sink_round (double value)
+{
+/* replacing the C99 round() function */
+    double min = floor (value);
+    if (fabs (value - min) < 0.5)
+	return (int) min;
+    return (int) (min + 1.0);
+}
+
+extern void
+tile_sink_init (rasterliteTileSinkPtr sink, rasterliteImagePtr canvas)
+{
+/* initializing a tile sink; a NULL canvas means a 1:1 new image */
+    memset (sink, 0, sizeof (rasterliteTileSink));
+    sink->canvas = canvas;
+    sink->own_canvas = (canvas == NULL);
+    sink->tile_pixel_x_size = 1.0;
+    sink->tile_pixel_y_size = 1.0;
+    sink->canvas_pixel_x_size = 1.0;
+    sink->canvas_pixel_y_size = 1.0;
+    sink->transparent_color = -1;
+    sink->status = TILE_SINK_PENDING;
+}
+
+static void
+tile_sink_free_buffers (rasterliteTileSinkPtr sink)
+{
+/* freeing the per-tile work buffers */
+    if (sink->scanline)
+	free (sink->scanline);
+    if (sink->sums)
+	free (sink->sums);
+    sink->scanline = NULL;
+    sink->sums = NULL;
+}
+
+extern int
+tile_sink_begin (rasterliteTileSinkPtr sink, int width, int height,
+		 int color_space)
+{
+/*
+/ the decoder has just read the tile header
+/ returns 0 when the decoder can stop here [gray rectangle or error]
+*/
+    tile_sink_free_buffers (sink);
+    sink->src_width = width;
+    sink->src_height = height;
+    sink->color_space = color_space;
+    sink->dst_row = 0;
+    if (width <= 0 || height <= 0)
+      {
+	  sink->status = TILE_SINK_ERROR;
+	  return 0;
+      }
+    if (sink->own_canvas)
+      {
+	  /* building a new image [any previous frame is discarded] */
+	  if (sink->canvas)
+	      image_destroy (sink->canvas);
+	  sink->canvas = image_create (width, height);
+	  if (sink->canvas == NULL)
+	    {
+		sink->status = TILE_SINK_ERROR;
+		return 0;
+	    }
+	  sink->canvas->color_space = color_space;
+	  sink->width = width;
+	  sink->height = height;
+	  sink->status = TILE_SINK_DRAW;
+	  return 1;
+      }
+/* the tile position and dims on the canvas */
+    sink->width =
+	sink_round (((double) width * sink->tile_pixel_x_size) /
+		    sink->canvas_pixel_x_size) + 1;
+    sink->height =
+	sink_round (((double) height * sink->tile_pixel_y_size) /
+		    sink->canvas_pixel_y_size) + 1;
+    sink->base_x = sink_round (sink->origin_x);
+    sink->base_y = sink_round (sink->origin_y);
+    if (sink->width > (width * 16) || sink->height > (height * 16))
+      {
+	  /* TOO BIG: the caller will draw a gray rectangle */
+	  sink->status = TILE_SINK_GRAY;
+	  return 0;
+      }
+    sink->resized = (sink->width != width || sink->height != height);
+    sink->x_factor = 0;
+    sink->y_factor = 0;
+    if (sink->resized && (width % sink->width) == 0 && width >= sink->width
+	&& (height % sink->height) == 0 && height >= sink->height)
+      {
+	  /* integral shrink: averaging pixel boxes as image_resize() does */
+	  sink->x_factor = width / sink->width;
+	  sink->y_factor = height / sink->height;
+	  sink->sums = calloc (sink->width * 3, sizeof (unsigned int));
+	  if (sink->sums == NULL)
+	    {
+		sink->status = TILE_SINK_ERROR;
+		return 0;
+	    }
+      }
+    sink->x_delta = (width << 16) / sink->width;
+    sink->y_delta = (height << 16) / sink->height;
+    sink->scanline = malloc (sizeof (int) * width);
+    if (sink->scanline == NULL)
+      {
+	  sink->status = TILE_SINK_ERROR;
+	  return 0;
+      }
+    sink->status = TILE_SINK_DRAW;
+    return 1;
+}
+
+extern int *
+tile_sink_scanline (rasterliteTileSinkPtr sink, int y)
+{
+/*
+/ returns the buffer the decoder has to fill with the source row Y
+/ [true colors], or NULL when this row doesn't reach the canvas at all
+/ rows have to be requested top-down, one by one
+*/
+    int j;
+    rasterliteImagePtr canvas = sink->canvas;
+    if (sink->status != TILE_SINK_DRAW || y < 0 || y >= sink->src_height)
+	return NULL;
+    if (sink->own_canvas)
+	return canvas->pixels[y];
+    if (sink->base_x >= canvas->sx || sink->base_x + sink->width <= 0)
+	return NULL;
+    if (sink->y_factor)
+      {
+	  /* box filter: one canvas row every Y_FACTOR source rows */
+	  j = sink->base_y + (y / sink->y_factor);
+	  if (j < 0 || j >= canvas->sy)
+	      return NULL;
+	  return sink->scanline;
+      }
+/* nearest neighbour: the run of canvas rows replicating this source row */
+    while (sink->dst_row < sink->height
+	   && ((sink->dst_row * sink->y_delta) >> 16) < y)
+	sink->dst_row++;
+    sink->run_first = sink->dst_row;
+    j = sink->dst_row;
+    while (j < sink->height && ((j * sink->y_delta) >> 16) == y)
+	j++;
+    sink->run_last = j - 1;
+    if (sink->run_last < sink->run_first)
+	return NULL;
+    if (sink->base_y + sink->run_last < 0
+	|| sink->base_y + sink->run_first >= canvas->sy)
+	return NULL;
+    return sink->scanline;
+}
+
+static void
+tile_sink_span (rasterliteTileSinkPtr sink, int dst_y, const int *row)
+{
+/* drawing a nearest neighbour canvas row, clipped */
+    int i;
+    int x;
+    int pixel;
+    int first = 0;
+    int last = sink->width;
+    int *out = sink->canvas->pixels[dst_y] + sink->base_x;
+    if (sink->base_x < 0)
+	first = -(sink->base_x);
+    if (sink->base_x + last > sink->canvas->sx)
+	last = sink->canvas->sx - sink->base_x;
+    x = first * sink->x_delta;
+    for (i = first; i < last; i++, x += sink->x_delta)
+      {
+	  pixel = row[x >> 16];
+	  if (pixel == sink->transparent_color)
+	      continue;
+	  out[i] = pixel;
+      }
+}
+
+static void
+tile_sink_box (rasterliteTileSinkPtr sink, int y)
+{
+/* accumulating a source row into the box filter, flushing completed rows */
+    int x;
+    int i;
+    int pixel;
+    int first = 0;
+    int last = sink->width;
+    unsigned int counter;
+    unsigned int *sum;
+    int *out;
+    for (x = 0; x < sink->src_width; x++)
+      {
+	  pixel = sink->scanline[x];
+	  sum = sink->sums + ((x / sink->x_factor) * 3);
+	  sum[0] += true_color_get_red (pixel);
+	  sum[1] += true_color_get_green (pixel);
+	  sum[2] += true_color_get_blue (pixel);
+      }
+    if ((y % sink->y_factor) != (sink->y_factor - 1))
+	return;
+    counter = sink->x_factor * sink->y_factor;
+    out =
+	sink->canvas->pixels[sink->base_y + (y / sink->y_factor)] +
+	sink->base_x;
+    if (sink->base_x < 0)
+	first = -(sink->base_x);
+    if (sink->base_x + last > sink->canvas->sx)
+	last = sink->canvas->sx - sink->base_x;
+    for (i = first; i < last; i++)
+      {
+	  sum = sink->sums + (i * 3);
+	  pixel =
+	      true_color ((sum[0] / counter), (sum[1] / counter),
+			  (sum[2] / counter));
+	  if (pixel != sink->transparent_color)
+	      out[i] = pixel;
+      }
+    memset (sink->sums, 0, sizeof (unsigned int) * 3 * sink->width);
+}
+
+extern void
+tile_sink_commit (rasterliteTileSinkPtr sink, int y)
+{
+/* the decoder has filled the buffer returned by tile_sink_scanline() */
+    int j;
+    int dst_y;
+    double t0;
+    if (sink->status != TILE_SINK_DRAW || sink->own_canvas)
+	return;
+    t0 = phase_clock ();
+    if (sink->y_factor)
+	tile_sink_box (sink, y);
+    else
+      {
+	  for (j = sink->run_first; j <= sink->run_last; j++)
+	    {
+		dst_y = sink->base_y + j;
+		if (dst_y < 0)
+		    continue;
+		if (dst_y >= sink->canvas->sy)
+		    break;
+		tile_sink_span (sink, dst_y, sink->scanline);
+	    }
+      }
+    if (sink->resized)
+	sink->resample_time += phase_clock () - t0;
+    else
+	sink->composite_time += phase_clock () - t0;
+}
+
+extern rasterliteImagePtr
+tile_sink_release (rasterliteTileSinkPtr sink, int ret)
+{
+/*
+/ releasing the tile sink once the decoder returned RET
+/ returns the new image built by a sink having a NULL canvas
+*/
+    rasterliteImagePtr img = NULL;
+    tile_sink_free_buffers (sink);
+    if (sink->own_canvas)
+      {
+	  if (ret == RASTERLITE_OK && sink->status == TILE_SINK_DRAW)
+	      img = sink->canvas;
+	  else if (sink->canvas)
+	      image_destroy (sink->canvas);
+	  sink->canvas = NULL;
+      }
+    return img;
+}
+
 #define floor2(exp) ((long) exp)
 
 extern void
@@ -332,6 +607,7 @@ image_to_rgb_array (const rasterliteImagePtr img, int *size)
     unsigned char *data = NULL;
     unsigned char *p;
     int sz = img->sx * img->sy * 3;
+    RASTERLITE_PROBE3 (encode__start, "rgb", img->sx, img->sy);
     *size = 0;
 /* allocating the RGB array */
     data = malloc (sz);
@@ -347,6 +623,7 @@ image_to_rgb_array (const rasterliteImagePtr img, int *size)
 	    }
       }
     *size = sz;
+    RASTERLITE_PROBE2 (encode__done, "rgb", *size);
     return data;
 }
 
@@ -365,6 +642,7 @@ image_to_rgba_array (int transparent_color, const rasterliteImagePtr img,
     unsigned char *data = NULL;
     unsigned char *p;
     int sz = img->sx * img->sy * 4;
+    RASTERLITE_PROBE3 (encode__start, "rgba", img->sx, img->sy);
     *size = 0;
 /* allocating the RGB array */
     data = malloc (sz);
@@ -388,6 +666,7 @@ image_to_rgba_array (int transparent_color, const rasterliteImagePtr img,
 	    }
       }
     *size = sz;
+    RASTERLITE_PROBE2 (encode__done, "rgba", *size);
     return data;
 }
 
@@ -406,6 +685,7 @@ image_to_argb_array (int transparent_color, const rasterliteImagePtr img,
     unsigned char *data = NULL;
     unsigned char *p;
     int sz = img->sx * img->sy * 4;
+    RASTERLITE_PROBE3 (encode__start, "argb", img->sx, img->sy);
     *size = 0;
 /* allocating the RGB array */
     data = malloc (sz);
@@ -429,6 +709,7 @@ image_to_argb_array (int transparent_color, const rasterliteImagePtr img,
 	    }
       }
     *size = sz;
+    RASTERLITE_PROBE2 (encode__done, "argb", *size);
     return data;
 }
 
@@ -442,6 +723,7 @@ image_to_bgr_array (const rasterliteImagePtr img, int *size)
     unsigned char *data = NULL;
     unsigned char *p;
     int sz = img->sx * img->sy * 3;
+    RASTERLITE_PROBE3 (encode__start, "bgr", img->sx, img->sy);
     *size = 0;
 /* allocating the RGB array */
     data = malloc (sz);
@@ -457,6 +739,7 @@ image_to_bgr_array (const rasterliteImagePtr img, int *size)
 	    }
       }
     *size = sz;
+    RASTERLITE_PROBE2 (encode__done, "bgr", *size);
     return data;
 }
 
@@ -475,6 +758,7 @@ image_to_bgra_array (int transparent_color, const rasterliteImagePtr img,
     unsigned char *data = NULL;
     unsigned char *p;
     int sz = img->sx * img->sy * 4;
+    RASTERLITE_PROBE3 (encode__start, "bgra", img->sx, img->sy);
     *size = 0;
 /* allocating the RGB array */
     data = malloc (sz);
@@ -498,6 +782,7 @@ image_to_bgra_array (int transparent_color, const rasterliteImagePtr img,
 	    }
       }
     *size = sz;
+    RASTERLITE_PROBE2 (encode__done, "bgra", *size);
     return data;
 }
 
@@ -514,6 +799,7 @@ image_from_rgb_array (const void *raw, int width, int height)
     const unsigned char *data = raw;
     const unsigned char *p;
     rasterliteImagePtr img = image_create (width, height);
+    RASTERLITE_PROBE2 (decode__start, "rgb", width * height * 3);
     if (!img)
 	return NULL;
     for (y = 0; y < img->sy; y++)
@@ -528,6 +814,8 @@ image_from_rgb_array (const void *raw, int width, int height)
 		img->pixels[y][x] = pixel;
 	    }
       }
+    RASTERLITE_PROBE3 (decode__done, "rgb", img ? img->sx : 0,
+		       img ? img->sy : 0);
     return img;
 }
 
@@ -545,6 +833,7 @@ image_from_rgba_array (const void *raw, int width, int height)
     const unsigned char *data = raw;
     const unsigned char *p;
     rasterliteImagePtr img = image_create (width, height);
+    RASTERLITE_PROBE2 (decode__start, "rgba", width * height * 4);
     if (!img)
 	return NULL;
     for (y = 0; y < img->sy; y++)
@@ -560,6 +849,8 @@ image_from_rgba_array (const void *raw, int width, int height)
 		img->pixels[y][x] = pixel;
 	    }
       }
+    RASTERLITE_PROBE3 (decode__done, "rgba", img ? img->sx : 0,
+		       img ? img->sy : 0);
     return img;
 }
 
@@ -577,6 +868,7 @@ image_from_argb_array (const void *raw, int width, int height)
     const unsigned char *data = raw;
     const unsigned char *p;
     rasterliteImagePtr img = image_create (width, height);
+    RASTERLITE_PROBE2 (decode__start, "argb", width * height * 4);
     if (!img)
 	return NULL;
     for (y = 0; y < img->sy; y++)
@@ -593,6 +885,8 @@ image_from_argb_array (const void *raw, int width, int height)
 		img->pixels[y][x] = pixel;
 	    }
       }
+    RASTERLITE_PROBE3 (decode__done, "argb", img ? img->sx : 0,
+		       img ? img->sy : 0);
     return img;
 }
 
@@ -609,6 +903,7 @@ image_from_bgr_array (const void *raw, int width, int height)
     const unsigned char *data = raw;
     const unsigned char *p;
     rasterliteImagePtr img = image_create (width, height);
+    RASTERLITE_PROBE2 (decode__start, "bgr", width * height * 3);
     if (!img)
 	return NULL;
     for (y = 0; y < img->sy; y++)
@@ -623,6 +918,8 @@ image_from_bgr_array (const void *raw, int width, int height)
 		img->pixels[y][x] = pixel;
 	    }
       }
+    RASTERLITE_PROBE3 (decode__done, "bgr", img ? img->sx : 0,
+		       img ? img->sy : 0);
     return img;
 }
 
@@ -640,6 +937,7 @@ image_from_bgra_array (const void *raw, int width, int height)
     const unsigned char *data = raw;
     const unsigned char *p;
     rasterliteImagePtr img = image_create (width, height);
+    RASTERLITE_PROBE2 (decode__start, "bgra", width * height * 4);
     if (!img)
 	return NULL;
     for (y = 0; y < img->sy; y++)
@@ -655,6 +953,8 @@ image_from_bgra_array (const void *raw, int width, int height)
 		img->pixels[y][x] = pixel;
 	    }
       }
+    RASTERLITE_PROBE3 (decode__done, "bgra", img ? img->sx : 0,
+		       img ? img->sy : 0);
     return img;
 }
 
@@ -712,32 +1012,6 @@ is_image_grayscale (const rasterliteImagePtr img)
     return RASTERLITE_TRUE;
 }
 
-static void
-palette_init (int *palette)
-{
-/* initializing an empty palette */
-    int x;
-    for (x = 0; x < 256; x++)
-	palette[x] = INT_MAX;
-}
-
-static int
-palette_check (int *palette, int pixel)
-{
-    int x;
-    for (x = 0; x < 256; x++)
-      {
-	  if (palette[x] == pixel)
-	      return RASTERLITE_TRUE;
-	  if (palette[x] == INT_MAX)
-	    {
-		palette[x] = pixel;
-		return RASTERLITE_TRUE;
-	    }
-      }
-    return RASTERLITE_FALSE;
-}
-
 extern int
 is_image_palette256 (const rasterliteImagePtr img)
 {
@@ -745,14 +1019,14 @@ is_image_palette256 (const rasterliteImagePtr img)
     int x;
     int y;
     int pixel;
-    int palette[256];
-    palette_init (palette);
+    struct palette_map palette;
+    palette_init (&palette);
     for (y = 0; y < img->sy; y++)
       {
 	  for (x = 0; x < img->sx; x++)
 	    {
 		pixel = img->pixels[y][x];
-		if (palette_check (palette, pixel) == RASTERLITE_TRUE)
+		if (palette_lookup (&palette, pixel) >= 0)
 		    continue;
 		return RASTERLITE_FALSE;
 	    }
@@ -52,6 +52,11 @@
 #include <string.h>
 #include <limits.h>
 
+#ifndef _WIN32
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
 #include <tiffio.h>
 
 #ifdef SPATIALITE_AMALGAMATION
@@ -78,7 +83,23 @@
 static int
 xgdReallocDynamic (dynamicPtr * dp, int required)
 {
+/* growing [or trimming] the buffer; owned buffers go through the pool */
     void *newPtr;
+    int capacity;
+    if (dp->freeOK && required > dp->realSize)
+      {
+	  newPtr = buffer_pool_acquire (required, &capacity);
+	  if (!newPtr)
+	    {
+		dp->dataGood = FALSE;
+		return FALSE;
+	    }
+	  memcpy (newPtr, dp->data, dp->logicalSize);
+	  buffer_pool_release (dp->data, dp->realSize);
+	  dp->data = newPtr;
+	  dp->realSize = capacity;
+	  return TRUE;
+      }
     if ((newPtr = realloc (dp->data, required)))
       {
 	  dp->realSize = required;
@@ -108,7 +129,7 @@ xgdFreeDynamicCtx (struct xgdIOCtx *ctx)
     free (ctx);
     if ((dp->data != NULL) && (dp->freeOK))
       {
-	  free (dp->data);
+	  buffer_pool_release (dp->data, dp->realSize);
 	  dp->data = NULL;
       }
     dp->realSize = 0;
@@ -123,7 +144,7 @@ allocDynamic (dynamicPtr * dp, int initialSize, const void *data)
       {
 	  dp->logicalSize = 0;
 	  dp->dataGood = FALSE;
-	  dp->data = malloc (initialSize);
+	  dp->data = buffer_pool_acquire (initialSize, &initialSize);
       }
     else
       {
@@ -283,11 +304,151 @@ newDynamic (int initialSize, const void *data, int freeOKFlag)
 static int
 trimDynamic (dynamicPtr * dp)
 {
+/* trimming only largely oversized buffers, so to keep recycling them */
     if (!dp->freeOK)
 	return TRUE;
+    if (dp->logicalSize <= 0 || dp->realSize <= 2 * dp->logicalSize)
+	return TRUE;
     return xgdReallocDynamic (dp, dp->logicalSize);
 }
 
+/*
+/ a thread-local pool of idle output buffers, by power-of-two size classes
+/ pooled buffers simply are malloc() blocks: the caller may as well free()
+/ them, or hand them back through buffer_pool_release()
+*/
+
+#ifndef _WIN32
+
+#define BUFFER_POOL_CLASSES	(BUFFER_POOL_MAX_CLASS - BUFFER_POOL_MIN_CLASS + 1)
+
+struct buffer_pool
+{
+/* the calling thread's idle buffers */
+    void *buffers[BUFFER_POOL_CLASSES][BUFFER_POOL_DEPTH];
+    int capacity[BUFFER_POOL_CLASSES][BUFFER_POOL_DEPTH];
+    int count[BUFFER_POOL_CLASSES];
+    size_t bytes;
+};
+
+static pthread_key_t buffer_pool_key;
+static pthread_once_t buffer_pool_once = PTHREAD_ONCE_INIT;
+static int buffer_pool_ok = 0;
+
+static void
+buffer_pool_destroy (void *arg)
+{
+/* the owning thread is exiting: freeing all its idle buffers */
+    struct buffer_pool *pool = arg;
+    int k;
+    int i;
+    for (k = 0; k < BUFFER_POOL_CLASSES; k++)
+      {
+	  for (i = 0; i < pool->count[k]; i++)
+	      free (pool->buffers[k][i]);
+      }
+    free (pool);
+}
+
+static void
+buffer_pool_init (void)
+{
+/* creating the thread-specific key, just once */
+    if (pthread_key_create (&buffer_pool_key, buffer_pool_destroy) == 0)
+	buffer_pool_ok = 1;
+}
+
+static struct buffer_pool *
+buffer_pool_get (void)
+{
+/* the calling thread's pool [created on first use] */
+    struct buffer_pool *pool;
+    pthread_once (&buffer_pool_once, buffer_pool_init);
+    if (!buffer_pool_ok)
+	return NULL;
+    pool = pthread_getspecific (buffer_pool_key);
+    if (pool)
+	return pool;
+    pool = calloc (1, sizeof (struct buffer_pool));
+    if (pool == NULL)
+	return NULL;
+    if (pthread_setspecific (buffer_pool_key, pool) != 0)
+      {
+	  free (pool);
+	  return NULL;
+      }
+    return pool;
+}
+
+#endif /* not WIN32 */
+
+extern void *
+buffer_pool_acquire (int size, int *capacity)
+{
+/*
+/ returns a buffer of at least SIZE bytes, recycling some idle one
+/ when possible; its actual size is returned into CAPACITY
+*/
+    void *buffer;
+    int k = BUFFER_POOL_MIN_CLASS;
+    int alloc_size = size;
+#ifndef _WIN32
+    int j;
+    struct buffer_pool *pool;
+    while (k <= BUFFER_POOL_MAX_CLASS && (1 << k) < size)
+	k++;
+    if (k <= BUFFER_POOL_MAX_CLASS)
+      {
+	  /* rounding up to the size class, so to be recycled later */
+	  alloc_size = 1 << k;
+	  pool = buffer_pool_get ();
+	  for (j = k; pool && j <= k + 2 && j <= BUFFER_POOL_MAX_CLASS; j++)
+	    {
+		int c = j - BUFFER_POOL_MIN_CLASS;
+		if (pool->count[c] > 0)
+		  {
+		      pool->count[c] -= 1;
+		      *capacity = pool->capacity[c][pool->count[c]];
+		      pool->bytes -= *capacity;
+		      return pool->buffers[c][pool->count[c]];
+		  }
+	    }
+      }
+#endif
+    buffer = malloc (alloc_size);
+    *capacity = buffer ? alloc_size : 0;
+    return buffer;
+}
+
+extern void
+buffer_pool_release (void *buffer, int capacity)
+{
+/* handing a buffer of CAPACITY bytes back to the calling thread's pool */
+#ifndef _WIN32
+    int k = BUFFER_POOL_MIN_CLASS;
+    struct buffer_pool *pool;
+    if (buffer == NULL)
+	return;
+    if (capacity >= (1 << BUFFER_POOL_MIN_CLASS))
+      {
+	  while (k < BUFFER_POOL_MAX_CLASS && (1 << (k + 1)) <= capacity)
+	      k++;
+	  pool = buffer_pool_get ();
+	  if (pool && pool->count[k - BUFFER_POOL_MIN_CLASS] < BUFFER_POOL_DEPTH
+	      && pool->bytes + capacity <= BUFFER_POOL_MAX_BYTES)
+	    {
+		int c = k - BUFFER_POOL_MIN_CLASS;
+		pool->buffers[c][pool->count[c]] = buffer;
+		pool->capacity[c][pool->count[c]] = capacity;
+		pool->count[c] += 1;
+		pool->bytes += capacity;
+		return;
+	    }
+      }
+#endif
+    free (buffer);
+}
+
 extern int
 overflow2 (int a, int b)
 {
@@ -327,7 +488,7 @@ xgdDPExtractData (struct xgdIOCtx *ctx, int *size)
 	  *size = 0;
 	  data = NULL;
 	  if ((dp->data != NULL) && (dp->freeOK))
-	      free (dp->data);
+	      buffer_pool_release (dp->data, dp->realSize);
       }
     dp->data = NULL;
     dp->realSize = 0;
@@ -368,21 +529,130 @@ xgdNewDynamicCtxEx (int initialSize, const void *data, int freeOKFlag)
     return (xgdIOCtx *) ctx;
 }
 
-extern int
-palette_set (int *mapping, int color)
+extern void
+palette_init (struct palette_map *map)
 {
+/* initializing an empty palette */
     int i;
     for (i = 0; i < 256; i++)
+	map->colors[i] = -1;
+    for (i = 0; i < PALETTE_HASH_SIZE; i++)
+	map->keys[i] = -1;
+    map->count = 0;
+    map->last_color = -1;
+    map->last_index = 0;
+}
+
+extern int
+palette_lookup (struct palette_map *map, int color)
+{
+/* 
+/ returns the palette index of this color, adding it if not yet there;
+/ -1 if the palette already is full
+*/
+    unsigned int slot;
+    if (color == map->last_color)
+	return map->last_index;
+    slot =
+	(((unsigned int) color * 2654435761U) >> 23) & (PALETTE_HASH_SIZE - 1);
+    while (map->keys[slot] != -1)
       {
-	  if (mapping[i] == color)
-	      return i;
-	  if (mapping[i] == -1)
+	  if (map->keys[slot] == color)
 	    {
-		mapping[i] = color;
-		return i;
+		map->last_color = color;
+		map->last_index = map->index[slot];
+		return map->last_index;
 	    }
+	  slot = (slot + 1) & (PALETTE_HASH_SIZE - 1);
       }
-    return 0;
+    if (map->count == 256)
+	return -1;
+    map->keys[slot] = color;
+    map->index[slot] = (unsigned char) (map->count);
+    map->colors[map->count] = color;
+    map->last_color = color;
+    map->last_index = map->count;
+    map->count += 1;
+    return map->last_index;
+}
+
+extern int
+palette_set (struct palette_map *map, int color)
+{
+/* mapping a pixel for some palette encoder; colors beyond the 256th map to 0 */
+    int index = palette_lookup (map, color);
+    if (index < 0)
+	return 0;
+    return index;
+}
+
+/* the process-wide cap on the threads of a single encoder [0: one per CPU] */
+static int encoder_threads_max = 0;
+
+#ifndef _WIN32
+
+static pthread_key_t encoder_threads_key;
+static pthread_once_t encoder_threads_once = PTHREAD_ONCE_INIT;
+static int encoder_threads_ok = 0;
+
+static void
+encoder_threads_init (void)
+{
+/* creating the thread-specific key, just once */
+    if (pthread_key_create (&encoder_threads_key, NULL) == 0)
+	encoder_threads_ok = 1;
+}
+
+#endif /* not WIN32 */
+
+extern void
+set_encoder_threads (int threads)
+{
+/* capping the threads of each encoder, process-wide */
+    if (threads < 0)
+	threads = 0;
+    encoder_threads_max = threads;
+}
+
+extern void
+set_thread_encoder_threads (int threads)
+{
+/* 
+/ capping the threads of each encoder run by the calling thread, overriding
+/ the process-wide cap [0 restores it]; meant for worker threads, as other
+/ workers already keep the remaining CPUs busy
+*/
+#ifndef _WIN32
+    pthread_once (&encoder_threads_once, encoder_threads_init);
+    if (!encoder_threads_ok)
+	return;
+    if (threads < 0)
+	threads = 0;
+    pthread_setspecific (encoder_threads_key, (void *) (long) threads);
+#endif
+}
+
+extern int
+parallel_encoder_threads (const rasterliteImagePtr img)
+{
+/* how many threads should encode this image [0: the plain serial encoder] */
+    int threads = 0;
+#ifndef _WIN32
+    int max = encoder_threads_max;
+    if ((double) img->sx * (double) img->sy < PARALLEL_ENCODER_MIN_PIXELS)
+	return 0;
+    pthread_once (&encoder_threads_once, encoder_threads_init);
+    if (encoder_threads_ok && pthread_getspecific (encoder_threads_key))
+	max = (int) (long) pthread_getspecific (encoder_threads_key);
+    threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+    if (max > 0 && threads > max)
+	threads = max;
+    if (threads > 64)
+	threads = 64;
+    if (threads < 2)
+	threads = 0;
+#endif
+    return threads;
 }
 
 extern int
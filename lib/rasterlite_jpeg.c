@@ -53,6 +53,10 @@
 #include <limits.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 #include <tiffio.h>
 #include <jpeglib.h>
 #include <jerror.h>
@@ -65,6 +69,7 @@
 
 #include <spatialite/gaiageo.h>
 
+#include "rasterlite.h"
 #include "rasterlite_internals.h"
 
 /* 
@@ -286,9 +291,10 @@ jpeg_xgdIOCtx_dest (j_compress_ptr cinfo, xgdIOCtx * outfile)
 }
 
 static void
-xgdImageJpegCtx (rasterliteImagePtr img, xgdIOCtx * outfile, int quality,
-		 int mode)
+xgdImageJpegCtxRows (rasterliteImagePtr img, xgdIOCtx * outfile, int quality,
+		     int mode, int profile, int first_row, int last_row)
 {
+/* compressing the rows [first_row, last_row) of some image as JPEG */
     struct jpeg_compress_struct cinfo;
     struct jpeg_error_mgr jerr;
     int i, j, jidx;
@@ -310,7 +316,7 @@ xgdImageJpegCtx (rasterliteImagePtr img, xgdIOCtx * outfile, int quality,
     cinfo.err->error_exit = fatal_jpeg_error;
     jpeg_create_compress (&cinfo);
     cinfo.image_width = img->sx;
-    cinfo.image_height = img->sy;
+    cinfo.image_height = last_row - first_row;
     if (mode == IMAGE_JPEG_BW)
       {
 	  /* GRAYSCALE */
@@ -326,6 +332,14 @@ xgdImageJpegCtx (rasterliteImagePtr img, xgdIOCtx * outfile, int quality,
     jpeg_set_defaults (&cinfo);
     if (quality >= 0)
 	jpeg_set_quality (&cinfo, quality, TRUE);
+    if (profile == RASTERLITE_JPEG_PROFILE_SPEED)
+	cinfo.dct_method = JDCT_IFAST;
+    else if (profile == RASTERLITE_JPEG_PROFILE_SIZE)
+      {
+	  /* optimized Huffman tables, progressive scans */
+	  cinfo.optimize_coding = TRUE;
+	  jpeg_simple_progression (&cinfo);
+      }
     jpeg_xgdIOCtx_dest (&cinfo, outfile);
     row = (JSAMPROW) calloc (1, cinfo.image_width * cinfo.input_components
 			     * sizeof (JSAMPLE));
@@ -338,14 +352,18 @@ xgdImageJpegCtx (rasterliteImagePtr img, xgdIOCtx * outfile, int quality,
       }
     rowptr[0] = row;
     jpeg_start_compress (&cinfo, TRUE);
-    sprintf (comment, "CREATOR: jpeg-wrapper (using IJG JPEG v%d),",
-	     JPEG_LIB_VERSION);
-    if (quality >= 0)
-	sprintf (comment + strlen (comment), " quality = %d\n", quality);
-    else
-	strcat (comment + strlen (comment), " default quality\n");
-    jpeg_write_marker (&cinfo, JPEG_COM, (unsigned char *) comment,
-		       (unsigned int) strlen (comment));
+    if (profile != RASTERLITE_JPEG_PROFILE_SPEED)
+      {
+	  sprintf (comment, "CREATOR: jpeg-wrapper (using IJG JPEG v%d),",
+		   JPEG_LIB_VERSION);
+	  if (quality >= 0)
+	      sprintf (comment + strlen (comment), " quality = %d\n",
+		       quality);
+	  else
+	      strcat (comment + strlen (comment), " default quality\n");
+	  jpeg_write_marker (&cinfo, JPEG_COM, (unsigned char *) comment,
+			     (unsigned int) strlen (comment));
+      }
 #if BITS_IN_JSAMPLE == 12
     fprintf (stderr,
 	     "jpeg-wrapper: error: jpeg library was compiled for 12-bit\n"
@@ -356,7 +374,7 @@ xgdImageJpegCtx (rasterliteImagePtr img, xgdIOCtx * outfile, int quality,
 	     "'make clean' and 'make install' libjpeg again. Sorry.\n");
     goto error;
 #endif /* BITS_IN_JSAMPLE == 12 */
-    for (i = 0; i < img->sy; i++)
+    for (i = first_row; i < last_row; i++)
       {
 	  for (jidx = 0, j = 0; j < img->sx; j++)
 	    {
@@ -384,6 +402,249 @@ xgdImageJpegCtx (rasterliteImagePtr img, xgdIOCtx * outfile, int quality,
     free (row);
 }
 
+#ifndef _WIN32
+
+/*
+/ parallel JPEG encoding
+/
+/ big images are split into bands of whole MCU rows, each one encoded
+/ by some worker thread as a standalone baseline JPEG; all bands share
+/ the very same tables, so that their entropy coded segments can be
+/ stitched together into a single JPEG, with a restart interval exactly
+/ spanning one band and RSTn markers in between
+*/
+
+#define JPEG_BAND_PIXELS	(1024 * 1024)
+
+struct jpeg_band
+{
+/* a band of MCU rows to be encoded */
+    int first_row;
+    int last_row;		/* exclusive */
+    unsigned char *jpeg;	/* the standalone band JPEG */
+    int size;
+    int sof;			/* offset of the SOF0 segment */
+    int sos;			/* offset of the SOS segment */
+    int scan;			/* offset of the entropy coded data */
+};
+
+struct jpeg_parallel
+{
+/* the shared state of a parallel JPEG encoding */
+    rasterliteImagePtr img;
+    int quality;
+    int mode;
+    int profile;
+    struct jpeg_band *bands;
+    int n_bands;
+    int next_band;
+    pthread_mutex_t mutex;
+};
+
+static int
+jpeg_parse_band (struct jpeg_band *band)
+{
+/* locating the SOF0 and SOS segments of some band JPEG */
+    int pos = 2;
+    int len;
+    unsigned char *p = band->jpeg;
+    band->sof = -1;
+    band->sos = -1;
+    if (p == NULL || band->size < 4 || p[0] != 0xff || p[1] != 0xd8)
+	return 0;
+    if (p[band->size - 2] != 0xff || p[band->size - 1] != 0xd9)
+	return 0;
+    while (pos + 4 <= band->size)
+      {
+	  if (p[pos] != 0xff)
+	      return 0;
+	  len = (p[pos + 2] << 8) | p[pos + 3];
+	  if (p[pos + 1] == 0xc0)
+	      band->sof = pos;
+	  else if (p[pos + 1] >= 0xc1 && p[pos + 1] <= 0xcf
+		   && p[pos + 1] != 0xc4 && p[pos + 1] != 0xcc)
+	      return 0;		/* not a baseline JPEG */
+	  if (p[pos + 1] == 0xda)
+	    {
+		band->sos = pos;
+		band->scan = pos + 2 + len;
+		return (band->sof > 0 && band->scan <= band->size - 2);
+	    }
+	  pos += 2 + len;
+      }
+    return 0;
+}
+
+static void *
+jpeg_parallel_worker (void *arg)
+{
+/* a worker thread encoding JPEG bands until none is left */
+    struct jpeg_parallel *par = (struct jpeg_parallel *) arg;
+    struct jpeg_band *band;
+    xgdIOCtx *out;
+    int idx;
+    while (1)
+      {
+	  pthread_mutex_lock (&(par->mutex));
+	  idx = par->next_band++;
+	  pthread_mutex_unlock (&(par->mutex));
+	  if (idx >= par->n_bands)
+	      break;
+	  band = par->bands + idx;
+	  out = xgdNewDynamicCtx (2048, NULL);
+	  xgdImageJpegCtxRows (par->img, out, par->quality, par->mode,
+			       par->profile, band->first_row, band->last_row);
+	  band->jpeg = xgdDPExtractData (out, &(band->size));
+	  out->xgd_free (out);
+      }
+    return NULL;
+}
+
+static int
+xgdImageJpegCtxParallel (rasterliteImagePtr img, xgdIOCtx * outfile,
+			 int quality, int mode, int profile, int threads)
+{
+/* compressing an image as JPEG using many threads */
+    struct jpeg_parallel par;
+    struct jpeg_band *band;
+    int mcu_width = (mode == IMAGE_JPEG_BW) ? 8 : 16;
+    int mcu_height = mcu_width;
+    int mcus_per_row = (img->sx + mcu_width - 1) / mcu_width;
+    int mcu_rows;
+    int rows_per_band;
+    int restart_interval;
+    int i;
+    int started = 0;
+    int ok = 1;
+    int h_max = 0;
+    int v_max = 0;
+    unsigned char *p;
+    unsigned char marker[6];
+    pthread_t *workers;
+
+    if (img->sy > 65535)
+	return 0;
+    if (profile == RASTERLITE_JPEG_PROFILE_SIZE)
+	return 0;		/* per-band optimized tables can't be stitched */
+/* splitting the image into bands of MCU rows */
+    mcu_rows = JPEG_BAND_PIXELS / ((double) mcus_per_row * mcu_width)
+	/ mcu_height;
+    if (mcu_rows < 1)
+	mcu_rows = 1;
+    if (mcu_rows * mcus_per_row > 65535)
+	mcu_rows = 65535 / mcus_per_row;
+    if (mcu_rows < 1)
+	return 0;		/* too wide for a restart interval */
+    restart_interval = mcu_rows * mcus_per_row;
+    rows_per_band = mcu_rows * mcu_height;
+    par.img = img;
+    par.quality = quality;
+    par.mode = mode;
+    par.profile = profile;
+    par.n_bands = (img->sy + rows_per_band - 1) / rows_per_band;
+    par.bands = malloc (sizeof (struct jpeg_band) * par.n_bands);
+    if (!(par.bands))
+	return 0;
+    for (i = 0; i < par.n_bands; i++)
+      {
+	  band = par.bands + i;
+	  band->first_row = i * rows_per_band;
+	  band->last_row = band->first_row + rows_per_band;
+	  if (band->last_row > img->sy)
+	      band->last_row = img->sy;
+	  band->jpeg = NULL;
+	  band->size = 0;
+      }
+    par.next_band = 0;
+    pthread_mutex_init (&(par.mutex), NULL);
+    if (threads > par.n_bands)
+	threads = par.n_bands;
+    workers = malloc (sizeof (pthread_t) * threads);
+    if (workers)
+      {
+	  for (i = 0; i < threads; i++)
+	    {
+		if (pthread_create (workers + started, NULL,
+				    jpeg_parallel_worker, &par) == 0)
+		    started++;
+	    }
+      }
+    if (!started)
+      {
+	  /* falling back to serial encoding */
+	  jpeg_parallel_worker (&par);
+      }
+    for (i = 0; i < started; i++)
+	pthread_join (workers[i], NULL);
+    if (workers)
+	free (workers);
+    pthread_mutex_destroy (&(par.mutex));
+    for (i = 0; i < par.n_bands; i++)
+      {
+	  if (!jpeg_parse_band (par.bands + i))
+	      ok = 0;
+      }
+    if (!ok)
+	goto stop;
+
+/* checking the MCU size actually chosen by libjpeg */
+    band = par.bands;
+    p = band->jpeg + band->sof;
+    for (i = 0; i < p[9]; i++)
+      {
+	  int hv = p[11 + (i * 3)];
+	  if ((hv >> 4) > h_max)
+	      h_max = hv >> 4;
+	  if ((hv & 0x0f) > v_max)
+	      v_max = hv & 0x0f;
+      }
+    if (h_max * 8 != mcu_width || v_max * 8 != mcu_height)
+      {
+	  ok = 0;
+	  goto stop;
+      }
+
+/* the first band's headers, declaring the whole image height */
+    p[5] = (unsigned char) ((img->sy >> 8) & 0xff);
+    p[6] = (unsigned char) (img->sy & 0xff);
+    xgdPutBuf (band->jpeg, band->sos, outfile);
+    marker[0] = 0xff;
+    marker[1] = 0xdd;		/* DRI */
+    marker[2] = 0x00;
+    marker[3] = 0x04;
+    marker[4] = (unsigned char) ((restart_interval >> 8) & 0xff);
+    marker[5] = (unsigned char) (restart_interval & 0xff);
+    xgdPutBuf (marker, 6, outfile);
+    xgdPutBuf (band->jpeg + band->sos, band->scan - band->sos, outfile);
+/* the entropy coded segments, separated by RSTn markers */
+    for (i = 0; i < par.n_bands; i++)
+      {
+	  band = par.bands + i;
+	  if (i > 0)
+	    {
+		marker[0] = 0xff;
+		marker[1] = (unsigned char) (0xd0 + ((i - 1) % 8));
+		xgdPutBuf (marker, 2, outfile);
+	    }
+	  xgdPutBuf (band->jpeg + band->scan, band->size - 2 - band->scan,
+		     outfile);
+      }
+    marker[0] = 0xff;
+    marker[1] = 0xd9;		/* EOI */
+    xgdPutBuf (marker, 2, outfile);
+
+  stop:
+    for (i = 0; i < par.n_bands; i++)
+      {
+	  if (par.bands[i].jpeg)
+	      free (par.bands[i].jpeg);
+      }
+    free (par.bands);
+    return ok;
+}
+
+#endif /* not WIN32 */
+
 static int
 CMYKToRGB (int c, int m, int y, int k, int inverted)
 {
@@ -399,19 +660,20 @@ CMYKToRGB (int c, int m, int y, int k, int inverted)
 		       (255 - y) * (255 - k) / 255);
 }
 
-static rasterliteImagePtr
-xgdImageCreateFromJpegCtx (xgdIOCtx * infile)
+static int
+xgdImageCreateFromJpegCtx (xgdIOCtx * infile, int profile,
+			   rasterliteTileSinkPtr sink)
 {
     struct jpeg_decompress_struct cinfo;
     struct jpeg_error_mgr jerr;
     jmpbuf_wrapper jmpbufw;
     volatile JSAMPROW row = 0;
-    volatile rasterliteImagePtr img = 0;
     JSAMPROW rowptr[1];
     int i, j, retval;
     JDIMENSION nrows;
     int channels = 3;
     int inverted = 0;
+    int color_space;
     memset (&cinfo, 0, sizeof (cinfo));
     memset (&jerr, 0, sizeof (jerr));
     cinfo.err = jpeg_std_error (&jerr);
@@ -420,9 +682,7 @@ xgdImageCreateFromJpegCtx (xgdIOCtx * infile)
       {
 	  if (row)
 	      free (row);
-	  if (img)
-	      image_destroy ((rasterliteImagePtr) img);
-	  return 0;
+	  return RASTERLITE_ERROR;
       }
     cinfo.err->error_exit = fatal_jpeg_error;
     jpeg_create_decompress (&cinfo);
@@ -440,12 +700,6 @@ xgdImageCreateFromJpegCtx (xgdIOCtx * infile)
 	fprintf (stderr,
 		 "jpeg-wrapper: warning: JPEG image width (%u) is greater than INT_MAX\n",
 		 cinfo.image_width);
-    img = image_create ((int) cinfo.image_width, (int) cinfo.image_height);
-    if (img == 0)
-      {
-	  fprintf (stderr, "jpeg-wrapper error: cannot allocate image\n");
-	  goto error;
-      }
     if ((cinfo.jpeg_color_space == JCS_CMYK) ||
 	(cinfo.jpeg_color_space == JCS_YCCK))
       {
@@ -455,13 +709,20 @@ xgdImageCreateFromJpegCtx (xgdIOCtx * infile)
       {
 	  cinfo.out_color_space = JCS_RGB;
       }
+    if (profile == RASTERLITE_JPEG_PROFILE_SPEED)
+      {
+	  /* trading a little quality for throughput */
+	  cinfo.dct_method = JDCT_IFAST;
+	  cinfo.do_fancy_upsampling = FALSE;
+	  cinfo.do_block_smoothing = FALSE;
+      }
 
     if (jpeg_start_decompress (&cinfo) != TRUE)
 	fprintf (stderr,
 		 "jpeg-wrapper: warning: jpeg_start_decompress reports suspended data source\n");
     if (cinfo.out_color_space == JCS_RGB)
       {
-	  img->color_space = COLORSPACE_RGB;
+	  color_space = COLORSPACE_RGB;
 	  if (cinfo.output_components != 3)
 	    {
 		fprintf (stderr,
@@ -473,7 +734,7 @@ xgdImageCreateFromJpegCtx (xgdIOCtx * infile)
       }
     else if (cinfo.out_color_space == JCS_GRAYSCALE)
       {
-	  img->color_space = COLORSPACE_GRAYSCALE;
+	  color_space = COLORSPACE_GRAYSCALE;
 	  if (cinfo.output_components != 1)
 	    {
 		fprintf (stderr,
@@ -486,7 +747,7 @@ xgdImageCreateFromJpegCtx (xgdIOCtx * infile)
     else if (cinfo.out_color_space == JCS_CMYK)
       {
 	  jpeg_saved_marker_ptr marker;
-	  img->color_space = COLORSPACE_RGB;
+	  color_space = COLORSPACE_RGB;
 	  if (cinfo.output_components != 4)
 	    {
 		fprintf (stderr,
@@ -523,6 +784,20 @@ xgdImageCreateFromJpegCtx (xgdIOCtx * infile)
 	     "'make clean' and 'make install' libjpeg again. Sorry.\n");
     goto error;
 #endif /* BITS_IN_JSAMPLE == 12 */
+    if (!tile_sink_begin
+	(sink, (int) cinfo.output_width, (int) cinfo.output_height,
+	 color_space))
+      {
+	  /* nothing more to decode */
+	  jpeg_destroy_decompress (&cinfo);
+	  if (sink->status == TILE_SINK_ERROR)
+	    {
+		fprintf (stderr,
+			 "jpeg-wrapper error: cannot allocate image\n");
+		return RASTERLITE_ERROR;
+	    }
+	  return RASTERLITE_OK;
+      }
     row = calloc (cinfo.output_width * channels, sizeof (JSAMPLE));
     if (row == 0)
       {
@@ -531,20 +806,23 @@ xgdImageCreateFromJpegCtx (xgdIOCtx * infile)
 	  goto error;
       }
     rowptr[0] = row;
-    if (cinfo.out_color_space == JCS_CMYK)
+    for (i = 0; i < (int) cinfo.output_height; i++)
       {
-	  for (i = 0; i < (int) cinfo.output_height; i++)
+	  register JSAMPROW currow = row;
+	  register int *tpix;
+	  nrows = jpeg_read_scanlines (&cinfo, rowptr, 1);
+	  if (nrows != 1)
+	    {
+		fprintf (stderr,
+			 "jpeg-wrapper: error: jpeg_read_scanlines returns %u, expected 1\n",
+			 nrows);
+		goto error;
+	    }
+	  tpix = tile_sink_scanline (sink, i);
+	  if (tpix == NULL)
+	      continue;		/* not reaching the canvas */
+	  if (cinfo.out_color_space == JCS_CMYK)
 	    {
-		register JSAMPROW currow = row;
-		register int *tpix = img->pixels[i];
-		nrows = jpeg_read_scanlines (&cinfo, rowptr, 1);
-		if (nrows != 1)
-		  {
-		      fprintf (stderr,
-			       "jpeg-wrapper: error: jpeg_read_scanlines returns %u, expected 1\n",
-			       nrows);
-		      goto error;
-		  }
 		for (j = 0; j < (int) cinfo.output_width;
 		     j++, currow += 4, tpix++)
 		  {
@@ -553,94 +831,113 @@ xgdImageCreateFromJpegCtx (xgdIOCtx * infile)
 				     inverted);
 		  }
 	    }
-      }
-    else if (cinfo.out_color_space == JCS_GRAYSCALE)
-      {
-	  for (i = 0; i < (int) cinfo.output_height; i++)
+	  else if (cinfo.out_color_space == JCS_GRAYSCALE)
 	    {
-		register JSAMPROW currow = row;
-		register int *tpix = img->pixels[i];
-		nrows = jpeg_read_scanlines (&cinfo, rowptr, 1);
-		if (nrows != 1)
-		  {
-		      fprintf (stderr,
-			       "jpeg-wrapper: error: jpeg_read_scanlines returns %u, expected 1\n",
-			       nrows);
-		      goto error;
-		  }
 		for (j = 0; j < (int) cinfo.output_width; j++, currow++, tpix++)
 		  {
 		      *tpix = true_color (currow[0], currow[0], currow[0]);
 		  }
 	    }
-      }
-    else
-      {
-	  for (i = 0; i < (int) cinfo.output_height; i++)
+	  else
 	    {
-		register JSAMPROW currow = row;
-		register int *tpix = img->pixels[i];
-		nrows = jpeg_read_scanlines (&cinfo, rowptr, 1);
-		if (nrows != 1)
-		  {
-		      fprintf (stderr,
-			       "jpeg-wrapper: error: jpeg_read_scanlines returns %u, expected 1\n",
-			       nrows);
-		      goto error;
-		  }
 		for (j = 0; j < (int) cinfo.output_width;
 		     j++, currow += 3, tpix++)
 		  {
 		      *tpix = true_color (currow[0], currow[1], currow[2]);
 		  }
 	    }
+	  tile_sink_commit (sink, i);
       }
     if (jpeg_finish_decompress (&cinfo) != TRUE)
 	fprintf (stderr,
 		 "jpeg-wrapper: warning: jpeg_finish_decompress reports suspended data source\n");
     jpeg_destroy_decompress (&cinfo);
     free (row);
-    return (rasterliteImagePtr) img;
+    return RASTERLITE_OK;
   error:
     jpeg_destroy_decompress (&cinfo);
     if (row)
 	free (row);
-    if (img)
-	image_destroy ((rasterliteImagePtr) img);
-    return 0;
+    return RASTERLITE_ERROR;
 }
 
 extern void *
-image_to_jpeg (const rasterliteImagePtr img, int *size, int quality)
+image_to_jpeg (const rasterliteImagePtr img, int *size, int quality,
+	       int profile)
 {
 /* compressing an image as JPEG RGB */
     void *rv;
+#ifndef _WIN32
+    int threads;
+#endif
     xgdIOCtx *out = xgdNewDynamicCtx (2048, NULL);
-    xgdImageJpegCtx (img, out, quality, IMAGE_JPEG_RGB);
+    RASTERLITE_PROBE3 (encode__start, "jpeg_rgb", img->sx, img->sy);
+#ifndef _WIN32
+    threads = parallel_encoder_threads (img);
+    if (threads == 0
+	|| !xgdImageJpegCtxParallel (img, out, quality, IMAGE_JPEG_RGB, profile,
+				     threads))
+	xgdImageJpegCtxRows (img, out, quality, IMAGE_JPEG_RGB, profile, 0,
+			     img->sy);
+#else
+    xgdImageJpegCtxRows (img, out, quality, IMAGE_JPEG_RGB, profile, 0, img->sy);
+#endif
     rv = xgdDPExtractData (out, size);
     out->xgd_free (out);
+    RASTERLITE_PROBE2 (encode__done, "jpeg_rgb", *size);
     return rv;
 }
 
 extern void *
-image_to_jpeg_grayscale (const rasterliteImagePtr img, int *size, int quality)
+image_to_jpeg_grayscale (const rasterliteImagePtr img, int *size, int quality,
+			 int profile)
 {
 /* compressing an image as JPEG GRAYSCALE */
     void *rv;
+#ifndef _WIN32
+    int threads;
+#endif
     xgdIOCtx *out = xgdNewDynamicCtx (2048, NULL);
-    xgdImageJpegCtx (img, out, quality, IMAGE_JPEG_BW);
+    RASTERLITE_PROBE3 (encode__start, "jpeg_gray", img->sx, img->sy);
+#ifndef _WIN32
+    threads = parallel_encoder_threads (img);
+    if (threads == 0
+	|| !xgdImageJpegCtxParallel (img, out, quality, IMAGE_JPEG_BW, profile,
+				     threads))
+	xgdImageJpegCtxRows (img, out, quality, IMAGE_JPEG_BW, profile, 0,
+			     img->sy);
+#else
+    xgdImageJpegCtxRows (img, out, quality, IMAGE_JPEG_BW, profile, 0, img->sy);
+#endif
     rv = xgdDPExtractData (out, size);
     out->xgd_free (out);
+    RASTERLITE_PROBE2 (encode__done, "jpeg_gray", *size);
     return rv;
 }
 
-extern rasterliteImagePtr
-image_from_jpeg (int size, const void *data)
+extern int
+image_from_jpeg_sink (int size, const void *data, int profile,
+		      rasterliteTileSinkPtr sink)
 {
-/* uncompressing a JPEG */
-    rasterliteImagePtr img;
+/* uncompressing a JPEG straight into a tile sink */
+    int ret;
     xgdIOCtx *in = xgdNewDynamicCtxEx (size, data, 0);
-    img = xgdImageCreateFromJpegCtx (in);
+    RASTERLITE_PROBE2 (decode__start, "jpeg", size);
+    ret = xgdImageCreateFromJpegCtx (in, profile, sink);
     in->xgd_free (in);
-    return img;
+    RASTERLITE_PROBE3 (decode__done, "jpeg",
+		       ret == RASTERLITE_OK ? sink->src_width : 0,
+		       ret == RASTERLITE_OK ? sink->src_height : 0);
+    return ret;
+}
+
+extern rasterliteImagePtr
+image_from_jpeg (int size, const void *data, int profile)
+{
+/* uncompressing a JPEG */
+    rasterliteTileSink sink;
+    tile_sink_init (&sink, NULL);
+    return tile_sink_release (&sink,
+			      image_from_jpeg_sink (size, data, profile,
+						    &sink));
 }
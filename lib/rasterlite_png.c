@@ -47,8 +47,13 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 #include <tiffio.h>
 #include <png.h>
+#include <zlib.h>
 
 #ifdef SPATIALITE_AMALGAMATION
 #include <spatialite/sqlite3.h>
@@ -61,6 +66,7 @@
 #define TRUE 1
 #define FALSE 0
 
+#include "rasterlite.h"
 #include "rasterlite_internals.h"
 
 /* 
@@ -78,7 +84,10 @@ typedef struct _jmpbuf_wrapper
 }
 jmpbuf_wrapper;
 
-static jmpbuf_wrapper xgdPngJmpbufStruct;
+/*
+/ each encoder/decoder allocates its own jmpbuf wrapper on the stack,
+/ so that independent threads can safely encode/decode PNG images at once
+*/
 
 static void
 xgdPngErrorHandler (png_structp png_ptr, png_const_charp msg)
@@ -122,32 +131,82 @@ xgdPngFlushData (png_structp png_ptr)
 	return;			/* does absolutely nothing - required in order to suppress warnings */
 }
 
-static rasterliteImagePtr
-xgdImageCreateFromPngCtx (xgdIOCtx * infile)
+static void
+png_decode_row (rasterliteTileSinkPtr sink, int h, png_bytep row,
+		 int color_type, int *red, int *green, int *blue)
+{
+/* feeding the tile sink with a decoded PNG row */
+    int w;
+    int *pixels = tile_sink_scanline (sink, h);
+    if (pixels == NULL)
+	return;			/* not reaching the canvas */
+    switch (color_type)
+      {
+      case PNG_COLOR_TYPE_RGB:
+	  for (w = 0; w < sink->src_width; w++)
+	    {
+		register png_byte r = *row++;
+		register png_byte g = *row++;
+		register png_byte b = *row++;
+		pixels[w] = true_color (r, g, b);
+	    }
+	  break;
+      case PNG_COLOR_TYPE_RGB_ALPHA:
+	  for (w = 0; w < sink->src_width; w++)
+	    {
+		register png_byte r = *row++;
+		register png_byte g = *row++;
+		register png_byte b = *row++;
+		row++;
+		pixels[w] = true_color (r, g, b);
+	    }
+	  break;
+      case PNG_COLOR_TYPE_GRAY:
+      case PNG_COLOR_TYPE_GRAY_ALPHA:
+	  for (w = 0; w < sink->src_width; ++w)
+	    {
+		register png_byte idx = row[w];
+		pixels[w] = true_color (idx, idx, idx);
+	    }
+	  break;
+      default:
+	  for (w = 0; w < sink->src_width; ++w)
+	    {
+		register png_byte idx = row[w];
+		pixels[w] = true_color (red[idx], green[idx], blue[idx]);
+	    }
+      }
+    tile_sink_commit (sink, h);
+}
+
+static int
+xgdImageCreateFromPngCtx (xgdIOCtx * infile, rasterliteTileSinkPtr sink)
 {
     png_byte sig[8];
     png_structp png_ptr;
+#ifndef PNG_SETJMP_NOT_SUPPORTED
+    jmpbuf_wrapper xgdPngJmpbufStruct;
+#endif
     png_infop info_ptr;
-    png_uint_32 width, height, rowbytes, w, h;
+    png_uint_32 width, height, rowbytes, h;
     int bit_depth, color_type, interlace_type;
     int num_palette;
     png_colorp palette;
     int red[256];
     int green[256];
     int blue[256];
+    int color_space = COLORSPACE_RGB;
     png_bytep image_data = NULL;
     png_bytepp row_pointers = NULL;
-    rasterliteImagePtr im = NULL;
-    int i, j;
-    volatile int palette_allocated = FALSE;
+    int i;
     memset (sig, 0, sizeof (sig));
     if (xgdGetBuf (sig, 8, infile) < 8)
       {
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
     if (png_sig_cmp (sig, 0, 8))
       {
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
 #ifndef PNG_SETJMP_NOT_SUPPORTED
     png_ptr =
@@ -160,7 +219,7 @@ xgdImageCreateFromPngCtx (xgdIOCtx * infile)
       {
 	  fprintf (stderr,
 		   "png-wrapper error: cannot allocate libpng main struct\n");
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
     info_ptr = png_create_info_struct (png_ptr);
     if (info_ptr == NULL)
@@ -168,7 +227,7 @@ xgdImageCreateFromPngCtx (xgdIOCtx * infile)
 	  fprintf (stderr,
 		   "png-wrapper error: cannot allocate libpng info struct\n");
 	  png_destroy_read_struct (&png_ptr, NULL, NULL);
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
 #ifndef PNG_SETJMP_NOT_SUPPORTED
     if (setjmp (xgdPngJmpbufStruct.jmpbuf))
@@ -176,7 +235,7 @@ xgdImageCreateFromPngCtx (xgdIOCtx * infile)
 	  fprintf (stderr,
 		   "png-wrapper error: setjmp returns error condition 1\n");
 	  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
 #endif
     png_set_sig_bytes (png_ptr, 8);
@@ -184,16 +243,6 @@ xgdImageCreateFromPngCtx (xgdIOCtx * infile)
     png_read_info (png_ptr, info_ptr);
     png_get_IHDR (png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
 		  &interlace_type, NULL, NULL);
-    im = image_create ((int) width, (int) height);
-    if (im == NULL)
-      {
-	  fprintf (stderr,
-		   "png-wrapper error: cannot allocate gdImage struct\n");
-	  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
-	  free (image_data);
-	  free (row_pointers);
-	  return NULL;
-      }
     if (bit_depth == 16)
       {
 	  png_set_strip_16 (png_ptr);
@@ -210,17 +259,13 @@ xgdImageCreateFromPngCtx (xgdIOCtx * infile)
 	  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
 	  free (image_data);
 	  free (row_pointers);
-	  if (im)
-	    {
-		image_destroy (im);
-	    }
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
 #endif
     switch (color_type)
       {
       case PNG_COLOR_TYPE_PALETTE:
-	  im->color_space = COLORSPACE_PALETTE;
+	  color_space = COLORSPACE_PALETTE;
 	  png_get_PLTE (png_ptr, info_ptr, &palette, &num_palette);
 	  for (i = 0; i < num_palette; i++)
 	    {
@@ -231,78 +276,75 @@ xgdImageCreateFromPngCtx (xgdIOCtx * infile)
 	  break;
       case PNG_COLOR_TYPE_GRAY:
       case PNG_COLOR_TYPE_GRAY_ALPHA:
-	  im->color_space = COLORSPACE_GRAYSCALE;
-	  if ((palette = malloc (256 * sizeof (png_color))) == NULL)
+	  color_space = COLORSPACE_GRAYSCALE;
+	  break;
+      case PNG_COLOR_TYPE_RGB:
+      case PNG_COLOR_TYPE_RGB_ALPHA:
+	  color_space = COLORSPACE_RGB;
+	  break;
+      }
+    png_read_update_info (png_ptr, info_ptr);
+    rowbytes = png_get_rowbytes (png_ptr, info_ptr);
+    if (!tile_sink_begin (sink, (int) width, (int) height, color_space))
+      {
+	  /* nothing more to decode */
+	  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+	  if (sink->status == TILE_SINK_ERROR)
 	    {
 		fprintf (stderr,
-			 "png-wrapper error: cannot allocate gray palette\n");
-		png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
-		return NULL;
+			 "png-wrapper error: cannot allocate gdImage struct\n");
+		return RASTERLITE_ERROR;
 	    }
-	  palette_allocated = TRUE;
-	  if (bit_depth < 8)
+	  return RASTERLITE_OK;
+      }
+    if (interlace_type == PNG_INTERLACE_NONE)
+      {
+	  /* progressive decoding, one row at once */
+	  image_data = malloc (rowbytes);
+	  if (!image_data)
 	    {
-		num_palette = 1 << bit_depth;
-		for (i = 0; i < 256; ++i)
-		  {
-		      j = (255 * i) / (num_palette - 1);
-		      palette[i].red = palette[i].green = palette[i].blue = j;
-		  }
+		fprintf (stderr,
+			 "png-wrapper error: cannot allocate image data\n");
+		png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+		return RASTERLITE_ERROR;
 	    }
-	  else
+	  for (h = 0; h < height; h++)
 	    {
-		num_palette = 256;
-		for (i = 0; i < 256; ++i)
-		  {
-		      palette[i].red = palette[i].green = palette[i].blue = i;
-		  }
+		png_read_row (png_ptr, image_data, NULL);
+		png_decode_row (sink, (int) h, image_data, color_type, red,
+				green, blue);
 	    }
-	  break;
-
-      case PNG_COLOR_TYPE_RGB:
-      case PNG_COLOR_TYPE_RGB_ALPHA:
-	  im->color_space = COLORSPACE_RGB;
-	  break;
+	  png_read_end (png_ptr, NULL);
+	  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+	  free (image_data);
+	  return RASTERLITE_OK;
       }
-    png_read_update_info (png_ptr, info_ptr);
-    rowbytes = png_get_rowbytes (png_ptr, info_ptr);
+/* interlaced: the whole image has to be decoded first */
     if (overflow2 (rowbytes, height))
       {
 	  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
     image_data = malloc (rowbytes * height);
     if (!image_data)
       {
 	  fprintf (stderr, "png-wrapper error: cannot allocate image data\n");
 	  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
-	  if (im)
-	    {
-		image_destroy (im);
-	    }
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
     if (overflow2 (height, sizeof (png_bytep)))
       {
 	  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
 	  free (image_data);
-	  if (im)
-	    {
-		image_destroy (im);
-	    }
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
     row_pointers = malloc (height * sizeof (png_bytep));
     if (!row_pointers)
       {
 	  fprintf (stderr, "png-wrapper error: cannot allocate row pointers\n");
 	  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
-	  if (im)
-	    {
-		image_destroy (im);
-	    }
 	  free (image_data);
-	  return NULL;
+	  return RASTERLITE_ERROR;
       }
     for (h = 0; h < height; ++h)
       {
@@ -311,76 +353,55 @@ xgdImageCreateFromPngCtx (xgdIOCtx * infile)
     png_read_image (png_ptr, row_pointers);
     png_read_end (png_ptr, NULL);
     png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
-    switch (color_type)
+    for (h = 0; h < height; h++)
+	png_decode_row (sink, (int) h, row_pointers[h], color_type, red, green,
+			blue);
+    free (image_data);
+    free (row_pointers);
+    return RASTERLITE_OK;
+}
+
+static void
+xgdPngSetOptions (png_structp png_ptr, int quality)
+{
+/* applying the compression options packed by RASTERLITE_PNG_QUALITY() */
+    int level;
+    int filters;
+    int strategy;
+    if (quality < 0 || !(quality & RASTERLITE_PNG_OPTIONS))
       {
-      case PNG_COLOR_TYPE_RGB:
-	  for (h = 0; h < height; h++)
-	    {
-		int boffset = 0;
-		for (w = 0; w < width; w++)
-		  {
-		      register png_byte r = row_pointers[h][boffset++];
-		      register png_byte g = row_pointers[h][boffset++];
-		      register png_byte b = row_pointers[h][boffset++];
-		      im->pixels[h][w] = true_color (r, g, b);
-		  }
-	    }
-	  break;
-      case PNG_COLOR_TYPE_RGB_ALPHA:
-	  for (h = 0; h < height; h++)
-	    {
-		int boffset = 0;
-		for (w = 0; w < width; w++)
-		  {
-		      register png_byte r = row_pointers[h][boffset++];
-		      register png_byte g = row_pointers[h][boffset++];
-		      register png_byte b = row_pointers[h][boffset++];
-		      boffset++;
-		      im->pixels[h][w] = true_color (r, g, b);
-		  }
-	    }
-	  break;
-      case PNG_COLOR_TYPE_GRAY:
-      case PNG_COLOR_TYPE_GRAY_ALPHA:
-	  for (h = 0; h < height; ++h)
-	    {
-		for (w = 0; w < width; ++w)
-		  {
-		      register png_byte idx = row_pointers[h][w];
-		      im->pixels[h][w] = true_color (idx, idx, idx);
-		  }
-	    }
-	  break;
-      default:
-	  for (h = 0; h < height; ++h)
-	    {
-		for (w = 0; w < width; ++w)
-		  {
-		      register png_byte idx = row_pointers[h][w];
-		      im->pixels[h][w] =
-			  true_color (red[idx], green[idx], blue[idx]);
-		  }
-	    }
+	  /* no packed options: zlib/libpng defaults */
+	  png_set_compression_level (png_ptr, -1);
+	  return;
       }
-    if (palette_allocated)
+    level = (quality & RASTERLITE_PNG_LEVEL_MASK) - 1;
+    if (level > 9)
+	level = 9;
+    png_set_compression_level (png_ptr, level);
+    filters = quality & RASTERLITE_PNG_FILTER_ALL;
+    if (filters)
       {
-	  free (palette);
+	  /* RASTERLITE_PNG_FILTER_xx are the libpng PNG_FILTER_xx bits << 1 */
+	  png_set_filter (png_ptr, PNG_FILTER_TYPE_BASE, filters >> 1);
       }
-    free (image_data);
-    free (row_pointers);
-    return im;
+    strategy = quality & RASTERLITE_PNG_STRATEGY_MASK;
+    if (strategy)
+	png_set_compression_strategy (png_ptr, (strategy >> 9) - 1);
 }
 
 static void
-xgdImagePngCtxPalette (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
+xgdImagePngCtxPalette (rasterliteImagePtr img, xgdIOCtx * outfile, int quality)
 {
     int i, j, bit_depth = 0, interlace_type;
     int width = img->sx;
     int height = img->sy;
-    int mapping[256];
+    struct palette_map mapping;
     int colors;
     png_color palette[256];
     png_structp png_ptr;
+#ifndef PNG_SETJMP_NOT_SUPPORTED
+    jmpbuf_wrapper xgdPngJmpbufStruct;
+#endif
     png_infop info_ptr;
     png_bytep *row_pointers;
     int **ptpixels = img->pixels;
@@ -418,9 +439,8 @@ xgdImagePngCtxPalette (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
 #endif
     png_set_write_fn (png_ptr, (void *) outfile, xgdPngWriteData,
 		      xgdPngFlushData);
-    png_set_compression_level (png_ptr, level);
-    for (i = 0; i < 256; ++i)
-	mapping[i] = -1;
+    xgdPngSetOptions (png_ptr, quality);
+    palette_init (&mapping);
     for (j = 0; j < height; ++j)
       {
 	  pThisRow = *ptpixels++;
@@ -428,17 +448,11 @@ xgdImagePngCtxPalette (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
 	    {
 		int index;
 		thisPixel = *pThisRow;
-		index = palette_set (mapping, thisPixel);
+		index = palette_set (&mapping, thisPixel);
 		*pThisRow++ = index;
 	    }
       }
-    colors = 0;
-    for (i = 0; i < 256; ++i)
-      {
-	  if (mapping[i] == -1)
-	      break;
-	  colors++;
-      }
+    colors = mapping.count;
     if (colors <= 2)
 	bit_depth = 1;
     else if (colors <= 4)
@@ -453,9 +467,9 @@ xgdImagePngCtxPalette (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
 		  PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
     for (i = 0; i < colors; i++)
       {
-	  palette[i].red = true_color_get_red (mapping[i]);
-	  palette[i].green = true_color_get_green (mapping[i]);
-	  palette[i].blue = true_color_get_blue (mapping[i]);
+	  palette[i].red = true_color_get_red (mapping.colors[i]);
+	  palette[i].green = true_color_get_green (mapping.colors[i]);
+	  palette[i].blue = true_color_get_blue (mapping.colors[i]);
       }
     png_set_PLTE (png_ptr, info_ptr, palette, colors);
     png_write_info (png_ptr, info_ptr);
@@ -494,12 +508,15 @@ xgdImagePngCtxPalette (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
 }
 
 static void
-xgdImagePngCtxGrayscale (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
+xgdImagePngCtxGrayscale (rasterliteImagePtr img, xgdIOCtx * outfile, int quality)
 {
     int i, j, bit_depth = 0, interlace_type;
     int width = img->sx;
     int height = img->sy;
     png_structp png_ptr;
+#ifndef PNG_SETJMP_NOT_SUPPORTED
+    jmpbuf_wrapper xgdPngJmpbufStruct;
+#endif
     png_infop info_ptr;
     png_bytep *row_pointers;
     int **ptpixels = img->pixels;
@@ -536,7 +553,7 @@ xgdImagePngCtxGrayscale (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
 #endif
     png_set_write_fn (png_ptr, (void *) outfile, xgdPngWriteData,
 		      xgdPngFlushData);
-    png_set_compression_level (png_ptr, level);
+    xgdPngSetOptions (png_ptr, quality);
     bit_depth = 8;
     interlace_type = PNG_INTERLACE_NONE;
     png_set_IHDR (png_ptr, info_ptr, width, height, bit_depth,
@@ -578,12 +595,15 @@ xgdImagePngCtxGrayscale (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
 }
 
 static void
-xgdImagePngCtxRgb (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
+xgdImagePngCtxRgb (rasterliteImagePtr img, xgdIOCtx * outfile, int quality)
 {
     int i, j, bit_depth = 0, interlace_type;
     int width = img->sx;
     int height = img->sy;
     png_structp png_ptr;
+#ifndef PNG_SETJMP_NOT_SUPPORTED
+    jmpbuf_wrapper xgdPngJmpbufStruct;
+#endif
     png_infop info_ptr;
     png_bytep *row_pointers;
     png_bytep p_scanline;
@@ -622,7 +642,7 @@ xgdImagePngCtxRgb (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
 #endif
     png_set_write_fn (png_ptr, (void *) outfile, xgdPngWriteData,
 		      xgdPngFlushData);
-    png_set_compression_level (png_ptr, level);
+    xgdPngSetOptions (png_ptr, quality);
     bit_depth = 8;
     interlace_type = PNG_INTERLACE_NONE;
     png_set_IHDR (png_ptr, info_ptr, width, height, bit_depth,
@@ -669,49 +689,557 @@ xgdImagePngCtxRgb (rasterliteImagePtr img, xgdIOCtx * outfile, int level)
     png_destroy_write_struct (&png_ptr, &info_ptr);
 }
 
+/*
+/ parallel PNG encoding [pigz-style]
+/
+/ big images are split into row blocks, each one independently filtered
+/ and deflated by some worker thread; every block but the last one ends
+/ on a full flush boundary, and is primed with the last 32KB preceding
+/ it, so that their plain concatenation is a single valid zlib stream
+*/
+
+#ifndef _WIN32
+
+#define PNG_BLOCK_BYTES	(512 * 1024)
+#define PNG_WINDOW_SIZE	32768
+
+struct png_block
+{
+/* a block of rows to be deflated */
+    int first_row;
+    int last_row;		/* exclusive */
+    unsigned char *deflated;	/* the compressed block */
+    int deflated_size;
+    int reserved;		/* leading bytes left free for the zlib header */
+    uLong adler;		/* Adler-32 of the block's uncompressed rows */
+    uLong length;		/* the block's uncompressed size */
+    int ok;
+};
+
+struct png_parallel
+{
+/* the shared state of a parallel PNG encoding */
+    rasterliteImagePtr img;
+    int channels;		/* 1 = GRAYSCALE, 3 = RGB */
+    int filters;		/* PNG_FILTER_xx bits */
+    int level;
+    int strategy;
+    struct png_block *blocks;
+    int n_blocks;
+    int next_block;
+    pthread_mutex_t mutex;
+};
+
+static void
+png_unpack_row (struct png_parallel *par, int row, unsigned char *out)
+{
+/* extracting the raw samples of some image row */
+    int i;
+    int color;
+    int *p_in = par->img->pixels[row];
+    if (par->channels == 1)
+      {
+	  for (i = 0; i < par->img->sx; i++)
+	      *out++ = (unsigned char) *p_in++;
+	  return;
+      }
+    for (i = 0; i < par->img->sx; i++)
+      {
+	  color = *p_in++;
+	  *out++ = true_color_get_red (color);
+	  *out++ = true_color_get_green (color);
+	  *out++ = true_color_get_blue (color);
+      }
+}
+
+static int
+png_paeth (int a, int b, int c)
+{
+/* the PAETH predictor */
+    int p = a + b - c;
+    int pa = abs (p - a);
+    int pb = abs (p - b);
+    int pc = abs (p - c);
+    if (pa <= pb && pa <= pc)
+	return a;
+    if (pb <= pc)
+	return b;
+    return c;
+}
+
+static void
+png_filter_row (int type, const unsigned char *row,
+		const unsigned char *prior, int row_bytes, int bpp,
+		unsigned char *out)
+{
+/* applying a PNG filter to a row; prior is NULL for the first one */
+    int i;
+    *out++ = (unsigned char) type;
+    if (prior == NULL)
+      {
+	  /* the first row: UP is NONE, AVG and PAETH only look left */
+	  if (type == PNG_FILTER_VALUE_UP)
+	      type = PNG_FILTER_VALUE_NONE;
+	  else if (type == PNG_FILTER_VALUE_PAETH)
+	      type = PNG_FILTER_VALUE_SUB;
+	  else if (type == PNG_FILTER_VALUE_AVG)
+	    {
+		for (i = 0; i < bpp; i++)
+		    out[i] = row[i];
+		for (; i < row_bytes; i++)
+		    out[i] = (unsigned char) (row[i] - (row[i - bpp] >> 1));
+		return;
+	    }
+      }
+    switch (type)
+      {
+      case PNG_FILTER_VALUE_SUB:
+	  for (i = 0; i < bpp; i++)
+	      out[i] = row[i];
+	  for (; i < row_bytes; i++)
+	      out[i] = (unsigned char) (row[i] - row[i - bpp]);
+	  break;
+      case PNG_FILTER_VALUE_UP:
+	  for (i = 0; i < row_bytes; i++)
+	      out[i] = (unsigned char) (row[i] - prior[i]);
+	  break;
+      case PNG_FILTER_VALUE_AVG:
+	  for (i = 0; i < bpp; i++)
+	      out[i] = (unsigned char) (row[i] - (prior[i] >> 1));
+	  for (; i < row_bytes; i++)
+	      out[i] =
+		  (unsigned char) (row[i] - ((row[i - bpp] + prior[i]) >> 1));
+	  break;
+      case PNG_FILTER_VALUE_PAETH:
+	  for (i = 0; i < bpp; i++)
+	      out[i] = (unsigned char) (row[i] - prior[i]);
+	  for (; i < row_bytes; i++)
+	      out[i] =
+		  (unsigned char) (row[i] -
+				   png_paeth (row[i - bpp], prior[i],
+					      prior[i - bpp]));
+	  break;
+      default:
+	  memcpy (out, row, row_bytes);
+	  break;
+      };
+}
+
+static void
+png_best_filter (struct png_parallel *par, const unsigned char *row,
+		 const unsigned char *prior, int row_bytes,
+		 unsigned char *out, unsigned char *trial)
+{
+/* choosing the filter minimizing the sum of absolute differences, as libpng does */
+    static const int masks[5] = { PNG_FILTER_NONE, PNG_FILTER_SUB,
+	PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH
+    };
+    int type;
+    int i;
+    unsigned long sum;
+    unsigned long best_sum = 0;
+    int best = -1;
+    for (type = 0; type < 5; type++)
+      {
+	  if (!(par->filters & masks[type]))
+	      continue;
+	  if (best < 0 && !(par->filters & ~masks[type]))
+	    {
+		/* a single filter: no need to compare */
+		png_filter_row (type, row, prior, row_bytes, par->channels,
+				out);
+		return;
+	    }
+	  png_filter_row (type, row, prior, row_bytes, par->channels, trial);
+	  sum = 0;
+	  for (i = 1; i <= row_bytes; i++)
+	      sum += (trial[i] < 128) ? trial[i] : 256 - trial[i];
+	  if (best < 0 || sum < best_sum)
+	    {
+		best = type;
+		best_sum = sum;
+		memcpy (out, trial, row_bytes + 1);
+	    }
+      }
+}
+
+static int
+png_deflate_block (struct png_parallel *par, struct png_block *block,
+		   int is_last)
+{
+/* filtering and deflating a block of rows */
+    int row_bytes = par->img->sx * par->channels;
+    int first = block->first_row;
+    int rows;
+    int row;
+    int dict_size;
+    unsigned char *raw = NULL;
+    unsigned char *prior;
+    unsigned char *current;
+    unsigned char *trial = NULL;
+    unsigned char *filtered = NULL;
+    unsigned char *p_out;
+    unsigned long max_size;
+    z_stream strm;
+    int ret;
+
+/* the rows preceding the block are filtered once again as the dictionary */
+    first -= (PNG_WINDOW_SIZE + row_bytes) / (row_bytes + 1);
+    if (first < 0)
+	first = 0;
+    rows = block->last_row - first;
+    raw = malloc (row_bytes * 2);
+    trial = malloc (row_bytes + 1);
+    filtered = malloc ((size_t) rows * (row_bytes + 1));
+    if (!raw || !trial || !filtered)
+	goto error;
+    prior = NULL;
+    current = raw;
+    if (first > 0)
+      {
+	  prior = raw + row_bytes;
+	  png_unpack_row (par, first - 1, prior);
+      }
+    p_out = filtered;
+    for (row = first; row < block->last_row; row++)
+      {
+	  png_unpack_row (par, row, current);
+	  png_best_filter (par, current, prior, row_bytes, p_out, trial);
+	  p_out += row_bytes + 1;
+	  prior = current;
+	  current = (current == raw) ? raw + row_bytes : raw;
+      }
+    free (raw);
+    raw = NULL;
+    free (trial);
+    trial = NULL;
+
+    dict_size = (block->first_row - first) * (row_bytes + 1);
+    block->length =
+	(uLong) (block->last_row - block->first_row) * (row_bytes + 1);
+    block->adler = adler32 (adler32 (0L, Z_NULL, 0), filtered + dict_size,
+			    block->length);
+    memset (&strm, 0, sizeof (z_stream));
+    if (deflateInit2 (&strm, par->level, Z_DEFLATED, -15, 8, par->strategy)
+	!= Z_OK)
+	goto error;
+    if (dict_size > PNG_WINDOW_SIZE)
+      {
+	  /* only the last 32KB may be referenced */
+	  deflateSetDictionary (&strm,
+				filtered + dict_size - PNG_WINDOW_SIZE,
+				PNG_WINDOW_SIZE);
+      }
+    else if (dict_size > 0)
+	deflateSetDictionary (&strm, filtered, dict_size);
+/* room for the zlib header, the flush marker and the Adler-32 trailer */
+    max_size = deflateBound (&strm, block->length) + block->reserved + 16;
+    block->deflated = malloc (max_size);
+    if (!(block->deflated))
+      {
+	  deflateEnd (&strm);
+	  goto error;
+      }
+    strm.next_in = filtered + dict_size;
+    strm.avail_in = block->length;
+    strm.next_out = block->deflated + block->reserved;
+    strm.avail_out = max_size - block->reserved - 4;
+    ret = deflate (&strm, is_last ? Z_FINISH : Z_FULL_FLUSH);
+    block->deflated_size = block->reserved + strm.total_out;
+    deflateEnd (&strm);
+    if ((is_last && ret != Z_STREAM_END) || (!is_last && ret != Z_OK)
+	|| strm.avail_in != 0 || strm.avail_out == 0)
+	goto error;
+    free (filtered);
+    return 1;
+
+  error:
+    if (raw)
+	free (raw);
+    if (trial)
+	free (trial);
+    if (filtered)
+	free (filtered);
+    return 0;
+}
+
+static void *
+png_parallel_worker (void *arg)
+{
+/* a worker thread deflating PNG blocks until none is left */
+    struct png_parallel *par = (struct png_parallel *) arg;
+    struct png_block *block;
+    int idx;
+    while (1)
+      {
+	  pthread_mutex_lock (&(par->mutex));
+	  idx = par->next_block++;
+	  pthread_mutex_unlock (&(par->mutex));
+	  if (idx >= par->n_blocks)
+	      break;
+	  block = par->blocks + idx;
+	  block->ok = png_deflate_block (par, block, idx == par->n_blocks - 1);
+      }
+    return NULL;
+}
+
+static void
+png_put_uint32 (unsigned char *p, uLong value)
+{
+/* storing a PNG [big endian] 32 bit integer */
+    p[0] = (unsigned char) ((value >> 24) & 0xff);
+    p[1] = (unsigned char) ((value >> 16) & 0xff);
+    p[2] = (unsigned char) ((value >> 8) & 0xff);
+    p[3] = (unsigned char) (value & 0xff);
+}
+
+static void
+png_put_chunk (xgdIOCtx * outfile, const char *name,
+	       const unsigned char *data, int length)
+{
+/* writing a PNG chunk */
+    unsigned char buf[8];
+    uLong crc = crc32 (0L, Z_NULL, 0);
+    crc = crc32 (crc, (const Bytef *) name, 4);
+    if (length > 0)
+	crc = crc32 (crc, data, length);
+    png_put_uint32 (buf, length);
+    memcpy (buf + 4, name, 4);
+    xgdPutBuf (buf, 8, outfile);
+    if (length > 0)
+	xgdPutBuf (data, length, outfile);
+    png_put_uint32 (buf, crc);
+    xgdPutBuf (buf, 4, outfile);
+}
+
+static int
+xgdImagePngCtxParallel (rasterliteImagePtr img, xgdIOCtx * outfile,
+			int quality, int channels, int threads)
+{
+/* compressing a GRAYSCALE or RGB image as PNG using many threads */
+    struct png_parallel par;
+    struct png_block *block;
+    int row_bytes = img->sx * channels;
+    int rows_per_block;
+    int i;
+    int started = 0;
+    int ok = 1;
+    int flevel;
+    uLong adler;
+    unsigned char ihdr[13];
+    pthread_t *workers;
+    static const unsigned char signature[8] =
+	{ 137, 80, 78, 71, 13, 10, 26, 10 };
+
+/* the same compression options as xgdPngSetOptions() */
+    par.img = img;
+    par.channels = channels;
+    par.filters = PNG_ALL_FILTERS;
+    par.level = Z_DEFAULT_COMPRESSION;
+    par.strategy = -1;
+    if (quality >= 0 && (quality & RASTERLITE_PNG_OPTIONS))
+      {
+	  par.level = (quality & RASTERLITE_PNG_LEVEL_MASK) - 1;
+	  if (par.level > 9)
+	      par.level = 9;
+	  if (quality & RASTERLITE_PNG_FILTER_ALL)
+	      par.filters = (quality & RASTERLITE_PNG_FILTER_ALL) >> 1;
+	  if (quality & RASTERLITE_PNG_STRATEGY_MASK)
+	      par.strategy =
+		  ((quality & RASTERLITE_PNG_STRATEGY_MASK) >> 9) - 1;
+      }
+    if (par.strategy < 0)
+	par.strategy =
+	    (par.filters == PNG_FILTER_NONE) ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+
+/* splitting the image into row blocks */
+    rows_per_block = PNG_BLOCK_BYTES / (row_bytes + 1);
+    if (rows_per_block < 1)
+	rows_per_block = 1;
+    par.n_blocks = (img->sy + rows_per_block - 1) / rows_per_block;
+    par.blocks = malloc (sizeof (struct png_block) * par.n_blocks);
+    if (!(par.blocks))
+	return 0;
+    for (i = 0; i < par.n_blocks; i++)
+      {
+	  block = par.blocks + i;
+	  block->first_row = i * rows_per_block;
+	  block->last_row = block->first_row + rows_per_block;
+	  if (block->last_row > img->sy)
+	      block->last_row = img->sy;
+	  block->deflated = NULL;
+	  block->deflated_size = 0;
+	  block->reserved = (i == 0) ? 2 : 0;
+	  block->ok = 0;
+      }
+    par.next_block = 0;
+    pthread_mutex_init (&(par.mutex), NULL);
+    if (threads > par.n_blocks)
+	threads = par.n_blocks;
+    workers = malloc (sizeof (pthread_t) * threads);
+    if (workers)
+      {
+	  for (i = 0; i < threads; i++)
+	    {
+		if (pthread_create (workers + started, NULL,
+				    png_parallel_worker, &par) == 0)
+		    started++;
+	    }
+      }
+    if (!started)
+      {
+	  /* falling back to serial deflating */
+	  png_parallel_worker (&par);
+      }
+    for (i = 0; i < started; i++)
+	pthread_join (workers[i], NULL);
+    if (workers)
+	free (workers);
+    pthread_mutex_destroy (&(par.mutex));
+    for (i = 0; i < par.n_blocks; i++)
+      {
+	  if (!(par.blocks[i].ok))
+	      ok = 0;
+      }
+    if (!ok)
+	goto stop;
+
+/* the zlib header and the Adler-32 trailer of the whole stream */
+    block = par.blocks;
+    if (par.level == 0 || par.level == 1)
+	flevel = 0;
+    else if (par.level >= 2 && par.level <= 5)
+	flevel = 1;
+    else if (par.level < 0 || par.level == 6)
+	flevel = 2;
+    else
+	flevel = 3;
+    block->deflated[0] = 0x78;
+    block->deflated[1] = (unsigned char) (flevel << 6);
+    block->deflated[1] += 31 - ((0x78 * 256 + block->deflated[1]) % 31);
+    adler = adler32 (0L, Z_NULL, 0);
+    for (i = 0; i < par.n_blocks; i++)
+      {
+	  block = par.blocks + i;
+	  adler = adler32_combine (adler, block->adler, block->length);
+      }
+    block = par.blocks + (par.n_blocks - 1);
+    png_put_uint32 (block->deflated + block->deflated_size, adler);
+    block->deflated_size += 4;
+
+/* writing the PNG chunks */
+    xgdPutBuf (signature, 8, outfile);
+    png_put_uint32 (ihdr, img->sx);
+    png_put_uint32 (ihdr + 4, img->sy);
+    ihdr[8] = 8;
+    ihdr[9] = (channels == 1) ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_RGB;
+    ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+    ihdr[11] = PNG_FILTER_TYPE_BASE;
+    ihdr[12] = PNG_INTERLACE_NONE;
+    png_put_chunk (outfile, "IHDR", ihdr, 13);
+    for (i = 0; i < par.n_blocks; i++)
+      {
+	  block = par.blocks + i;
+	  png_put_chunk (outfile, "IDAT", block->deflated,
+			 block->deflated_size);
+      }
+    png_put_chunk (outfile, "IEND", NULL, 0);
+
+  stop:
+    for (i = 0; i < par.n_blocks; i++)
+      {
+	  if (par.blocks[i].deflated)
+	      free (par.blocks[i].deflated);
+      }
+    free (par.blocks);
+    return ok;
+}
+
+#endif /* not WIN32 */
+
 extern void *
-image_to_png_palette (const rasterliteImagePtr img, int *size)
+image_to_png_palette (const rasterliteImagePtr img, int *size, int quality)
 {
 /* compressing an image as PNG PALETTE */
     void *rv;
     xgdIOCtx *out = xgdNewDynamicCtx (2048, NULL);
-    xgdImagePngCtxPalette (img, out, -1);
+    RASTERLITE_PROBE3 (encode__start, "png_palette", img->sx, img->sy);
+    xgdImagePngCtxPalette (img, out, quality);
     rv = xgdDPExtractData (out, size);
     out->xgd_free (out);
+    RASTERLITE_PROBE2 (encode__done, "png_palette", *size);
     return rv;
 }
 
 extern void *
-image_to_png_grayscale (const rasterliteImagePtr img, int *size)
+image_to_png_grayscale (const rasterliteImagePtr img, int *size, int quality)
 {
 /* compressing an image as PNG GRAYSCALE */
     void *rv;
+#ifndef _WIN32
+    int threads;
+#endif
     xgdIOCtx *out = xgdNewDynamicCtx (2048, NULL);
-    xgdImagePngCtxGrayscale (img, out, -1);
+    RASTERLITE_PROBE3 (encode__start, "png_gray", img->sx, img->sy);
+#ifndef _WIN32
+    threads = parallel_encoder_threads (img);
+    if (threads == 0
+	|| !xgdImagePngCtxParallel (img, out, quality, 1, threads))
+	xgdImagePngCtxGrayscale (img, out, quality);
+#else
+    xgdImagePngCtxGrayscale (img, out, quality);
+#endif
     rv = xgdDPExtractData (out, size);
     out->xgd_free (out);
+    RASTERLITE_PROBE2 (encode__done, "png_gray", *size);
     return rv;
 }
 
 extern void *
-image_to_png_rgb (const rasterliteImagePtr img, int *size)
+image_to_png_rgb (const rasterliteImagePtr img, int *size, int quality)
 {
 /* compressing an image as PNG RGB */
     void *rv;
+#ifndef _WIN32
+    int threads;
+#endif
     xgdIOCtx *out = xgdNewDynamicCtx (2048, NULL);
-    xgdImagePngCtxRgb (img, out, -1);
+    RASTERLITE_PROBE3 (encode__start, "png_rgb", img->sx, img->sy);
+#ifndef _WIN32
+    threads = parallel_encoder_threads (img);
+    if (threads == 0
+	|| !xgdImagePngCtxParallel (img, out, quality, 3, threads))
+	xgdImagePngCtxRgb (img, out, quality);
+#else
+    xgdImagePngCtxRgb (img, out, quality);
+#endif
     rv = xgdDPExtractData (out, size);
     out->xgd_free (out);
+    RASTERLITE_PROBE2 (encode__done, "png_rgb", *size);
     return rv;
 }
 
+extern int
+image_from_png_sink (int size, const void *data, rasterliteTileSinkPtr sink)
+{
+/* uncompressing a PNG straight into a tile sink */
+    int ret;
+    xgdIOCtx *in = xgdNewDynamicCtxEx (size, data, 0);
+    RASTERLITE_PROBE2 (decode__start, "png", size);
+    ret = xgdImageCreateFromPngCtx (in, sink);
+    in->xgd_free (in);
+    RASTERLITE_PROBE3 (decode__done, "png",
+		       ret == RASTERLITE_OK ? sink->src_width : 0,
+		       ret == RASTERLITE_OK ? sink->src_height : 0);
+    return ret;
+}
+
 extern rasterliteImagePtr
 image_from_png (int size, const void *data)
 {
 /* uncompressing a PNG */
-    rasterliteImagePtr img;
-    xgdIOCtx *in = xgdNewDynamicCtxEx (size, data, 0);
-    img = xgdImageCreateFromPngCtx (in);
-    in->xgd_free (in);
-    return img;
+    rasterliteTileSink sink;
+    tile_sink_init (&sink, NULL);
+    return tile_sink_release (&sink,
+			      image_from_png_sink (size, data, &sink));
 }
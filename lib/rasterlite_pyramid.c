@@ -0,0 +1,2063 @@
+/*
+/ rasterlite_pyramid.c
+/
+/ building Pyramid levels [and Topmost levels] for a RasterLite datasource
+/
+/ version 1.1a, 2011 November 12
+/
+/ Author: Sandro Furieri a.furieri@lqt.it
+/
+/ ------------------------------------------------------------------------------
+/
+/ Version: MPL 1.1/GPL 2.0/LGPL 2.1
+/
+/ The contents of this file are subject to the Mozilla Public License Version
+/ 1.1 (the "License"); you may not use this file except in compliance with
+/ the License. You may obtain a copy of the License at
+/ http://www.mozilla.org/MPL/
+/
+/ Software distributed under the License is distributed on an "AS IS" basis,
+/ WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+/ for the specific language governing rights and limitations under the
+/ License.
+/
+/ The Original Code is the RasterLite library
+/
+/ The Initial Developer of the Original Code is Alessandro Furieri
+/
+/ Portions created by the Initial Developer are Copyright (C) 2009
+/ the Initial Developer. All Rights Reserved.
+/
+/ Alternatively, the contents of this file may be used under the terms of
+/ either the GNU General Public License Version 2 or later (the "GPL"), or
+/ the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+/ in which case the provisions of the GPL or the LGPL are applicable instead
+/ of those above. If you wish to allow use of your version of this file only
+/ under the terms of either the GPL or the LGPL, and not to allow others to
+/ use your version of this file under the terms of the MPL, indicate your
+/ decision by deleting the provisions above and replace them with the notice
+/ and other provisions required by the GPL or the LGPL. If you do not delete
+/ the provisions above, a recipient may use your version of this file under
+/ the terms of any one of the MPL, the GPL or the LGPL.
+/
+*/
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+/* MSVC strictly requires this include [off_t] */
+#include <sys/types.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "rasterlite_tiff_hdrs.h"
+#include <tiffio.h>
+
+#ifdef SPATIALITE_AMALGAMATION
+#include <spatialite/sqlite3.h>
+#else
+#include <sqlite3.h>
+#endif
+
+#include <spatialite/gaiaexif.h>
+#include <spatialite/gaiageo.h>
+#include <spatialite.h>
+
+#include "rasterlite.h"
+#include "rasterlite_internals.h"
+
+#ifdef _WIN32
+#define strcasecmp	_stricmp
+#endif /* not WIN32 */
+
+#if defined(_WIN32) || defined (__MINGW32__)
+#define FORMAT_64	"%I64d"
+#else
+#define FORMAT_64	"%lld"
+#endif
+
+#define TILE_UPPER_LEFT		1
+#define TILE_UPPER_RIGHT	2
+#define TILE_LOWER_LEFT		3
+#define TILE_LOWER_RIGHT	4
+
+#define PYRAMID_MISALIGNED	2
+#define PYRAMID_CANCELLED	-3
+
+#define PYRAMID_JOBS_BLOCK	1024	/* initial size of the tiles list */
+
+struct pyramid_piece
+{
+/* a source tile to be drawn into a pyramid tile */
+    sqlite3_int64 id;		/* the source raster ID */
+    unsigned char *blob;	/* the source raster [still compressed] */
+    int blob_size;
+    int base_x;			/* placement into the full size image */
+    int base_y;
+    int declared_width;		/* expected dims; -1 if not checked */
+    int declared_height;
+    struct pyramid_piece *next;
+};
+
+struct pyramid_job
+{
+/* a pyramid tile to be rendered */
+    int tileNo;
+    int width;			/* the full size image dims */
+    int height;
+    int thumb_width;		/* the thumbnail dims */
+    int thumb_height;
+    double min_x;		/* the thumbnail MBR */
+    double min_y;
+    double max_x;
+    double max_y;
+    int srid;
+    struct pyramid_piece *first;
+    struct pyramid_piece *last;
+    int status;			/* 1 = ready, -1 = empty, 0 = error */
+    unsigned char *blob;	/* the compressed thumbnail */
+    int blob_size;
+    char error[256];
+};
+
+struct pyramid_context
+{
+/* the pyramid rendering context, shared by all worker threads */
+    rasterlitePtr handle;
+    const rasterlitePyramidOptions *options;
+    rasterlitePyramidProgress progress;
+    void *user_data;
+    int threads;
+    int transparent_color;
+    int background_color;
+    struct pyramid_job *jobs;
+    int max_job;
+    int next_job;
+    int end_job;
+    int failed;
+#ifndef _WIN32
+    pthread_mutex_t mutex;
+#endif
+};
+
+#ifdef _WIN32
+#define PYRAMID_LOCK(ctx)
+#define PYRAMID_UNLOCK(ctx)
+#else
+#define PYRAMID_LOCK(ctx)	pthread_mutex_lock (&((ctx)->mutex))
+#define PYRAMID_UNLOCK(ctx)	pthread_mutex_unlock (&((ctx)->mutex))
+#endif
+
+static void
+pyramid_error (struct pyramid_context *ctx, const char *error)
+{
+/* setting up an error message on the HANDLE */
+    reset_error (ctx->handle);
+    set_error (ctx->handle, error);
+}
+
+static void
+pyramid_sql_error (struct pyramid_context *ctx)
+{
+/* setting up an SQL error message on the HANDLE */
+    char error[1024];
+    sprintf (error, "SQL error: %s\n", sqlite3_errmsg (ctx->handle->handle));
+    pyramid_error (ctx, error);
+}
+
+static int
+pyramid_exec (struct pyramid_context *ctx, const char *sql)
+{
+/* executing a simple SQL statement */
+    int ret;
+    char *sql_err = NULL;
+    char error[1024];
+    ret = sqlite3_exec (ctx->handle->handle, sql, NULL, NULL, &sql_err);
+    if (ret != SQLITE_OK)
+      {
+	  sprintf (error, "SQL error [%s]: %s\n", sql, sql_err);
+	  sqlite3_free (sql_err);
+	  pyramid_error (ctx, error);
+	  return 0;
+      }
+    return 1;
+}
+
+static int
+pyramid_report (struct pyramid_context *ctx, const char *source_name,
+		int level, int done, int total)
+{
+/* reporting progress; returns 0 if the caller asked to cancel */
+    if (!(ctx->progress))
+	return 1;
+    if (ctx->progress (source_name, level, done, total, ctx->user_data) != 0)
+	return 0;
+    return 1;
+}
+
+static void
+free_source_item (struct source_item *item)
+{
+/* freeing a source item struct */
+    if (item->name)
+	free (item->name);
+    free (item);
+}
+
+static void
+init_sources (struct sources_list *list)
+{
+/* initializing the raster sources list */
+    list->first = NULL;
+    list->last = NULL;
+}
+
+static void
+free_sources (struct sources_list *list)
+{
+/* freeing the raster sources list */
+    struct source_item *p;
+    struct source_item *pN;
+    p = list->first;
+    while (p)
+      {
+	  pN = p->next;
+	  free_source_item (p);
+	  p = pN;
+      }
+}
+
+static void
+add_source (struct sources_list *list, const char *name, int count)
+{
+/* adding a raster source to the list */
+    struct source_item *p;
+    int len = strlen (name);
+    p = malloc (sizeof (struct source_item));
+    p->name = malloc (len + 1);
+    strcpy (p->name, name);
+    p->count = count;
+    p->next = NULL;
+    if (list->first == NULL)
+	list->first = p;
+    if (list->last != NULL)
+	list->last->next = p;
+    list->last = p;
+}
+
+static void
+init_tiles (struct tiles_list *list)
+{
+/* initializing the raster tiles list */
+    list->first = NULL;
+    list->last = NULL;
+}
+
+static void
+free_tiles (struct tiles_list *list)
+{
+/* freeing the raster tiles list */
+    struct tile_item *p;
+    struct tile_item *pN;
+    p = list->first;
+    while (p)
+      {
+	  pN = p->next;
+	  free (p);
+	  p = pN;
+      }
+}
+
+static void
+add_tile (struct tiles_list *list, sqlite3_int64 id, int srid, double min_x,
+	  double min_y, double max_x, double max_y, int width, int height)
+{
+/* adding a raster tile to the list */
+    struct tile_item *p;
+    p = malloc (sizeof (struct tile_item));
+    p->id = id;
+    p->srid = srid;
+    p->min_x = min_x;
+    p->min_y = min_y;
+    p->max_x = max_x;
+    p->max_y = max_y;
+    p->width = width;
+    p->height = height;
+    p->next = NULL;
+    if (list->first == NULL)
+	list->first = p;
+    if (list->last != NULL)
+	list->last->next = p;
+    list->last = p;
+}
+
+static int
+find_first_tile (struct tiles_list *list, double min_x, double max_y, double *x,
+		 double *y)
+{
+/* searching the first tile [uppermost, leftmost] */
+    struct tile_item *p = list->first;
+    while (p)
+      {
+	  if (p->min_x == min_x && p->max_y == max_y)
+	    {
+		*x = p->max_x;
+		*y = p->min_y;
+		return 1;
+	    }
+	  p = p->next;
+      }
+    return 0;
+}
+
+static int
+find_tile_right (struct tiles_list *list, double *x, double *y)
+{
+/* searching the next tile [rightmost] */
+    struct tile_item *p;
+    if (*x == DBL_MAX || *y == DBL_MAX)
+	return 0;
+    p = list->first;
+    while (p)
+      {
+	  if (p->min_x == *x && p->min_y == *y)
+	    {
+		*x = p->max_x;
+		*y = p->min_y;
+		return 1;
+	    }
+	  p = p->next;
+      }
+    return 0;
+}
+
+static int
+find_tile_down (struct tiles_list *list, double *x, double *y)
+{
+/* searching the next tile [lowermost] */
+    struct tile_item *p;
+    if (*x == DBL_MAX || *y == DBL_MAX)
+	return 0;
+    p = list->first;
+    while (p)
+      {
+	  if (p->min_x == *x && p->max_y == *y)
+	    {
+		*x = p->max_x;
+		*y = p->min_y;
+		return 1;
+	    }
+	  p = p->next;
+      }
+    return 0;
+}
+
+static struct tile_item *
+find_tile (struct tiles_list *list, double x, double y, int mode)
+{
+/* searching a tile */
+    struct tile_item *p = list->first;
+    while (p)
+      {
+	  switch (mode)
+	    {
+	    case TILE_UPPER_LEFT:
+		if (p->max_x == x && p->min_y == y)
+		    return p;
+		break;
+	    case TILE_UPPER_RIGHT:
+		if (p->min_x == x && p->min_y == y)
+		    return p;
+		break;
+	    case TILE_LOWER_LEFT:
+		if (p->max_x == x && p->max_y == y)
+		    return p;
+		break;
+	    case TILE_LOWER_RIGHT:
+		if (p->min_x == x && p->max_y == y)
+		    return p;
+		break;
+	    }
+	  p = p->next;
+      }
+    return NULL;
+}
+
+static void
+init_job (struct pyramid_job *job, int tileNo)
+{
+/* initializing a pyramid tile to be rendered */
+    job->tileNo = tileNo;
+    job->width = 0;
+    job->height = 0;
+    job->thumb_width = 0;
+    job->thumb_height = 0;
+    job->min_x = 0.0;
+    job->min_y = 0.0;
+    job->max_x = 0.0;
+    job->max_y = 0.0;
+    job->srid = -1;
+    job->first = NULL;
+    job->last = NULL;
+    job->status = 0;
+    job->blob = NULL;
+    job->blob_size = 0;
+    *(job->error) = '\0';
+}
+
+static struct pyramid_piece *
+add_piece (struct pyramid_job *job, sqlite3_int64 id, int base_x, int base_y,
+	   int declared_width, int declared_height)
+{
+/* adding a source tile to some pyramid tile */
+    struct pyramid_piece *p = malloc (sizeof (struct pyramid_piece));
+    p->id = id;
+    p->blob = NULL;
+    p->blob_size = 0;
+    p->base_x = base_x;
+    p->base_y = base_y;
+    p->declared_width = declared_width;
+    p->declared_height = declared_height;
+    p->next = NULL;
+    if (job->first == NULL)
+	job->first = p;
+    if (job->last != NULL)
+	job->last->next = p;
+    job->last = p;
+    return p;
+}
+
+static void
+free_pieces (struct pyramid_job *job)
+{
+/* freeing all the source tiles of some pyramid tile */
+    struct pyramid_piece *p;
+    struct pyramid_piece *pN;
+    p = job->first;
+    while (p)
+      {
+	  pN = p->next;
+	  if (p->blob)
+	      free (p->blob);
+	  free (p);
+	  p = pN;
+      }
+    job->first = NULL;
+    job->last = NULL;
+}
+
+static void
+free_jobs (struct pyramid_job *jobs, int max_job)
+{
+/* freeing the pyramid tiles to be rendered */
+    int i;
+    if (!jobs)
+	return;
+    for (i = 0; i < max_job; i++)
+      {
+	  free_pieces (jobs + i);
+	  if (jobs[i].blob)
+	      free (jobs[i].blob);
+      }
+    free (jobs);
+}
+
+static int
+int_round (double value)
+{
+/* replacing the C99 round() function */
+    double min = floor (value);
+    if (fabs (value - min) < 0.5)
+	return (int) min;
+    return (int) (min + 1.0);
+}
+
+static rasterliteImagePtr
+raster_decode (const void *blob, int blob_size, int jpeg_profile)
+{
+/* trying to decode a BLOB as an image */
+    rasterliteImagePtr img = NULL;
+    int type = gaiaGuessBlobType (blob, blob_size);
+    if (type == GAIA_JPEG_BLOB || type == GAIA_EXIF_BLOB
+	|| type == GAIA_EXIF_GPS_BLOB)
+	img = image_from_jpeg (blob_size, (void *) blob, jpeg_profile);
+    else if (type == GAIA_PNG_BLOB)
+	img = image_from_png (blob_size, (void *) blob);
+    else if (type == GAIA_GIF_BLOB)
+	img = image_from_gif (blob_size, (void *) blob);
+    else if (type == GAIA_TIFF_BLOB)
+	img = image_from_tiff (blob_size, (void *) blob);
+    return img;
+}
+
+static void
+copy_rectangle (rasterliteImagePtr output, rasterliteImagePtr input,
+		int transparent_color, int base_x, int base_y)
+{
+/* copying a raster rectangle */
+    int x;
+    int y;
+    int dst_x;
+    int dst_y;
+    int pixel;
+    for (y = 0; y < input->sy; y++)
+      {
+	  dst_y = base_y + y;
+	  if (dst_y < 0)
+	      continue;
+	  if (dst_y >= output->sy)
+	      break;
+	  for (x = 0; x < input->sx; x++)
+	    {
+		dst_x = base_x + x;
+		if (dst_x < 0)
+		    continue;
+		if (dst_x >= output->sx)
+		    break;
+		pixel = input->pixels[y][x];
+		if (pixel == transparent_color)
+		    continue;
+		image_set_pixel (output, dst_x, dst_y, pixel);
+	    }
+      }
+}
+
+static int
+copy_rectangle_half (rasterliteImagePtr output, rasterliteImagePtr input,
+		     int base_x, int base_y)
+{
+/*
+/ copying a raster rectangle directly at half resolution
+/
+/ this is only possible when the input rectangle is aligned on 2x2 blocks
+/ [even placement, even dims or clipped by the output edge]; in this case
+/ averaging each 2x2 block gives exactly the same pixel as make_thumbnail()
+/ applied on the full size image would do
+*/
+    int x;
+    int y;
+    int dst_x;
+    int dst_y;
+    int p0;
+    int p1;
+    int p2;
+    int p3;
+    int red;
+    int green;
+    int blue;
+    if ((base_x % 2) != 0 || (base_y % 2) != 0)
+	return 0;
+    if ((input->sx % 2) != 0 && (base_x + input->sx) <= (output->sx * 2))
+	return 0;
+    if ((input->sy % 2) != 0 && (base_y + input->sy) <= (output->sy * 2))
+	return 0;
+    for (y = 0; y + 1 < input->sy; y += 2)
+      {
+	  dst_y = (base_y + y) / 2;
+	  if (dst_y < 0)
+	      continue;
+	  if (dst_y >= output->sy)
+	      break;
+	  for (x = 0; x + 1 < input->sx; x += 2)
+	    {
+		dst_x = (base_x + x) / 2;
+		if (dst_x < 0)
+		    continue;
+		if (dst_x >= output->sx)
+		    break;
+		p0 = input->pixels[y][x];
+		p1 = input->pixels[y][x + 1];
+		p2 = input->pixels[y + 1][x];
+		p3 = input->pixels[y + 1][x + 1];
+		red =
+		    (true_color_get_red (p0) + true_color_get_red (p1) +
+		     true_color_get_red (p2) + true_color_get_red (p3)) / 4;
+		green =
+		    (true_color_get_green (p0) + true_color_get_green (p1) +
+		     true_color_get_green (p2) +
+		     true_color_get_green (p3)) / 4;
+		blue =
+		    (true_color_get_blue (p0) + true_color_get_blue (p1) +
+		     true_color_get_blue (p2) + true_color_get_blue (p3)) / 4;
+		image_set_pixel (output, dst_x, dst_y,
+				 true_color (red, green, blue));
+	    }
+      }
+    return 1;
+}
+
+static int
+composite_job (struct pyramid_context *ctx, struct pyramid_job *job,
+	       rasterliteImagePtr output, int half_size)
+{
+/*
+/ drawing all the source tiles of some pyramid tile
+/
+/ returns: 1 on success, -1 if no source tile was drawn, 0 on error
+/ and PYRAMID_MISALIGNED if a source tile cannot be drawn at half resolution
+*/
+    char dummy64[64];
+    int hits = 0;
+    rasterliteImagePtr img;
+    struct pyramid_piece *piece = job->first;
+    while (piece)
+      {
+	  img = NULL;
+	  if (piece->blob)
+	      img =
+		  raster_decode (piece->blob, piece->blob_size,
+				 ctx->handle->jpeg_profile);
+	  if (piece->declared_width >= 0)
+	    {
+		/* strictly checking the source tile */
+		sprintf (dummy64, FORMAT_64, piece->id);
+		if (img == NULL)
+		  {
+		      sprintf (job->error,
+			       "tile ID=%s [not a valid image]", dummy64);
+		      return 0;
+		  }
+		if (img->sx != piece->declared_width
+		    || img->sy != piece->declared_height)
+		  {
+		      sprintf (job->error,
+			       "tile ID=%s [unexpected Width and Height]",
+			       dummy64);
+		      image_destroy (img);
+		      return 0;
+		  }
+	    }
+	  if (img)
+	    {
+		if (half_size)
+		  {
+		      if (!copy_rectangle_half
+			  (output, img, piece->base_x, piece->base_y))
+			{
+			    image_destroy (img);
+			    return PYRAMID_MISALIGNED;
+			}
+		  }
+		else
+		    copy_rectangle (output, img, ctx->transparent_color,
+				    piece->base_x, piece->base_y);
+		image_destroy (img);
+		hits++;
+	    }
+	  piece = piece->next;
+      }
+    if (!hits)
+	return -1;
+    return 1;
+}
+
+static int
+render_job (struct pyramid_context *ctx, struct pyramid_job *job)
+{
+/* rendering and compressing a pyramid tile */
+    int ret = PYRAMID_MISALIGNED;
+    rasterliteImagePtr full_size;
+    rasterliteImagePtr thumbnail;
+    thumbnail = image_create (job->thumb_width, job->thumb_height);
+    if (!thumbnail)
+      {
+	  strcpy (job->error, "insufficient memory");
+	  return 0;
+      }
+    if (ctx->transparent_color < 0 && job->thumb_width * 2 == job->width
+	&& job->thumb_height * 2 == job->height)
+      {
+	  /* trying to directly composite at half resolution */
+	  image_fill (thumbnail, ctx->background_color);
+	  ret = composite_job (ctx, job, thumbnail, 1);
+      }
+    if (ret == PYRAMID_MISALIGNED)
+      {
+	  /* compositing the full size image, then building the thumbnail */
+	  full_size = image_create (job->width, job->height);
+	  if (!full_size)
+	    {
+		strcpy (job->error, "insufficient memory");
+		image_destroy (thumbnail);
+		return 0;
+	    }
+	  image_fill (full_size, ctx->background_color);
+	  ret = composite_job (ctx, job, full_size, 0);
+	  if (ret > 0)
+	      make_thumbnail (thumbnail, full_size);
+	  image_destroy (full_size);
+      }
+    free_pieces (job);
+    if (ret <= 0)
+      {
+	  image_destroy (thumbnail);
+	  return ret;
+      }
+    if (ctx->options->image_type == GAIA_TIFF_BLOB)
+      {
+	  job->blob =
+	      image_to_tiff_rgb (thumbnail, &(job->blob_size),
+				 ctx->options->quality_factor);
+	  if (!(job->blob))
+	      strcpy (job->error, "TIFF RGB compression error");
+      }
+    else if (ctx->options->image_type == GAIA_PNG_BLOB)
+      {
+	  job->blob =
+	      image_to_png_rgb (thumbnail, &(job->blob_size),
+				ctx->options->quality_factor);
+	  if (!(job->blob))
+	      strcpy (job->error, "PNG RGB compression error");
+      }
+    else
+      {
+	  job->blob =
+	      image_to_jpeg (thumbnail, &(job->blob_size),
+			     ctx->options->quality_factor,
+			     ctx->handle->jpeg_profile);
+	  if (!(job->blob))
+	      strcpy (job->error, "JPEG compression error");
+      }
+    image_destroy (thumbnail);
+    if (!(job->blob))
+	return 0;
+    return 1;
+}
+
+static void *
+pyramid_worker (void *arg)
+{
+/* a worker rendering the pyramid tiles of the current batch */
+    struct pyramid_context *ctx = (struct pyramid_context *) arg;
+    struct pyramid_job *job;
+    int idx;
+    while (1)
+      {
+	  /* fetching the next tile to be rendered */
+	  PYRAMID_LOCK (ctx);
+	  if (ctx->failed)
+	      idx = ctx->end_job;
+	  else
+	      idx = ctx->next_job++;
+	  PYRAMID_UNLOCK (ctx);
+	  if (idx >= ctx->end_job)
+	      break;
+	  job = ctx->jobs + idx;
+	  job->status = render_job (ctx, job);
+	  if (job->status == 0)
+	    {
+		PYRAMID_LOCK (ctx);
+		ctx->failed = 1;
+		PYRAMID_UNLOCK (ctx);
+	    }
+      }
+    return NULL;
+}
+
+#ifndef _WIN32
+static void *
+pyramid_thread (void *arg)
+{
+/* a worker thread: the other workers keep the remaining CPUs busy */
+    set_thread_encoder_threads (1);
+    return pyramid_worker (arg);
+}
+#endif
+
+static int
+render_batch (struct pyramid_context *ctx, int first, int last)
+{
+/* rendering a batch of pyramid tiles, possibly using many threads */
+    int threads = ctx->threads;
+    ctx->next_job = first;
+    ctx->end_job = last;
+#ifndef _WIN32
+    if (threads > last - first)
+	threads = last - first;
+    if (threads > 1)
+      {
+	  pthread_t *workers = malloc (sizeof (pthread_t) * threads);
+	  int started = 0;
+	  int i;
+	  for (i = 0; i < threads; i++)
+	    {
+		if (pthread_create (workers + started, NULL, pyramid_thread,
+				    ctx) == 0)
+		    started++;
+	    }
+	  if (!started)
+	    {
+		/* falling back to serial rendering */
+		pyramid_worker (ctx);
+	    }
+	  for (i = 0; i < started; i++)
+	      pthread_join (workers[i], NULL);
+	  free (workers);
+	  return !(ctx->failed);
+      }
+#endif
+    pyramid_worker (ctx);
+    return !(ctx->failed);
+}
+
+static int
+fetch_level_pieces (struct pyramid_context *ctx, sqlite3_stmt * stmt,
+		    struct pyramid_job *job)
+{
+/* reading the source tiles of some Pyramid Level tile */
+    int ret;
+    char error[1024];
+    char dummy64[64];
+    const void *blob;
+    struct pyramid_piece *piece = job->first;
+    while (piece)
+      {
+	  sqlite3_reset (stmt);
+	  sqlite3_clear_bindings (stmt);
+	  sqlite3_bind_int64 (stmt, 1, piece->id);
+	  while (1)
+	    {
+		/* scrolling the result set */
+		ret = sqlite3_step (stmt);
+		if (ret == SQLITE_DONE)
+		    break;	/* end of result set */
+		if (ret == SQLITE_ROW)
+		  {
+		      /* retrieving query values */
+		      if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB
+			  && piece->blob == NULL)
+			{
+			    blob = sqlite3_column_blob (stmt, 0);
+			    piece->blob_size = sqlite3_column_bytes (stmt, 0);
+			    piece->blob = malloc (piece->blob_size);
+			    memcpy (piece->blob, blob, piece->blob_size);
+			}
+		  }
+		else
+		  {
+		      pyramid_sql_error (ctx);
+		      return 0;
+		  }
+	    }
+	  if (!(piece->blob))
+	    {
+		sprintf (dummy64, FORMAT_64, piece->id);
+		sprintf (error, "tile ID=%s not found [or not a BLOB]",
+			 dummy64);
+		pyramid_error (ctx, error);
+		return 0;
+	    }
+	  piece = piece->next;
+      }
+    return 1;
+}
+
+static int
+fetch_topmost_pieces (struct pyramid_context *ctx, sqlite3_stmt * stmt,
+		      struct pyramid_job *job, double x_size, double y_size)
+{
+/* reading all the source tiles intersecting some Topmost tile */
+    int ret;
+    const void *blob;
+    struct pyramid_piece *piece;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_double (stmt, 1, job->max_x);
+    sqlite3_bind_double (stmt, 2, job->min_x);
+    sqlite3_bind_double (stmt, 3, job->max_y);
+    sqlite3_bind_double (stmt, 4, job->min_y);
+    sqlite3_bind_double (stmt, 5, x_size);
+    sqlite3_bind_double (stmt, 6, y_size);
+    while (1)
+      {
+	  /* scrolling the result set */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		/* retrieving query values */
+		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT
+		    && sqlite3_column_type (stmt, 1) == SQLITE_FLOAT
+		    && sqlite3_column_type (stmt, 3) == SQLITE_BLOB)
+		  {
+		      /* fetching the tile MBR and the Raster Image */
+		      double x =
+			  (sqlite3_column_double (stmt, 0) -
+			   job->min_x) / x_size;
+		      double y =
+			  (double) job->height -
+			  ((sqlite3_column_double (stmt, 1) -
+			    job->min_y) / y_size);
+		      piece =
+			  add_piece (job, 0, int_round (x), int_round (y), -1,
+				     -1);
+		      blob = sqlite3_column_blob (stmt, 3);
+		      piece->blob_size = sqlite3_column_bytes (stmt, 3);
+		      piece->blob = malloc (piece->blob_size);
+		      memcpy (piece->blob, blob, piece->blob_size);
+		      job->srid = sqlite3_column_int (stmt, 2);
+		  }
+	    }
+	  else
+	    {
+		pyramid_sql_error (ctx);
+		return 0;
+	    }
+      }
+    return 1;
+}
+
+static int
+insert_metadata (struct pyramid_context *ctx, const char *source_name,
+		 struct pyramid_job *job, sqlite3_int64 id_raster,
+		 double x_size, double y_size, sqlite3_stmt * stmt)
+{
+/* inserting the metadata of some pyramid tile */
+    int ret;
+    unsigned char *blob;
+    int blob_size;
+    gaiaGeomCollPtr geom;
+    gaiaPolygonPtr polyg;
+    geom = gaiaAllocGeomColl ();
+    geom->Srid = job->srid;
+    polyg = gaiaAddPolygonToGeomColl (geom, 5, 0);
+    gaiaSetPoint (polyg->Exterior->Coords, 0, job->min_x, job->min_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 1, job->max_x, job->min_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 2, job->max_x, job->max_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 3, job->min_x, job->max_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 4, job->min_x, job->min_y);
+    gaiaToSpatiaLiteBlobWkb (geom, &blob, &blob_size);
+    gaiaFreeGeomColl (geom);
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_int64 (stmt, 1, id_raster);
+    sqlite3_bind_text (stmt, 2, source_name, strlen (source_name),
+		       SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 3, job->tileNo);
+    sqlite3_bind_int (stmt, 4, job->thumb_width);
+    sqlite3_bind_int (stmt, 5, job->thumb_height);
+    sqlite3_bind_double (stmt, 6, x_size);
+    sqlite3_bind_double (stmt, 7, y_size);
+    sqlite3_bind_blob (stmt, 8, blob, blob_size, free);
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	return 1;
+    pyramid_sql_error (ctx);
+    return 0;
+}
+
+static int
+store_level (struct pyramid_context *ctx, const char *source_name,
+	     int level, int topmost, double x_size, double y_size)
+{
+/*
+/ rendering and storing all the planned tiles of a pyramid level
+/
+/ the compressed source tiles are read on the handle's own connection,
+/ a batch at a time [according to the memory limit]; decoding, compositing
+/ and compressing are then performed by the worker threads, and finally the
+/ thumbnails are INSERTed by the calling thread, preserving the tiles order
+/
+/ reading a compressed BLOB by its ID costs about 1/60 of rendering a
+/ thumbnail, so serial reads hardly limit the workers; per-worker read
+/ connections would moreover hit SQLITE_BUSY as soon as the still pending
+/ write transaction spills its page cache, and could not reopen a
+/ ":memory:" or temporary DB at all
+*/
+    sqlite3 *sqlite = ctx->handle->handle;
+    const char *table = ctx->handle->table_prefix;
+    sqlite3_stmt *stmt_fetch = NULL;
+    sqlite3_stmt *stmt_raster = NULL;
+    sqlite3_stmt *stmt_meta = NULL;
+    int ret;
+    char sql[1024];
+    char error[1024];
+    double budget;
+    double buffered;
+    int first;
+    int last;
+    int done = 0;
+    int i;
+    struct pyramid_job *job;
+    struct pyramid_piece *piece;
+    if (!pyramid_report (ctx, source_name, level, 0, ctx->max_job))
+	return PYRAMID_CANCELLED;
+    if (ctx->options->memory_limit > 0)
+	budget = (double) (ctx->options->memory_limit) * 1024.0 * 1024.0;
+    else
+	budget = DBL_MAX;
+/* the complete operation is handled as an unique SQL Transaction */
+    if (!pyramid_exec (ctx, "BEGIN"))
+	return 0;
+/* creating the SELECT prepared statement */
+    if (topmost)
+      {
+	  strcpy (sql, "SELECT MbrMinX(m.geometry), MbrMaxY(m.geometry), ");
+	  strcat (sql, "SRID(m.geometry), r.raster FROM \"");
+	  strcat (sql, table);
+	  strcat (sql, "_metadata\" AS m, \"");
+	  strcat (sql, table);
+	  strcat (sql, "_rasters\" AS r WHERE m.ROWID IN (SELECT pkid ");
+	  strcat (sql, "FROM \"idx_");
+	  strcat (sql, table);
+	  strcat (sql, "_metadata_geometry\" ");
+	  strcat (sql,
+		  "WHERE xmin < ? AND xmax > ? AND ymin < ? AND ymax > ?) ");
+	  strcat (sql,
+		  "AND m.pixel_x_size = ? AND m.pixel_y_size = ? AND r.id = m.id");
+      }
+    else
+	sprintf (sql, "SELECT raster FROM \"%s_rasters\" WHERE id = ?", table);
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt_fetch, NULL);
+    if (ret != SQLITE_OK)
+	goto sql_error;
+/* creating the INSERT INTO xx_rasters prepared statement */
+    sprintf (sql, "INSERT INTO \"%s_rasters\" ", table);
+    strcat (sql, "(id, raster) ");
+    strcat (sql, " VALUES (NULL, ?)");
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt_raster, NULL);
+    if (ret != SQLITE_OK)
+	goto sql_error;
+/* creating the INSERT INTO xx_metadata prepared statement */
+    sprintf (sql, "INSERT INTO \"%s_metadata\" ", table);
+    strcat (sql, "(id, source_name, tile_id, width, height, ");
+    strcat (sql, "pixel_x_size, pixel_y_size, geometry) ");
+    strcat (sql, " VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt_meta, NULL);
+    if (ret != SQLITE_OK)
+	goto sql_error;
+
+    first = 0;
+    while (first < ctx->max_job)
+      {
+	  /* reading the next batch of source tiles */
+	  buffered = 0.0;
+	  last = first;
+	  while (last < ctx->max_job)
+	    {
+		if (last > first && buffered >= budget)
+		    break;
+		job = ctx->jobs + last;
+		if (topmost)
+		    ret =
+			fetch_topmost_pieces (ctx, stmt_fetch, job, x_size,
+					      y_size);
+		else
+		    ret = fetch_level_pieces (ctx, stmt_fetch, job);
+		if (!ret)
+		    goto error;
+		piece = job->first;
+		while (piece)
+		  {
+		      buffered += (double) (piece->blob_size);
+		      piece = piece->next;
+		  }
+		buffered +=
+		    (double) (job->thumb_width) * (double) (job->thumb_height) *
+		    3.0;
+		last++;
+	    }
+	  /* rendering the batch */
+	  ctx->failed = 0;
+	  if (!render_batch (ctx, first, last))
+	    {
+		for (i = first; i < last; i++)
+		  {
+		      job = ctx->jobs + i;
+		      if (job->status == 0 && *(job->error) != '\0')
+			{
+			    sprintf (error, "%s PyramidLevel %d: %s",
+				     source_name ? source_name : "TopMost",
+				     level, job->error);
+			    pyramid_error (ctx, error);
+			    break;
+			}
+		  }
+		goto error;
+	    }
+	  /* INSERTing the rendered tiles */
+	  for (i = first; i < last; i++)
+	    {
+		job = ctx->jobs + i;
+		if (job->status == 1)
+		  {
+		      sqlite3_reset (stmt_raster);
+		      sqlite3_clear_bindings (stmt_raster);
+		      sqlite3_bind_blob (stmt_raster, 1, job->blob,
+					 job->blob_size, free);
+		      job->blob = NULL;
+		      ret = sqlite3_step (stmt_raster);
+		      if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+			  ;
+		      else
+			  goto sql_error;
+		      if (!insert_metadata
+			  (ctx, source_name ? source_name : "TopMost", job,
+			   sqlite3_last_insert_rowid (sqlite), x_size * 2.0,
+			   y_size * 2.0, stmt_meta))
+			  goto error;
+		  }
+		done++;
+		if (!pyramid_report (ctx, source_name, level, done,
+				     ctx->max_job))
+		  {
+		      ret = PYRAMID_CANCELLED;
+		      goto cancel;
+		  }
+	    }
+	  first = last;
+      }
+    sqlite3_finalize (stmt_fetch);
+    sqlite3_finalize (stmt_raster);
+    sqlite3_finalize (stmt_meta);
+/* committing the still pending SQL Transaction */
+    if (!pyramid_exec (ctx, "COMMIT"))
+	return 0;
+    return 1;
+
+  sql_error:
+    pyramid_sql_error (ctx);
+  error:
+    ret = 0;
+  cancel:
+    if (stmt_fetch)
+	sqlite3_finalize (stmt_fetch);
+    if (stmt_raster)
+	sqlite3_finalize (stmt_raster);
+    if (stmt_meta)
+	sqlite3_finalize (stmt_meta);
+    sqlite3_exec (sqlite, "ROLLBACK", NULL, NULL, NULL);
+    return ret;
+}
+
+static int
+plan_level_tile (struct pyramid_context *ctx, const char *source_name,
+		 struct pyramid_job *job, struct tile_item *tile_1,
+		 struct tile_item *tile_2, struct tile_item *tile_3,
+		 struct tile_item *tile_4)
+{
+/* planning a Pyramid Level tile [up to 4 source tiles] */
+    char error[1024];
+    char dummy64_1[64];
+    char dummy64_2[64];
+    if (tile_1 && tile_2 && tile_3 && tile_4)
+	;
+    else if (tile_1 && tile_3 && !tile_2 && !tile_4)
+	;
+    else if (tile_1 && tile_2 && !tile_3 && !tile_4)
+	;
+    else if (tile_1 && !tile_2 && !tile_3 && !tile_4)
+	;
+    else
+      {
+	  sprintf (error,
+		   "Error in raster source \"%s\": invalid tile pattern",
+		   source_name);
+	  pyramid_error (ctx, error);
+	  return 0;
+      }
+/* checking sizes */
+    if (tile_3 && tile_1->width != tile_3->width)
+      {
+	  sprintf (dummy64_1, FORMAT_64, tile_1->id);
+	  sprintf (dummy64_2, FORMAT_64, tile_3->id);
+	  goto width_mismatch;
+      }
+    if (tile_4 && tile_2->width != tile_4->width)
+      {
+	  sprintf (dummy64_1, FORMAT_64, tile_2->id);
+	  sprintf (dummy64_2, FORMAT_64, tile_4->id);
+	  goto width_mismatch;
+      }
+    if (tile_2 && tile_1->height != tile_2->height)
+      {
+	  sprintf (dummy64_1, FORMAT_64, tile_1->id);
+	  sprintf (dummy64_2, FORMAT_64, tile_2->id);
+	  goto height_mismatch;
+      }
+    if (tile_4 && tile_3->height != tile_4->height)
+      {
+	  sprintf (dummy64_1, FORMAT_64, tile_3->id);
+	  sprintf (dummy64_2, FORMAT_64, tile_4->id);
+	  goto height_mismatch;
+      }
+/* checking SRIDs */
+    if ((tile_2 && tile_2->srid != tile_1->srid)
+	|| (tile_3 && tile_3->srid != tile_1->srid)
+	|| (tile_4 && tile_4->srid != tile_1->srid))
+      {
+	  sprintf (dummy64_1, FORMAT_64, tile_1->id);
+	  sprintf (error, "Mismatching SRIDs: Tile ID=%s", dummy64_1);
+	  pyramid_error (ctx, error);
+	  return 0;
+      }
+/* setting up the thumbnail tile MBR aka BBOX */
+    job->srid = tile_1->srid;
+    job->min_x = tile_1->min_x;
+    job->max_y = tile_1->max_y;
+    job->max_x = tile_2 ? tile_2->max_x : tile_1->max_x;
+    job->min_y = tile_3 ? tile_3->min_y : tile_1->min_y;
+    job->width = tile_1->width + (tile_2 ? tile_2->width : 0);
+    job->height = tile_1->height + (tile_3 ? tile_3->height : 0);
+    job->thumb_width = job->width / 2;
+    job->thumb_height = job->height / 2;
+/* the source tiles to be drawn */
+    add_piece (job, tile_1->id, 0, 0, tile_1->width, tile_1->height);
+    if (tile_2)
+	add_piece (job, tile_2->id, job->width - tile_2->width, 0,
+		   tile_2->width, tile_2->height);
+    if (tile_3)
+	add_piece (job, tile_3->id, 0, job->height - tile_3->height,
+		   tile_3->width, tile_3->height);
+    if (tile_4)
+	add_piece (job, tile_4->id, job->width - tile_4->width,
+		   job->height - tile_4->height, tile_4->width,
+		   tile_4->height);
+    return 1;
+
+  width_mismatch:
+    sprintf (error, "Mismatching tile sizes [Width] Tile ID=%s ID=%s",
+	     dummy64_1, dummy64_2);
+    pyramid_error (ctx, error);
+    return 0;
+  height_mismatch:
+    sprintf (error, "Mismatching tile sizes [Height] Tile ID=%s ID=%s",
+	     dummy64_1, dummy64_2);
+    pyramid_error (ctx, error);
+    return 0;
+}
+
+static int
+build_pyramid_level (struct pyramid_context *ctx, int level, double x_size,
+		     double y_size, struct source_item *item)
+{
+/* building a pyramid level; returns the number of thumbnail tiles */
+    sqlite3 *sqlite = ctx->handle->handle;
+    const char *table = ctx->handle->table_prefix;
+    sqlite3_stmt *stmt;
+    int ret;
+    char sql[1024];
+    char sql2[512];
+    char error[1024];
+    sqlite3_int64 id;
+    int srid;
+    double tile_min_x;
+    double tile_min_y;
+    double tile_max_x;
+    double tile_max_y;
+    double source_min_x = DBL_MAX;
+    double source_min_y = DBL_MAX;
+    double source_max_x = -DBL_MAX;
+    double source_max_y = -DBL_MAX;
+    int tile_width;
+    int tile_height;
+    struct tiles_list tiles;
+    struct tile_item *tile_1;
+    struct tile_item *tile_2;
+    struct tile_item *tile_3;
+    struct tile_item *tile_4;
+    double x;
+    double y;
+    int max_tile = 0;
+    int alloc_tile;
+    struct pyramid_job *jobs = NULL;
+
+    init_tiles (&tiles);
+/* retrieving the tiles   */
+    strcpy (sql,
+	    "SELECT id, Srid(geometry), MbrMinX(geometry), MbrMinY(geometry), ");
+    strcat (sql, "MbrMaxX(geometry),  MbrMaxY(geometry), width, height ");
+    sprintf (sql2, "FROM \"%s_metadata\"", table);
+    strcat (sql, sql2);
+    strcat (sql,
+	    " WHERE source_name = ? AND pixel_x_size = ? AND pixel_y_size = ?");
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  pyramid_sql_error (ctx);
+	  return 0;
+      }
+/* binding query params */
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_text (stmt, 1, item->name, strlen (item->name), SQLITE_STATIC);
+    sqlite3_bind_double (stmt, 2, x_size);
+    sqlite3_bind_double (stmt, 3, y_size);
+    while (1)
+      {
+	  /* scrolling the result set */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		/* retrieving query values */
+		id = sqlite3_column_int64 (stmt, 0);
+		srid = sqlite3_column_int (stmt, 1);
+		tile_min_x = sqlite3_column_double (stmt, 2);
+		if (tile_min_x < source_min_x)
+		    source_min_x = tile_min_x;
+		tile_min_y = sqlite3_column_double (stmt, 3);
+		if (tile_min_y < source_min_y)
+		    source_min_y = tile_min_y;
+		tile_max_x = sqlite3_column_double (stmt, 4);
+		if (tile_max_x > source_max_x)
+		    source_max_x = tile_max_x;
+		tile_max_y = sqlite3_column_double (stmt, 5);
+		if (tile_max_y > source_max_y)
+		    source_max_y = tile_max_y;
+		tile_width = sqlite3_column_int (stmt, 6);
+		tile_height = sqlite3_column_int (stmt, 7);
+		add_tile (&tiles, id, srid, tile_min_x, tile_min_y, tile_max_x,
+			  tile_max_y, tile_width, tile_height);
+	    }
+	  else
+	    {
+		pyramid_sql_error (ctx);
+		sqlite3_finalize (stmt);
+		free_tiles (&tiles);
+		return 0;
+	    }
+      }
+    sqlite3_finalize (stmt);
+
+    if (!find_first_tile (&tiles, source_min_x, source_max_y, &x, &y))
+      {
+	  /* error: cannot find the first tile [uppermost, lefmost] */
+	  sprintf (error,
+		   "Error in raster source \"%s\": first tile [uppermost & leftmost] not found",
+		   item->name);
+	  pyramid_error (ctx, error);
+	  goto error;
+      }
+    max_tile = 0;
+    alloc_tile = PYRAMID_JOBS_BLOCK;
+    jobs = malloc (sizeof (struct pyramid_job) * alloc_tile);
+    if (!jobs)
+	goto no_memory;
+    while (1)
+      {
+	  /* grouping the source tiles 4 by 4 */
+	  tile_1 = find_tile (&tiles, x, y, TILE_UPPER_LEFT);
+	  tile_2 = find_tile (&tiles, x, y, TILE_UPPER_RIGHT);
+	  tile_3 = find_tile (&tiles, x, y, TILE_LOWER_LEFT);
+	  tile_4 = find_tile (&tiles, x, y, TILE_LOWER_RIGHT);
+	  if (!tile_1 && !tile_2 && !tile_3 && !tile_4)
+	      break;
+	  if (max_tile == alloc_tile)
+	    {
+		/* growing the list of tiles to be rendered */
+		struct pyramid_job *more =
+		    realloc (jobs, sizeof (struct pyramid_job) * alloc_tile * 2);
+		if (!more)
+		    goto no_memory;
+		jobs = more;
+		alloc_tile *= 2;
+	    }
+	  init_job (jobs + max_tile, max_tile);
+	  if (!plan_level_tile
+	      (ctx, item->name, jobs + max_tile, tile_1, tile_2, tile_3,
+	       tile_4))
+	    {
+		max_tile++;
+		goto error;
+	    }
+	  max_tile++;
+	  /* trying to continue on the same row */
+	  x = DBL_MAX;
+	  y = DBL_MAX;
+	  if (tile_2)
+	    {
+		x = tile_2->max_x;
+		y = tile_2->min_y;
+	    }
+	  else if (tile_4)
+	    {
+		x = tile_4->max_x;
+		y = tile_4->max_y;
+	    }
+	  if (find_tile_right (&tiles, &x, &y))
+	      continue;
+	  x = DBL_MAX;
+	  y = DBL_MAX;
+	  /* trying to continue on the next row */
+	  x = source_min_x;
+	  if (tile_3)
+	      y = tile_3->min_y;
+	  else if (tile_4)
+	      y = tile_4->min_y;
+	  if (find_tile_down (&tiles, &x, &y))
+	      continue;
+	  break;
+      }
+    free_tiles (&tiles);
+
+    ctx->transparent_color = -1;
+    ctx->background_color = true_color (0, 0, 0);
+    ctx->jobs = jobs;
+    ctx->max_job = max_tile;
+    if (ctx->options->test_mode)
+      {
+	  pyramid_report (ctx, item->name, level, 0, max_tile);
+	  free_jobs (jobs, max_tile);
+	  return 1;
+      }
+    ret = store_level (ctx, item->name, level, 0, x_size, y_size);
+    free_jobs (jobs, max_tile);
+    if (ret <= 0)
+	return ret;
+    return max_tile;
+
+  no_memory:
+    pyramid_error (ctx, "insufficient memory");
+  error:
+    free_tiles (&tiles);
+    free_jobs (jobs, max_tile);
+    return 0;
+}
+
+static int
+build_topmost_level (struct pyramid_context *ctx, int level, double x_size,
+		     double y_size)
+{
+/* building a pyramid topmost level; returns the number of tiles */
+    sqlite3 *sqlite = ctx->handle->handle;
+    const char *table = ctx->handle->table_prefix;
+    sqlite3_stmt *stmt;
+    int ret;
+    char sql[1024];
+    char sql2[512];
+    char error[1024];
+    double extent_min_x = DBL_MAX;
+    double extent_min_y = DBL_MAX;
+    double extent_max_x = -DBL_MAX;
+    double extent_max_y = -DBL_MAX;
+    double extent_width;
+    double extent_height;
+    int pixel_width;
+    int pixel_height;
+    int tile_width;
+    int tile_height;
+    int sect;
+    int extra_width;
+    int extra_height;
+    int baseHorz;
+    int baseVert;
+    int maxTile = 0;
+    int tileNo;
+    int eff_tile_width;
+    int eff_tile_height;
+    int tile_size2 = ctx->options->tile_size * 2;
+    double tile_min_x;
+    double tile_min_y;
+    double tile_max_x;
+    double tile_max_y;
+    struct pyramid_job *jobs;
+    struct pyramid_job *job;
+/* cheching the full extent */
+    strcpy (sql, "SELECT Min(MbrMinX(geometry)), Min(MbrMinY(geometry)), ");
+    strcat (sql, "Max(MbrMaxX(geometry)), Max(MbrMaxY(geometry)) ");
+    sprintf (sql2, "FROM \"%s_metadata\"", table);
+    strcat (sql, sql2);
+    strcat (sql, " WHERE pixel_x_size = ? AND pixel_y_size = ?");
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  pyramid_sql_error (ctx);
+	  return 0;
+      }
+/* binding query params */
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_double (stmt, 1, x_size);
+    sqlite3_bind_double (stmt, 2, y_size);
+    while (1)
+      {
+	  /* scrolling the result set */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		/* retrieving query values */
+		extent_min_x = sqlite3_column_double (stmt, 0);
+		extent_min_y = sqlite3_column_double (stmt, 1);
+		extent_max_x = sqlite3_column_double (stmt, 2);
+		extent_max_y = sqlite3_column_double (stmt, 3);
+	    }
+	  else
+	    {
+		pyramid_sql_error (ctx);
+		sqlite3_finalize (stmt);
+		return 0;
+	    }
+      }
+    sqlite3_finalize (stmt);
+/* computing the level total width and height in pixels */
+    extent_width = extent_max_x - extent_min_x;
+    extent_height = extent_max_y - extent_min_y;
+    pixel_width = (int) (extent_width / x_size);
+    if ((double) pixel_width * x_size < extent_width)
+	pixel_width++;
+    pixel_height = (int) (extent_height / y_size);
+    if ((double) pixel_height * y_size < extent_height)
+	pixel_height++;
+    if (pixel_width <= 0 || pixel_height <= 0)
+      {
+	  sprintf (error, "TopMost Level %d: invalid dimension [%d x %d]",
+		   level, pixel_width, pixel_height);
+	  pyramid_error (ctx, error);
+	  return 0;
+      }
+/* computing the tile dims */
+    tile_width = pixel_width;
+    tile_height = pixel_height;
+    sect = 1;
+    while (1)
+      {
+	  if (tile_width > tile_size2 || tile_height > tile_size2)
+	    {
+		sect++;
+		tile_width = pixel_width / sect;
+		tile_height = pixel_height / sect;
+		continue;
+	    }
+	  if ((tile_width * sect) < pixel_width)
+	      tile_width++;
+	  if ((tile_height * sect) < pixel_height)
+	      tile_height++;
+	  break;
+      }
+    extra_width = tile_width * sect;
+    extra_height = tile_height * sect;
+
+/* preparing the list of tiles to be rendered */
+    jobs = malloc (sizeof (struct pyramid_job) * sect * sect);
+    if (!jobs)
+      {
+	  pyramid_error (ctx, "insufficient memory");
+	  return 0;
+      }
+    tile_min_x = extent_min_x;
+    tile_max_y = extent_max_y;
+    tile_min_y = extent_max_y - ((double) tile_height * y_size);
+    if (tile_min_y < extent_min_y)
+	tile_min_y = extent_min_y;
+    baseHorz = 0;
+    baseVert = 0;
+    for (tileNo = 0; tileNo < sect * sect; tileNo++)
+      {
+	  /* sectioning the level into tiles */
+	  if ((baseHorz + tile_width) <= pixel_width)
+	      eff_tile_width = tile_width;
+	  else
+	      eff_tile_width = pixel_width - baseHorz;
+	  if ((baseVert + tile_height) <= pixel_height)
+	      eff_tile_height = tile_height;
+	  else
+	      eff_tile_height = pixel_height - baseVert;
+	  tile_max_x =
+	      extent_min_x + ((double) (baseHorz + eff_tile_width) * x_size);
+	  if (tile_max_x > extent_max_x)
+	      tile_max_x = extent_max_x;
+	  job = jobs + maxTile;
+	  init_job (job, maxTile);
+	  job->width = eff_tile_width;
+	  job->height = eff_tile_height;
+	  job->thumb_width = (eff_tile_width + 1) / 2;
+	  job->thumb_height = (eff_tile_height + 1) / 2;
+	  job->min_x = tile_min_x;
+	  job->min_y = tile_min_y;
+	  job->max_x = tile_max_x;
+	  job->max_y = tile_max_y;
+	  maxTile++;
+	  baseHorz += tile_width;
+	  tile_min_x = tile_max_x;
+	  if (baseHorz >= extra_width)
+	    {
+		baseHorz = 0;
+		baseVert += tile_height;
+		if (baseVert >= extra_height)
+		    break;
+		tile_min_x = extent_min_x;
+		tile_max_y = tile_min_y;
+		tile_min_y =
+		    extent_max_y -
+		    ((double) (baseVert + eff_tile_height) * y_size);
+		if (tile_min_y < extent_min_y)
+		    tile_min_y = extent_min_y;
+	    }
+      }
+
+    ctx->transparent_color = ctx->handle->transparent_color;
+    ctx->background_color = ctx->handle->background_color;
+    ctx->jobs = jobs;
+    ctx->max_job = maxTile;
+    if (ctx->options->test_mode)
+      {
+	  pyramid_report (ctx, NULL, level, 0, maxTile);
+	  free_jobs (jobs, maxTile);
+	  return 1;
+      }
+    ret = store_level (ctx, NULL, level, 1, x_size, y_size);
+    free_jobs (jobs, maxTile);
+    if (ret <= 0)
+	return ret;
+    return maxTile;
+}
+
+static int
+create_raster_pyramids (struct pyramid_context *ctx)
+{
+/* checking if table 'raster_pyramids' exists - if not, we'll create */
+    sqlite3 *sqlite = ctx->handle->handle;
+    int ret;
+    char sql[1024];
+    const char *name;
+    int i;
+    char **results;
+    int rows;
+    int columns;
+    int table_prefix = 0;
+    int pixel_x_size = 0;
+    int pixel_y_size = 0;
+    int tile_count = 0;
+/* checking if already exists */
+    strcpy (sql, "PRAGMA table_info(raster_pyramids)");
+    ret = sqlite3_get_table (sqlite, sql, &results, &rows, &columns, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  pyramid_sql_error (ctx);
+	  return 0;
+      }
+    if (rows < 1)
+	;
+    else
+      {
+	  for (i = 1; i <= rows; i++)
+	    {
+		name = results[(i * columns) + 1];
+		if (name != NULL)
+		  {
+		      if (strcasecmp (name, "table_prefix") == 0)
+			  table_prefix = 1;
+		      if (strcasecmp (name, "pixel_x_size") == 0)
+			  pixel_x_size = 1;
+		      if (strcasecmp (name, "pixel_y_size") == 0)
+			  pixel_y_size = 1;
+		      if (strcasecmp (name, "tile_count") == 0)
+			  tile_count = 1;
+		  }
+	    }
+      }
+    sqlite3_free_table (results);
+    if (table_prefix && pixel_x_size && pixel_y_size && tile_count)
+	return 1;
+    else if (!table_prefix && !pixel_x_size && !pixel_y_size && !tile_count)
+	;
+    else
+      {
+	  pyramid_error (ctx,
+			 "table \"raster_pyramids\" already exists, but has an invalid column layout");
+	  return 0;
+      }
+/* creating the table */
+    strcpy (sql, "CREATE TABLE raster_pyramids (\n");
+    strcat (sql, "table_prefix TEXT NOT NULL,\n");
+    strcat (sql, "pixel_x_size DOUBLE NOT NULL,\n");
+    strcat (sql, "pixel_y_size DOUBLE NOT NULL,\n");
+    strcat (sql, "tile_count INTEGER NOT NULL)");
+    return pyramid_exec (ctx, sql);
+}
+
+static int
+update_raster_pyramids (struct pyramid_context *ctx)
+{
+/* updating the 'raster_pyramids' table and the 'idx_resolution' index */
+    const char *table = ctx->handle->table_prefix;
+    char sql[1024];
+    char sql2[512];
+    sprintf (sql, "DELETE FROM raster_pyramids WHERE table_prefix LIKE '%s'",
+	     table);
+    if (!pyramid_exec (ctx, sql))
+	return 0;
+    strcpy (sql, "INSERT INTO raster_pyramids ");
+    strcat (sql, "(table_prefix, pixel_x_size, pixel_y_size, tile_count) ");
+    sprintf (sql2, "SELECT '%s', pixel_x_size, pixel_y_size, Count(*) ", table);
+    strcat (sql, sql2);
+    sprintf (sql2, "FROM \"%s_metadata\" ", table);
+    strcat (sql, sql2);
+    strcat (sql, "WHERE pixel_x_size > 0 AND pixel_y_size > 0 ");
+    strcat (sql, "GROUP BY pixel_x_size, pixel_y_size");
+    if (!pyramid_exec (ctx, sql))
+	return 0;
+    if (!pyramid_exec (ctx, "DROP INDEX IF EXISTS idx_resolution"))
+	return 0;
+    sprintf (sql, "CREATE INDEX idx_resolution ON \"%s_metadata\" ", table);
+    strcat (sql, " (pixel_x_size, pixel_y_size)");
+    return pyramid_exec (ctx, sql);
+}
+
+static int
+fetch_base_resolution (struct pyramid_context *ctx, int topmost,
+		       double *x_size, double *y_size)
+{
+/*
+/ retrieving the base resolution: the finest one for Pyramid Levels,
+/ or the coarsest not TopMost one for Topmost Levels
+*/
+    sqlite3 *sqlite = ctx->handle->handle;
+    sqlite3_stmt *stmt;
+    int ret;
+    char sql[1024];
+    int found = 0;
+    if (topmost)
+	sprintf (sql,
+		 "SELECT Max(pixel_x_size), Max(pixel_y_size) FROM \"%s_metadata\" WHERE source_name <> 'TopMost' AND ",
+		 ctx->handle->table_prefix);
+    else
+	sprintf (sql,
+		 "SELECT Min(pixel_x_size), Min(pixel_y_size) FROM \"%s_metadata\" WHERE ",
+		 ctx->handle->table_prefix);
+    strcat (sql, "pixel_x_size > 0 AND pixel_y_size > 0");
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  pyramid_sql_error (ctx);
+	  return 0;
+      }
+    while (1)
+      {
+	  /* scrolling the result set */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		/* retrieving query values */
+		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT
+		    && sqlite3_column_type (stmt, 1) == SQLITE_FLOAT)
+		  {
+		      *x_size = sqlite3_column_double (stmt, 0);
+		      *y_size = sqlite3_column_double (stmt, 1);
+		      found = 1;
+		  }
+	    }
+	  else
+	    {
+		pyramid_sql_error (ctx);
+		sqlite3_finalize (stmt);
+		return 0;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (!found)
+      {
+	  pyramid_error (ctx,
+			 "the datasource doesn't seems to contain any raster tile");
+	  return 0;
+      }
+    return 1;
+}
+
+static int
+delete_levels_above (struct pyramid_context *ctx, double x_size,
+		     double y_size)
+{
+/* deleting any already existing tile coarser than the given resolution */
+    sqlite3 *sqlite = ctx->handle->handle;
+    const char *table = ctx->handle->table_prefix;
+    sqlite3_stmt *stmt;
+    int ret;
+    int pass;
+    char sql[1024];
+    char sql2[512];
+    if (!pyramid_exec (ctx, "BEGIN"))
+	return 0;
+    for (pass = 0; pass < 2; pass++)
+      {
+	  if (pass == 0)
+	    {
+		sprintf (sql, "DELETE FROM \"%s_rasters\"", table);
+		sprintf (sql2, " WHERE id IN (SELECT id FROM \"%s_metadata\" ",
+			 table);
+		strcat (sql, sql2);
+		strcat (sql, " WHERE pixel_x_size > ? AND pixel_y_size > ?)");
+	    }
+	  else
+	    {
+		sprintf (sql, "DELETE FROM \"%s_metadata\"", table);
+		strcat (sql, " WHERE pixel_x_size > ? AND pixel_y_size > ?");
+	    }
+	  ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+	  if (ret != SQLITE_OK)
+	      goto error;
+	  /* binding query params */
+	  sqlite3_reset (stmt);
+	  sqlite3_clear_bindings (stmt);
+	  sqlite3_bind_double (stmt, 1, x_size);
+	  sqlite3_bind_double (stmt, 2, y_size);
+	  ret = sqlite3_step (stmt);
+	  sqlite3_finalize (stmt);
+	  if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	      ;
+	  else
+	      goto error;
+      }
+    return pyramid_exec (ctx, "COMMIT");
+  error:
+    pyramid_sql_error (ctx);
+    sqlite3_exec (sqlite, "ROLLBACK", NULL, NULL, NULL);
+    return 0;
+}
+
+static int
+build_levels (struct pyramid_context *ctx)
+{
+/* building the Pyramid Levels for each raster source */
+    sqlite3 *sqlite = ctx->handle->handle;
+    sqlite3_stmt *stmt;
+    int ret;
+    char sql[1024];
+    double x_size;
+    double y_size;
+    struct sources_list sources;
+    struct source_item *item;
+    int level;
+    double new_x_size;
+    double new_y_size;
+    if (!fetch_base_resolution (ctx, 0, &x_size, &y_size))
+	return 0;
+    init_sources (&sources);
+/* identifying the raster sources to be pyramidized */
+    sprintf (sql, "SELECT source_name, Count(*) FROM \"%s_metadata\"",
+	     ctx->handle->table_prefix);
+    strcat (sql, " WHERE pixel_x_size = ? AND pixel_y_size = ?");
+    strcat (sql, " GROUP BY source_name ORDER BY source_name");
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  pyramid_sql_error (ctx);
+	  return 0;
+      }
+/* binding query params */
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_double (stmt, 1, x_size);
+    sqlite3_bind_double (stmt, 2, y_size);
+    while (1)
+      {
+	  /* scrolling the result set */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		/* retrieving query values */
+		add_source (&sources,
+			    (const char *) sqlite3_column_text (stmt, 0),
+			    sqlite3_column_int (stmt, 1));
+	    }
+	  else
+	    {
+		pyramid_sql_error (ctx);
+		sqlite3_finalize (stmt);
+		free_sources (&sources);
+		return 0;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (!(sources.first))
+      {
+	  pyramid_error (ctx, "There is no raster source to be pyramidized");
+	  return 0;
+      }
+
+    if (!(ctx->options->test_mode))
+      {
+	  if (!delete_levels_above (ctx, x_size, y_size))
+	    {
+		free_sources (&sources);
+		return 0;
+	    }
+      }
+    item = sources.first;
+    while (item)
+      {
+	  level = 1;
+	  new_x_size = x_size;
+	  new_y_size = y_size;
+	  while (1)
+	    {
+		ret =
+		    build_pyramid_level (ctx, level, new_x_size, new_y_size,
+					 item);
+		if (ret <= 0)
+		  {
+		      free_sources (&sources);
+		      return ret;
+		  }
+		if (ret <= 1 || ctx->options->test_mode)
+		    break;
+		/* looping on the next level */
+		level++;
+		new_x_size *= 2.0;
+		new_y_size *= 2.0;
+	    }
+	  item = item->next;
+      }
+    free_sources (&sources);
+    return 1;
+}
+
+static int
+build_topmost_levels (struct pyramid_context *ctx)
+{
+/* building the Topmost Levels, merging all raster sources together */
+    double x_size;
+    double y_size;
+    int level = 1;
+    int ret;
+    if (!fetch_base_resolution (ctx, 1, &x_size, &y_size))
+	return 0;
+    if (!(ctx->options->test_mode))
+      {
+	  if (!delete_levels_above (ctx, x_size, y_size))
+	      return 0;
+      }
+    while (1)
+      {
+	  ret = build_topmost_level (ctx, level, x_size, y_size);
+	  if (ret <= 0)
+	      return ret;
+	  if (ret <= 1 || ctx->options->test_mode)
+	      break;
+	  /* looping on the next level */
+	  level++;
+	  x_size *= 2.0;
+	  y_size *= 2.0;
+      }
+    return 1;
+}
+
+static void
+refresh_levels (rasterlitePtr handle)
+{
+/* refreshing the available resolutions on the HANDLE */
+    if (handle->pixel_x_size)
+	free (handle->pixel_x_size);
+    if (handle->pixel_y_size)
+	free (handle->pixel_y_size);
+    if (handle->tile_count)
+	free (handle->tile_count);
+    handle->pixel_x_size = NULL;
+    handle->pixel_y_size = NULL;
+    handle->tile_count = NULL;
+    handle->levels = 0;
+    fetch_resolutions (handle);
+}
+
+RASTERLITE_DECLARE void
+rasterliteInitPyramidOptions (rasterlitePyramidOptionsPtr options)
+{
+/* initializing the pyramid options to their default values */
+    options->mode = RASTERLITE_PYRAMID_ALL;
+    options->image_type = GAIA_JPEG_BLOB;
+    options->quality_factor = 75;
+    options->tile_size = 512;
+    options->threads = 0;
+    options->memory_limit = 256;
+    options->test_mode = 0;
+}
+
+RASTERLITE_DECLARE int
+rasterliteBuildPyramids (void *ext_handle,
+			 const rasterlitePyramidOptions * options,
+			 rasterlitePyramidProgress progress_cb, void *user_data)
+{
+/*
+/ building the Pyramid Levels and/or the Topmost Levels
+/
+/ the HANDLE only needs to be connected to the DB: a datasource lacking
+/ any Pyramid [or even the "raster_pyramids" table] is perfectly valid
+*/
+    rasterlitePtr handle = (rasterlitePtr) ext_handle;
+    struct pyramid_context ctx;
+    rasterlitePyramidOptions defaults;
+    int ret = 1;
+    if (handle == NULL)
+	return RASTERLITE_ERROR;
+    if (handle->handle == NULL)
+      {
+	  /* rasterliteOpen() has already set up the error message */
+	  if (!(handle->last_error))
+	      set_error (handle, "the datasource isn't connected to any DB");
+	  return RASTERLITE_ERROR;
+      }
+    if (options == NULL)
+      {
+	  rasterliteInitPyramidOptions (&defaults);
+	  options = &defaults;
+      }
+    reset_error (handle);
+    ctx.handle = handle;
+    ctx.options = options;
+    ctx.progress = progress_cb;
+    ctx.user_data = user_data;
+    ctx.threads = options->threads;
+#ifdef _WIN32
+    ctx.threads = 1;
+#else
+    if (ctx.threads <= 0)
+	ctx.threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+    if (ctx.threads < 1)
+	ctx.threads = 1;
+    if (ctx.threads > 64)
+	ctx.threads = 64;
+    pthread_mutex_init (&(ctx.mutex), NULL);
+#endif
+    ctx.jobs = NULL;
+    ctx.max_job = 0;
+    ctx.failed = 0;
+    if (!(options->test_mode))
+      {
+	  if (!create_raster_pyramids (&ctx))
+	    {
+		ret = 0;
+		goto end;
+	    }
+      }
+    if (options->mode & RASTERLITE_PYRAMID_LEVELS)
+	ret = build_levels (&ctx);
+    if (ret > 0 && (options->mode & RASTERLITE_PYRAMID_TOPMOST))
+	ret = build_topmost_levels (&ctx);
+    if (!(options->test_mode) && (ret > 0 || ret == PYRAMID_CANCELLED))
+      {
+	  /* the levels completed before cancelling are kept */
+	  if (!update_raster_pyramids (&ctx))
+	      ret = 0;
+      }
+    if (ret == PYRAMID_CANCELLED)
+      {
+	  reset_error (handle);
+	  set_error (handle, "pyramid building cancelled");
+      }
+  end:
+#ifndef _WIN32
+    pthread_mutex_destroy (&(ctx.mutex));
+#endif
+    if (!(options->test_mode) && (ret > 0 || ret == PYRAMID_CANCELLED))
+	refresh_levels (handle);
+    if (ret <= 0)
+	return RASTERLITE_ERROR;
+    return RASTERLITE_OK;
+}
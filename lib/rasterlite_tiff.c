@@ -62,8 +62,13 @@
 
 #include <spatialite/gaiageo.h>
 
+#include "rasterlite.h"
 #include "rasterlite_internals.h"
 
+#define TIFF_STRIP_BYTES	(64 * 1024)
+
+#define TIFF_HEADER_BYTES	4096
+
 struct memfile
 {
 /* a struct emulating a file [memory mapped] */
@@ -71,8 +76,67 @@ struct memfile
     tsize_t size;
     tsize_t eof;
     toff_t current;
+    int growable;		/* the buffer belongs to the memfile itself */
 };
 
+static void
+memfile_create (struct memfile *mem, tsize_t expected)
+{
+/* an empty output memfile, pre-sized for the expected TIFF */
+    mem->buffer = malloc (expected);
+    mem->size = mem->buffer ? expected : 0;
+    mem->eof = 0;
+    mem->current = 0;
+    mem->growable = 1;
+}
+
+static int
+memfile_reserve (struct memfile *mem, toff_t needed)
+{
+/* growing the buffer geometrically; never zero-filled */
+    tsize_t size;
+    unsigned char *buffer;
+    if (needed <= (toff_t) mem->size)
+	return 1;
+    if (!mem->growable)
+	return 0;
+    size = mem->size;
+    if (size < TIFF_HEADER_BYTES)
+	size = TIFF_HEADER_BYTES;
+    while ((toff_t) size < needed)
+	size *= 2;
+    buffer = realloc (mem->buffer, size);
+    if (buffer == NULL)
+	return 0;
+    mem->buffer = buffer;
+    mem->size = size;
+    return 1;
+}
+
+static unsigned char *
+memfile_detach (struct memfile *mem, int *size)
+{
+/* handing the encoded TIFF over to the caller, with no further copy */
+    unsigned char *buffer = mem->buffer;
+    mem->buffer = NULL;
+    *size = 0;
+    if (mem->eof <= 0)
+      {
+	  free (buffer);
+	  return NULL;
+      }
+    if (mem->size - mem->eof > mem->eof / 4)
+      {
+	  /* trimming a largely oversized buffer */
+	  unsigned char *trimmed = realloc (buffer, mem->eof);
+	  if (trimmed)
+	      buffer = trimmed;
+      }
+    *size = mem->eof;
+    return buffer;
+}
+
+
 static tsize_t
 readproc (thandle_t clientdata, tdata_t data, tsize_t size)
 {
@@ -94,8 +158,13 @@ writeproc (thandle_t clientdata, tdata_t data, tsize_t size)
 {
 /* emulating the write()  function */
     struct memfile *mem = clientdata;
-    if ((mem->current + size) >= (toff_t) mem->size)
+    if (!memfile_reserve (mem, mem->current + size))
 	return -1;
+    if (mem->current > (toff_t) mem->eof)
+      {
+	  /* zero-filling the hole left by some seek past the end */
+	  memset (mem->buffer + mem->eof, '\0', mem->current - mem->eof);
+      }
     memcpy (mem->buffer + mem->current, (unsigned char *) data, size);
     mem->current += size;
     if (mem->current > (toff_t) mem->eof)
@@ -106,7 +175,7 @@ writeproc (thandle_t clientdata, tdata_t data, tsize_t size)
 static toff_t
 seekproc (thandle_t clientdata, toff_t offset, int whence)
 {
-/* emulating the lseek()  function */
+/* emulating the lseek()  function [the size only grows when writing] */
     struct memfile *mem = clientdata;
     switch (whence)
       {
@@ -114,23 +183,17 @@ seekproc (thandle_t clientdata, toff_t offset, int whence)
 	  if ((int) (mem->current + offset) < 0)
 	      return (toff_t) - 1;
 	  mem->current += offset;
-	  if ((toff_t) mem->eof < mem->current)
-	      mem->eof = (tsize_t) (mem->current);
 	  break;
       case SEEK_END:
 	  if ((int) (mem->eof + offset) < 0)
 	      return (toff_t) - 1;
 	  mem->current = mem->eof + offset;
-	  if ((toff_t) mem->eof < mem->current)
-	      mem->eof = (tsize_t) (mem->current);
 	  break;
       case SEEK_SET:
       default:
 	  if ((int) offset < 0)
 	      return (toff_t) - 1;
 	  mem->current = offset;
-	  if ((toff_t) mem->eof < mem->current)
-	      mem->eof = (tsize_t) (mem->current);
 	  break;
       };
     return mem->current;
@@ -169,6 +232,79 @@ unmapproc (thandle_t clientdata, tdata_t data, toff_t offset)
     return;
 }
 
+static int
+tiff_compression (int quality)
+{
+/* the TIFF compression packed into the quality factor */
+    int compression;
+    if (quality < 0 || !(quality & RASTERLITE_TIFF_OPTIONS))
+	return COMPRESSION_NONE;
+    switch (quality & RASTERLITE_TIFF_COMPRESSION_MASK)
+      {
+      case RASTERLITE_TIFF_DEFLATE:
+	  compression = COMPRESSION_ADOBE_DEFLATE;
+	  break;
+      case RASTERLITE_TIFF_LZW:
+	  compression = COMPRESSION_LZW;
+	  break;
+      case RASTERLITE_TIFF_ZSTD:
+#ifdef COMPRESSION_ZSTD
+	  compression = COMPRESSION_ZSTD;
+#else
+	  compression = COMPRESSION_ADOBE_DEFLATE;
+#endif
+	  break;
+      default:
+	  return COMPRESSION_NONE;
+      };
+    if (!TIFFIsCODECConfigured ((uint16) compression))
+      {
+	  /* falling back to Deflate, then to no compression at all */
+	  compression = COMPRESSION_ADOBE_DEFLATE;
+	  if (!TIFFIsCODECConfigured ((uint16) compression))
+	      compression = COMPRESSION_NONE;
+      }
+    return compression;
+}
+
+static tsize_t
+tiff_expected_size (const rasterliteImagePtr img, int bits_per_pixel,
+		    int quality)
+{
+/* guessing the TIFF size: headers, strip tables, then the pixels */
+    tsize_t pixels =
+	((((tsize_t) img->sx * bits_per_pixel) + 7) / 8) * (tsize_t) img->sy;
+    if (bits_per_pixel == 1
+	|| tiff_compression (quality) != COMPRESSION_NONE)
+	pixels /= 2;
+    return TIFF_HEADER_BYTES + ((tsize_t) img->sy * 8) + pixels;
+}
+
+static void
+tiff_set_storage (TIFF * out, int quality, int predictor, tsize_t line_bytes,
+		  int height)
+{
+/* setting up the strips layout and compression */
+    int rows;
+    int compression = tiff_compression (quality);
+    TIFFSetField (out, TIFFTAG_COMPRESSION, compression);
+    if (compression == COMPRESSION_NONE)
+      {
+	  /* uncompressed: one row per strip */
+	  TIFFSetField (out, TIFFTAG_ROWSPERSTRIP, 1);
+	  return;
+      }
+    if (predictor && (quality & RASTERLITE_TIFF_PREDICTOR))
+	TIFFSetField (out, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+/* compressed: strips of about TIFF_STRIP_BYTES */
+    rows = TIFF_STRIP_BYTES / line_bytes;
+    if (rows < 1)
+	rows = 1;
+    if (rows > height)
+	rows = height;
+    TIFFSetField (out, TIFFTAG_ROWSPERSTRIP, rows);
+}
+
 extern void *
 image_to_tiff_fax4 (const rasterliteImagePtr img, int *size)
 {
@@ -188,17 +324,18 @@ image_to_tiff_fax4 (const rasterliteImagePtr img, int *size)
     int pixel;
     unsigned char byte;
     int pos;
-    clientdata.buffer = malloc (1024 * 1024);
-    memset (clientdata.buffer, '\0', 1024 * 1024);
-    clientdata.size = 1024 * 1024;
-    clientdata.eof = 0;
-    clientdata.current = 0;
+    RASTERLITE_PROBE3 (encode__start, "tiff_fax4", img->sx, img->sy);
+    memfile_create (&clientdata, tiff_expected_size (img, 1, -1));
     *size = 0;
     out =
 	TIFFClientOpen ("tiff", "w", &clientdata, readproc, writeproc, seekproc,
 			closeproc, sizeproc, mapproc, unmapproc);
     if (out == NULL)
-	return NULL;
+      {
+	  free (clientdata.buffer);
+	  RASTERLITE_PROBE2 (encode__done, "tiff_fax4", *size);
+	  return NULL;
+      }
 /* setting up the TIFF headers */
     TIFFSetField (out, TIFFTAG_SUBFILETYPE, 0);
     TIFFSetField (out, TIFFTAG_IMAGEWIDTH, img->sx);
@@ -288,62 +425,55 @@ image_to_tiff_fax4 (const rasterliteImagePtr img, int *size)
       }
     _TIFFfree (strip);
     TIFFClose (out);
-    if (clientdata.eof > 0)
-      {
-	  tiff_image = malloc (clientdata.eof);
-	  memcpy (tiff_image, clientdata.buffer, clientdata.eof);
-	  *size = clientdata.eof;
-      }
-    free (clientdata.buffer);
+    tiff_image = memfile_detach (&clientdata, size);
+    RASTERLITE_PROBE2 (encode__done, "tiff_fax4", *size);
     return tiff_image;
 }
 
 extern void *
-image_to_tiff_palette (const rasterliteImagePtr img, int *size)
+image_to_tiff_palette (const rasterliteImagePtr img, int *size, int quality)
 {
 /* compressing a palettte image as TIFF  PALETTE */
     unsigned char *tiff_image = NULL;
     TIFF *out;
     int row;
     int col;
-    int extimated_size;
     tsize_t line_bytes;
     uint16 red[256];
     uint16 green[256];
     uint16 blue[256];
-    int mapping[256];
+    struct palette_map mapping;
     int index;
     unsigned char *scanline = NULL;
     unsigned char *line_ptr;
     struct memfile clientdata;
     int pixel;
-    extimated_size = (256 * 1024) + (img->sx * img->sy);
-    clientdata.buffer = malloc (extimated_size);
-    memset (clientdata.buffer, '\0', extimated_size);
-    clientdata.size = extimated_size;
-    clientdata.eof = 0;
-    clientdata.current = 0;
+    RASTERLITE_PROBE3 (encode__start, "tiff_palette", img->sx, img->sy);
+    memfile_create (&clientdata, tiff_expected_size (img, 8, quality));
     *size = 0;
     out =
 	TIFFClientOpen ("tiff", "w", &clientdata, readproc, writeproc, seekproc,
 			closeproc, sizeproc, mapproc, unmapproc);
     if (out == NULL)
-	return NULL;
+      {
+	  free (clientdata.buffer);
+	  RASTERLITE_PROBE2 (encode__done, "tiff_palette", *size);
+	  return NULL;
+      }
 /* bulding the palette */
-    for (col = 0; col < 256; col++)
-	mapping[col] = -1;
+    palette_init (&mapping);
     for (row = 0; row < img->sy; row++)
       {
 	  for (col = 0; col < img->sx; col++)
 	    {
 		pixel = img->pixels[row][col];
-		index = palette_set (mapping, pixel);
+		index = palette_set (&mapping, pixel);
 		img->pixels[row][col] = index;
 	    }
       }
     for (col = 0; col < 256; col++)
       {
-	  if (mapping[col] == -1)
+	  if (mapping.colors[col] == -1)
 	    {
 		red[col] = 0;
 		green[col] = 0;
@@ -351,7 +481,7 @@ image_to_tiff_palette (const rasterliteImagePtr img, int *size)
 	    }
 	  else
 	    {
-		pixel = mapping[col];
+		pixel = mapping.colors[col];
 		red[col] = (uint16) (true_color_get_red (pixel) * 256);
 		green[col] = (uint16) (true_color_get_green (pixel) * 256);
 		blue[col] = (uint16) (true_color_get_blue (pixel) * 256);
@@ -370,11 +500,11 @@ image_to_tiff_palette (const rasterliteImagePtr img, int *size)
     TIFFSetField (out, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
     TIFFSetField (out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_PALETTE);
     TIFFSetField (out, TIFFTAG_COLORMAP, red, green, blue);
-    TIFFSetField (out, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
     TIFFSetField (out, TIFFTAG_SOFTWARE, "SpatiaLite-tools");
-    TIFFSetField (out, TIFFTAG_ROWSPERSTRIP, 1);
-/* allocating the scan-line buffer */
     line_bytes = img->sx;
+/* palette indices: no predictor at all */
+    tiff_set_storage (out, quality, 0, line_bytes, img->sy);
+/* allocating the scan-line buffer */
     scanline = (unsigned char *) _TIFFmalloc (line_bytes);
     for (row = 0; row < img->sy; row++)
       {
@@ -385,42 +515,37 @@ image_to_tiff_palette (const rasterliteImagePtr img, int *size)
       }
     _TIFFfree (scanline);
     TIFFClose (out);
-    if (clientdata.eof > 0)
-      {
-	  tiff_image = malloc (clientdata.eof);
-	  memcpy (tiff_image, clientdata.buffer, clientdata.eof);
-	  *size = clientdata.eof;
-      }
-    free (clientdata.buffer);
+    tiff_image = memfile_detach (&clientdata, size);
+    RASTERLITE_PROBE2 (encode__done, "tiff_palette", *size);
     return tiff_image;
 }
 
 extern void *
-image_to_tiff_grayscale (const rasterliteImagePtr img, int *size)
+image_to_tiff_grayscale (const rasterliteImagePtr img, int *size,
+			 int quality)
 {
 /* compressing a grayscale image as TIFF  GRAYSCALE */
     unsigned char *tiff_image = NULL;
     TIFF *out;
     int row;
     int col;
-    int extimated_size;
     tsize_t line_bytes;
     unsigned char *scanline = NULL;
     unsigned char *line_ptr;
     struct memfile clientdata;
     int pixel;
-    extimated_size = (256 * 1024) + (img->sx * img->sy);
-    clientdata.buffer = malloc (extimated_size);
-    memset (clientdata.buffer, '\0', extimated_size);
-    clientdata.size = extimated_size;
-    clientdata.eof = 0;
-    clientdata.current = 0;
+    RASTERLITE_PROBE3 (encode__start, "tiff_gray", img->sx, img->sy);
+    memfile_create (&clientdata, tiff_expected_size (img, 8, quality));
     *size = 0;
     out =
 	TIFFClientOpen ("tiff", "w", &clientdata, readproc, writeproc, seekproc,
 			closeproc, sizeproc, mapproc, unmapproc);
     if (out == NULL)
-	return NULL;
+      {
+	  free (clientdata.buffer);
+	  RASTERLITE_PROBE2 (encode__done, "tiff_gray", *size);
+	  return NULL;
+      }
 /* setting up the TIFF headers */
     TIFFSetField (out, TIFFTAG_SUBFILETYPE, 0);
     TIFFSetField (out, TIFFTAG_IMAGEWIDTH, img->sx);
@@ -433,11 +558,10 @@ image_to_tiff_grayscale (const rasterliteImagePtr img, int *size)
     TIFFSetField (out, TIFFTAG_YRESOLUTION, 300.0);
     TIFFSetField (out, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
     TIFFSetField (out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-    TIFFSetField (out, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
     TIFFSetField (out, TIFFTAG_SOFTWARE, "SpatiaLite-tools");
-    TIFFSetField (out, TIFFTAG_ROWSPERSTRIP, 1);
-/* allocating the scan-line buffer */
     line_bytes = img->sx;
+    tiff_set_storage (out, quality, 1, line_bytes, img->sy);
+/* allocating the scan-line buffer */
     scanline = (unsigned char *) _TIFFmalloc (line_bytes);
     for (row = 0; row < img->sy; row++)
       {
@@ -451,42 +575,36 @@ image_to_tiff_grayscale (const rasterliteImagePtr img, int *size)
       }
     _TIFFfree (scanline);
     TIFFClose (out);
-    if (clientdata.eof > 0)
-      {
-	  tiff_image = malloc (clientdata.eof);
-	  memcpy (tiff_image, clientdata.buffer, clientdata.eof);
-	  *size = clientdata.eof;
-      }
-    free (clientdata.buffer);
+    tiff_image = memfile_detach (&clientdata, size);
+    RASTERLITE_PROBE2 (encode__done, "tiff_gray", *size);
     return tiff_image;
 }
 
 extern void *
-image_to_tiff_rgb (const rasterliteImagePtr img, int *size)
+image_to_tiff_rgb (const rasterliteImagePtr img, int *size, int quality)
 {
 /* compressing an RGBimage as TIFF  RGB */
     unsigned char *tiff_image = NULL;
     TIFF *out;
     int row;
     int col;
-    int extimated_size;
     tsize_t line_bytes;
     unsigned char *scanline = NULL;
     unsigned char *line_ptr;
     struct memfile clientdata;
     int pixel;
-    extimated_size = (256 * 1024) + (img->sx * img->sy * 3);
-    clientdata.buffer = malloc (extimated_size);
-    memset (clientdata.buffer, '\0', extimated_size);
-    clientdata.size = extimated_size;
-    clientdata.eof = 0;
-    clientdata.current = 0;
+    RASTERLITE_PROBE3 (encode__start, "tiff_rgb", img->sx, img->sy);
+    memfile_create (&clientdata, tiff_expected_size (img, 24, quality));
     *size = 0;
     out =
 	TIFFClientOpen ("tiff", "w", &clientdata, readproc, writeproc, seekproc,
 			closeproc, sizeproc, mapproc, unmapproc);
     if (out == NULL)
-	return NULL;
+      {
+	  free (clientdata.buffer);
+	  RASTERLITE_PROBE2 (encode__done, "tiff_rgb", *size);
+	  return NULL;
+      }
 /* setting up the TIFF headers */
     TIFFSetField (out, TIFFTAG_SUBFILETYPE, 0);
     TIFFSetField (out, TIFFTAG_IMAGEWIDTH, img->sx);
@@ -499,11 +617,10 @@ image_to_tiff_rgb (const rasterliteImagePtr img, int *size)
     TIFFSetField (out, TIFFTAG_YRESOLUTION, 300.0);
     TIFFSetField (out, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
     TIFFSetField (out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-    TIFFSetField (out, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
     TIFFSetField (out, TIFFTAG_SOFTWARE, "SpatiaLite-tools");
-    TIFFSetField (out, TIFFTAG_ROWSPERSTRIP, 1);
-/* allocating the scan-line buffer */
     line_bytes = img->sx * 3;
+    tiff_set_storage (out, quality, 1, line_bytes, img->sy);
+/* allocating the scan-line buffer */
     scanline = (unsigned char *) _TIFFmalloc (line_bytes);
     for (row = 0; row < img->sy; row++)
       {
@@ -519,21 +636,15 @@ image_to_tiff_rgb (const rasterliteImagePtr img, int *size)
       }
     _TIFFfree (scanline);
     TIFFClose (out);
-    if (clientdata.eof > 0)
-      {
-	  tiff_image = malloc (clientdata.eof);
-	  memcpy (tiff_image, clientdata.buffer, clientdata.eof);
-	  *size = clientdata.eof;
-      }
-    free (clientdata.buffer);
+    tiff_image = memfile_detach (&clientdata, size);
+    RASTERLITE_PROBE2 (encode__done, "tiff_rgb", *size);
     return tiff_image;
 }
 
-extern rasterliteImagePtr
-image_from_tiff (int size, const void *data)
+extern int
+image_from_tiff_sink (int size, const void *data, rasterliteTileSinkPtr sink)
 {
-/* uncompressing a TIFF */
-    rasterliteImagePtr img;
+/* uncompressing a TIFF straight into a tile sink */
     uint16 bits_per_sample;
     uint16 samples_per_pixel;
     uint16 photometric;
@@ -542,6 +653,7 @@ image_from_tiff (int size, const void *data)
     uint32 rows_strip = 0;
     uint32 *raster = NULL;
     uint32 *scanline;
+    int *pixels;
     struct memfile clientdata;
     int x;
     int y;
@@ -549,18 +661,20 @@ image_from_tiff (int size, const void *data)
     int strip_no;
     int effective_strip;
     uint32 pixel;
-    int color;
+    int color_space = COLORSPACE_RGB;
     TIFF *in = (TIFF *) 0;
+    RASTERLITE_PROBE2 (decode__start, "tiff", size);
     clientdata.buffer = (unsigned char *) data;
     clientdata.size = size;
     clientdata.eof = size;
     clientdata.current = 0;
+    clientdata.growable = 0;
     in = TIFFClientOpen ("tiff", "r", &clientdata, readproc, writeproc,
 			 seekproc, closeproc, sizeproc, mapproc, unmapproc);
     if (in == NULL)
-	return NULL;
+	goto error;
     if (TIFFIsTiled (in))
-	return NULL;
+	goto error;
 /* retrieving the TIFF dimensions */
     TIFFGetField (in, TIFFTAG_IMAGELENGTH, &height);
     TIFFGetField (in, TIFFTAG_IMAGEWIDTH, &width);
@@ -568,16 +682,27 @@ image_from_tiff (int size, const void *data)
     TIFFGetField (in, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
     TIFFGetField (in, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
     TIFFGetField (in, TIFFTAG_PHOTOMETRIC, &photometric);
-    img = image_create (width, height);
-    raster = malloc (sizeof (uint32) * (width * rows_strip));
     if (bits_per_sample == 1 && samples_per_pixel == 1)
-	img->color_space = COLORSPACE_MONOCHROME;
+	color_space = COLORSPACE_MONOCHROME;
     if (bits_per_sample == 8 && samples_per_pixel == 1 && photometric == 3)
-	img->color_space = COLORSPACE_PALETTE;
+	color_space = COLORSPACE_PALETTE;
     if (bits_per_sample == 8 && samples_per_pixel == 1 && photometric < 2)
-	img->color_space = COLORSPACE_GRAYSCALE;
+	color_space = COLORSPACE_GRAYSCALE;
     if (samples_per_pixel >= 3)
-	img->color_space = COLORSPACE_RGB;
+	color_space = COLORSPACE_RGB;
+    if (!tile_sink_begin (sink, (int) width, (int) height, color_space))
+      {
+	  /* nothing more to decode */
+	  if (sink->status == TILE_SINK_ERROR)
+	      goto error;
+	  TIFFClose (in);
+	  RASTERLITE_PROBE3 (decode__done, "tiff", sink->src_width,
+			     sink->src_height);
+	  return RASTERLITE_OK;
+      }
+    raster = malloc (sizeof (uint32) * (width * rows_strip));
+    if (raster == NULL)
+	goto error;
     for (strip_no = 0; strip_no < (int) height; strip_no += rows_strip)
       {
 	  if (!TIFFReadRGBAStrip (in, strip_no, raster))
@@ -585,29 +710,47 @@ image_from_tiff (int size, const void *data)
 	  effective_strip = rows_strip;
 	  if ((strip_no + rows_strip) > height)
 	      effective_strip = height - strip_no;
-	  for (y = 0; y < effective_strip; y++)
+	  /* the strip comes bottom-up: feeding the sink top-down */
+	  for (img_y = strip_no; img_y < strip_no + effective_strip; img_y++)
 	    {
-		img_y = strip_no + ((effective_strip - y) - 1);
+		y = (effective_strip - (img_y - strip_no)) - 1;
+		pixels = tile_sink_scanline (sink, img_y);
+		if (pixels == NULL)
+		    continue;	/* not reaching the canvas */
 		scanline = raster + (width * y);
 		for (x = 0; x < (int) width; x++)
 		  {
 		      pixel = scanline[x];
-		      color =
+		      pixels[x] =
 			  true_color (TIFFGetR (pixel), TIFFGetG (pixel),
 				      TIFFGetB (pixel));
-		      image_set_pixel (img, x, img_y, color);
 		  }
+		tile_sink_commit (sink, img_y);
 	    }
       }
     TIFFClose (in);
     free (raster);
-    return img;
+    RASTERLITE_PROBE3 (decode__done, "tiff", sink->src_width,
+		       sink->src_height);
+    return RASTERLITE_OK;
 
   error:
-    TIFFClose (in);
-    image_destroy (img);
-    free (raster);
-    return NULL;
+    if (in)
+	TIFFClose (in);
+    if (raster)
+	free (raster);
+    RASTERLITE_PROBE3 (decode__done, "tiff", 0, 0);
+    return RASTERLITE_ERROR;
+}
+
+extern rasterliteImagePtr
+image_from_tiff (int size, const void *data)
+{
+/* uncompressing a TIFF */
+    rasterliteTileSink sink;
+    tile_sink_init (&sink, NULL);
+    return tile_sink_release (&sink,
+			      image_from_tiff_sink (size, data, &sink));
 }
 
 extern int
@@ -662,6 +805,7 @@ write_geotiff (const char *path, const void *raster,
     clientdata.size = size;
     clientdata.eof = size;
     clientdata.current = 0;
+    clientdata.growable = 0;
     in = TIFFClientOpen ("tiff", "r", &clientdata, readproc, writeproc,
 			 seekproc, closeproc, sizeproc, mapproc, unmapproc);
     if (!in)
@@ -0,0 +1,999 @@
+/*
+/ rasterlite_bench.c
+/
+/ a tool replaying raster requests against a SpatiaLite DB
+/ and measuring the rendering latency
+/
+/ version 1.1a, 2011 November 12
+/
+/ Author: Sandro Furieri a.furieri@lqt.it
+/
+/ ------------------------------------------------------------------------------
+/
+/ Version: MPL 1.1/GPL 2.0/LGPL 2.1
+/
+/ The contents of this file are subject to the Mozilla Public License Version
+/ 1.1 (the "License"); you may not use this file except in compliance with
+/ the License. You may obtain a copy of the License at
+/ http://www.mozilla.org/MPL/
+/
+/ Software distributed under the License is distributed on an "AS IS" basis,
+/ WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+/ for the specific language governing rights and limitations under the
+/ License.
+/
+/ The Original Code is the RasterLite library
+/
+/ The Initial Developer of the Original Code is Alessandro Furieri
+/
+/ Portions created by the Initial Developer are Copyright (C) 2009
+/ the Initial Developer. All Rights Reserved.
+/
+/ Alternatively, the contents of this file may be used under the terms of
+/ either the GNU General Public License Version 2 or later (the "GPL"), or
+/ the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+/ in which case the provisions of the GPL or the LGPL are applicable instead
+/ of those above. If you wish to allow use of your version of this file only
+/ under the terms of either the GPL or the LGPL, and not to allow others to
+/ use your version of this file under the terms of the MPL, indicate your
+/ decision by deleting the provisions above and replace them with the notice
+/ and other provisions required by the GPL or the LGPL. If you do not delete
+/ the provisions above, a recipient may use your version of this file under
+/ the terms of any one of the MPL, the GPL or the LGPL.
+/
+*/
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+/* MSVC strictly requires this include [off_t] */
+#include <sys/types.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+#include <time.h>
+#else
+#include <sys/time.h>
+#endif
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#include <tiffio.h>
+
+#ifdef SPATIALITE_AMALGAMATION
+#include <spatialite/sqlite3.h>
+#else
+#include <sqlite3.h>
+#endif
+
+#include <spatialite/gaiaexif.h>
+#include <spatialite/gaiageo.h>
+#include <spatialite.h>
+
+#include "rasterlite.h"
+
+#define ARG_NONE			0
+#define ARG_DB_PATH			1
+#define ARG_TABLE_NAME		2
+#define ARG_WORKLOAD		3
+#define ARG_LOG_PATH		4
+#define ARG_REQUESTS		5
+#define ARG_THREADS			6
+#define ARG_SEED			7
+#define ARG_RASTER_WIDTH	8
+#define ARG_RASTER_HEIGHT	9
+#define ARG_IMAGE_TYPE		10
+#define ARG_QUALITY_FACTOR	11
+
+#define WORKLOAD_RANDOM		1
+#define WORKLOAD_ZOOM		2
+#define WORKLOAD_SEED		3
+#define WORKLOAD_LOG		4
+
+#define BENCH_PHASES		5
+
+#ifdef _WIN32
+#define strcasecmp	_stricmp
+#endif /* not WIN32 */
+
+struct bench_request
+{
+/* a single replayed raster request */
+    double cx;
+    double cy;
+    double pixel_size;
+    int width;
+    int height;
+    int image_type;
+    int ok;
+    double elapsed;
+    double phase_time[BENCH_PHASES];
+    int rows;
+    int tiles;
+    int resized_tiles;
+};
+
+struct bench_job
+{
+/* the whole workload, shared by all the worker threads */
+    struct bench_request *requests;
+    int count;
+    int next;
+    int quality_factor;
+#ifndef _WIN32
+    pthread_mutex_t mutex;
+#endif
+};
+
+struct bench_worker
+{
+/* a worker thread, owning its own RasterLite handle */
+    struct bench_job *job;
+    void *handle;
+#ifndef _WIN32
+    pthread_t thread;
+#endif
+};
+
+struct bench_extent
+{
+/* the datasource extent and finest resolution */
+    double min_x;
+    double min_y;
+    double max_x;
+    double max_y;
+    double min_res;
+};
+
+#ifdef _WIN32
+#define BENCH_LOCK(job)
+#define BENCH_UNLOCK(job)
+#else
+#define BENCH_LOCK(job)	pthread_mutex_lock (&((job)->mutex))
+#define BENCH_UNLOCK(job)	pthread_mutex_unlock (&((job)->mutex))
+#endif
+
+static const char *phase_names[BENCH_PHASES] = {
+    "SQL", "decode", "resample", "composite", "encode"
+};
+
+static double
+bench_clock ()
+{
+/* a wall-clock timestamp, in seconds */
+#if defined(_WIN32) && !defined(__MINGW32__)
+/* MSVC's clock() measures the elapsed wall-clock time */
+    return (double) clock () / (double) CLOCKS_PER_SEC;
+#else
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (double) tv.tv_sec + ((double) tv.tv_usec / 1000000.0);
+#endif
+}
+
+static double
+bench_random (unsigned int *state)
+{
+/*
+/ a deterministic xorshift generator returning [0.0 - 1.0), so that
+/ the same seed always replays the same workload on every platform
+*/
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (double) (x & 0xffffff) / (double) 0x1000000;
+}
+
+static int
+parse_image_type (const char *name)
+{
+/* parsing an image type name */
+    if (strcasecmp (name, "JPEG") == 0)
+	return GAIA_JPEG_BLOB;
+    if (strcasecmp (name, "GIF") == 0)
+	return GAIA_GIF_BLOB;
+    if (strcasecmp (name, "PNG") == 0)
+	return GAIA_PNG_BLOB;
+    if (strcasecmp (name, "TIFF") == 0)
+	return GAIA_TIFF_BLOB;
+    return -1;
+}
+
+static int
+get_extent (void *handle, struct bench_extent *ext)
+{
+/* retrieving the datasource extent and its finest resolution */
+    int levels;
+    int lvl;
+    double x_size;
+    double y_size;
+    int tiles;
+    if (rasterliteGetExtent
+	(handle, &(ext->min_x), &(ext->min_y), &(ext->max_x),
+	 &(ext->max_y)) != RASTERLITE_OK)
+	return 0;
+    levels = rasterliteGetLevels (handle);
+    if (levels <= 0)
+	return 0;
+    ext->min_res = 0.0;
+    for (lvl = 0; lvl < levels; lvl++)
+      {
+	  if (rasterliteGetResolution (handle, lvl, &x_size, &y_size, &tiles)
+	      != RASTERLITE_OK)
+	      continue;
+	  if (ext->min_res == 0.0 || x_size < ext->min_res)
+	      ext->min_res = x_size;
+      }
+    if (ext->min_res <= 0.0 || ext->max_x <= ext->min_x
+	|| ext->max_y <= ext->min_y)
+	return 0;
+    return 1;
+}
+
+static double
+full_view_resolution (struct bench_extent *ext, int width, int height)
+{
+/* the pixel size showing the whole extent in a single request */
+    double res_x = (ext->max_x - ext->min_x) / (double) width;
+    double res_y = (ext->max_y - ext->min_y) / (double) height;
+    double res = (res_x > res_y) ? res_x : res_y;
+    if (res < ext->min_res)
+	res = ext->min_res;
+    return res;
+}
+
+static void
+set_request (struct bench_request *req, double cx, double cy,
+	     double pixel_size, int width, int height, int image_type)
+{
+/* initializing a request */
+    memset (req, 0, sizeof (struct bench_request));
+    req->cx = cx;
+    req->cy = cy;
+    req->pixel_size = pixel_size;
+    req->width = width;
+    req->height = height;
+    req->image_type = image_type;
+}
+
+static void
+random_walk (struct bench_request *requests, int count,
+	     struct bench_extent *ext, int width, int height, int image_type,
+	     unsigned int *seed)
+{
+/*
+/ a panning user: every request moves by up to half a view from the
+/ previous one, and now and then zooms in or out by a factor of two
+*/
+    int i;
+    double max_res = full_view_resolution (ext, width, height);
+    double res = ext->min_res * 4.0;
+    double cx = (ext->min_x + ext->max_x) / 2.0;
+    double cy = (ext->min_y + ext->max_y) / 2.0;
+    double r;
+    if (res > max_res)
+	res = max_res;
+    for (i = 0; i < count; i++)
+      {
+	  r = bench_random (seed);
+	  if (r < 0.1 && res / 2.0 >= ext->min_res)
+	      res /= 2.0;
+	  else if (r > 0.9 && res * 2.0 <= max_res)
+	      res *= 2.0;
+	  cx += (bench_random (seed) - 0.5) * (double) width *res;
+	  cy += (bench_random (seed) - 0.5) * (double) height *res;
+	  if (cx < ext->min_x)
+	      cx = ext->min_x;
+	  if (cx > ext->max_x)
+	      cx = ext->max_x;
+	  if (cy < ext->min_y)
+	      cy = ext->min_y;
+	  if (cy > ext->max_y)
+	      cy = ext->max_y;
+	  set_request (requests + i, cx, cy, res, width, height, image_type);
+      }
+}
+
+static void
+zoom_sweep (struct bench_request *requests, int count,
+	    struct bench_extent *ext, int width, int height, int image_type,
+	    unsigned int *seed)
+{
+/*
+/ zooming from the finest resolution up to the whole extent and back
+/ again, around a random point, in steps of sqrt(2)
+*/
+    int i;
+    double max_res = full_view_resolution (ext, width, height);
+    double res = ext->min_res;
+    double step = sqrt (2.0);
+    double cx = 0.0;
+    double cy = 0.0;
+    int zoom_out = 1;
+    for (i = 0; i < count; i++)
+      {
+	  if (res == ext->min_res)
+	    {
+		/* a new sweep around a new point */
+		cx = ext->min_x + bench_random (seed) * (ext->max_x -
+							 ext->min_x);
+		cy = ext->min_y + bench_random (seed) * (ext->max_y -
+							 ext->min_y);
+	    }
+	  set_request (requests + i, cx, cy, res, width, height, image_type);
+	  if (zoom_out)
+	    {
+		res *= step;
+		if (res >= max_res)
+		  {
+		      res = max_res;
+		      zoom_out = 0;
+		  }
+	    }
+	  else
+	    {
+		res /= step;
+		if (res <= ext->min_res)
+		  {
+		      res = ext->min_res;
+		      zoom_out = 1;
+		  }
+	    }
+      }
+}
+
+static void
+tile_seed (struct bench_request *requests, int count,
+	   struct bench_extent *ext, int width, int height, int image_type)
+{
+/*
+/ seeding a tile cache: the whole extent is covered row by row, starting
+/ from a single tile and halving the pixel size at each level down to
+/ the finest resolution, then starting over again
+*/
+    int i = 0;
+    double res = full_view_resolution (ext, width, height);
+    double max_res = res;
+    double tile_w;
+    double tile_h;
+    double x;
+    double y;
+    while (i < count)
+      {
+	  tile_w = (double) width *res;
+	  tile_h = (double) height *res;
+	  for (y = ext->max_y; y > ext->min_y && i < count; y -= tile_h)
+	    {
+		for (x = ext->min_x; x < ext->max_x && i < count; x += tile_w)
+		  {
+		      set_request (requests + i, x + (tile_w / 2.0),
+				   y - (tile_h / 2.0), res, width, height,
+				   image_type);
+		      i++;
+		  }
+	    }
+	  if (res / 2.0 < ext->min_res)
+	      res = max_res;
+	  else
+	      res /= 2.0;
+      }
+}
+
+static int
+read_log (struct bench_request *requests, int count, const char *log_path,
+	  int width, int height, int image_type)
+{
+/*
+/ replaying a recorded log: same format as rasterlite_tool --batch files
+/ center-x center-y pixel-ratio [width height [JPEG|GIF|PNG|TIFF]] ...
+/ the log is replayed again from the start until count requests are read
+*/
+    FILE *in;
+    char line[8192];
+    char type[32];
+    char *p;
+    int i = 0;
+    int found;
+    int fields;
+    double cx;
+    double cy;
+    double pixel_size;
+    int w;
+    int h;
+    int t;
+    if (strcmp (log_path, "-") == 0)
+	in = stdin;
+    else
+	in = fopen (log_path, "rb");
+    if (!in)
+      {
+	  fprintf (stderr, "cannot open \"%s\"\n", log_path);
+	  return 0;
+      }
+    while (i < count)
+      {
+	  found = 0;
+	  while (i < count && fgets (line, sizeof (line), in))
+	    {
+		p = line;
+		while (*p == ' ' || *p == '\t')
+		    p++;
+		if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+		    continue;
+		w = width;
+		h = height;
+		t = image_type;
+		fields =
+		    sscanf (p, "%lf %lf %lf %d %d %31s", &cx, &cy, &pixel_size,
+			    &w, &h, type);
+		if (fields < 3 || fields == 4 || pixel_size <= 0.0)
+		    continue;
+		if (fields == 6)
+		  {
+		      t = parse_image_type (type);
+		      if (t < 0)
+			  t = image_type;
+		  }
+		if (w < 64 || w > 32768 || h < 64 || h > 32768)
+		    continue;
+		set_request (requests + i, cx, cy, pixel_size, w, h, t);
+		i++;
+		found = 1;
+	    }
+	  if (!found || in == stdin)
+	      break;
+	  rewind (in);
+      }
+    if (in != stdin)
+	fclose (in);
+    return i;
+}
+
+static void *
+bench_worker (void *arg)
+{
+/* a worker replaying requests on its own RasterLite handle */
+    struct bench_worker *worker = (struct bench_worker *) arg;
+    struct bench_job *job = worker->job;
+    struct bench_request *req;
+    rasterliteStats stats;
+    void *raster;
+    int size;
+    double start;
+    int i;
+    while (1)
+      {
+	  /* fetching the next request */
+	  BENCH_LOCK (job);
+	  i = job->next;
+	  job->next += 1;
+	  BENCH_UNLOCK (job);
+	  if (i >= job->count)
+	      break;
+	  req = job->requests + i;
+	  raster = NULL;
+	  start = bench_clock ();
+	  req->ok =
+	      rasterliteGetRaster (worker->handle, req->cx, req->cy,
+				   req->pixel_size, req->width, req->height,
+				   req->image_type, job->quality_factor,
+				   &raster, &size) == RASTERLITE_OK;
+	  req->elapsed = bench_clock () - start;
+	  if (rasterliteGetLastStats (worker->handle, &stats) == RASTERLITE_OK)
+	    {
+		req->phase_time[0] = stats.sql_time;
+		req->phase_time[1] = stats.decode_time;
+		req->phase_time[2] = stats.resample_time;
+		req->phase_time[3] = stats.composite_time;
+		req->phase_time[4] = stats.encode_time;
+		req->rows = stats.rows;
+		req->tiles =
+		    stats.jpeg_tiles + stats.png_tiles + stats.gif_tiles +
+		    stats.tiff_tiles;
+		req->resized_tiles = stats.resized_tiles;
+	    }
+	  if (raster)
+	      free (raster);
+      }
+    return NULL;
+}
+
+static int
+cmp_elapsed (const void *p1, const void *p2)
+{
+/* compares two latencies [for qsort] */
+    double e1 = *((const double *) p1);
+    double e2 = *((const double *) p2);
+    if (e1 < e2)
+	return -1;
+    if (e1 > e2)
+	return 1;
+    return 0;
+}
+
+static double
+percentile (double *sorted, int count, int pct)
+{
+/* the nearest-rank percentile of an already sorted array */
+    int rank = (count * pct + 99) / 100;
+    if (rank < 1)
+	rank = 1;
+    return sorted[rank - 1];
+}
+
+static void
+bench_report (struct bench_job *job, int threads, double wall_clock)
+{
+/* printing the throughput, the latency percentiles and the phase split */
+    int i;
+    int j;
+    int ok = 0;
+    double total = 0.0;
+    double phases = 0.0;
+    double phase_total[BENCH_PHASES];
+    double rows = 0.0;
+    double tiles = 0.0;
+    double resized = 0.0;
+    double *elapsed = malloc (sizeof (double) * (job->count + 1));
+    for (j = 0; j < BENCH_PHASES; j++)
+	phase_total[j] = 0.0;
+    for (i = 0; i < job->count; i++)
+      {
+	  struct bench_request *req = job->requests + i;
+	  if (!(req->ok))
+	      continue;
+	  elapsed[ok] = req->elapsed;
+	  total += req->elapsed;
+	  for (j = 0; j < BENCH_PHASES; j++)
+	    {
+		phase_total[j] += req->phase_time[j];
+		phases += req->phase_time[j];
+	    }
+	  rows += req->rows;
+	  tiles += req->tiles;
+	  resized += req->resized_tiles;
+	  ok++;
+      }
+    printf ("-----------------------------------------------------\n");
+    printf ("Threads:       %d\n", threads);
+    printf ("Requests:      %d rendered, %d failed\n", ok, job->count - ok);
+    printf ("Wall clock:    %1.3f s [%1.2f requests/s]\n", wall_clock,
+	    (wall_clock > 0.0) ? (double) ok / wall_clock : 0.0);
+    if (ok > 0)
+      {
+	  qsort (elapsed, ok, sizeof (double), cmp_elapsed);
+	  printf ("Latency:       avg=%1.3f p50=%1.3f p95=%1.3f ms\n",
+		  (total / (double) ok) * 1000.0,
+		  percentile (elapsed, ok, 50) * 1000.0,
+		  percentile (elapsed, ok, 95) * 1000.0);
+	  printf ("               p99=%1.3f max=%1.3f ms\n",
+		  percentile (elapsed, ok, 99) * 1000.0,
+		  elapsed[ok - 1] * 1000.0);
+	  printf ("Tiles:         %1.1f rows, %1.1f decoded, %1.1f resized\n",
+		  rows / (double) ok, tiles / (double) ok,
+		  resized / (double) ok);
+	  printf ("Breakdown:     [avg ms per request]\n");
+	  for (j = 0; j < BENCH_PHASES; j++)
+	      printf ("   %-10s  %10.3f ms  %5.1f%%\n", phase_names[j],
+		      (phase_total[j] / (double) ok) * 1000.0,
+		      (phases > 0.0) ? (phase_total[j] * 100.0) / phases : 0.0);
+	  printf ("   %-10s  %10.3f ms\n", "other",
+		  ((total - phases) / (double) ok) * 1000.0);
+      }
+    free (elapsed);
+}
+
+static int
+run_bench (struct bench_request *requests, int count, const char *db_path,
+	   const char *table, int threads, int quality_factor)
+{
+/* replaying the whole workload once, using some worker threads */
+    struct bench_job job;
+    struct bench_worker *workers;
+    int started = 0;
+    int failed = 0;
+    int i;
+    double start;
+    job.requests = requests;
+    job.count = count;
+    job.next = 0;
+    job.quality_factor = quality_factor;
+#ifdef _WIN32
+    threads = 1;
+#else
+    pthread_mutex_init (&(job.mutex), NULL);
+#endif
+    if (threads > count)
+	threads = count;
+    if (threads < 1)
+	threads = 1;
+    for (i = 0; i < count; i++)
+      {
+	  requests[i].ok = 0;
+	  requests[i].elapsed = 0.0;
+	  memset (requests[i].phase_time, 0, sizeof (requests[i].phase_time));
+	  requests[i].rows = 0;
+	  requests[i].tiles = 0;
+	  requests[i].resized_tiles = 0;
+      }
+    workers = malloc (sizeof (struct bench_worker) * threads);
+
+/* each worker owns its handle; opening them all up front */
+    for (i = 0; i < threads; i++)
+      {
+	  workers[i].job = &job;
+	  workers[i].handle = rasterliteOpen (db_path, table);
+	  if (rasterliteIsError (workers[i].handle))
+	    {
+		printf ("error: %s\n", rasterliteGetLastError (workers[i].handle));
+		rasterliteClose (workers[i].handle);
+		threads = i;
+		break;
+	    }
+      }
+/* the workers keep all the CPUs busy: each image is encoded serially */
+    rasterliteSetEncoderThreads ((threads > 1) ? 1 : 0);
+    start = bench_clock ();
+    if (threads > 1)
+      {
+#ifndef _WIN32
+	  for (i = 0; i < threads; i++)
+	    {
+		if (pthread_create
+		    (&(workers[i].thread), NULL, bench_worker,
+		     workers + i) == 0)
+		    started++;
+		else
+		    break;
+	    }
+	  if (!started)
+	    {
+		/* falling back to serial replaying */
+		bench_worker (workers);
+		started = 1;
+	    }
+	  else
+	    {
+		for (i = 0; i < started; i++)
+		    pthread_join (workers[i].thread, NULL);
+	    }
+#endif
+      }
+    else if (threads == 1)
+      {
+	  bench_worker (workers);
+	  started = 1;
+      }
+    if (threads > 0)
+	bench_report (&job, started, bench_clock () - start);
+    for (i = 0; i < threads; i++)
+	rasterliteClose (workers[i].handle);
+    for (i = 0; i < count; i++)
+      {
+	  if (!(requests[i].ok))
+	      failed = 1;
+      }
+    free (workers);
+#ifndef _WIN32
+    pthread_mutex_destroy (&(job.mutex));
+#endif
+    if (threads == 0)
+	return 1;
+    return failed;
+}
+
+static void
+do_help ()
+{
+/* printing the argument list */
+    fprintf (stderr, "\n\nusage: rasterlite_bench ARGLIST\n");
+    fprintf (stderr,
+	     "==============================================================\n");
+    fprintf (stderr,
+	     "-? or --help                      print this help message\n");
+    fprintf (stderr,
+	     "-d or --db-path     pathname      the SpatiaLite db path\n");
+    fprintf (stderr, "-T or --table-name  name          DB table name\n");
+    fprintf (stderr,
+	     "-w or --workload    type          [RANDOM|ZOOM|SEED|LOG]\n");
+    fprintf (stderr,
+	     "-l or --log         pathname      a recorded requests log [- = stdin]\n");
+    fprintf (stderr,
+	     "-r or --requests    num           [default = 1000]\n");
+    fprintf (stderr,
+	     "-n or --threads     num           [default = one per CPU]\n");
+    fprintf (stderr, "-s or --seed        num           [default = 1]\n");
+    fprintf (stderr, "-W or --width       num           [default = 256]\n");
+    fprintf (stderr, "-H or --height      num           [default = 256]\n");
+    fprintf (stderr,
+	     "-i or --image-type  type          [JPEG|GIF|PNG|TIFF]\n");
+    fprintf (stderr,
+	     "-q or --quality     num           [default = 75(JPEG)]\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+/* the MAIN function simply perform arguments checking */
+    int i;
+    int next_arg = ARG_NONE;
+    const char *db_path = NULL;
+    const char *table = NULL;
+    const char *log_path = NULL;
+    const char *workload_name = "RANDOM";
+    int workload = WORKLOAD_RANDOM;
+    int count = 1000;
+    int threads = 1;
+    unsigned int seed = 1;
+    unsigned int state;
+    int width = 256;
+    int height = 256;
+    int quality_factor = -999999;
+    int image_type = GAIA_PNG_BLOB;
+    int error = 0;
+    int ret;
+    void *handle;
+    struct bench_extent ext;
+    struct bench_request *requests;
+#ifndef _WIN32
+    threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+    for (i = 1; i < argc; i++)
+      {
+	  /* parsing the invocation arguments */
+	  if (next_arg != ARG_NONE)
+	    {
+		switch (next_arg)
+		  {
+		  case ARG_DB_PATH:
+		      db_path = argv[i];
+		      break;
+		  case ARG_TABLE_NAME:
+		      table = argv[i];
+		      break;
+		  case ARG_WORKLOAD:
+		      workload_name = argv[i];
+		      workload = -1;
+		      if (strcasecmp (argv[i], "RANDOM") == 0)
+			  workload = WORKLOAD_RANDOM;
+		      if (strcasecmp (argv[i], "ZOOM") == 0)
+			  workload = WORKLOAD_ZOOM;
+		      if (strcasecmp (argv[i], "SEED") == 0)
+			  workload = WORKLOAD_SEED;
+		      if (strcasecmp (argv[i], "LOG") == 0)
+			  workload = WORKLOAD_LOG;
+		      break;
+		  case ARG_LOG_PATH:
+		      log_path = argv[i];
+		      break;
+		  case ARG_REQUESTS:
+		      count = atoi (argv[i]);
+		      break;
+		  case ARG_THREADS:
+		      threads = atoi (argv[i]);
+		      break;
+		  case ARG_SEED:
+		      seed = (unsigned int) strtoul (argv[i], NULL, 10);
+		      break;
+		  case ARG_RASTER_WIDTH:
+		      width = atoi (argv[i]);
+		      break;
+		  case ARG_RASTER_HEIGHT:
+		      height = atoi (argv[i]);
+		      break;
+		  case ARG_IMAGE_TYPE:
+		      image_type = parse_image_type (argv[i]);
+		      break;
+		  case ARG_QUALITY_FACTOR:
+		      quality_factor = atoi (argv[i]);
+		      break;
+		  };
+		next_arg = ARG_NONE;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--help") == 0
+	      || strcmp (argv[i], "-?") == 0)
+	    {
+		do_help ();
+		return -1;
+	    }
+	  if (strcmp (argv[i], "-d") == 0
+	      || strcasecmp (argv[i], "--db-path") == 0)
+	    {
+		next_arg = ARG_DB_PATH;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-T") == 0
+	      || strcasecmp (argv[i], "--table-name") == 0)
+	    {
+		next_arg = ARG_TABLE_NAME;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-w") == 0
+	      || strcasecmp (argv[i], "--workload") == 0)
+	    {
+		next_arg = ARG_WORKLOAD;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-l") == 0
+	      || strcasecmp (argv[i], "--log") == 0)
+	    {
+		next_arg = ARG_LOG_PATH;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-r") == 0
+	      || strcasecmp (argv[i], "--requests") == 0)
+	    {
+		next_arg = ARG_REQUESTS;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-n") == 0
+	      || strcasecmp (argv[i], "--threads") == 0)
+	    {
+		next_arg = ARG_THREADS;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-s") == 0
+	      || strcasecmp (argv[i], "--seed") == 0)
+	    {
+		next_arg = ARG_SEED;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-W") == 0
+	      || strcasecmp (argv[i], "--width") == 0)
+	    {
+		next_arg = ARG_RASTER_WIDTH;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-H") == 0
+	      || strcasecmp (argv[i], "--height") == 0)
+	    {
+		next_arg = ARG_RASTER_HEIGHT;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-i") == 0
+	      || strcasecmp (argv[i], "--image-type") == 0)
+	    {
+		next_arg = ARG_IMAGE_TYPE;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-q") == 0
+	      || strcasecmp (argv[i], "--quality") == 0)
+	    {
+		next_arg = ARG_QUALITY_FACTOR;
+		continue;
+	    }
+	  fprintf (stderr, "unknown argument: %s\n", argv[i]);
+	  error = 1;
+      }
+    if (error)
+      {
+	  do_help ();
+	  return -1;
+      }
+/* checking the arguments */
+    if (!db_path)
+      {
+	  fprintf (stderr, "did you forget setting the --db-path argument ?\n");
+	  error = 1;
+      }
+    if (!table)
+      {
+	  fprintf (stderr,
+		   "did you forget setting the --table-name argument ?\n");
+	  error = 1;
+      }
+    if (workload < 0)
+      {
+	  fprintf (stderr, "invalid workload: %s\n", workload_name);
+	  error = 1;
+      }
+    if (workload == WORKLOAD_LOG && !log_path)
+      {
+	  fprintf (stderr, "did you forget setting the --log argument ?\n");
+	  error = 1;
+      }
+    if (image_type < 0)
+      {
+	  fprintf (stderr, "invalid image type\n");
+	  error = 1;
+      }
+    if (count < 1)
+      {
+	  fprintf (stderr, "invalid requests count: %d\n", count);
+	  error = 1;
+      }
+    if (width < 64 || width > 32768 || height < 64 || height > 32768)
+      {
+	  fprintf (stderr, "invalid raster dims: %d x %d\n", width, height);
+	  error = 1;
+      }
+    if (error)
+      {
+	  do_help ();
+	  return -1;
+      }
+/* normalizing the quality factor */
+    if (quality_factor == -999999)
+	quality_factor = 75;
+    if (quality_factor < 10)
+	quality_factor = 10;
+    if (quality_factor > 90)
+	quality_factor = 90;
+    if (threads < 1)
+	threads = 1;
+    if (threads > 64)
+	threads = 64;
+    if (seed == 0)
+	seed = 1;
+    state = seed;
+
+/* preparing the workload */
+    handle = rasterliteOpen (db_path, table);
+    if (rasterliteIsError (handle))
+      {
+	  printf ("error: %s\n", rasterliteGetLastError (handle));
+	  rasterliteClose (handle);
+	  return 1;
+      }
+    requests = malloc (sizeof (struct bench_request) * count);
+    if (workload == WORKLOAD_LOG)
+	count = read_log (requests, count, log_path, width, height, image_type);
+    else
+      {
+	  if (!get_extent (handle, &ext))
+	    {
+		printf ("error: unable to get the datasource extent\n");
+		rasterliteClose (handle);
+		free (requests);
+		return 1;
+	    }
+	  if (workload == WORKLOAD_ZOOM)
+	      zoom_sweep (requests, count, &ext, width, height, image_type,
+			  &state);
+	  else if (workload == WORKLOAD_SEED)
+	      tile_seed (requests, count, &ext, width, height, image_type);
+	  else
+	      random_walk (requests, count, &ext, width, height, image_type,
+			   &state);
+      }
+    rasterliteClose (handle);
+    if (count == 0)
+      {
+	  printf ("error: the workload is empty\n");
+	  free (requests);
+	  return 1;
+      }
+
+    printf ("=====================================================\n");
+    printf ("             Benchmark Summary\n");
+    printf ("=====================================================\n");
+    printf ("SpatiaLite DB path: '%s'\n", db_path);
+    printf ("Table prefix: '%s'\n", table);
+    if (workload == WORKLOAD_LOG)
+	printf ("Workload: LOG '%s'\n", log_path);
+    else
+	printf ("Workload: %s seed=%u\n",
+		(workload == WORKLOAD_ZOOM) ? "ZOOM" : (workload ==
+							 WORKLOAD_SEED) ?
+		"SEED" : "RANDOM", seed);
+    printf ("Requests: %d\n", count);
+    printf ("=====================================================\n");
+
+/* replaying first on a single thread, then on all of them */
+    ret = run_bench (requests, count, db_path, table, 1, quality_factor);
+    if (threads > 1)
+	ret |= run_bench (requests, count, db_path, table, threads,
+			  quality_factor);
+    printf ("=====================================================\n");
+    free (requests);
+    return ret;
+}
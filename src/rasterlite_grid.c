@@ -50,7 +50,30 @@
 #include <errno.h>
 #include <sys/types.h>
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
 #include "rasterlite_tiff_hdrs.h"
+#include <tiffio.h>
+#include <zlib.h>
+
+#ifdef SPATIALITE_AMALGAMATION
+#include <spatialite/sqlite3.h>
+#else
+#include <sqlite3.h>
+#endif
+
+#include <spatialite/gaiaexif.h>
+#include <spatialite/gaiageo.h>
+#include <spatialite.h>
+
+#include "rasterlite.h"
+#include "rasterlite_internals.h"
 
 #if defined(_WIN32) && !defined(__MINGW32__)
 #include <io.h>
@@ -76,6 +99,14 @@
 #define ARG_SCALE			11
 #define ARG_AZIMUTH			12
 #define ARG_ALTITUDE		13
+#define ARG_THREADS			14
+#define ARG_DB_PATH			15
+#define ARG_TABLE_NAME		16
+#define ARG_TILE_SIZE		17
+#define ARG_IMAGE_TYPE		18
+#define ARG_QUALITY_FACTOR	19
+#define ARG_TIFF_COMPRESSION	20
+#define ARG_TIFF_TILE_SIZE	21
 
 #define ASCII_GRID	100
 #define FLOAT_GRID	101
@@ -84,6 +115,24 @@
 #define BYTE_ORDER_BIG	1
 #define BYTE_ORDER_LITTLE	2
 
+#define GRID_ROW_OK			0
+#define GRID_ROW_EXCEEDING	1
+#define GRID_ROW_UNMATCHED	2
+
+#define GRID_ROWS_STEP		8
+
+#define COLOR_LUT_MIN_COLORS	16
+#define COLOR_LUT_MAX_SIZE	(1024 * 1024)
+#define COLOR_LUT_MAX_DIGITS	4
+
+#define TIFF_STRIP_BYTES	(64 * 1024)
+
+#define LZW_CLEAR		256
+#define LZW_EOI			257
+#define LZW_FIRST		258
+#define LZW_MAX_CODE	4095
+#define LZW_HASH_SIZE	9001
+
 struct colorTable
 {
 /* a color table value range */
@@ -94,14 +143,93 @@ struct colorTable
     unsigned char blue;
 };
 
-struct triple_scan
+struct color_map
+{
+/* a sorted Color Table, possibly backed by a dense lookup table */
+    struct colorTable *table;
+    int colors;
+    int *lut;
+    double *lut_values;
+    double lut_first;
+    double lut_scale;
+    int lut_size;
+};
+
+struct grid_tile
 {
-/* the 3-scanlines object for Shaded Relief */
+/* a tile [or a TIFF strip] cut out of the current strip of rendered rows */
+    int base_x;
+    int base_y;
+    int width;
+    int height;
+    void *blob;
+    int blob_size;
+};
+
+struct lzw_output
+{
+/* the LZW encoder's output bit stream [MSB first, as TIFF expects] */
+    unsigned char *p;
+    unsigned long bits;
+    int count;
+};
+
+struct grid_sink
+{
+/* where rendered scanlines go: a GeoTIFF file or a RasterLite table */
+    const char *tiff_path;
+    const char *proj4text;
+    int compression;
+    int tiff_tile_size;
+    int rows_per_strip;
+    TIFF *tiff;
+    GTIF *gtif;
+    sqlite3 *handle;
+    const char *table;
+    const char *source_name;
+    int srid;
+    int image_type;
+    int quality_factor;
+    int tile_size;
+    int threads;
+    int width;
+    int height;
+    int rows;
+    double upper_left_x;
+    double upper_left_y;
+    double pixel_size;
+    int tile_height;
+    int tiles_count;
+    struct grid_tile *tiles;
+    unsigned char *strip;
+    int strip_rows;
+    int strip_base;
+    int tile_no;
+    int next_tile;
+    int in_transaction;
+    sqlite3_stmt *stmt_raster;
+    sqlite3_stmt *stmt_meta;
+#ifndef _WIN32
+    pthread_mutex_t mutex;
+#endif
+};
+
+struct shade_band
+{
+/* a band of Grid rows for Shaded Relief, plus one halo row on each side */
     int ncols;
-    double z_factor;
-    double scale_factor;
-    double altitude;
-    double azimuth;
+    int max_rows;
+    int loaded;
+    int first_row;
+    int threads;
+    float *cells;
+    unsigned char *rgb;
+    int *status;
+    double *unmatched;
+    double k_factor;
+    double sin_alt;
+    double x_coeff;
+    double y_coeff;
     int mono_color;
     unsigned char mono_red;
     unsigned char mono_green;
@@ -110,10 +238,55 @@ struct triple_scan
     unsigned char no_red;
     unsigned char no_green;
     unsigned char no_blue;
-    float *row1;
-    float *row2;
-    float *row3;
-    float *current_row;
+    struct color_map *color_map;
+    int next_row;
+#ifndef _WIN32
+    pthread_mutex_t mutex;
+#endif
+};
+struct grid_map
+{
+/* a memory mapped Grid file */
+    unsigned char *base;
+    size_t size;
+    int mapped;
+};
+
+struct grid_block
+{
+/* a block of ASCII Grid rows, parsed in parallel */
+    int max_rows;
+    int rows;
+    int columns;
+    int threads;
+    const char **row_start;
+    const char **row_end;
+    double *values;
+    int *status;
+    double *unmatched;
+    unsigned char *rgb;
+    struct color_map *color_map;
+    double nodata;
+    unsigned char no_red;
+    unsigned char no_green;
+    unsigned char no_blue;
+    int next_row;
+#ifndef _WIN32
+    pthread_mutex_t mutex;
+#endif
+};
+
+#ifdef _WIN32
+#define GRID_LOCK(block)
+#define GRID_UNLOCK(block)
+#else
+#define GRID_LOCK(block)	pthread_mutex_lock (&((block)->mutex))
+#define GRID_UNLOCK(block)	pthread_mutex_unlock (&((block)->mutex))
+#endif
+
+static const double grid_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
 };
 
 static int
@@ -153,15 +326,38 @@ cmp_color_bsearch (const void *p1, const void *p2)
 }
 
 static int
-match_color (struct colorTable *color_table, int colors, double value,
-	     unsigned char *red, unsigned char *green, unsigned char *blue)
+match_color (struct color_map *map, double value, unsigned char *red,
+	     unsigned char *green, unsigned char *blue)
 {
 /* mapping a value into the corresponding color */
     struct colorTable *ret;
     struct colorTable src;
+    if (map->lut)
+      {
+	  /* 
+	     / trying the lookup table first: the value must exactly match
+	     / one of the quantised values the table has been built from
+	   */
+	  double t = value * map->lut_scale - map->lut_first;
+	  if (t > -0.5 && t < (double) (map->lut_size) - 0.5)
+	    {
+		int slot = (int) (t + 0.5);
+		int idx = map->lut[slot];
+		if (map->lut_values[slot] != value)
+		    goto search;
+		if (idx < 0)
+		    return 0;
+		ret = map->table + idx;
+		*red = ret->red;
+		*green = ret->green;
+		*blue = ret->blue;
+		return 1;
+	    }
+      }
+  search:
     src.min = value;
     ret =
-	bsearch (&src, color_table, colors, sizeof (struct colorTable),
+	bsearch (&src, map->table, map->colors, sizeof (struct colorTable),
 		 cmp_color_bsearch);
     if (ret)
       {
@@ -173,406 +369,1312 @@ match_color (struct colorTable *color_table, int colors, double value,
     return 0;
 }
 
-static struct triple_scan *
-triple_alloc (int ncols)
-{
-/* allocating the 3-scanlines object */
-    struct triple_scan *p = malloc (sizeof (struct triple_scan));
-    p->ncols = ncols;
-    p->row1 = malloc (sizeof (float) * ncols);
-    p->row2 = malloc (sizeof (float) * ncols);
-    p->row3 = malloc (sizeof (float) * ncols);
-    p->current_row = p->row1;
-    p->mono_color = 0;
-    p->mono_red = 0;
-    p->mono_green = 0;
-    p->mono_blue = 0;
-    p->no_data_value = 0.0;
-    p->no_red = 0;
-    p->no_green = 0;
-    p->no_blue = 0;
-    p->z_factor = 1.0;
-    p->scale_factor = 1.0;
-    p->altitude = 45.0;
-    p->azimuth = 315.0;
-    return p;
-}
-
-static void
-triple_free (struct triple_scan *p)
-{
-/* freeing the 3-scanlines object */
-    free (p->row1);
-    free (p->row2);
-    free (p->row3);
-    free (p);
-}
-
 static void
-triple_set_no_data (struct triple_scan *p, float no_data_value,
-		    unsigned char no_red, unsigned char no_green,
-		    unsigned char no_blue)
+color_map_domain (struct colorTable *table, int colors, double *lo,
+		  double *hi)
 {
-/* setting NODATA params */
-    p->no_data_value = no_data_value;
-    p->no_red = no_red;
-    p->no_green = no_green;
-    p->no_blue = no_blue;
+/* 
+/ determining the value domain covered by the lookup table:
+/ open-ended first/last intervals [e.g. -99999 / 99999] are 
+/ excluded when the whole range is too wide
+*/
+    int i;
+    double min = table[0].min;
+    double max = table[0].max;
+    double inner_min;
+    double inner_max;
+    for (i = 1; i < colors; i++)
+      {
+	  if (table[i].max > max)
+	      max = table[i].max;
+      }
+    *lo = min;
+    *hi = max;
+    if (max - min < COLOR_LUT_MAX_SIZE)
+	return;
+    inner_min = max;
+    inner_max = min;
+    for (i = 0; i < colors; i++)
+      {
+	  if (table[i].min > min && table[i].min < inner_min)
+	      inner_min = table[i].min;
+	  if (table[i].max > min && table[i].max < inner_min)
+	      inner_min = table[i].max;
+	  if (table[i].min < max && table[i].min > inner_max)
+	      inner_max = table[i].min;
+	  if (table[i].max < max && table[i].max > inner_max)
+	      inner_max = table[i].max;
+      }
+    *lo = inner_min;
+    *hi = inner_max;
 }
 
-static void
-triple_set_monochrome_params (struct triple_scan *p, int mono_color,
-			      unsigned char mono_red, unsigned char mono_green,
-			      unsigned char mono_blue)
+static struct color_map *
+color_map_alloc (struct colorTable *table, int colors)
 {
-/* setting ShadedRelief params */
-    p->mono_color = mono_color;
-    p->mono_red = mono_red;
-    p->mono_green = mono_green;
-    p->mono_blue = mono_blue;
+/* 
+/ creating a Color Map; a dense lookup table is built whenever 
+/ the table's value domain can be quantised into no more than
+/ COLOR_LUT_MAX_SIZE slots, so that integer and fixed-decimal
+/ Grid values are classified by a single indexed load
+/ [very short tables are left to BSEARCH, which is cheaper]
+*/
+    struct color_map *map = malloc (sizeof (struct color_map));
+    struct colorTable *ret;
+    struct colorTable src;
+    double lo;
+    double hi;
+    double first = 0.0;
+    double last = 0.0;
+    double scale = 1.0;
+    int digits;
+    int i;
+    if (!map)
+	return NULL;
+    map->table = table;
+    map->colors = colors;
+    map->lut = NULL;
+    map->lut_values = NULL;
+    map->lut_first = 0.0;
+    map->lut_scale = 1.0;
+    map->lut_size = 0;
+    if (colors < COLOR_LUT_MIN_COLORS)
+	return map;
+    color_map_domain (table, colors, &lo, &hi);
+    if (!(hi >= lo && hi - lo < COLOR_LUT_MAX_SIZE))
+	return map;
+    for (digits = COLOR_LUT_MAX_DIGITS; digits >= 0; digits--)
+      {
+	  /* choosing the finest quantum fitting into the lookup table */
+	  scale = grid_pow10[digits];
+	  first = floor (lo * scale);
+	  last = ceil (hi * scale);
+	  if (fabs (first) > 1e15 || fabs (last) > 1e15)
+	      continue;
+	  if (last - first < COLOR_LUT_MAX_SIZE)
+	      break;
+      }
+    if (digits < 0)
+	return map;
+    map->lut_size = (int) (last - first) + 1;
+    map->lut = malloc (sizeof (int) * map->lut_size);
+    map->lut_values = malloc (sizeof (double) * map->lut_size);
+    if (!map->lut || !map->lut_values)
+      {
+	  /* insufficient memory: falling back to BSEARCH alone */
+	  if (map->lut)
+	      free (map->lut);
+	  if (map->lut_values)
+	      free (map->lut_values);
+	  map->lut = NULL;
+	  map->lut_values = NULL;
+	  map->lut_size = 0;
+	  return map;
+      }
+    map->lut_first = first;
+    map->lut_scale = scale;
+    for (i = 0; i < map->lut_size; i++)
+      {
+	  /* classifying each quantised value exactly as BSEARCH does */
+	  src.min = (first + (double) i) / scale;
+	  map->lut_values[i] = src.min;
+	  ret =
+	      bsearch (&src, table, colors, sizeof (struct colorTable),
+		       cmp_color_bsearch);
+	  map->lut[i] = ret ? (int) (ret - table) : -1;
+      }
+    return map;
 }
 
 static void
-triple_set_shaded_relief_params (struct triple_scan *p, double z, double scale,
-				 double alt, double az)
+color_map_free (struct color_map *map)
 {
-/* setting ShadedRelief params */
-    p->z_factor = z;
-    p->scale_factor = scale;
-    p->altitude = alt;
-    p->azimuth = az;
+/* freeing a Color Map */
+    if (map->lut)
+	free (map->lut);
+    if (map->lut_values)
+	free (map->lut_values);
+    free (map);
 }
 
-static void
-triple_rotate (struct triple_scan *p)
+static int
+grid_db_connect (struct grid_sink *sink, const char *path)
 {
-/* rotating the 3-scanlines */
-    if (p->current_row == p->row1)
-      {
-	  p->current_row = p->row2;
-	  goto zero_init;
+/* trying to connect the SpatiaLite DB */
+    int ret;
+    int metadata = 0;
+    sqlite3_stmt *stmt;
+    spatialite_init (0);
+    printf ("SQLite version: %s\n", sqlite3_libversion ());
+    printf ("SpatiaLite version: %s\n\n", spatialite_version ());
+    ret = sqlite3_open_v2 (path, &(sink->handle), SQLITE_OPEN_READWRITE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("cannot open DB '%s': %s\n", path,
+		  sqlite3_errmsg (sink->handle));
+	  sqlite3_close (sink->handle);
+	  sink->handle = NULL;
+	  return 0;
       }
-    if (p->current_row == p->row2)
+    ret =
+	sqlite3_prepare_v2 (sink->handle, "SELECT CheckSpatialMetaData()", -1,
+			    &stmt, NULL);
+    if (ret == SQLITE_OK)
       {
-	  p->current_row = p->row3;
-	  goto zero_init;
+	  if (sqlite3_step (stmt) == SQLITE_ROW)
+	      metadata = sqlite3_column_int (stmt, 0);
+	  sqlite3_finalize (stmt);
       }
-    p->current_row = p->row1;
-    p->row1 = p->row2;
-    p->row2 = p->row3;
-    p->row3 = p->current_row;
-  zero_init:
-    memset (p->current_row, 0, sizeof (float) * p->ncols);
+    if (metadata > 0)
+	return 1;
+    printf ("DB '%s'\n", path);
+    printf ("doesn't seems to contain valid Spatial Metadata ...\n\n");
+    printf ("Please, run the 'spatialite-init' SQL script \n");
+    printf ("in order to initialize Spatial Metadata\n\n");
+    sqlite3_close (sink->handle);
+    sink->handle = NULL;
+    return 0;
 }
 
-static void
-triple_store_cell (struct triple_scan *p, int icol, float value)
+static int
+grid_db_exec (sqlite3 * handle, const char *sql, const char *what)
 {
-/* storing a cell value into 3-scanlines */
-    if (icol < 0 || icol >= p->ncols)
-	return;
-    *(p->current_row + icol) = value;
+/* executing an SQL statement, reporting any error */
+    char *sql_err = NULL;
+    int ret = sqlite3_exec (handle, sql, NULL, NULL, &sql_err);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("%s error: %s\n", what, sql_err);
+	  sqlite3_free (sql_err);
+	  return 0;
+      }
+    return 1;
 }
 
 static int
-triple_is_valid (struct triple_scan *p)
+grid_db_create_tables (struct grid_sink *sink)
 {
-/* checking for validitity */
-    if (p->current_row == p->row3)
+/* creating the RasterLite tables, unless they already exist */
+    char sql[1024];
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    sprintf (sql,
+	     "SELECT f_geometry_column FROM geometry_columns WHERE "
+	     "Lower(f_table_name) = Lower('%s_metadata')", sink->table);
+    ret =
+	sqlite3_get_table (sink->handle, sql, &results, &rows, &columns, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("SQL error: %s\n", sqlite3_errmsg (sink->handle));
+	  return 0;
+      }
+    sqlite3_free_table (results);
+    if (rows > 0)
 	return 1;
-    return 0;
+
+    printf ("Creating DB table '%s_metadata'\n", sink->table);
+    sprintf (sql, "CREATE TABLE %s_metadata (\n", sink->table);
+    strcat (sql, "id INTEGER NOT NULL PRIMARY KEY,\n");
+    strcat (sql, "source_name TEXT NOT NULL,\n");
+    strcat (sql, "tile_id INTEGER NOT NULL,\n");
+    strcat (sql, "width INTEGER NOT NULL,\n");
+    strcat (sql, "height INTEGER NOT NULL,\n");
+    strcat (sql, "pixel_x_size DOUBLE NOT NULL,\n");
+    strcat (sql, "pixel_y_size DOUBLE NOT NULL)\n");
+    if (!grid_db_exec (sink->handle, sql, "CREATE TABLE metadata"))
+	return 0;
+    sprintf (sql,
+	     "SELECT AddGeometryColumn('%s_metadata', 'geometry', %d, 'POLYGON', 2)",
+	     sink->table, sink->srid);
+    if (!grid_db_exec (sink->handle, sql, "AddGeometryColumn"))
+	return 0;
+    sprintf (sql, "SELECT CreateSpatialIndex('%s_metadata', 'geometry')",
+	     sink->table);
+    if (!grid_db_exec (sink->handle, sql, "CreateSpatialIndex"))
+	return 0;
+
+    printf ("Creating DB table '%s_rasters'\n\n", sink->table);
+    sprintf (sql, "CREATE TABLE %s_rasters (\n", sink->table);
+    strcat (sql, "id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,\n");
+    strcat (sql, "raster BLOB NOT NULL)\n");
+    if (!grid_db_exec (sink->handle, sql, "CREATE TABLE rasters"))
+	return 0;
+
+/* the same priming row rasterlite_load inserts */
+    sprintf (sql, "INSERT INTO \"%s_metadata\" ", sink->table);
+    strcat (sql,
+	    "(id, source_name, tile_id, width, height, pixel_x_size, pixel_y_size, geometry) VALUES (");
+    strcat (sql, "0, 'raster metadata', 0, 0, 0, 0, 0, NULL)");
+    return grid_db_exec (sink->handle, sql, "INSERT INTO metadata");
 }
 
 static void
-triple_shaded_relief (struct triple_scan *p, unsigned char *raster)
+lzw_put_code (struct lzw_output *out, int code, int nbits)
 {
-/* creating a shaded relief scanline */
-    int j;
-    int n;
-    double x;
-    double y;
-    double aspect;
-    double slope;
-    double cang;
-    int gray;
-    float afWin[9];
-    const double degreesToRadians = M_PI / 180.0;
-    const double altRadians = p->altitude * degreesToRadians;
-    const double azRadians = p->azimuth * degreesToRadians;
-    double red;
-    double green;
-    double blue;
-    double alpha;
-    int bContainsNull;
-    unsigned char *p_raster = raster;
-    unsigned char r;
-    unsigned char g;
-    unsigned char b;
+/* appending a variable length code to the output bit stream */
+    out->bits = (out->bits << nbits) | code;
+    out->count += nbits;
+    while (out->count >= 8)
+      {
+	  out->count -= 8;
+	  *(out->p)++ = (unsigned char) (out->bits >> out->count);
+      }
+    out->bits &= (1UL << out->count) - 1;
+}
 
+static unsigned char *
+grid_lzw_encode (const unsigned char *in, int size, int *out_size)
+{
 /*
-/ Move a 3x3 pafWindow over each cell 
-/ (where the cell in question is #4)
-/ 
-/      0 1 2
-/      3 4 5
-/      6 7 8
+/ TIFF flavoured LZW compression
+/
+/ code widths grow from 9 up to 12 bits one code earlier than GIF does
+/ [the "early change" rule libtiff's decoder expects]; a Clear code is
+/ emitted as soon as the string table fills up
 */
-    for (j = 0; j < p->ncols; j++)
-      {
-	  /* Exclude the edges */
-	  if (j == 0 || j == p->ncols - 1)
-	      continue;
-
-	  bContainsNull = 0;
-
-	  afWin[0] = p->row1[j - 1];
-	  afWin[1] = p->row1[j];
-	  afWin[2] = p->row1[j + 1];
-	  afWin[3] = p->row2[j - 1];
-	  afWin[4] = p->row2[j];
-	  afWin[5] = p->row2[j + 1];
-	  afWin[6] = p->row3[j - 1];
-	  afWin[7] = p->row3[j];
-	  afWin[8] = p->row3[j + 1];
-
-	  for (n = 0; n <= 8; n++)
-	    {
-		if (afWin[n] == p->no_data_value)
+    int keys[LZW_HASH_SIZE];
+    short codes[LZW_HASH_SIZE];
+    struct lzw_output out;
+    unsigned char *buf = malloc ((size_t) size * 2 + 64);
+    int nbits = 9;
+    int max_code = 511;
+    int free_ent = LZW_FIRST;
+    int ent;
+    int key;
+    int h;
+    int i;
+    if (!buf)
+	return NULL;
+    out.p = buf;
+    out.bits = 0;
+    out.count = 0;
+    memset (keys, 0xff, sizeof (keys));
+    lzw_put_code (&out, LZW_CLEAR, nbits);
+    if (size > 0)
+      {
+	  ent = in[0];
+	  for (i = 1; i < size; i++)
+	    {
+		key = (ent << 8) | in[i];
+		h = key % LZW_HASH_SIZE;
+		while (keys[h] >= 0)
 		  {
-		      bContainsNull = 1;
-		      break;
+		      if (keys[h] == key)
+			  break;
+		      h++;
+		      if (h == LZW_HASH_SIZE)
+			  h = 0;
 		  }
-	    }
-
-	  if (bContainsNull)
-	    {
-		/* We have nulls so write nullValue and move on */
-		r = p->no_red;
-		g = p->no_green;
-		b = p->no_blue;
-	    }
-	  else
-	    {
-		/* We have a valid 3x3 window. */
-
-		/* ---------------------------------------
-		 * Compute Hillshade
-		 */
-
-		/* First Slope ... */
-		x = p->z_factor * ((afWin[0] + afWin[3] + afWin[3] + afWin[6]) -
-				   (afWin[2] + afWin[5] + afWin[5] +
-				    afWin[8])) / (8.0 * p->scale_factor);
-
-		y = p->z_factor * ((afWin[6] + afWin[7] + afWin[7] + afWin[8]) -
-				   (afWin[0] + afWin[1] + afWin[1] +
-				    afWin[2])) / (8.0 * p->scale_factor);
-
-		slope = M_PI / 2 - atan (sqrt (x * x + y * y));
-
-		/* ... then aspect... */
-		aspect = atan2 (x, y);
-
-		/* ... then the shade value */
-		cang = sin (altRadians) * sin (slope) +
-		    cos (altRadians) * cos (slope) *
-		    cos (azRadians - M_PI / 2 - aspect);
-
-		if (cang <= 0.0)
-		    cang = 1.0;
-		else
-		    cang = 1.0 + (254.0 * cang);
-
-		if (p->mono_color)
+		if (keys[h] == key)
 		  {
-		      /* using the monochrome base color + ALPHA */
-		      alpha = cang / 255.0;
-		      red = (double) (p->mono_red) * alpha;
-		      green = (double) (p->mono_green) * alpha;
-		      blue = (double) (p->mono_blue) * alpha;
-		      if (red < 0.0)
-			  red = 0.0;
-		      if (green < 0.0)
-			  green = 0.0;
-		      if (blue < 0.0)
-			  blue = 0.0;
-		      if (red > 255.0)
-			  red = 255.0;
-		      if (green > 255.0)
-			  green = 255.0;
-		      if (blue > 255.0)
-			  blue = 255.0;
-		      r = (unsigned char) red;
-		      g = (unsigned char) green;
-		      b = (unsigned) blue;
+		      /* the current string is already known */
+		      ent = codes[h];
+		      continue;
 		  }
-		else
+		lzw_put_code (&out, ent, nbits);
+		ent = in[i];
+		keys[h] = key;
+		codes[h] = (short) free_ent++;
+		if (free_ent == LZW_MAX_CODE - 1)
 		  {
-		      /* plain gray-scale */
-		      gray = (int) cang;
-		      r = (unsigned char) gray;
-		      g = (unsigned char) gray;
-		      b = (unsigned) gray;
+		      /* the string table is full: resetting */
+		      memset (keys, 0xff, sizeof (keys));
+		      lzw_put_code (&out, LZW_CLEAR, nbits);
+		      free_ent = LZW_FIRST;
+		      nbits = 9;
+		      max_code = 511;
 		  }
+		else if (free_ent > max_code)
+		  {
+		      nbits++;
+		      max_code = (1 << nbits) - 1;
+		  }
+	    }
+	  lzw_put_code (&out, ent, nbits);
+	  free_ent++;
+	  if (free_ent == LZW_MAX_CODE - 1)
+	    {
+		lzw_put_code (&out, LZW_CLEAR, nbits);
+		nbits = 9;
 	    }
-	  *p_raster++ = r;
-	  *p_raster++ = g;
-	  *p_raster++ = b;
+	  else if (free_ent > max_code)
+	      nbits++;
       }
+    lzw_put_code (&out, LZW_EOI, nbits);
+    if (out.count > 0)
+	*(out.p)++ = (unsigned char) (out.bits << (8 - out.count));
+    *out_size = out.p - buf;
+    return buf;
 }
 
-static int
-triple_shaded_relief_color (struct colorTable *color_table, int colors,
-			    struct triple_scan *p, unsigned char *raster,
-			    int row)
+static void
+grid_tiff_encode (struct grid_sink *sink, struct grid_tile *tile)
 {
-/* creating a shaded relief color scanline */
-    int j;
-    int n;
-    double x;
-    double y;
-    double aspect;
-    double slope;
-    double cang;
-    float afWin[9];
-    const double degreesToRadians = M_PI / 180.0;
-    const double altRadians = p->altitude * degreesToRadians;
-    const double azRadians = p->azimuth * degreesToRadians;
-    double red;
-    double green;
-    double blue;
-    double alpha;
-    double thisValue;
-    int bContainsNull;
-    unsigned char *p_raster = raster;
-    unsigned char r;
-    unsigned char g;
-    unsigned char b;
-
-/*
-/ Move a 3x3 pafWindow over each cell 
-/ (where the cell in question is #4)
-/ 
-/      0 1 2
-/      3 4 5
-/      6 7 8
-*/
-    for (j = 0; j < p->ncols; j++)
+/* copying a TIFF strip [or tile] out of the current strip of rows and compressing it */
+    int y;
+    int i;
+    int chunk_width = tile->width;
+    int chunk_height = tile->height;
+    int row_size;
+    int size;
+    unsigned char *raw;
+    unsigned char *p;
+    uLongf zip_size;
+    tile->blob = NULL;
+    tile->blob_size = 0;
+    if (sink->tiff_tile_size > 0)
+      {
+	  /* TIFF tiles always have the nominal size, padding included */
+	  chunk_width = sink->tiff_tile_size;
+	  chunk_height = sink->tiff_tile_size;
+      }
+    row_size = chunk_width * 3;
+    size = row_size * chunk_height;
+    raw = malloc (size);
+    if (!raw)
+	return;
+    if (chunk_width != tile->width || chunk_height != tile->height)
+	memset (raw, 0, size);
+    for (y = 0; y < tile->height; y++)
+      {
+	  memcpy (raw + ((size_t) y * row_size),
+		  sink->strip +
+		  ((((size_t) (tile->base_y + y) * sink->width) +
+		    tile->base_x) * 3), (size_t) (tile->width) * 3);
+      }
+    if (sink->compression == COMPRESSION_NONE)
       {
-	  /* Exclude the edges */
-	  if (j == 0 || j == p->ncols - 1)
-	      continue;
-
-	  bContainsNull = 0;
-
-	  afWin[0] = p->row1[j - 1];
-	  afWin[1] = p->row1[j];
-	  afWin[2] = p->row1[j + 1];
-	  afWin[3] = p->row2[j - 1];
-	  afWin[4] = p->row2[j];
-	  afWin[5] = p->row2[j + 1];
-	  afWin[6] = p->row3[j - 1];
-	  afWin[7] = p->row3[j];
-	  afWin[8] = p->row3[j + 1];
-
-	  thisValue = afWin[4];
+	  tile->blob = raw;
+	  tile->blob_size = size;
+	  return;
+      }
 
-	  for (n = 0; n <= 8; n++)
+/* applying the horizontal predictor [each sample minus the previous pixel's one] */
+    for (y = 0; y < chunk_height; y++)
+      {
+	  p = raw + ((size_t) y * row_size);
+	  for (i = row_size - 1; i >= 3; i--)
+	      p[i] -= p[i - 3];
+      }
+    if (sink->compression == COMPRESSION_LZW)
+	tile->blob = grid_lzw_encode (raw, size, &(tile->blob_size));
+    else
+      {
+	  zip_size = compressBound (size);
+	  tile->blob = malloc (zip_size);
+	  if (tile->blob
+	      && compress2 (tile->blob, &zip_size, raw, size,
+			    Z_DEFAULT_COMPRESSION) == Z_OK)
+	      tile->blob_size = zip_size;
+	  else if (tile->blob)
 	    {
-		if (afWin[n] == p->no_data_value)
-		  {
-		      bContainsNull = 1;
-		      break;
-		  }
+		free (tile->blob);
+		tile->blob = NULL;
 	    }
+      }
+    free (raw);
+}
 
-	  if (bContainsNull)
+static void
+grid_tile_encode (struct grid_sink *sink, struct grid_tile *tile)
+{
+/* cutting a tile out of the current strip and compressing it */
+    int x;
+    int y;
+    const unsigned char *p;
+    rasterliteImagePtr img;
+    if (!(sink->handle))
+      {
+	  grid_tiff_encode (sink, tile);
+	  return;
+      }
+    img = image_create (tile->width, sink->strip_rows);
+    tile->blob = NULL;
+    tile->blob_size = 0;
+    if (!img)
+	return;
+    for (y = 0; y < sink->strip_rows; y++)
+      {
+	  p = sink->strip + (((size_t) y * sink->width) + tile->base_x) * 3;
+	  for (x = 0; x < tile->width; x++)
 	    {
-		/* We have nulls so write nullValue and move on */
-		r = p->no_red;
-		g = p->no_green;
-		b = p->no_blue;
+		img->pixels[y][x] = true_color (p[0], p[1], p[2]);
+		p += 3;
 	    }
-	  else
-	    {
-		/* We have a valid 3x3 window. */
-
-		/* ---------------------------------------
-		 * Compute Hillshade
-		 */
-
-		/* First Slope ... */
-		x = p->z_factor * ((afWin[0] + afWin[3] + afWin[3] + afWin[6]) -
-				   (afWin[2] + afWin[5] + afWin[5] +
-				    afWin[8])) / (8.0 * p->scale_factor);
-
-		y = p->z_factor * ((afWin[6] + afWin[7] + afWin[7] + afWin[8]) -
-				   (afWin[0] + afWin[1] + afWin[1] +
-				    afWin[2])) / (8.0 * p->scale_factor);
+      }
+    if (sink->image_type == GAIA_PNG_BLOB)
+	tile->blob =
+	    image_to_png_rgb (img, &(tile->blob_size), sink->quality_factor);
+    else if (sink->image_type == GAIA_TIFF_BLOB)
+	tile->blob =
+	    image_to_tiff_rgb (img, &(tile->blob_size), sink->quality_factor);
+    else
+	tile->blob =
+	    image_to_jpeg (img, &(tile->blob_size), sink->quality_factor,
+			   RASTERLITE_JPEG_PROFILE_DEFAULT);
+    image_destroy (img);
+}
 
-		slope = M_PI / 2 - atan (sqrt (x * x + y * y));
+static void *
+grid_tile_worker (void *arg)
+{
+/* a worker compressing tiles of the current strip */
+    struct grid_sink *sink = (struct grid_sink *) arg;
+    int i;
+    while (1)
+      {
+	  /* fetching the next tile */
+	  GRID_LOCK (sink);
+	  i = sink->next_tile;
+	  sink->next_tile += 1;
+	  GRID_UNLOCK (sink);
+	  if (i >= sink->tiles_count)
+	      break;
+	  grid_tile_encode (sink, sink->tiles + i);
+      }
+    return NULL;
+}
 
-		/* ... then aspect... */
-		aspect = atan2 (x, y);
+static void
+grid_tile_encode_all (struct grid_sink *sink)
+{
+/* compressing all the tiles of the current strip, possibly using many threads */
+    int threads = sink->threads;
+    sink->next_tile = 0;
+#ifndef _WIN32
+    if (threads > sink->tiles_count)
+	threads = sink->tiles_count;
+    if (threads > 1)
+      {
+	  pthread_t *workers = malloc (sizeof (pthread_t) * threads);
+	  int started = 0;
+	  int i;
+	  for (i = 0; i < threads; i++)
+	    {
+		if (pthread_create (workers + started, NULL, grid_tile_worker,
+				    sink) == 0)
+		    started++;
+	    }
+	  if (!started)
+	    {
+		/* falling back to serial compression */
+		grid_tile_worker (sink);
+	    }
+	  for (i = 0; i < started; i++)
+	      pthread_join (workers[i], NULL);
+	  free (workers);
+	  return;
+      }
+#endif
+    grid_tile_worker (sink);
+}
 
-		/* ... then the shade value */
-		cang = sin (altRadians) * sin (slope) +
-		    cos (altRadians) * cos (slope) *
-		    cos (azRadians - M_PI / 2 - aspect);
+static int
+grid_tile_insert (struct grid_sink *sink, struct grid_tile *tile)
+{
+/* INSERTing a compressed tile and its metadata into the DB */
+    int ret;
+    unsigned char *blob;
+    int blob_size;
+    double min_x;
+    double max_x;
+    double min_y;
+    double max_y;
+    sqlite3_int64 id_raster;
+    gaiaGeomCollPtr geom;
+    gaiaPolygonPtr polyg;
+    sqlite3_reset (sink->stmt_raster);
+    sqlite3_clear_bindings (sink->stmt_raster);
+    sqlite3_bind_blob (sink->stmt_raster, 1, tile->blob, tile->blob_size,
+		       free);
+    tile->blob = NULL;
+    ret = sqlite3_step (sink->stmt_raster);
+    if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+      {
+	  printf ("sqlite3_step() error: %s\n", sqlite3_errmsg (sink->handle));
+	  return 0;
+      }
+    id_raster = sqlite3_last_insert_rowid (sink->handle);
+
+/* creating a Geometry corresponding to this raster */
+    min_x = sink->upper_left_x + ((double) (tile->base_x) * sink->pixel_size);
+    max_x =
+	sink->upper_left_x +
+	((double) (tile->base_x + tile->width) * sink->pixel_size);
+    max_y = sink->upper_left_y - ((double) (sink->strip_base) * sink->pixel_size);
+    min_y =
+	sink->upper_left_y -
+	((double) (sink->strip_base + sink->strip_rows) * sink->pixel_size);
+    geom = gaiaAllocGeomColl ();
+    geom->Srid = sink->srid;
+    polyg = gaiaAddPolygonToGeomColl (geom, 5, 0);
+    gaiaSetPoint (polyg->Exterior->Coords, 0, min_x, max_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 1, max_x, max_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 2, max_x, min_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 3, min_x, min_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 4, min_x, max_y);
+    gaiaToSpatiaLiteBlobWkb (geom, &blob, &blob_size);
+    gaiaFreeGeomColl (geom);
+
+    sqlite3_reset (sink->stmt_meta);
+    sqlite3_clear_bindings (sink->stmt_meta);
+    sqlite3_bind_int64 (sink->stmt_meta, 1, id_raster);
+    sqlite3_bind_text (sink->stmt_meta, 2, sink->source_name,
+		       strlen (sink->source_name), SQLITE_STATIC);
+    sqlite3_bind_int (sink->stmt_meta, 3, sink->tile_no);
+    sqlite3_bind_int (sink->stmt_meta, 4, tile->width);
+    sqlite3_bind_int (sink->stmt_meta, 5, sink->strip_rows);
+    sqlite3_bind_double (sink->stmt_meta, 6, sink->pixel_size);
+    sqlite3_bind_double (sink->stmt_meta, 7, sink->pixel_size);
+    sqlite3_bind_blob (sink->stmt_meta, 8, blob, blob_size, free);
+    ret = sqlite3_step (sink->stmt_meta);
+    if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+      {
+	  printf ("sqlite3_step() error: %s\n", sqlite3_errmsg (sink->handle));
+	  return 0;
+      }
+    sink->tile_no += 1;
+    return 1;
+}
 
-		if (cang <= 0.0)
-		    cang = 1.0;
+static int
+grid_sink_flush_tiff (struct grid_sink *sink)
+{
+/* compressing the buffered TIFF strips [or tiles], then writing them in order */
+    int i;
+    int ok = 1;
+    tsize_t ret;
+    struct grid_tile *tile;
+    if (sink->tiff_tile_size <= 0)
+      {
+	  /* the last strip of rows may hold fewer TIFF strips */
+	  sink->tiles_count =
+	      (sink->strip_rows + sink->rows_per_strip -
+	       1) / sink->rows_per_strip;
+	  for (i = 0; i < sink->tiles_count; i++)
+	    {
+		tile = sink->tiles + i;
+		tile->height = sink->rows_per_strip;
+		if (tile->base_y + tile->height > sink->strip_rows)
+		    tile->height = sink->strip_rows - tile->base_y;
+	    }
+      }
+    else
+      {
+	  for (i = 0; i < sink->tiles_count; i++)
+	      sink->tiles[i].height = sink->strip_rows;
+      }
+    grid_tile_encode_all (sink);
+    for (i = 0; i < sink->tiles_count; i++)
+      {
+	  tile = sink->tiles + i;
+	  if (ok && !(tile->blob))
+	    {
+		printf ("\tTIFF compression error @ row=%d\n",
+			sink->strip_base + tile->base_y);
+		printf ("An invalid GeoTIFF was generated ... aborting ...\n");
+		ok = 0;
+	    }
+	  if (ok)
+	    {
+		if (sink->tiff_tile_size > 0)
+		    ret =
+			TIFFWriteRawTile (sink->tiff, sink->tile_no, tile->blob,
+					  tile->blob_size);
 		else
-		    cang = 1.0 + (254.0 * cang);
-
-		/* merging the color + ALPHA */
-		if (!match_color (color_table, colors, thisValue, &r, &g, &b))
+		    ret =
+			TIFFWriteRawStrip (sink->tiff, sink->tile_no,
+					   tile->blob, tile->blob_size);
+		if (ret < 0)
 		  {
+		      printf ("\tTIFF write error @ row=%d\n",
+			      sink->strip_base + tile->base_y);
 		      printf
-			  ("Grid row %d: unmatched value %1.8f; color not found\n",
-			   row, thisValue);
-		      return 0;
+			  ("An invalid GeoTIFF was generated ... aborting ...\n");
+		      ok = 0;
 		  }
-		alpha = cang / 255.0;
-		red = (double) r *alpha;
-		green = (double) g *alpha;
-		blue = (double) b *alpha;
-		if (red < 0.0)
-		    red = 0.0;
-		if (green < 0.0)
-		    green = 0.0;
-		if (blue < 0.0)
-		    blue = 0.0;
-		if (red > 255.0)
-		    red = 255.0;
-		if (green > 255.0)
-		    green = 255.0;
-		if (blue > 255.0)
-		    blue = 255.0;
-		r = (unsigned char) red;
-		g = (unsigned char) green;
-		b = (unsigned) blue;
-	    }
-	  *p_raster++ = r;
-	  *p_raster++ = g;
-	  *p_raster++ = b;
+	    }
+	  if (tile->blob)
+	      free (tile->blob);
+	  tile->blob = NULL;
+	  sink->tile_no += 1;
       }
-    return 1;
+    sink->strip_base += sink->strip_rows;
+    sink->strip_rows = 0;
+    return ok;
 }
 
 static int
-parse_hex (const char hi, const char lo)
+grid_sink_flush_strip (struct grid_sink *sink)
 {
-/* parsing an hexedecimal value XX */
-    int hex;
-    switch (hi)
-      {
-	  /* parsing the leftmost byte */
-      case '0':
-	  hex = 0;
-	  break;
-      case '1':
-	  hex = 1 * 16;
+/* tiling the strip of rows buffered so far */
+    int i;
+    int ok = 1;
+    if (sink->strip_rows <= 0)
+	return 1;
+    if (!(sink->handle))
+	return grid_sink_flush_tiff (sink);
+    grid_tile_encode_all (sink);
+    for (i = 0; i < sink->tiles_count; i++)
+      {
+	  struct grid_tile *tile = sink->tiles + i;
+	  if (ok && !(tile->blob))
+	    {
+		printf ("Tile compression error\n");
+		ok = 0;
+	    }
+	  if (ok)
+	      ok = grid_tile_insert (sink, tile);
+	  if (tile->blob)
+	      free (tile->blob);
+	  tile->blob = NULL;
+      }
+    sink->strip_base += sink->strip_rows;
+    sink->strip_rows = 0;
+    return ok;
+}
+
+static int
+grid_sink_open_db (struct grid_sink *sink)
+{
+/* preparing the RasterLite table to receive the rendered tiles */
+    char sql[1024];
+    int tile_width;
+    int tile_height;
+    int sect;
+    int i;
+    int ret;
+
+/* computing the tile dims, exactly as rasterlite_load does */
+    tile_width = sink->width;
+    tile_height = sink->height;
+    sect = 1;
+    while (tile_width > sink->tile_size || tile_height > sink->tile_size)
+      {
+	  sect++;
+	  tile_width = sink->width / sect;
+	  tile_height = sink->height / sect;
+      }
+    if ((tile_width * sect) < sink->width)
+	tile_width++;
+    if ((tile_height * sect) < sink->height)
+	tile_height++;
+    sink->tile_height = tile_height;
+    sink->tiles_count = (sink->width + tile_width - 1) / tile_width;
+    sink->tiles = malloc (sizeof (struct grid_tile) * sink->tiles_count);
+    for (i = 0; i < sink->tiles_count; i++)
+      {
+	  struct grid_tile *tile = sink->tiles + i;
+	  tile->base_x = i * tile_width;
+	  tile->base_y = 0;
+	  tile->width = tile_width;
+	  if (tile->base_x + tile->width > sink->width)
+	      tile->width = sink->width - tile->base_x;
+	  tile->height = 0;
+	  tile->blob = NULL;
+	  tile->blob_size = 0;
+      }
+    sink->strip = malloc ((size_t) tile_height * sink->width * 3);
+    printf ("RequiredTiles:   %d tiles [%dh x %dv]\n",
+	    sink->tiles_count * ((sink->height + tile_height - 1) /
+				   tile_height), tile_width, tile_height);
+
+/* the complete operation is handled as an unique SQL Transaction */
+    if (!grid_db_exec (sink->handle, "BEGIN", "BEGIN TRANSACTION"))
+	return 0;
+    sink->in_transaction = 1;
+    if (!grid_db_create_tables (sink))
+	return 0;
+    sprintf (sql, "INSERT INTO \"%s_rasters\" (id, raster) VALUES (NULL, ?)",
+	     sink->table);
+    ret =
+	sqlite3_prepare_v2 (sink->handle, sql, strlen (sql),
+			    &(sink->stmt_raster), NULL);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("SQL error: %s\n%s\n", sql, sqlite3_errmsg (sink->handle));
+	  return 0;
+      }
+    sprintf (sql, "INSERT INTO \"%s_metadata\" ", sink->table);
+    strcat (sql, "(id, source_name, tile_id, width, height, ");
+    strcat (sql, "pixel_x_size, pixel_y_size, geometry) ");
+    strcat (sql, " VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+    ret =
+	sqlite3_prepare_v2 (sink->handle, sql, strlen (sql),
+			    &(sink->stmt_meta), NULL);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("SQL error: %s\n%s\n", sql, sqlite3_errmsg (sink->handle));
+	  return 0;
+      }
+    return 1;
+}
+
+static void
+grid_sink_tiff_layout (struct grid_sink *sink)
+{
+/* 
+/ laying out the GeoTIFF: rendered rows are buffered until a whole
+/ row of TIFF tiles [or a few TIFF strips per worker thread] is ready
+*/
+    int i;
+    int strips;
+    struct grid_tile *tile;
+    sink->rows_per_strip = TIFF_STRIP_BYTES / (sink->width * 3);
+    if (sink->rows_per_strip < 1)
+	sink->rows_per_strip = 1;
+    if (sink->tiff_tile_size > 0)
+      {
+	  sink->tile_height = sink->tiff_tile_size;
+	  sink->tiles_count =
+	      (sink->width + sink->tiff_tile_size - 1) / sink->tiff_tile_size;
+      }
+    else
+      {
+	  strips = sink->threads * 4;
+	  sink->tile_height = sink->rows_per_strip * strips;
+	  sink->tiles_count = strips;
+      }
+    sink->tiles = malloc (sizeof (struct grid_tile) * sink->tiles_count);
+    for (i = 0; i < sink->tiles_count; i++)
+      {
+	  tile = sink->tiles + i;
+	  if (sink->tiff_tile_size > 0)
+	    {
+		tile->base_x = i * sink->tiff_tile_size;
+		tile->base_y = 0;
+		tile->width = sink->tiff_tile_size;
+		if (tile->base_x + tile->width > sink->width)
+		    tile->width = sink->width - tile->base_x;
+	    }
+	  else
+	    {
+		tile->base_x = 0;
+		tile->base_y = i * sink->rows_per_strip;
+		tile->width = sink->width;
+	    }
+	  tile->height = 0;
+	  tile->blob = NULL;
+	  tile->blob_size = 0;
+      }
+    sink->strip = malloc ((size_t) sink->tile_height * sink->width * 3);
+}
+
+static int
+grid_sink_open (struct grid_sink *sink, int width, int height,
+		double upper_left_x, double upper_left_y, double pixel_size)
+{
+/* preparing the output: a GeoTIFF file or a RasterLite table */
+    double tiepoint[6];
+    double pixsize[3];
+    sink->width = width;
+    sink->height = height;
+    sink->upper_left_x = upper_left_x;
+    sink->upper_left_y = upper_left_y;
+    sink->pixel_size = pixel_size;
+    sink->rows = 0;
+    if (sink->handle)
+	return grid_sink_open_db (sink);
+
+/* creating the GeoTIFF file */
+    grid_sink_tiff_layout (sink);
+    sink->tiff = XTIFFOpen (sink->tiff_path, "w");
+    if (!(sink->tiff))
+      {
+	  printf ("\tCould not open TIFF image '%s'\n", sink->tiff_path);
+	  return 0;
+      }
+    sink->gtif = GTIFNew (sink->tiff);
+    if (!(sink->gtif))
+      {
+	  printf ("\tCould not open GeoTIFF image '%s'\n", sink->tiff_path);
+	  return 0;
+      }
+
+/* writing the TIFF Tags */
+    TIFFSetField (sink->tiff, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField (sink->tiff, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField (sink->tiff, TIFFTAG_COMPRESSION, sink->compression);
+    if (sink->compression != COMPRESSION_NONE)
+	TIFFSetField (sink->tiff, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    TIFFSetField (sink->tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+    if (sink->tiff_tile_size > 0)
+      {
+	  TIFFSetField (sink->tiff, TIFFTAG_TILEWIDTH, sink->tiff_tile_size);
+	  TIFFSetField (sink->tiff, TIFFTAG_TILELENGTH, sink->tiff_tile_size);
+      }
+    else
+	TIFFSetField (sink->tiff, TIFFTAG_ROWSPERSTRIP, sink->rows_per_strip);
+    TIFFSetField (sink->tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField (sink->tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    TIFFSetField (sink->tiff, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField (sink->tiff, TIFFTAG_SAMPLESPERPIXEL, 3);
+
+/* writing the GeoTIFF Tags */
+    pixsize[0] = pixel_size;
+    pixsize[1] = pixel_size;
+    pixsize[2] = 0.0;
+    TIFFSetField (sink->tiff, GTIFF_PIXELSCALE, 3, pixsize);
+    tiepoint[0] = 0.0;
+    tiepoint[1] = 0.0;
+    tiepoint[2] = 0.0;
+    tiepoint[3] = upper_left_x;
+    tiepoint[4] = upper_left_y;
+    tiepoint[5] = 0.0;
+    TIFFSetField (sink->tiff, GTIFF_TIEPOINTS, 6, tiepoint);
+    GTIFSetFromProj4 (sink->gtif, sink->proj4text);
+    GTIFWriteKeys (sink->gtif);
+    return 1;
+}
+
+static int
+grid_sink_write (struct grid_sink *sink, const unsigned char *rgb)
+{
+/* buffering the next rendered RGB scanline into the current strip of tiles */
+    memcpy (sink->strip + ((size_t) (sink->strip_rows) * sink->width * 3), rgb,
+	    (size_t) (sink->width) * 3);
+    sink->strip_rows += 1;
+    sink->rows += 1;
+    if (sink->strip_rows == sink->tile_height || sink->rows == sink->height)
+	return grid_sink_flush_strip (sink);
+    return 1;
+}
+
+static void
+grid_sink_close (struct grid_sink *sink)
+{
+/* finalizing the output; the DB transaction is committed only if complete */
+    if (sink->gtif)
+	GTIFFree (sink->gtif);
+    if (sink->tiff)
+	XTIFFClose (sink->tiff);
+    sink->gtif = NULL;
+    sink->tiff = NULL;
+    if (sink->stmt_raster)
+	sqlite3_finalize (sink->stmt_raster);
+    if (sink->stmt_meta)
+	sqlite3_finalize (sink->stmt_meta);
+    sink->stmt_raster = NULL;
+    sink->stmt_meta = NULL;
+    if (sink->in_transaction)
+      {
+	  if (sink->rows == sink->height
+	      && grid_db_exec (sink->handle, "COMMIT", "COMMIT TRANSACTION"))
+	    {
+		printf ("InsertedTiles:   %d rows in table \"%s_rasters\"\n",
+			sink->tile_no, sink->table);
+		printf ("                 %d rows in table \"%s_metadata\"\n",
+			sink->tile_no, sink->table);
+	    }
+	  else
+	    {
+		/* some error occurred; performing a ROLLBACK */
+		printf
+		    ("\nSome unexpected error occurred: performing a ROLLBACK\n");
+		sqlite3_exec (sink->handle, "ROLLBACK", NULL, NULL, NULL);
+	    }
+	  sink->in_transaction = 0;
+      }
+    if (sink->strip)
+	free (sink->strip);
+    if (sink->tiles)
+	free (sink->tiles);
+    sink->strip = NULL;
+    sink->tiles = NULL;
+}
+
+static void
+grid_sink_init (struct grid_sink *sink)
+{
+/* initializing an output sink [GeoTIFF by default] */
+    memset (sink, 0, sizeof (struct grid_sink));
+    sink->compression = COMPRESSION_NONE;
+    sink->image_type = GAIA_JPEG_BLOB;
+    sink->quality_factor = 75;
+    sink->tile_size = 512;
+    sink->threads = 1;
+#ifndef _WIN32
+    pthread_mutex_init (&(sink->mutex), NULL);
+#endif
+}
+
+static void
+grid_sink_destroy (struct grid_sink *sink)
+{
+/* releasing an output sink */
+    grid_sink_close (sink);
+    if (sink->handle)
+	sqlite3_close (sink->handle);
+    sink->handle = NULL;
+#ifndef _WIN32
+    pthread_mutex_destroy (&(sink->mutex));
+#endif
+}
+
+static struct shade_band *
+shade_band_alloc (int ncols, int nrows, int threads)
+{
+/* allocating a Shaded Relief band [about 8 MB of elevations] */
+    struct shade_band *band = malloc (sizeof (struct shade_band));
+    int max_rows = (8 * 1024 * 1024) / (ncols * (int) sizeof (float));
+    if (max_rows < threads * GRID_ROWS_STEP)
+	max_rows = threads * GRID_ROWS_STEP;
+    if (max_rows > nrows)
+	max_rows = nrows;
+    if (max_rows < 1)
+	max_rows = 1;
+    band->ncols = ncols;
+    band->max_rows = max_rows;
+    band->loaded = 0;
+    band->first_row = 0;
+    band->threads = threads;
+    band->cells = malloc (sizeof (float) * (size_t) (max_rows + 2) * ncols);
+    band->rgb = malloc ((size_t) max_rows * (ncols - 2) * 3);
+    band->status = malloc (sizeof (int) * max_rows);
+    band->unmatched = malloc (sizeof (double) * max_rows);
+    band->k_factor = 1.0 / 8.0;
+    band->sin_alt = 0.0;
+    band->x_coeff = 0.0;
+    band->y_coeff = 0.0;
+    band->mono_color = 0;
+    band->mono_red = 0;
+    band->mono_green = 0;
+    band->mono_blue = 0;
+    band->no_data_value = 0.0;
+    band->no_red = 0;
+    band->no_green = 0;
+    band->no_blue = 0;
+    band->color_map = NULL;
+    band->next_row = 0;
+#ifndef _WIN32
+    pthread_mutex_init (&(band->mutex), NULL);
+#endif
+    return band;
+}
+
+static void
+shade_band_free (struct shade_band *band)
+{
+/* freeing a Shaded Relief band */
+    free (band->cells);
+    free (band->rgb);
+    free (band->status);
+    free (band->unmatched);
+#ifndef _WIN32
+    pthread_mutex_destroy (&(band->mutex));
+#endif
+    free (band);
+}
+
+static void
+shade_band_set_params (struct shade_band *band, double z, double scale,
+		       double alt, double az)
+{
+/* 
+/ setting ShadedRelief params
+/
+/ the classic hillshade formula:
+/   slope = PI/2 - atan(sqrt(x*x + y*y))
+/   aspect = atan2(x, y)
+/   cang = sin(alt) * sin(slope) +
+/          cos(alt) * cos(slope) * cos(az - PI/2 - aspect)
+/ expands to a trig-free expression, once the constant terms are folded:
+/   cang = (sin(alt) + x * cos(alt) * sin(az - PI/2) +
+/           y * cos(alt) * cos(az - PI/2)) / sqrt(1 + x*x + y*y)
+*/
+    const double degreesToRadians = M_PI / 180.0;
+    const double altRadians = alt * degreesToRadians;
+    const double azRadians = az * degreesToRadians - M_PI / 2;
+    band->k_factor = z / (8.0 * scale);
+    band->sin_alt = sin (altRadians);
+    band->x_coeff = cos (altRadians) * sin (azRadians);
+    band->y_coeff = cos (altRadians) * cos (azRadians);
+}
+
+static void
+shade_band_set_monochrome (struct shade_band *band, int mono_color,
+			   unsigned char mono_red, unsigned char mono_green,
+			   unsigned char mono_blue)
+{
+/* setting the monochrome base color */
+    band->mono_color = mono_color;
+    band->mono_red = mono_red;
+    band->mono_green = mono_green;
+    band->mono_blue = mono_blue;
+}
+
+static void
+shade_band_set_no_data (struct shade_band *band, float no_data_value,
+			unsigned char no_red, unsigned char no_green,
+			unsigned char no_blue)
+{
+/* setting NODATA params */
+    band->no_data_value = no_data_value;
+    band->no_red = no_red;
+    band->no_green = no_green;
+    band->no_blue = no_blue;
+}
+
+static float *
+shade_band_next_row (struct shade_band *band)
+{
+/* returning the slot for the next Grid row to be loaded */
+    return band->cells + ((size_t) band->loaded * band->ncols);
+}
+
+static void
+shade_band_compute (const struct shade_band *band, const float *row1,
+		    const float *row2, const float *row3, double *cang)
+{
+/* 
+/ computing the shade values of a whole scanline
+/ [a branch-free loop, which the compiler is free to vectorize]
+/
+/ a 3x3 window moves over each cell (where the cell in question is #4)
+/
+/      0 1 2
+/      3 4 5
+/      6 7 8
+*/
+    int j;
+    const int last = band->ncols - 1;
+    const double k = band->k_factor;
+    const double sin_alt = band->sin_alt;
+    const double x_coeff = band->x_coeff;
+    const double y_coeff = band->y_coeff;
+    for (j = 1; j < last; j++)
+      {
+	  double x = k * ((row1[j - 1] + row2[j - 1] + row2[j - 1] +
+			   row3[j - 1]) - (row1[j + 1] + row2[j + 1] +
+					   row2[j + 1] + row3[j + 1]));
+	  double y = k * ((row3[j - 1] + row3[j] + row3[j] + row3[j + 1]) -
+			  (row1[j - 1] + row1[j] + row1[j] + row1[j + 1]));
+	  cang[j] =
+	      (sin_alt + x * x_coeff + y * y_coeff) / sqrt (1.0 + x * x +
+							    y * y);
+      }
+}
+
+static int
+shade_band_row (struct shade_band *band, int i, double *cang)
+{
+/* creating a shaded relief scanline for the I-th row of the band */
+    int j;
+    int n;
+    int bContainsNull;
+    const int ncols = band->ncols;
+    const float *row1 = band->cells + ((size_t) i * ncols);
+    const float *row2 = row1 + ncols;
+    const float *row3 = row2 + ncols;
+    const float no_data = band->no_data_value;
+    float afWin[9];
+    double shade;
+    double alpha;
+    double red;
+    double green;
+    double blue;
+    unsigned char *p_raster = band->rgb + ((size_t) i * (ncols - 2) * 3);
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+
+    shade_band_compute (band, row1, row2, row3, cang);
+    for (j = 1; j < ncols - 1; j++)
+      {
+	  afWin[0] = row1[j - 1];
+	  afWin[1] = row1[j];
+	  afWin[2] = row1[j + 1];
+	  afWin[3] = row2[j - 1];
+	  afWin[4] = row2[j];
+	  afWin[5] = row2[j + 1];
+	  afWin[6] = row3[j - 1];
+	  afWin[7] = row3[j];
+	  afWin[8] = row3[j + 1];
+	  bContainsNull = 0;
+	  for (n = 0; n <= 8; n++)
+	    {
+		if (afWin[n] == no_data)
+		  {
+		      bContainsNull = 1;
+		      break;
+		  }
+	    }
+	  if (bContainsNull)
+	    {
+		/* We have nulls so write nullValue and move on */
+		*p_raster++ = band->no_red;
+		*p_raster++ = band->no_green;
+		*p_raster++ = band->no_blue;
+		continue;
+	    }
+	  shade = cang[j];
+	  if (shade <= 0.0)
+	      shade = 1.0;
+	  else
+	      shade = 1.0 + (254.0 * shade);
+	  if (band->color_map)
+	    {
+		/* merging the color + ALPHA */
+		if (!match_color (band->color_map, afWin[4], &r, &g, &b))
+		  {
+		      band->status[i] = GRID_ROW_UNMATCHED;
+		      band->unmatched[i] = afWin[4];
+		      return 0;
+		  }
+	    }
+	  else if (band->mono_color)
+	    {
+		/* using the monochrome base color + ALPHA */
+		r = band->mono_red;
+		g = band->mono_green;
+		b = band->mono_blue;
+	    }
+	  else
+	    {
+		/* plain gray-scale */
+		r = (unsigned char) shade;
+		*p_raster++ = r;
+		*p_raster++ = r;
+		*p_raster++ = r;
+		continue;
+	    }
+	  alpha = shade / 255.0;
+	  red = (double) r *alpha;
+	  green = (double) g *alpha;
+	  blue = (double) b *alpha;
+	  if (red > 255.0)
+	      red = 255.0;
+	  if (green > 255.0)
+	      green = 255.0;
+	  if (blue > 255.0)
+	      blue = 255.0;
+	  *p_raster++ = (unsigned char) red;
+	  *p_raster++ = (unsigned char) green;
+	  *p_raster++ = (unsigned char) blue;
+      }
+    band->status[i] = GRID_ROW_OK;
+    return 1;
+}
+
+static void *
+shade_band_worker (void *arg)
+{
+/* a worker shading rows of the current band */
+    struct shade_band *band = (struct shade_band *) arg;
+    double *cang = malloc (sizeof (double) * band->ncols);
+    int rows = band->loaded - 2;
+    int first;
+    int last;
+    int i;
+    while (1)
+      {
+	  /* fetching the next bunch of rows */
+	  GRID_LOCK (band);
+	  first = band->next_row;
+	  band->next_row += GRID_ROWS_STEP;
+	  GRID_UNLOCK (band);
+	  if (first >= rows)
+	      break;
+	  last = first + GRID_ROWS_STEP;
+	  if (last > rows)
+	      last = rows;
+	  for (i = first; i < last; i++)
+	      shade_band_row (band, i, cang);
+      }
+    free (cang);
+    return NULL;
+}
+
+static void
+shade_band_render (struct shade_band *band)
+{
+/* shading all the rows of the current band, possibly using many threads */
+    int threads = band->threads;
+    int rows = band->loaded - 2;
+    band->next_row = 0;
+#ifndef _WIN32
+    if (threads > (rows + GRID_ROWS_STEP - 1) / GRID_ROWS_STEP)
+	threads = (rows + GRID_ROWS_STEP - 1) / GRID_ROWS_STEP;
+    if (threads > 1)
+      {
+	  pthread_t *workers = malloc (sizeof (pthread_t) * threads);
+	  int started = 0;
+	  int i;
+	  for (i = 0; i < threads; i++)
+	    {
+		if (pthread_create (workers + started, NULL, shade_band_worker,
+				    band) == 0)
+		    started++;
+	    }
+	  if (!started)
+	    {
+		/* falling back to serial shading */
+		shade_band_worker (band);
+	    }
+	  for (i = 0; i < started; i++)
+	      pthread_join (workers[i], NULL);
+	  free (workers);
+	  return;
+      }
+#endif
+    shade_band_worker (band);
+}
+
+static int
+shade_band_flush (struct shade_band *band, struct grid_sink *sink, int nrows,
+		  int verbose)
+{
+/* 
+/ shading the rows currently loaded into the band and writing them
+/ in order; the last two rows are then kept as the next band's halo
+*/
+    int rows = band->loaded - 2;
+    int i;
+    int row;
+    unsigned char *raster;
+    if (rows <= 0)
+	return 1;
+    shade_band_render (band);
+    for (i = 0; i < rows; i++)
+      {
+	  /* the centre row of the I-th window */
+	  row = band->first_row + i + 1;
+	  if (verbose)
+	    {
+		fprintf (stderr, "writing scanline %d of %d\n", row + 1, nrows);
+		fflush (stderr);
+	    }
+	  if (band->status[i] == GRID_ROW_UNMATCHED)
+	    {
+		printf ("Grid row %d: unmatched value %1.8f; color not found\n",
+			row + 1, band->unmatched[i]);
+		return 0;
+	    }
+	  raster = band->rgb + ((size_t) i * (band->ncols - 2) * 3);
+	  if (!grid_sink_write (sink, raster))
+	      return 0;
+      }
+    memmove (band->cells, band->cells + ((size_t) rows * band->ncols),
+	     sizeof (float) * 2 * band->ncols);
+    band->first_row += rows;
+    band->loaded = 2;
+    return 1;
+}
+static int
+parse_hex (const char hi, const char lo)
+{
+/* parsing an hexedecimal value XX */
+    int hex;
+    switch (hi)
+      {
+	  /* parsing the leftmost byte */
+      case '0':
+	  hex = 0;
+	  break;
+      case '1':
+	  hex = 1 * 16;
 	  break;
       case '2':
 	  hex = 2 * 16;
@@ -991,116 +2093,445 @@ parseOrderHeader (const char *row, const char *tag, int *value)
 }
 
 static int
-fetch_scanline (int row, struct colorTable *color_table, int colors, FILE * asc,
-		unsigned char *raster, int columns, double nodata,
-		unsigned char no_red, unsigned char no_green,
-		unsigned char no_blue)
+grid_map_open (const char *path, struct grid_map *map)
 {
-/* feeding a TIFF scanline from an ASCII Grid */
-    int c;
-    int cell = 0;
-    char buf[1024];
-    char *ptr = buf;
-    double value;
-    unsigned char red;
-    unsigned char green;
-    unsigned char blue;
-    unsigned char *p_raster = raster;
-    while ((c = getc (asc)) != EOF)
-      {
-	  if (c == '\n')
-	      break;
-	  *ptr++ = c;
-	  if (c == ' ')
-	    {
-		/* value delimiter */
-		*ptr = '\0';
-		cell++;
-		if (cell > columns)
-		  {
-		      printf ("Grid row %d: exceding column\n", row);
-		      return 0;
-		  }
-		value = atof (buf);
-		if (value == nodata)
-		  {
-		      *p_raster++ = no_red;
-		      *p_raster++ = no_green;
-		      *p_raster++ = no_blue;
-		  }
-		else
-		  {
-		      if (match_color
-			  (color_table, colors, value, &red, &green, &blue))
-			{
-			    *p_raster++ = red;
-			    *p_raster++ = green;
-			    *p_raster++ = blue;
-			}
-		      else
-			{
-			    printf
-				("Grid row %d: unmatched value %1.8f; color not found\n",
-				 row, value);
-			    return 0;
-			}
-		  }
-		ptr = buf;
+/* mapping the whole Grid file into memory */
+#ifdef _WIN32
+    FILE *in;
+    long size;
+    map->base = NULL;
+    map->size = 0;
+    map->mapped = 0;
+    in = fopen (path, "rb");
+    if (!in)
+	return 0;
+    fseek (in, 0, SEEK_END);
+    size = ftell (in);
+    fseek (in, 0, SEEK_SET);
+    if (size > 0)
+      {
+	  map->base = malloc (size);
+	  if (!(map->base) || fread (map->base, 1, size, in) != (size_t) size)
+	    {
+		if (map->base)
+		    free (map->base);
+		map->base = NULL;
+		fclose (in);
+		return 0;
 	    }
       }
+    map->size = size;
+    fclose (in);
     return 1;
-}
+#else
+    struct stat st;
+    void *base;
+    int fd;
+    map->base = NULL;
+    map->size = 0;
+    map->mapped = 0;
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
+	return 0;
+    if (fstat (fd, &st) != 0)
+      {
+	  close (fd);
+	  return 0;
+      }
+    if (st.st_size > 0)
+      {
+	  base = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	  if (base == MAP_FAILED)
+	    {
+		close (fd);
+		return 0;
+	    }
+	  madvise (base, st.st_size, MADV_SEQUENTIAL);
+	  map->base = base;
+	  map->mapped = 1;
+      }
+    map->size = st.st_size;
+    close (fd);
+    return 1;
+#endif
+}
 
-static float
-fetch_float (const unsigned char *p, int byteorder, int endian_arch)
+static void
+grid_map_close (struct grid_map *map)
 {
-/* fetches a 32bit FLOAT from BLOB respecting declared endiannes */
-    union cvt
-    {
-	unsigned char byte[4];
-	float flt_value;
-    } convert;
-    if (endian_arch)
+/* unmapping the Grid file */
+    if (!(map->base))
+	return;
+#ifdef _WIN32
+    free (map->base);
+#else
+    if (map->mapped)
+	munmap (map->base, map->size);
+#endif
+    map->base = NULL;
+}
+
+static const char *
+grid_read_header (struct grid_map *map, int *ncols, int *nrows,
+		  double *xllcorner, double *yllcorner, double *cellsize,
+		  double *nodata)
+{
+/* parsing the ASCII Grid header; returns the first data row */
+    const char *p = (const char *) (map->base);
+    const char *end = p + map->size;
+    char buf[1024];
+    int len;
+    int row;
+    int err = 0;
+    for (row = 0; row < 6; row++)
       {
-	  /* this one is a LittleEndian CPU */
-	  if (byteorder == BYTE_ORDER_LITTLE)
+	  len = 0;
+	  while (p < end && *p != '\n')
 	    {
-		/* Litte-Endian float */
-		convert.byte[0] = *(p + 0);
-		convert.byte[1] = *(p + 1);
-		convert.byte[2] = *(p + 2);
-		convert.byte[3] = *(p + 3);
+		/* ignoring Return chars */
+		if (*p != '\r' && len < (int) sizeof (buf) - 1)
+		    buf[len++] = *p;
+		p++;
+	    }
+	  if (p >= end)
+	      return NULL;
+	  p++;
+	  buf[len] = '\0';
+	  switch (row)
+	    {
+	    case 0:
+		if (!parseIntHeader (buf, "ncols ", ncols))
+		    err = 1;
+		break;
+	    case 1:
+		if (!parseIntHeader (buf, "nrows ", nrows))
+		    err = 1;
+		break;
+	    case 2:
+		if (!parseDblHeader (buf, "xllcorner ", xllcorner))
+		    err = 1;
+		break;
+	    case 3:
+		if (!parseDblHeader (buf, "yllcorner ", yllcorner))
+		    err = 1;
+		break;
+	    case 4:
+		if (!parseDblHeader (buf, "cellsize ", cellsize))
+		    err = 1;
+		break;
+	    case 5:
+		if (!parseDblHeader (buf, "NODATA_value ", nodata))
+		    err = 1;
+		break;
+	    };
+      }
+    if (err || *ncols <= 0 || *nrows <= 0)
+	return NULL;
+    return p;
+}
+
+static const char *
+grid_parse_value (const char *p, const char *end, double *value)
+{
+/*
+/ parsing a single Grid cell value
+/
+/ up to 15 significant digits and a decimal exponent within 10^22 are
+/ exactly represented by a double, so a single multiplication [or division]
+/ returns the very same correctly rounded value strtod() would return;
+/ anything else [very long mantissas, NaN, hex ...] falls back to strtod()
+*/
+    const char *start = p;
+    char buf[128];
+    int len;
+    int negative = 0;
+    int digits = 0;
+    int significant = 0;
+    int exponent = 0;
+    int exp_value = 0;
+    int exp_negative = 0;
+    double mantissa = 0.0;
+    if (p < end && (*p == '-' || *p == '+'))
+      {
+	  if (*p == '-')
+	      negative = 1;
+	  p++;
+      }
+    while (p < end && *p >= '0' && *p <= '9')
+      {
+	  if (mantissa != 0.0 || *p != '0')
+	      significant++;
+	  mantissa = (mantissa * 10.0) + (double) (*p - '0');
+	  digits++;
+	  p++;
+      }
+    if (p < end && *p == '.')
+      {
+	  p++;
+	  while (p < end && *p >= '0' && *p <= '9')
+	    {
+		if (mantissa != 0.0 || *p != '0')
+		    significant++;
+		mantissa = (mantissa * 10.0) + (double) (*p - '0');
+		exponent--;
+		digits++;
+		p++;
+	    }
+      }
+    if (digits && p < end && (*p == 'e' || *p == 'E'))
+      {
+	  p++;
+	  if (p < end && (*p == '-' || *p == '+'))
+	    {
+		if (*p == '-')
+		    exp_negative = 1;
+		p++;
+	    }
+	  if (p >= end || *p < '0' || *p > '9')
+	      goto slow;
+	  while (p < end && *p >= '0' && *p <= '9')
+	    {
+		if (exp_value < 10000)
+		    exp_value = (exp_value * 10) + (*p - '0');
+		p++;
+	    }
+	  exponent += exp_negative ? -exp_value : exp_value;
+      }
+    if (!digits || significant > 15 || exponent < -22 || exponent > 22)
+	goto slow;
+    if (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+	goto slow;
+    if (exponent < 0)
+	mantissa /= grid_pow10[-exponent];
+    else if (exponent > 0)
+	mantissa *= grid_pow10[exponent];
+    *value = negative ? -mantissa : mantissa;
+    return p;
+
+  slow:
+    p = start;
+    len = 0;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+      {
+	  if (len < (int) sizeof (buf) - 1)
+	      buf[len++] = *p;
+	  p++;
+      }
+    buf[len] = '\0';
+    *value = atof (buf);
+    return p;
+}
+
+static int
+grid_parse_row (const char *p, const char *end, double *values, int columns)
+{
+/* parsing a Grid row; returns the cells count or -1 if exceeding */
+    int cell = 0;
+    while (1)
+      {
+	  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+	      p++;
+	  if (p >= end)
+	      break;
+	  if (cell >= columns)
+	      return -1;
+	  p = grid_parse_value (p, end, values + cell);
+	  cell++;
+      }
+    return cell;
+}
+
+static int
+grid_index_rows (struct grid_block *block, const char **cursor,
+		 const char *end, int rows)
+{
+/* locating the next block of Grid rows; returns the rows found */
+    const char *p = *cursor;
+    const char *nl;
+    int i;
+    for (i = 0; i < rows; i++)
+      {
+	  if (p >= end)
+	      break;
+	  nl = memchr (p, '\n', end - p);
+	  block->row_start[i] = p;
+	  if (nl)
+	    {
+		block->row_end[i] = nl;
+		p = nl + 1;
 	    }
 	  else
 	    {
-		/* Big Endian float */
-		convert.byte[0] = *(p + 3);
-		convert.byte[1] = *(p + 2);
-		convert.byte[2] = *(p + 1);
-		convert.byte[3] = *(p + 0);
+		block->row_end[i] = end;
+		p = end;
 	    }
       }
-    else
+    *cursor = p;
+    block->rows = i;
+    return i;
+}
+
+static void
+grid_parse_block_row (struct grid_block *block, int i)
+{
+/* parsing a single row of the current block */
+    double *values = block->values + ((size_t) i * block->columns);
+    unsigned char *p_raster;
+    unsigned char red;
+    unsigned char green;
+    unsigned char blue;
+    int cells;
+    int c;
+    block->status[i] = GRID_ROW_OK;
+    cells =
+	grid_parse_row (block->row_start[i], block->row_end[i], values,
+			block->columns);
+    if (cells < 0)
+      {
+	  block->status[i] = GRID_ROW_EXCEEDING;
+	  return;
+      }
+    for (c = cells; c < block->columns; c++)
+	values[c] = block->nodata;
+    if (!(block->rgb))
+	return;
+/* mapping values into colors */
+    p_raster = block->rgb + ((size_t) i * block->columns * 3);
+    for (c = 0; c < block->columns; c++)
       {
-	  /* this one is a BigEndian CPU */
-	  if (byteorder == BYTE_ORDER_BIG)
+	  if (values[c] == block->nodata)
 	    {
-		/* Big-Endian float */
-		convert.byte[0] = *(p + 0);
-		convert.byte[1] = *(p + 1);
-		convert.byte[2] = *(p + 2);
-		convert.byte[3] = *(p + 3);
+		*p_raster++ = block->no_red;
+		*p_raster++ = block->no_green;
+		*p_raster++ = block->no_blue;
+	    }
+	  else if (match_color
+		   (block->color_map, values[c], &red, &green, &blue))
+	    {
+		*p_raster++ = red;
+		*p_raster++ = green;
+		*p_raster++ = blue;
 	    }
 	  else
 	    {
-		/* Little Endian float */
-		convert.byte[0] = *(p + 3);
-		convert.byte[1] = *(p + 2);
-		convert.byte[2] = *(p + 1);
-		convert.byte[3] = *(p + 0);
+		block->status[i] = GRID_ROW_UNMATCHED;
+		block->unmatched[i] = values[c];
+		return;
 	    }
       }
-    return convert.flt_value;
+}
+
+static void *
+grid_block_worker (void *arg)
+{
+/* a worker parsing rows of the current block */
+    struct grid_block *block = (struct grid_block *) arg;
+    int first;
+    int last;
+    int i;
+    while (1)
+      {
+	  /* fetching the next bunch of rows */
+	  GRID_LOCK (block);
+	  first = block->next_row;
+	  block->next_row += GRID_ROWS_STEP;
+	  GRID_UNLOCK (block);
+	  if (first >= block->rows)
+	      break;
+	  last = first + GRID_ROWS_STEP;
+	  if (last > block->rows)
+	      last = block->rows;
+	  for (i = first; i < last; i++)
+	      grid_parse_block_row (block, i);
+      }
+    return NULL;
+}
+
+static void
+grid_parse_block (struct grid_block *block)
+{
+/* parsing all the rows of the current block, possibly using many threads */
+    int threads = block->threads;
+    block->next_row = 0;
+#ifndef _WIN32
+    if (threads > (block->rows + GRID_ROWS_STEP - 1) / GRID_ROWS_STEP)
+	threads = (block->rows + GRID_ROWS_STEP - 1) / GRID_ROWS_STEP;
+    if (threads > 1)
+      {
+	  pthread_t *workers = malloc (sizeof (pthread_t) * threads);
+	  int started = 0;
+	  int i;
+	  for (i = 0; i < threads; i++)
+	    {
+		if (pthread_create (workers + started, NULL, grid_block_worker,
+				    block) == 0)
+		    started++;
+	    }
+	  if (!started)
+	    {
+		/* falling back to serial parsing */
+		grid_block_worker (block);
+	    }
+	  for (i = 0; i < started; i++)
+	      pthread_join (workers[i], NULL);
+	  free (workers);
+	  return;
+      }
+#endif
+    grid_block_worker (block);
+}
+
+static struct grid_block *
+grid_block_alloc (int columns, int nrows, int threads, int want_rgb)
+{
+/* allocating a block of Grid rows [about 16 MB of parsed values] */
+    struct grid_block *block = malloc (sizeof (struct grid_block));
+    int max_rows = (16 * 1024 * 1024) / (columns * (int) sizeof (double));
+    if (max_rows < threads * GRID_ROWS_STEP)
+	max_rows = threads * GRID_ROWS_STEP;
+    if (max_rows > nrows)
+	max_rows = nrows;
+    if (max_rows < 1)
+	max_rows = 1;
+    block->max_rows = max_rows;
+    block->rows = 0;
+    block->columns = columns;
+    block->threads = threads;
+    block->row_start = malloc (sizeof (const char *) * max_rows);
+    block->row_end = malloc (sizeof (const char *) * max_rows);
+    block->values = malloc (sizeof (double) * (size_t) max_rows * columns);
+    block->status = malloc (sizeof (int) * max_rows);
+    block->unmatched = malloc (sizeof (double) * max_rows);
+    block->rgb = NULL;
+    if (want_rgb)
+	block->rgb = malloc ((size_t) max_rows * columns * 3);
+    block->color_map = NULL;
+    block->nodata = 0.0;
+    block->no_red = 0;
+    block->no_green = 0;
+    block->no_blue = 0;
+    block->next_row = 0;
+#ifndef _WIN32
+    pthread_mutex_init (&(block->mutex), NULL);
+#endif
+    return block;
+}
+
+static void
+grid_block_free (struct grid_block *block)
+{
+/* freeing a block of Grid rows */
+    free (block->row_start);
+    free (block->row_end);
+    free (block->values);
+    free (block->status);
+    free (block->unmatched);
+    if (block->rgb)
+	free (block->rgb);
+#ifndef _WIN32
+    pthread_mutex_destroy (&(block->mutex));
+#endif
+    free (block);
 }
 
 static int
@@ -1119,24 +2550,55 @@ check_endian_arch ()
 }
 
 static int
-fetch_float_scanline (int row, struct colorTable *color_table, int colors,
-		      unsigned char *floats, unsigned char *raster, int columns,
+float_needs_swap (int byteorder)
+{
+/* checking if the declared byte order differs from the CPU's own */
+    if (check_endian_arch ())
+	return byteorder == BYTE_ORDER_BIG;
+    return byteorder == BYTE_ORDER_LITTLE;
+}
+
+static void
+fetch_float_row (float *cells, const unsigned char *p, int columns, int swap)
+{
+/* 
+/ fetching a whole row of 32bit FLOATs at once; when the byte order 
+/ doesn't match this is a plain shift-and-mask loop the compiler is
+/ free to vectorize
+*/
+    int c;
+    uint32 w;
+    if (!swap)
+      {
+	  memcpy (cells, p, sizeof (float) * (size_t) columns);
+	  return;
+      }
+    for (c = 0; c < columns; c++)
+      {
+	  memcpy (&w, p, sizeof (uint32));
+	  w = (w >> 24) | ((w >> 8) & 0x0000ff00) | ((w << 8) & 0x00ff0000) |
+	      (w << 24);
+	  memcpy (cells + c, &w, sizeof (float));
+	  p += sizeof (uint32);
+      }
+}
+
+static int
+fetch_float_scanline (int row, struct color_map *color_map,
+		      const float *cells, unsigned char *raster, int columns,
 		      double nodata, unsigned char no_red,
-		      unsigned char no_green, unsigned char no_blue,
-		      int byteorder)
+		      unsigned char no_green, unsigned char no_blue)
 {
 /* feeding a TIFF scanline from a FLOAT Grid */
     int cell = 0;
     double value;
-    unsigned char *ptr = floats;
     unsigned char red;
     unsigned char green;
     unsigned char blue;
     unsigned char *p_raster = raster;
-    int endian_arch = check_endian_arch ();
     for (cell = 0; cell < columns; cell++)
       {
-	  value = fetch_float (ptr, byteorder, endian_arch);
+	  value = cells[cell];
 	  if (value == nodata)
 	    {
 		*p_raster++ = no_red;
@@ -1145,8 +2607,7 @@ fetch_float_scanline (int row, struct colorTable *color_table, int colors,
 	    }
 	  else
 	    {
-		if (match_color
-		    (color_table, colors, value, &red, &green, &blue))
+		if (match_color (color_map, value, &red, &green, &blue))
 		  {
 		      *p_raster++ = red;
 		      *p_raster++ = green;
@@ -1160,21 +2621,17 @@ fetch_float_scanline (int row, struct colorTable *color_table, int colors,
 		      return 0;
 		  }
 	    }
-	  ptr += sizeof (float);
       }
     return 1;
 }
 
 static void
-export_geoTiff_float (struct colorTable *color_table, int colors,
-		      const char *proj4text, const char *grid_path,
-		      const char *tiff_path, unsigned char no_red,
+export_geoTiff_float (struct color_map *color_map, struct grid_sink *sink,
+		      const char *grid_path, unsigned char no_red,
 		      unsigned char no_green, unsigned char no_blue,
 		      int verbose)
 {
 /* exporting a FLOAT GRID as GeoTIFF */
-    TIFF *tiff = NULL;
-    GTIF *gtif = NULL;
     int byteorder = BYTE_ORDER_NONE;
     int c;
     int row = 0;
@@ -1188,11 +2645,10 @@ export_geoTiff_float (struct colorTable *color_table, int colors,
     double yllcorner = 0.0;
     double cellsize = 0.0;
     double nodata = 0.0;
-    double tiepoint[6];
-    double pixsize[3];
     unsigned char *raster = NULL;
-    unsigned char *flt_buf = NULL;
-    size_t rd;
+    float *cells = NULL;
+    int swap;
+    struct grid_map map;
     FILE *grid;
 
 /* parsing the Grid Header .hdr */
@@ -1256,59 +2712,26 @@ export_geoTiff_float (struct colorTable *color_table, int colors,
       {
 	  /* there was some error */
 	  printf ("Invalid FLOAT Grid Header format in: %s\n", path);
-	  goto stop;
+	  fclose (grid);
+	  return;
       }
     fclose (grid);
 
-/* parsing the Grid Cells .flt */
+/* mapping the Grid Cells .flt */
     sprintf (path, "%s.flt", grid_path);
-    grid = fopen (path, "rb");
-    if (!grid)
+    if (!grid_map_open (path, &map))
       {
 	  printf ("Open error: %s\n", path);
 	  return;
       }
-/* creating the GeoTIFF file */
-    tiff = XTIFFOpen (tiff_path, "w");
-    if (!tiff)
-      {
-	  printf ("\tCould not open TIFF image '%s'\n", tiff_path);
-	  goto stop;
-      }
-    gtif = GTIFNew (tiff);
-    if (!gtif)
-      {
-	  printf ("\tCould not open GeoTIFF image '%s'\n", tiff_path);
-	  goto stop;
-      }
-
-/* writing the TIFF Tags */
-    TIFFSetField (tiff, TIFFTAG_IMAGEWIDTH, ncols);
-    TIFFSetField (tiff, TIFFTAG_IMAGELENGTH, nrows);
-    TIFFSetField (tiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-    TIFFSetField (tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-    TIFFSetField (tiff, TIFFTAG_ROWSPERSTRIP, 1);
-    TIFFSetField (tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-    TIFFSetField (tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-    TIFFSetField (tiff, TIFFTAG_BITSPERSAMPLE, 8);
-    TIFFSetField (tiff, TIFFTAG_SAMPLESPERPIXEL, 3);
-
-/* writing the GeoTIFF Tags */
-    pixsize[0] = cellsize;
-    pixsize[1] = cellsize;
-    pixsize[2] = 0.0;
-    TIFFSetField (tiff, GTIFF_PIXELSCALE, 3, pixsize);
-    tiepoint[0] = 0.0;
-    tiepoint[1] = 0.0;
-    tiepoint[2] = 0.0;
-    tiepoint[3] = xllcorner;
-    tiepoint[4] = yllcorner + (cellsize * nrows);
-    tiepoint[5] = 0.0;
-    TIFFSetField (tiff, GTIFF_TIEPOINTS, 6, tiepoint);
-    GTIFSetFromProj4 (gtif, proj4text);
-    GTIFWriteKeys (gtif);
+    swap = float_needs_swap (byteorder);
+/* creating the output GeoTIFF [or RasterLite table] */
+    if (!grid_sink_open
+	(sink, ncols, nrows, xllcorner, yllcorner + (cellsize * nrows),
+	 cellsize))
+	goto stop;
     raster = malloc (ncols * 3);
-    flt_buf = malloc (sizeof (float) * ncols);
+    cells = malloc (sizeof (float) * ncols);
     for (row = 0; row < nrows; row++)
       {
 	  if (verbose)
@@ -1316,24 +2739,21 @@ export_geoTiff_float (struct colorTable *color_table, int colors,
 		fprintf (stderr, "writing scanline %d of %d\n", row + 1, nrows);
 		fflush (stderr);
 	    }
-	  rd = fread (flt_buf, 1, ncols * sizeof (float), grid);
-	  if (rd != (sizeof (float) * ncols))
+	  if (((size_t) (row + 1) * ncols * sizeof (float)) > map.size)
 	    {
 		printf ("*** Grid read error ***\n");
 		printf ("An invalid GeoTIFF was generated ... aborting ...\n");
 		goto stop;
 	    }
+	  fetch_float_row (cells,
+			   map.base + ((size_t) row * ncols * sizeof (float)),
+			   ncols, swap);
 	  if (fetch_float_scanline
-	      (row + 1, color_table, colors, flt_buf, raster, ncols, nodata,
-	       no_red, no_green, no_blue, byteorder))
+	      (row + 1, color_map, cells, raster, ncols, nodata,
+	       no_red, no_green, no_blue))
 	    {
-		if (TIFFWriteScanline (tiff, raster, row, 0) < 0)
-		  {
-		      printf ("\tTIFF write error @ row=%d\n", row);
-		      printf
-			  ("An invalid GeoTIFF was generated ... aborting ...\n");
-		      goto stop;
-		  }
+		if (!grid_sink_write (sink, raster))
+		    goto stop;
 	    }
 	  else
 	    {
@@ -1344,462 +2764,126 @@ export_geoTiff_float (struct colorTable *color_table, int colors,
       }
 
   stop:
-    if (gtif)
-	GTIFFree (gtif);
-    if (tiff)
-	XTIFFClose (tiff);
+    grid_sink_close (sink);
     if (raster)
 	free (raster);
-    if (flt_buf)
-	free (flt_buf);
-    fclose (grid);
+    if (cells)
+	free (cells);
+    grid_map_close (&map);
 }
 
 static void
-export_geoTiff_ascii (struct colorTable *color_table, int colors,
-		      const char *proj4text, const char *grid_path,
-		      const char *tiff_path, unsigned char no_red,
+export_geoTiff_ascii (struct color_map *color_map, struct grid_sink *sink,
+		      const char *grid_path, unsigned char no_red,
 		      unsigned char no_green, unsigned char no_blue,
-		      int verbose)
+		      int threads, int verbose)
 {
 /* exporting an ASCII GRID as GeoTIFF */
-    TIFF *tiff = NULL;
-    GTIF *gtif = NULL;
-    int c;
     int row = 0;
-    char buf[1024];
-    char *ptr = buf;
-    int err = 0;
+    int i;
     int ncols = -1;
     int nrows = -1;
     double xllcorner = 0.0;
     double yllcorner = 0.0;
     double cellsize = 0.0;
     double nodata = 0.0;
-    double tiepoint[6];
-    double pixsize[3];
-    unsigned char *raster = NULL;
-    FILE *asc = fopen (grid_path, "rb");
-    if (!asc)
+    struct grid_map map;
+    struct grid_block *block = NULL;
+    const char *cursor;
+    const char *end;
+    if (!grid_map_open (grid_path, &map))
       {
 	  printf ("Open error: %s\n", grid_path);
 	  return;
       }
-    while ((c = getc (asc)) != EOF)
-      {
-	  if (c == '\r')
-	    {
-		/* ignoring Return chars */
-		continue;
-	    }
-	  if (c == '\n')
-	    {
-		*ptr = '\0';
-		switch (row)
-		  {
-		  case 0:
-		      if (!parseIntHeader (buf, "ncols ", &ncols))
-			  err = 1;
-		      break;
-		  case 1:
-		      if (!parseIntHeader (buf, "nrows ", &nrows))
-			  err = 1;
-		      break;
-		  case 2:
-		      if (!parseDblHeader (buf, "xllcorner ", &xllcorner))
-			  err = 1;
-		      break;
-		  case 3:
-		      if (!parseDblHeader (buf, "yllcorner ", &yllcorner))
-			  err = 1;
-		      break;
-		  case 4:
-		      if (!parseDblHeader (buf, "cellsize ", &cellsize))
-			  err = 1;
-		      break;
-		  case 5:
-		      if (!parseDblHeader (buf, "NODATA_value ", &nodata))
-			  err = 1;
-		      break;
-		  };
-		ptr = buf;
-		row++;
-		if (row == 6)
-		    break;
-		continue;
-	    }
-	  *ptr++ = c;
-      }
-    if (err)
+    cursor =
+	grid_read_header (&map, &ncols, &nrows, &xllcorner, &yllcorner,
+			  &cellsize, &nodata);
+    if (!cursor)
       {
 	  /* there was some error */
 	  printf ("Invalid ASCII Grid format in: %s\n", grid_path);
 	  goto stop;
-      }
-/* creating the GeoTIFF file */
-    tiff = XTIFFOpen (tiff_path, "w");
-    if (!tiff)
-      {
-	  printf ("\tCould not open TIFF image '%s'\n", tiff_path);
-	  goto stop;
-      }
-    gtif = GTIFNew (tiff);
-    if (!gtif)
-      {
-	  printf ("\tCould not open GeoTIFF image '%s'\n", tiff_path);
-	  goto stop;
-      }
-
-/* writing the TIFF Tags */
-    TIFFSetField (tiff, TIFFTAG_IMAGEWIDTH, ncols);
-    TIFFSetField (tiff, TIFFTAG_IMAGELENGTH, nrows);
-    TIFFSetField (tiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-    TIFFSetField (tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-    TIFFSetField (tiff, TIFFTAG_ROWSPERSTRIP, 1);
-    TIFFSetField (tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-    TIFFSetField (tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-    TIFFSetField (tiff, TIFFTAG_BITSPERSAMPLE, 8);
-    TIFFSetField (tiff, TIFFTAG_SAMPLESPERPIXEL, 3);
-
-/* writing the GeoTIFF Tags */
-    pixsize[0] = cellsize;
-    pixsize[1] = cellsize;
-    pixsize[2] = 0.0;
-    TIFFSetField (tiff, GTIFF_PIXELSCALE, 3, pixsize);
-    tiepoint[0] = 0.0;
-    tiepoint[1] = 0.0;
-    tiepoint[2] = 0.0;
-    tiepoint[3] = xllcorner;
-    tiepoint[4] = yllcorner + (cellsize * nrows);
-    tiepoint[5] = 0.0;
-    TIFFSetField (tiff, GTIFF_TIEPOINTS, 6, tiepoint);
-    GTIFSetFromProj4 (gtif, proj4text);
-    GTIFWriteKeys (gtif);
-    raster = malloc (ncols * 3);
-    for (row = 0; row < nrows; row++)
-      {
-	  if (verbose)
-	    {
-		fprintf (stderr, "writing scanline %d of %d\n", row + 1, nrows);
-		fflush (stderr);
-	    }
-	  if (fetch_scanline
-	      (row + 1, color_table, colors, asc, raster, ncols, nodata, no_red,
-	       no_green, no_blue))
-	    {
-		if (TIFFWriteScanline (tiff, raster, row, 0) < 0)
-		  {
-		      printf ("\tTIFF write error @ row=%d\n", row);
-		      printf
-			  ("An invalid GeoTIFF was generated ... aborting ...\n");
-		      goto stop;
-		  }
-	    }
-	  else
-	    {
-		printf ("*** Grid read error ***\n");
-		printf ("An invalid GeoTIFF was generated ... aborting ...\n");
-		goto stop;
-	    }
-      }
-
-  stop:
-    if (gtif)
-	GTIFFree (gtif);
-    if (tiff)
-	XTIFFClose (tiff);
-    if (raster)
-	free (raster);
-    fclose (asc);
-}
-
-static int
-fetch_float_scanline_shaded (unsigned char *floats, int columns,
-			     int byteorder, struct triple_scan *triplet)
-{
-/* feeding a TIFF scanline from a FLOAT Grid */
-    int cell = 0;
-    double value;
-    unsigned char *ptr = floats;
-    int endian_arch = check_endian_arch ();
-    for (cell = 0; cell < columns; cell++)
-      {
-	  value = fetch_float (ptr, byteorder, endian_arch);
-	  triple_store_cell (triplet, cell, (float) value);
-	  ptr += sizeof (float);
-      }
-    return 1;
-}
-
-static void
-export_geoTiff_shaded_float (struct colorTable *color_table, int colors,
-			     const char *proj4text, const char *grid_path,
-			     const char *tiff_path, unsigned char no_red,
-			     unsigned char no_green, unsigned char no_blue,
-			     int mono_color, unsigned char mono_red,
-			     unsigned char mono_green, unsigned char mono_blue,
-			     double z_factor, double scale_factor,
-			     double azimuth, double altitude, int verbose)
-{
-/* exporting a FLOAT GRID as GeoTIFF */
-    TIFF *tiff = NULL;
-    GTIF *gtif = NULL;
-    int byteorder = BYTE_ORDER_NONE;
-    int c;
-    int row = 0;
-    char buf[1024];
-    char path[1024];
-    char *ptr = buf;
-    int err = 0;
-    int ncols = -1;
-    int nrows = -1;
-    double xllcorner = 0.0;
-    double yllcorner = 0.0;
-    double cellsize = 0.0;
-    double nodata = 0.0;
-    double tiepoint[6];
-    double pixsize[3];
-    struct triple_scan *triplet = NULL;
-    unsigned char *raster = NULL;
-    unsigned char *flt_buf = NULL;
-    size_t rd;
-    FILE *grid;
-
-/* parsing the Grid Header .hdr */
-    sprintf (path, "%s.hdr", grid_path);
-    grid = fopen (path, "rb");
-    if (!grid)
-      {
-	  printf ("Open error: %s\n", path);
-	  return;
-      }
-    while ((c = getc (grid)) != EOF)
-      {
-	  if (c == '\r')
-	    {
-		/* ignoring Return chars */
-		continue;
-	    }
-	  if (c == '\n')
-	    {
-		*ptr = '\0';
-		switch (row)
-		  {
-		  case 0:
-		      if (!parseIntHeader (buf, "ncols ", &ncols))
-			  err = 1;
-		      break;
-		  case 1:
-		      if (!parseIntHeader (buf, "nrows ", &nrows))
-			  err = 1;
-		      break;
-		  case 2:
-		      if (!parseDblHeader (buf, "xllcorner ", &xllcorner))
-			  err = 1;
-		      break;
-		  case 3:
-		      if (!parseDblHeader (buf, "yllcorner ", &yllcorner))
-			  err = 1;
-		      break;
-		  case 4:
-		      if (!parseDblHeader (buf, "cellsize ", &cellsize))
-			  err = 1;
-		      break;
-		  case 5:
-		      if (!parseDblHeader (buf, "NODATA_value ", &nodata))
-			  err = 1;
-		      break;
-		  case 6:
-		      if (!parseOrderHeader (buf, "byteorder ", &byteorder))
-			  err = 1;
-		      break;
-		  };
-		ptr = buf;
-		row++;
-		if (row == 7)
-		    break;
-		continue;
-	    }
-	  *ptr++ = c;
-      }
-    if (err)
-      {
-	  /* there was some error */
-	  printf ("Invalid FLOAT Grid Header format in: %s\n", path);
-	  goto stop;
-      }
-    fclose (grid);
-
-/* resizing CellSize */
-    cellsize = (cellsize * (double) ncols) / (double) (ncols - 2);
-
-/* parsing the Grid Cells .flt */
-    sprintf (path, "%s.flt", grid_path);
-    grid = fopen (path, "rb");
-    if (!grid)
-      {
-	  printf ("Open error: %s\n", path);
-	  return;
-      }
-/* creating the GeoTIFF file */
-    tiff = XTIFFOpen (tiff_path, "w");
-    if (!tiff)
-      {
-	  printf ("\tCould not open TIFF image '%s'\n", tiff_path);
-	  goto stop;
-      }
-    gtif = GTIFNew (tiff);
-    if (!gtif)
-      {
-	  printf ("\tCould not open GeoTIFF image '%s'\n", tiff_path);
-	  goto stop;
-      }
-
-/* writing the TIFF Tags */
-    TIFFSetField (tiff, TIFFTAG_IMAGEWIDTH, ncols - 2);
-    TIFFSetField (tiff, TIFFTAG_IMAGELENGTH, nrows - 2);
-    TIFFSetField (tiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-    TIFFSetField (tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-    TIFFSetField (tiff, TIFFTAG_ROWSPERSTRIP, 1);
-    TIFFSetField (tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-    TIFFSetField (tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-    TIFFSetField (tiff, TIFFTAG_BITSPERSAMPLE, 8);
-    TIFFSetField (tiff, TIFFTAG_SAMPLESPERPIXEL, 3);
-
-/* writing the GeoTIFF Tags */
-    pixsize[0] = cellsize;
-    pixsize[1] = cellsize;
-    pixsize[2] = 0.0;
-    TIFFSetField (tiff, GTIFF_PIXELSCALE, 3, pixsize);
-    tiepoint[0] = 0.0;
-    tiepoint[1] = 0.0;
-    tiepoint[2] = 0.0;
-    tiepoint[3] = xllcorner;
-    tiepoint[4] = yllcorner + (cellsize * nrows);
-    tiepoint[5] = 0.0;
-    TIFFSetField (tiff, GTIFF_TIEPOINTS, 6, tiepoint);
-    GTIFSetFromProj4 (gtif, proj4text);
-    GTIFWriteKeys (gtif);
-    raster = malloc (ncols * 3);
-    flt_buf = malloc (sizeof (float) * ncols);
-
-/* initializing the TripleRow object */
-    triplet = triple_alloc (ncols);
-    triple_set_shaded_relief_params (triplet, z_factor, scale_factor, altitude,
-				     azimuth);
-    triple_set_monochrome_params (triplet, mono_color, mono_red, mono_green,
-				  mono_blue);
-    triple_set_no_data (triplet, (float) nodata, no_red, no_green, no_blue);
-
-    for (row = 0; row < nrows; row++)
-      {
-	  if (verbose)
-	    {
-		fprintf (stderr, "writing scanline %d of %d\n", row + 1, nrows);
-		fflush (stderr);
-	    }
-	  rd = fread (flt_buf, 1, ncols * sizeof (float), grid);
-	  if (rd != (sizeof (float) * ncols))
-	    {
+      }
+    end = (const char *) (map.base) + map.size;
+/* creating the output GeoTIFF [or RasterLite table] */
+    if (!grid_sink_open
+	(sink, ncols, nrows, xllcorner, yllcorner + (cellsize * nrows),
+	 cellsize))
+	goto stop;
+
+/* parsing the Grid rows a block at a time, writing scanlines in order */
+    block = grid_block_alloc (ncols, nrows, threads, 1);
+    block->color_map = color_map;
+    block->nodata = nodata;
+    block->no_red = no_red;
+    block->no_green = no_green;
+    block->no_blue = no_blue;
+    while (row < nrows)
+      {
+	  int want = nrows - row;
+	  if (want > block->max_rows)
+	      want = block->max_rows;
+	  if (grid_index_rows (block, &cursor, end, want) != want)
+	    {
+		printf ("Grid row %d: unexpected end of file\n",
+			row + block->rows + 1);
 		printf ("*** Grid read error ***\n");
 		printf ("An invalid GeoTIFF was generated ... aborting ...\n");
 		goto stop;
 	    }
-	  if (fetch_float_scanline_shaded (flt_buf, ncols, byteorder, triplet))
+	  grid_parse_block (block);
+	  for (i = 0; i < block->rows; i++, row++)
 	    {
-		if (triple_is_valid (triplet))
+		if (verbose)
+		  {
+		      fprintf (stderr, "writing scanline %d of %d\n", row + 1,
+			       nrows);
+		      fflush (stderr);
+		  }
+		if (block->status[i] != GRID_ROW_OK)
 		  {
-		      int ret = 1;
-		      if (!color_table)
-			  triple_shaded_relief (triplet, raster);
+		      if (block->status[i] == GRID_ROW_EXCEEDING)
+			  printf ("Grid row %d: exceding column\n", row + 1);
 		      else
-			  ret =
-			      triple_shaded_relief_color (color_table, colors,
-							  triplet, raster,
-							  row + 1);
-		      if (!ret)
-			  goto stop;
-		      if (TIFFWriteScanline (tiff, raster, row - 2, 0) < 0)
-			{
-			    printf ("\tTIFF write error @ row=%d\n", row);
-			    printf
-				("An invalid GeoTIFF was generated ... aborting ...\n");
-			    goto stop;
-			}
+			  printf
+			      ("Grid row %d: unmatched value %1.8f; color not found\n",
+			       row + 1, block->unmatched[i]);
+		      printf ("*** Grid read error ***\n");
+		      printf
+			  ("An invalid GeoTIFF was generated ... aborting ...\n");
+		      goto stop;
 		  }
-		triple_rotate (triplet);
-	    }
-	  else
-	    {
-		printf ("*** Grid read error ***\n");
-		printf ("An invalid GeoTIFF was generated ... aborting ...\n");
-		goto stop;
+		if (!grid_sink_write
+		    (sink, block->rgb + ((size_t) i * ncols * 3)))
+		    goto stop;
 	    }
       }
 
   stop:
-    if (gtif)
-	GTIFFree (gtif);
-    if (tiff)
-	XTIFFClose (tiff);
-    if (raster)
-	free (raster);
-    if (flt_buf)
-	free (flt_buf);
-    fclose (grid);
-    if (triplet)
-	triple_free (triplet);
-}
-
-static int
-fetch_scanline_shaded (int row, FILE * asc, int columns,
-		       struct triple_scan *triplet)
-{
-/* feeding a TIFF scanline from an ASCII Grid */
-    int c;
-    int cell = 0;
-    char buf[1024];
-    char *ptr = buf;
-    double value;
-    while ((c = getc (asc)) != EOF)
-      {
-	  if (c == '\n')
-	      break;
-	  *ptr++ = c;
-	  if (c == ' ')
-	    {
-		/* value delimiter */
-		*ptr = '\0';
-		cell++;
-		if (cell > columns)
-		  {
-		      printf ("Grid row %d: exceding column\n", row);
-		      return 0;
-		  }
-		value = atof (buf);
-		triple_store_cell (triplet, cell, (float) value);
-		ptr = buf;
-	    }
-      }
-    return 1;
+    grid_sink_close (sink);
+    if (block)
+	grid_block_free (block);
+    grid_map_close (&map);
 }
 
 static void
-export_geoTiff_shaded_ascii (struct colorTable *color_table, int colors,
-			     const char *proj4text, const char *grid_path,
-			     const char *tiff_path, unsigned char no_red,
+export_geoTiff_shaded_float (struct color_map *color_map,
+			     struct grid_sink *sink, const char *grid_path,
+			     unsigned char no_red,
 			     unsigned char no_green, unsigned char no_blue,
 			     int mono_color, unsigned char mono_red,
 			     unsigned char mono_green, unsigned char mono_blue,
 			     double z_factor, double scale_factor,
-			     double azimuth, double altitude, int verbose)
+			     double azimuth, double altitude, int threads,
+			     int verbose)
 {
-/* exporting an ASCII GRID as GeoTIFF */
-    TIFF *tiff = NULL;
-    GTIF *gtif = NULL;
+/* exporting a FLOAT GRID as GeoTIFF */
+    int byteorder = BYTE_ORDER_NONE;
     int c;
     int row = 0;
     char buf[1024];
+    char path[1024];
     char *ptr = buf;
     int err = 0;
     int ncols = -1;
@@ -1808,17 +2892,20 @@ export_geoTiff_shaded_ascii (struct colorTable *color_table, int colors,
     double yllcorner = 0.0;
     double cellsize = 0.0;
     double nodata = 0.0;
-    double tiepoint[6];
-    double pixsize[3];
-    unsigned char *raster = NULL;
-    struct triple_scan *triplet = NULL;
-    FILE *asc = fopen (grid_path, "rb");
-    if (!asc)
+    struct shade_band *band = NULL;
+    int swap;
+    struct grid_map map;
+    FILE *grid;
+
+/* parsing the Grid Header .hdr */
+    sprintf (path, "%s.hdr", grid_path);
+    grid = fopen (path, "rb");
+    if (!grid)
       {
-	  printf ("Open error: %s\n", grid_path);
+	  printf ("Open error: %s\n", path);
 	  return;
       }
-    while ((c = getc (asc)) != EOF)
+    while ((c = getc (grid)) != EOF)
       {
 	  if (c == '\r')
 	    {
@@ -1854,10 +2941,14 @@ export_geoTiff_shaded_ascii (struct colorTable *color_table, int colors,
 		      if (!parseDblHeader (buf, "NODATA_value ", &nodata))
 			  err = 1;
 		      break;
+		  case 6:
+		      if (!parseOrderHeader (buf, "byteorder ", &byteorder))
+			  err = 1;
+		      break;
 		  };
 		ptr = buf;
 		row++;
-		if (row == 6)
+		if (row == 7)
 		    break;
 		continue;
 	    }
@@ -1866,111 +2957,173 @@ export_geoTiff_shaded_ascii (struct colorTable *color_table, int colors,
     if (err)
       {
 	  /* there was some error */
-	  printf ("Invalid ASCII Grid format in: %s\n", grid_path);
-	  goto stop;
+	  printf ("Invalid FLOAT Grid Header format in: %s\n", path);
+	  fclose (grid);
+	  return;
       }
+    fclose (grid);
 
 /* resizing CellSize */
     cellsize = (cellsize * (double) ncols) / (double) (ncols - 2);
 
-/* creating the GeoTIFF file */
-    tiff = XTIFFOpen (tiff_path, "w");
-    if (!tiff)
+/* mapping the Grid Cells .flt */
+    sprintf (path, "%s.flt", grid_path);
+    if (!grid_map_open (path, &map))
       {
-	  printf ("\tCould not open TIFF image '%s'\n", tiff_path);
-	  goto stop;
+	  printf ("Open error: %s\n", path);
+	  return;
       }
-    gtif = GTIFNew (tiff);
-    if (!gtif)
+    swap = float_needs_swap (byteorder);
+/* creating the output GeoTIFF [or RasterLite table] */
+    if (!grid_sink_open
+	(sink, ncols - 2, nrows - 2, xllcorner, yllcorner + (cellsize * nrows),
+	 cellsize))
+	goto stop;
+
+/* initializing the Shaded Relief band */
+    band = shade_band_alloc (ncols, nrows, threads);
+    shade_band_set_params (band, z_factor, scale_factor, altitude, azimuth);
+    shade_band_set_monochrome (band, mono_color, mono_red, mono_green,
+			       mono_blue);
+    shade_band_set_no_data (band, (float) nodata, no_red, no_green, no_blue);
+    band->color_map = color_map;
+
+    for (row = 0; row < nrows; row++)
       {
-	  printf ("\tCould not open GeoTIFF image '%s'\n", tiff_path);
-	  goto stop;
+	  if (((size_t) (row + 1) * ncols * sizeof (float)) > map.size)
+	    {
+		printf ("*** Grid read error ***\n");
+		printf ("An invalid GeoTIFF was generated ... aborting ...\n");
+		goto stop;
+	    }
+	  if (band->loaded == band->max_rows + 2)
+	    {
+		if (!shade_band_flush (band, sink, nrows, verbose))
+		    goto stop;
+	    }
+	  fetch_float_row (shade_band_next_row (band),
+			   map.base + ((size_t) row * ncols * sizeof (float)),
+			   ncols, swap);
+	  band->loaded++;
       }
+    shade_band_flush (band, sink, nrows, verbose);
 
-/* writing the TIFF Tags */
-    TIFFSetField (tiff, TIFFTAG_IMAGEWIDTH, ncols - 2);
-    TIFFSetField (tiff, TIFFTAG_IMAGELENGTH, nrows - 2);
-    TIFFSetField (tiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-    TIFFSetField (tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-    TIFFSetField (tiff, TIFFTAG_ROWSPERSTRIP, 1);
-    TIFFSetField (tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-    TIFFSetField (tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-    TIFFSetField (tiff, TIFFTAG_BITSPERSAMPLE, 8);
-    TIFFSetField (tiff, TIFFTAG_SAMPLESPERPIXEL, 3);
+  stop:
+    grid_sink_close (sink);
+    grid_map_close (&map);
+    if (band)
+	shade_band_free (band);
+}
 
-/* writing the GeoTIFF Tags */
-    pixsize[0] = cellsize;
-    pixsize[1] = cellsize;
-    pixsize[2] = 0.0;
-    TIFFSetField (tiff, GTIFF_PIXELSCALE, 3, pixsize);
-    tiepoint[0] = 0.0;
-    tiepoint[1] = 0.0;
-    tiepoint[2] = 0.0;
-    tiepoint[3] = xllcorner;
-    tiepoint[4] = yllcorner + (cellsize * nrows);
-    tiepoint[5] = 0.0;
-    TIFFSetField (tiff, GTIFF_TIEPOINTS, 6, tiepoint);
-    GTIFSetFromProj4 (gtif, proj4text);
-    GTIFWriteKeys (gtif);
-    raster = malloc (ncols * 3);
+static void
+export_geoTiff_shaded_ascii (struct color_map *color_map,
+			     struct grid_sink *sink, const char *grid_path,
+			     unsigned char no_red,
+			     unsigned char no_green, unsigned char no_blue,
+			     int mono_color, unsigned char mono_red,
+			     unsigned char mono_green, unsigned char mono_blue,
+			     double z_factor, double scale_factor,
+			     double azimuth, double altitude, int threads,
+			     int verbose)
+{
+/* exporting an ASCII GRID as GeoTIFF */
+    int row = 0;
+    int i;
+    int c;
+    int ncols = -1;
+    int nrows = -1;
+    double xllcorner = 0.0;
+    double yllcorner = 0.0;
+    double cellsize = 0.0;
+    double nodata = 0.0;
+    struct shade_band *band = NULL;
+    struct grid_map map;
+    struct grid_block *block = NULL;
+    const char *cursor;
+    const char *end;
+    double *values;
+    float *cells;
+    if (!grid_map_open (grid_path, &map))
+      {
+	  printf ("Open error: %s\n", grid_path);
+	  return;
+      }
+    cursor =
+	grid_read_header (&map, &ncols, &nrows, &xllcorner, &yllcorner,
+			  &cellsize, &nodata);
+    if (!cursor)
+      {
+	  /* there was some error */
+	  printf ("Invalid ASCII Grid format in: %s\n", grid_path);
+	  goto stop;
+      }
+    end = (const char *) (map.base) + map.size;
 
-/* initializing the TripleRow object */
-    triplet = triple_alloc (ncols);
-    triple_set_shaded_relief_params (triplet, z_factor, scale_factor, altitude,
-				     azimuth);
-    triple_set_monochrome_params (triplet, mono_color, mono_red, mono_green,
-				  mono_blue);
-    triple_set_no_data (triplet, (float) nodata, no_red, no_green, no_blue);
+/* resizing CellSize */
+    cellsize = (cellsize * (double) ncols) / (double) (ncols - 2);
 
-    for (row = 0; row < nrows; row++)
-      {
-	  if (verbose)
-	    {
-		fprintf (stderr, "writing scanline %d of %d\n", row + 1, nrows);
-		fflush (stderr);
+/* creating the output GeoTIFF [or RasterLite table] */
+    if (!grid_sink_open
+	(sink, ncols - 2, nrows - 2, xllcorner, yllcorner + (cellsize * nrows),
+	 cellsize))
+	goto stop;
+
+/* initializing the Shaded Relief band */
+    band = shade_band_alloc (ncols, nrows, threads);
+    shade_band_set_params (band, z_factor, scale_factor, altitude, azimuth);
+    shade_band_set_monochrome (band, mono_color, mono_red, mono_green,
+			       mono_blue);
+    shade_band_set_no_data (band, (float) nodata, no_red, no_green, no_blue);
+    band->color_map = color_map;
+
+/* parsing the Grid rows a block at a time, feeding the band in order */
+    block = grid_block_alloc (ncols, nrows, threads, 0);
+    block->nodata = nodata;
+    while (row < nrows)
+      {
+	  int want = nrows - row;
+	  if (want > block->max_rows)
+	      want = block->max_rows;
+	  if (grid_index_rows (block, &cursor, end, want) != want)
+	    {
+		printf ("Grid row %d: unexpected end of file\n",
+			row + block->rows + 1);
+		printf ("*** Grid read error ***\n");
+		printf ("An invalid GeoTIFF was generated ... aborting ...\n");
+		goto stop;
 	    }
-	  if (fetch_scanline_shaded (row + 1, asc, ncols, triplet))
+	  grid_parse_block (block);
+	  for (i = 0; i < block->rows; i++, row++)
 	    {
-		if (triple_is_valid (triplet))
+		if (block->status[i] != GRID_ROW_OK)
 		  {
-		      int ret = 1;
-		      if (!color_table)
-			  triple_shaded_relief (triplet, raster);
-		      else
-			  ret =
-			      triple_shaded_relief_color (color_table, colors,
-							  triplet, raster,
-							  row + 1);
-		      if (!ret)
+		      printf ("Grid row %d: exceding column\n", row + 1);
+		      printf ("*** Grid read error ***\n");
+		      printf
+			  ("An invalid GeoTIFF was generated ... aborting ...\n");
+		      goto stop;
+		  }
+		if (band->loaded == band->max_rows + 2)
+		  {
+		      if (!shade_band_flush (band, sink, nrows, verbose))
 			  goto stop;
-		      if (TIFFWriteScanline (tiff, raster, row - 2, 0) < 0)
-			{
-			    printf ("\tTIFF write error @ row=%d\n", row);
-			    printf
-				("An invalid GeoTIFF was generated ... aborting ...\n");
-			    goto stop;
-			}
 		  }
-		triple_rotate (triplet);
-	    }
-	  else
-	    {
-		printf ("*** Grid read error ***\n");
-		printf ("An invalid GeoTIFF was generated ... aborting ...\n");
-		goto stop;
+		values = block->values + ((size_t) i * ncols);
+		cells = shade_band_next_row (band);
+		for (c = 0; c < ncols; c++)
+		    cells[c] = (float) values[c];
+		band->loaded++;
 	    }
       }
+    shade_band_flush (band, sink, nrows, verbose);
 
   stop:
-    if (gtif)
-	GTIFFree (gtif);
-    if (tiff)
-	XTIFFClose (tiff);
-    if (raster)
-	free (raster);
-    fclose (asc);
-    if (triplet)
-	triple_free (triplet);
+    grid_sink_close (sink);
+    if (block)
+	grid_block_free (block);
+    grid_map_close (&map);
+    if (band)
+	shade_band_free (band);
 }
 
 static void
@@ -1993,7 +3146,23 @@ do_help ()
     fprintf (stderr, "-f or --grid-format   grid-type   [ASCII | FLOAT]\n");
     fprintf (stderr,
 	     "-n or --nodata-color  0xRRGGBB    [default = 0x000000]\n");
+    fprintf (stderr,
+	     "-tc or --tiff-compression type    [NONE | DEFLATE | LZW]\n");
+    fprintf (stderr,
+	     "-tt or --tiff-tile-size num       [default = none: strips]\n");
+    fprintf (stderr,
+	     "-th or --threads      num         [default = CPU count]\n");
     fprintf (stderr, "-v or --verbose                   verbose output\n\n");
+    fprintf (stderr, "Direct RasterLite output [instead of a GeoTIFF]:\n");
+    fprintf (stderr, "------------------------------------------------\n");
+    fprintf (stderr,
+	     "-d or --db-path       pathname    the SpatiaLite db path\n");
+    fprintf (stderr, "-T or --table-name    name        DB table name\n");
+    fprintf (stderr, "-e or --epsg-code     num         the EPSG code\n");
+    fprintf (stderr, "-ts or --tile-size    num         [default = 512]\n");
+    fprintf (stderr, "-i or --image-type    type        [JPEG|PNG|TIFF]\n");
+    fprintf (stderr,
+	     "-q or --quality       num         [default = 75(JPEG)]\n\n");
     fprintf (stderr, "Shaded Relief specific arguments:\n");
     fprintf (stderr, "---------------------------------\n");
     fprintf (stderr,
@@ -2005,6 +3174,7 @@ do_help ()
     fprintf (stderr, "-al or --altitude     numeric     [default = 45.0]\n\n");
     fprintf (stderr, "Please note: --monochrome and --color-path are\n");
     fprintf (stderr, "mutually exclusive options\n");
+    fprintf (stderr, "and so are --tiff-path and --db-path\n");
 }
 
 int
@@ -2017,10 +3187,20 @@ main (int argc, char *argv[])
     const char *color_path = NULL;
     const char *tiff_path = NULL;
     const char *proj4text = NULL;
+    const char *db_path = NULL;
+    const char *table = NULL;
+    int tile_size = 512;
+    int image_type = GAIA_JPEG_BLOB;
+    int quality_factor = -999999;
+    int epsg_code = -1;
+    int compression = COMPRESSION_NONE;
+    int tiff_tile_size = 0;
+    struct grid_sink sink;
     int grid_type = -1;
     int verbose = 0;
     int error = 0;
     struct colorTable *color_table = NULL;
+    struct color_map *color_map = NULL;
     unsigned char no_red = 0;
     unsigned char no_green = 0;
     unsigned char no_blue = 0;
@@ -2035,9 +3215,17 @@ main (int argc, char *argv[])
     double scale_factor = 1.0;
     double azimuth = 315.0;
     double altitude = 45.0;
+    int threads = 1;
     int colors;
     *error_nodata_color = '\0';
     *error_mono_color = '\0';
+#ifndef _WIN32
+    threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+	threads = 1;
+    if (threads > 64)
+	threads = 64;
+#endif
     for (i = 1; i < argc; i++)
       {
 	  /* parsing the invocation arguments */
@@ -2086,6 +3274,62 @@ main (int argc, char *argv[])
 		  case ARG_ALTITUDE:
 		      altitude = atof (argv[i]);
 		      break;
+		  case ARG_THREADS:
+		      threads = atoi (argv[i]);
+		      if (threads < 1)
+			  threads = 1;
+		      if (threads > 64)
+			  threads = 64;
+		      break;
+		  case ARG_DB_PATH:
+		      db_path = argv[i];
+		      break;
+		  case ARG_TABLE_NAME:
+		      table = argv[i];
+		      break;
+		  case ARG_TILE_SIZE:
+		      tile_size = atoi (argv[i]);
+		      if (tile_size < 128)
+			  tile_size = 128;
+		      if (tile_size > 8192)
+			  tile_size = 8192;
+		      break;
+		  case ARG_IMAGE_TYPE:
+		      if (strcasecmp (argv[i], "JPEG") == 0)
+			  image_type = GAIA_JPEG_BLOB;
+		      if (strcasecmp (argv[i], "PNG") == 0)
+			  image_type = GAIA_PNG_BLOB;
+		      if (strcasecmp (argv[i], "TIFF") == 0)
+			  image_type = GAIA_TIFF_BLOB;
+		      break;
+		  case ARG_QUALITY_FACTOR:
+		      quality_factor = atoi (argv[i]);
+		      break;
+		  case ARG_EPSG_CODE:
+		      epsg_code = atoi (argv[i]);
+		      break;
+		  case ARG_TIFF_COMPRESSION:
+		      if (strcasecmp (argv[i], "NONE") == 0)
+			  compression = COMPRESSION_NONE;
+		      if (strcasecmp (argv[i], "DEFLATE") == 0)
+			  compression = COMPRESSION_ADOBE_DEFLATE;
+		      if (strcasecmp (argv[i], "LZW") == 0)
+			  compression = COMPRESSION_LZW;
+		      break;
+		  case ARG_TIFF_TILE_SIZE:
+		      /* TIFF tiles must be a multiple of 16 */
+		      tiff_tile_size = atoi (argv[i]);
+		      if (tiff_tile_size > 0)
+			{
+			    tiff_tile_size = ((tiff_tile_size + 15) / 16) * 16;
+			    if (tiff_tile_size < 64)
+				tiff_tile_size = 64;
+			    if (tiff_tile_size > 1024)
+				tiff_tile_size = 1024;
+			}
+		      else
+			  tiff_tile_size = 0;
+		      break;
 		  };
 		next_arg = ARG_NONE;
 		continue;
@@ -2226,6 +3470,96 @@ main (int argc, char *argv[])
 		next_arg = ARG_ALTITUDE;
 		continue;
 	    }
+	  if (strcmp (argv[i], "-th") == 0)
+	    {
+		next_arg = ARG_THREADS;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--threads") == 0)
+	    {
+		next_arg = ARG_THREADS;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-d") == 0)
+	    {
+		next_arg = ARG_DB_PATH;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--db-path") == 0)
+	    {
+		next_arg = ARG_DB_PATH;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-T") == 0)
+	    {
+		next_arg = ARG_TABLE_NAME;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--table-name") == 0)
+	    {
+		next_arg = ARG_TABLE_NAME;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-ts") == 0)
+	    {
+		next_arg = ARG_TILE_SIZE;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--tile-size") == 0)
+	    {
+		next_arg = ARG_TILE_SIZE;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-i") == 0)
+	    {
+		next_arg = ARG_IMAGE_TYPE;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--image-type") == 0)
+	    {
+		next_arg = ARG_IMAGE_TYPE;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-q") == 0)
+	    {
+		next_arg = ARG_QUALITY_FACTOR;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-tc") == 0)
+	    {
+		next_arg = ARG_TIFF_COMPRESSION;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--tiff-compression") == 0)
+	    {
+		next_arg = ARG_TIFF_COMPRESSION;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-tt") == 0)
+	    {
+		next_arg = ARG_TIFF_TILE_SIZE;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--tiff-tile-size") == 0)
+	    {
+		next_arg = ARG_TIFF_TILE_SIZE;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--quality") == 0)
+	    {
+		next_arg = ARG_QUALITY_FACTOR;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-e") == 0)
+	    {
+		next_arg = ARG_EPSG_CODE;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--epsg-code") == 0)
+	    {
+		next_arg = ARG_EPSG_CODE;
+		continue;
+	    }
 	  fprintf (stderr, "unknown argument: %s\n", argv[i]);
 	  error = 1;
       }
@@ -2250,17 +3584,42 @@ main (int argc, char *argv[])
 		error = 1;
 	    }
       }
-    if (!tiff_path)
+    if (db_path)
       {
-	  fprintf (stderr,
-		   "did you forget setting the --tiff-path argument ?\n");
-	  error = 1;
+	  /* direct output into a RasterLite table */
+	  if (tiff_path)
+	    {
+		fprintf (stderr,
+			 "--tiff-path and --db-path are mutually exclusive\n");
+		error = 1;
+	    }
+	  if (!table)
+	    {
+		fprintf (stderr,
+			 "did you forget setting the --table-name argument ?\n");
+		error = 1;
+	    }
+	  if (epsg_code < 0)
+	    {
+		fprintf (stderr,
+			 "did you forget setting the --epsg-code argument ?\n");
+		error = 1;
+	    }
       }
-    if (!proj4text)
+    else
       {
-	  fprintf (stderr,
-		   "did you forget setting the --proj4text argument ?\n");
-	  error = 1;
+	  if (!tiff_path)
+	    {
+		fprintf (stderr,
+			 "did you forget setting the --tiff-path argument ?\n");
+		error = 1;
+	    }
+	  if (!proj4text)
+	    {
+		fprintf (stderr,
+			 "did you forget setting the --proj4text argument ?\n");
+		error = 1;
+	    }
       }
     if (grid_type < 0)
       {
@@ -2295,8 +3654,57 @@ main (int argc, char *argv[])
     printf ("Grid       pathname: '%s'\n", grid_path);
     if (color_path)
 	printf ("ColorTable pathname: '%s'\n", color_path);
-    printf ("GeoTIFF    pathname: '%s'\n", tiff_path);
-    printf ("PROJ.4       string: '%s'\n", proj4text);
+    if (image_type == GAIA_JPEG_BLOB)
+      {
+	  /* normalizing the quality factor */
+	  if (quality_factor == -999999)
+	      quality_factor = 75;
+	  if (quality_factor < 10)
+	      quality_factor = 10;
+	  if (quality_factor > 90)
+	      quality_factor = 90;
+      }
+    if (db_path)
+      {
+	  printf ("SpatiaLite DB path: '%s'\n", db_path);
+	  printf ("Table prefix: '%s'\n", table);
+	  printf ("EPSG code: %d\n", epsg_code);
+	  printf ("Tile preferred max size: %d pixels\n", tile_size);
+	  switch (image_type)
+	    {
+	    case GAIA_JPEG_BLOB:
+		printf ("Tile image type: JPEG quality=%d\n", quality_factor);
+		break;
+	    case GAIA_PNG_BLOB:
+		printf ("Tile image type: PNG [RGB]\n");
+		break;
+	    case GAIA_TIFF_BLOB:
+		printf ("Tile image type: TIFF [RGB]\n");
+		break;
+	    };
+      }
+    else
+      {
+	  printf ("GeoTIFF    pathname: '%s'\n", tiff_path);
+	  printf ("PROJ.4       string: '%s'\n", proj4text);
+	  switch (compression)
+	    {
+	    case COMPRESSION_ADOBE_DEFLATE:
+		printf ("GeoTIFF compression: DEFLATE [horizontal predictor]\n");
+		break;
+	    case COMPRESSION_LZW:
+		printf ("GeoTIFF compression: LZW [horizontal predictor]\n");
+		break;
+	    default:
+		printf ("GeoTIFF compression: NONE\n");
+		break;
+	    };
+	  if (tiff_tile_size > 0)
+	      printf ("GeoTIFF      layout: tiles %dx%d\n", tiff_tile_size,
+		      tiff_tile_size);
+	  else
+	      printf ("GeoTIFF      layout: strips\n");
+      }
     printf ("NoData        color: 0x%02x%02x%02x\n", no_red, no_green, no_blue);
     switch (grid_type)
       {
@@ -2310,6 +3718,9 @@ main (int argc, char *argv[])
 	  printf ("Grid Format: UNKNOWN\n");
 	  break;
       }
+#ifndef _WIN32
+    printf ("Worker threads: %d\n", threads);
+#endif
     if (shaded_relief)
       {
 	  printf ("\n           Shaded Relief arguments:\n");
@@ -2331,35 +3742,70 @@ main (int argc, char *argv[])
 		fprintf (stderr, "\n*********** Invalid Color Table\n");
 		return -1;
 	    }
+	  color_map = color_map_alloc (color_table, colors);
+	  if (!color_map)
+	    {
+		fprintf (stderr, "\n*********** insufficient memory\n");
+		free (color_table);
+		return -1;
+	    }
+      }
+    grid_sink_init (&sink);
+    sink.tiff_path = tiff_path;
+    sink.proj4text = proj4text;
+    sink.compression = compression;
+    sink.tiff_tile_size = tiff_tile_size;
+    sink.table = table;
+    sink.source_name = grid_path;
+    sink.srid = epsg_code;
+    sink.image_type = image_type;
+    sink.quality_factor = quality_factor;
+    sink.tile_size = tile_size;
+    sink.threads = threads;
+    if (threads > 1)
+      {
+	  /* the workers keep all the CPUs busy: each tile is encoded serially */
+	  rasterliteSetEncoderThreads (1);
+      }
+    if (db_path)
+      {
+	  if (!grid_db_connect (&sink, db_path))
+	    {
+		grid_sink_destroy (&sink);
+		if (color_map)
+		    color_map_free (color_map);
+		if (color_table)
+		    free (color_table);
+		return -1;
+	    }
       }
     if (shaded_relief)
       {
 	  if (grid_type == FLOAT_GRID)
-	      export_geoTiff_shaded_float (color_table, colors, proj4text,
-					   grid_path, tiff_path, no_red,
-					   no_green, no_blue, mono_color,
+	      export_geoTiff_shaded_float (color_map, &sink, grid_path,
+					   no_red, no_green, no_blue, mono_color,
 					   mono_red, mono_green, mono_blue,
 					   z_factor, scale_factor, azimuth,
-					   altitude, verbose);
+					   altitude, threads, verbose);
 	  else
-	      export_geoTiff_shaded_ascii (color_table, colors, proj4text,
-					   grid_path, tiff_path, no_red,
-					   no_green, no_blue, mono_color,
+	      export_geoTiff_shaded_ascii (color_map, &sink, grid_path,
+					   no_red, no_green, no_blue, mono_color,
 					   mono_red, mono_green, mono_blue,
 					   z_factor, scale_factor, azimuth,
-					   altitude, verbose);
+					   altitude, threads, verbose);
       }
     else
       {
 	  if (grid_type == FLOAT_GRID)
-	      export_geoTiff_float (color_table, colors, proj4text, grid_path,
-				    tiff_path, no_red, no_green, no_blue,
-				    verbose);
+	      export_geoTiff_float (color_map, &sink, grid_path, no_red,
+				    no_green, no_blue, verbose);
 	  else
-	      export_geoTiff_ascii (color_table, colors, proj4text, grid_path,
-				    tiff_path, no_red, no_green, no_blue,
-				    verbose);
+	      export_geoTiff_ascii (color_map, &sink, grid_path, no_red,
+				    no_green, no_blue, threads, verbose);
       }
+    grid_sink_destroy (&sink);
+    if (color_map)
+	color_map_free (color_map);
     if (color_table)
 	free (color_table);
     return 0;
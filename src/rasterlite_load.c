@@ -84,6 +84,11 @@
 #define ARG_IMAGE_TYPE		6
 #define ARG_QUALITY_FACTOR	7
 #define ARG_EPSG_CODE		8
+#define ARG_PNG_LEVEL		9
+#define ARG_PNG_FILTER		10
+#define ARG_PNG_STRATEGY	11
+#define ARG_JPEG_PROFILE	12
+#define ARG_TIFF_COMPRESSION	13
 
 static int
 read_by_tile (TIFF * tif, rasterliteImagePtr img, struct geo_info *infos,
@@ -332,7 +337,8 @@ export_tile (TIFF * tif, struct geo_info *infos, int baseVert, int baseHorz,
     if (infos->image_type == IMAGE_PNG_PALETTE)
       {
 	  /* compressing the section image as PNG PALETTE */
-	  image = image_to_png_palette (img, &image_size);
+	  image =
+	      image_to_png_palette (img, &image_size, infos->quality_factor);
 	  if (!image)
 	    {
 		printf ("PNG PALETTE compression error\n");
@@ -342,7 +348,8 @@ export_tile (TIFF * tif, struct geo_info *infos, int baseVert, int baseHorz,
     else if (infos->image_type == IMAGE_PNG_GRAYSCALE)
       {
 	  /* compressing the section image as PNG GRAYSCALE */
-	  image = image_to_png_grayscale (img, &image_size);
+	  image =
+	      image_to_png_grayscale (img, &image_size, infos->quality_factor);
 	  if (!image)
 	    {
 		printf ("PNG GRAYSCALE compression error\n");
@@ -352,7 +359,8 @@ export_tile (TIFF * tif, struct geo_info *infos, int baseVert, int baseHorz,
     else if (infos->image_type == IMAGE_PNG_RGB)
       {
 	  /* compressing the section image as PNG RGB */
-	  image = image_to_png_rgb (img, &image_size);
+	  image =
+	      image_to_png_rgb (img, &image_size, infos->quality_factor);
 	  if (!image)
 	    {
 		printf ("PNG RGB compression error\n");
@@ -382,7 +390,8 @@ export_tile (TIFF * tif, struct geo_info *infos, int baseVert, int baseHorz,
     else if (infos->image_type == IMAGE_TIFF_PALETTE)
       {
 	  /* compressing the section image as TIFF PALETTE */
-	  image = image_to_tiff_palette (img, &image_size);
+	  image =
+	      image_to_tiff_palette (img, &image_size, infos->quality_factor);
 	  if (!image)
 	    {
 		printf ("TIFF PALETTE compression error\n");
@@ -392,7 +401,9 @@ export_tile (TIFF * tif, struct geo_info *infos, int baseVert, int baseHorz,
     else if (infos->image_type == IMAGE_TIFF_GRAYSCALE)
       {
 	  /* compressing the section image as TIFF GRAYSCALE */
-	  image = image_to_tiff_grayscale (img, &image_size);
+	  image =
+	      image_to_tiff_grayscale (img, &image_size,
+				       infos->quality_factor);
 	  if (!image)
 	    {
 		printf ("TIFF GRAYSCALE compression error\n");
@@ -402,7 +413,8 @@ export_tile (TIFF * tif, struct geo_info *infos, int baseVert, int baseHorz,
     else if (infos->image_type == IMAGE_TIFF_RGB)
       {
 	  /* compressing the section image as TIFF RGB */
-	  image = image_to_tiff_rgb (img, &image_size);
+	  image =
+	      image_to_tiff_rgb (img, &image_size, infos->quality_factor);
 	  if (!image)
 	    {
 		printf ("TIFF RGB compression error\n");
@@ -413,7 +425,8 @@ export_tile (TIFF * tif, struct geo_info *infos, int baseVert, int baseHorz,
       {
 	  /* compressing the section image as JPEG GRAYSCALE */
 	  image =
-	      image_to_jpeg_grayscale (img, &image_size, infos->quality_factor);
+	      image_to_jpeg_grayscale (img, &image_size, infos->quality_factor,
+				       infos->jpeg_profile);
 	  if (!image)
 	    {
 		printf ("JPEG compression error\n");
@@ -423,7 +436,9 @@ export_tile (TIFF * tif, struct geo_info *infos, int baseVert, int baseHorz,
     else
       {
 	  /* default: compressing the section image as JPEG RGB */
-	  image = image_to_jpeg (img, &image_size, infos->quality_factor);
+	  image =
+	      image_to_jpeg (img, &image_size, infos->quality_factor,
+			     infos->jpeg_profile);
 	  if (!image)
 	    {
 		printf ("JPEG compression error\n");
@@ -715,7 +730,7 @@ create_raster_table (struct geo_info *infos)
 static int
 load_file (sqlite3 * handle, const char *file_path, const char *table,
 	   int tile_size, int test_mode, int verbose, int image_type,
-	   int quality_factor, int epsg_code)
+	   int quality_factor, int jpeg_profile, int epsg_code)
 {
 /* importing a single GeoTIFF file */
     int ret;
@@ -762,6 +777,7 @@ load_file (sqlite3 * handle, const char *file_path, const char *table,
     infos.table = table;
     infos.image_type = image_type;
     infos.quality_factor = quality_factor;
+    infos.jpeg_profile = jpeg_profile;
     infos.epsg_code = epsg_code;
     for (i = 0; i < NTILES; i++)
       {
@@ -1224,7 +1240,7 @@ load_file (sqlite3 * handle, const char *file_path, const char *table,
 static int
 load_dir (sqlite3 * handle, const char *dir_path, const char *table,
 	  int tile_size, int test_mode, int verbose, int image_type,
-	  int quality_factor, int epsg_code)
+	  int quality_factor, int jpeg_profile, int epsg_code)
 {
 /* importing GeoTIFF files from a whole DIRECTORY */
 #if defined(_WIN32) && !defined(__MINGW32__)
@@ -1253,7 +1269,7 @@ load_dir (sqlite3 * handle, const char *dir_path, const char *table,
 		      cnt +=
 			  load_file (handle, file_path, table, tile_size,
 				     test_mode, verbose, image_type,
-				     quality_factor, epsg_code);
+				     quality_factor, jpeg_profile, epsg_code);
 		  }
 		if (_findnext (hFile, &c_file) != 0)
 		    break;
@@ -1283,7 +1299,8 @@ load_dir (sqlite3 * handle, const char *dir_path, const char *table,
 	  sprintf (file_path, "%s/%s", dir_path, entry->d_name);
 	  cnt +=
 	      load_file (handle, file_path, table, tile_size, test_mode,
-			 verbose, image_type, quality_factor, epsg_code);
+			 verbose, image_type, quality_factor, jpeg_profile,
+			 epsg_code);
       }
     closedir (dir);
     return cnt;
@@ -1408,6 +1425,92 @@ db_connect (const char *path)
     return NULL;
 }
 
+static int
+parse_png_filter (const char *arg)
+{
+/* parsing a comma separated list of PNG row filters */
+    int filters = 0;
+    const char *p = arg;
+    while (*p != '\0')
+      {
+	  int len = strcspn (p, ",");
+	  if (len == 4 && strncasecmp (p, "NONE", 4) == 0)
+	      filters |= RASTERLITE_PNG_FILTER_NONE;
+	  else if (len == 3 && strncasecmp (p, "SUB", 3) == 0)
+	      filters |= RASTERLITE_PNG_FILTER_SUB;
+	  else if (len == 2 && strncasecmp (p, "UP", 2) == 0)
+	      filters |= RASTERLITE_PNG_FILTER_UP;
+	  else if (len == 3 && strncasecmp (p, "AVG", 3) == 0)
+	      filters |= RASTERLITE_PNG_FILTER_AVG;
+	  else if (len == 5 && strncasecmp (p, "PAETH", 5) == 0)
+	      filters |= RASTERLITE_PNG_FILTER_PAETH;
+	  else if (len == 3 && strncasecmp (p, "ALL", 3) == 0)
+	      filters |= RASTERLITE_PNG_FILTER_ALL;
+	  else
+	      return -1;
+	  p += len;
+	  if (*p == ',')
+	      p++;
+      }
+    return filters;
+}
+
+static int
+parse_png_strategy (const char *arg)
+{
+/* parsing a zlib compression strategy */
+    if (strcasecmp (arg, "DEFAULT") == 0)
+	return RASTERLITE_PNG_STRATEGY_DEFAULT;
+    if (strcasecmp (arg, "FILTERED") == 0)
+	return RASTERLITE_PNG_STRATEGY_FILTERED;
+    if (strcasecmp (arg, "HUFFMAN") == 0)
+	return RASTERLITE_PNG_STRATEGY_HUFFMAN;
+    if (strcasecmp (arg, "RLE") == 0)
+	return RASTERLITE_PNG_STRATEGY_RLE;
+    if (strcasecmp (arg, "FIXED") == 0)
+	return RASTERLITE_PNG_STRATEGY_FIXED;
+    return -1;
+}
+
+static int
+parse_tiff_compression (const char *arg)
+{
+/* parsing a TIFF compression */
+    if (strcasecmp (arg, "NONE") == 0)
+	return RASTERLITE_TIFF_NONE;
+    if (strcasecmp (arg, "DEFLATE") == 0)
+	return RASTERLITE_TIFF_DEFLATE;
+    if (strcasecmp (arg, "LZW") == 0)
+	return RASTERLITE_TIFF_LZW;
+    if (strcasecmp (arg, "ZSTD") == 0)
+	return RASTERLITE_TIFF_ZSTD;
+    return -1;
+}
+
+static const char *
+tiff_compression_name (int compression)
+{
+/* the printable name of some TIFF compression */
+    if (compression == RASTERLITE_TIFF_DEFLATE)
+	return "DEFLATE";
+    if (compression == RASTERLITE_TIFF_LZW)
+	return "LZW";
+    if (compression == RASTERLITE_TIFF_ZSTD)
+	return "ZSTD";
+    return "NONE";
+}
+
+static const char *
+jpeg_profile_name (int profile)
+{
+/* the printable name of some JPEG codec profile */
+    if (profile == RASTERLITE_JPEG_PROFILE_SPEED)
+	return "SPEED";
+    if (profile == RASTERLITE_JPEG_PROFILE_SIZE)
+	return "SIZE";
+    return "DEFAULT";
+}
+
 static void
 do_help ()
 {
@@ -1433,6 +1536,18 @@ do_help ()
     fprintf (stderr, "-i or --image-type  type          [JPEG|PNG|GIF|TIFF]\n");
     fprintf (stderr,
 	     "-q or --quality     num           [default = 75(JPEG)]\n");
+    fprintf (stderr,
+	     "-J or --jpeg-profile type         [DEFAULT|SPEED|SIZE]\n");
+    fprintf (stderr,
+	     "-z or --png-level   num           [0 - 9: PNG zlib level]\n");
+    fprintf (stderr,
+	     "-F or --png-filter  list          [NONE,SUB,UP,AVG,PAETH|ALL]\n");
+    fprintf (stderr,
+	     "-S or --png-strategy  type        [DEFAULT|FILTERED|HUFFMAN|RLE|FIXED]\n");
+    fprintf (stderr,
+	     "-C or --tiff-compression type     [NONE|DEFLATE|LZW|ZSTD]\n");
+    fprintf (stderr,
+	     "-P or --tiff-predictor            [TIFF horizontal predictor]\n");
 }
 
 int
@@ -1449,6 +1564,12 @@ main (int argc, char *argv[])
     int tile_size = 512;
     int test_mode = 0;
     int quality_factor = -999999;
+    int jpeg_profile = RASTERLITE_JPEG_PROFILE_DEFAULT;
+    int png_level = -1;
+    int png_filters = 0;
+    int png_strategy = 0;
+    int tiff_compression = RASTERLITE_TIFF_NONE;
+    int tiff_predictor = 0;
     int epsg_code = -1;
     int image_type = GAIA_JPEG_BLOB;
     int verbose = 0;
@@ -1493,6 +1614,57 @@ main (int argc, char *argv[])
 		  case ARG_QUALITY_FACTOR:
 		      quality_factor = atoi (argv[i]);
 		      break;
+		  case ARG_JPEG_PROFILE:
+		      if (strcasecmp (argv[i], "DEFAULT") == 0)
+			  jpeg_profile = RASTERLITE_JPEG_PROFILE_DEFAULT;
+		      else if (strcasecmp (argv[i], "SPEED") == 0)
+			  jpeg_profile = RASTERLITE_JPEG_PROFILE_SPEED;
+		      else if (strcasecmp (argv[i], "SIZE") == 0)
+			  jpeg_profile = RASTERLITE_JPEG_PROFILE_SIZE;
+		      else
+			{
+			    fprintf (stderr, "unknown JPEG profile: %s\n",
+				     argv[i]);
+			    error = 1;
+			}
+		      break;
+		  case ARG_PNG_LEVEL:
+		      png_level = atoi (argv[i]);
+		      if (png_level < 0)
+			  png_level = 0;
+		      if (png_level > 9)
+			  png_level = 9;
+		      break;
+		  case ARG_PNG_FILTER:
+		      png_filters = parse_png_filter (argv[i]);
+		      if (png_filters < 0)
+			{
+			    fprintf (stderr, "unknown PNG filter: %s\n",
+				     argv[i]);
+			    png_filters = 0;
+			    error = 1;
+			}
+		      break;
+		  case ARG_TIFF_COMPRESSION:
+		      tiff_compression = parse_tiff_compression (argv[i]);
+		      if (tiff_compression < 0)
+			{
+			    fprintf (stderr, "unknown TIFF compression: %s\n",
+				     argv[i]);
+			    tiff_compression = RASTERLITE_TIFF_NONE;
+			    error = 1;
+			}
+		      break;
+		  case ARG_PNG_STRATEGY:
+		      png_strategy = parse_png_strategy (argv[i]);
+		      if (png_strategy < 0)
+			{
+			    fprintf (stderr, "unknown PNG strategy: %s\n",
+				     argv[i]);
+			    png_strategy = 0;
+			    error = 1;
+			}
+		      break;
 		  case ARG_EPSG_CODE:
 		      epsg_code = atoi (argv[i]);
 		      break;
@@ -1596,6 +1768,66 @@ main (int argc, char *argv[])
 		next_arg = ARG_QUALITY_FACTOR;
 		continue;
 	    }
+	  if (strcmp (argv[i], "-J") == 0)
+	    {
+		next_arg = ARG_JPEG_PROFILE;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--jpeg-profile") == 0)
+	    {
+		next_arg = ARG_JPEG_PROFILE;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-z") == 0)
+	    {
+		next_arg = ARG_PNG_LEVEL;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--png-level") == 0)
+	    {
+		next_arg = ARG_PNG_LEVEL;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-F") == 0)
+	    {
+		next_arg = ARG_PNG_FILTER;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--png-filter") == 0)
+	    {
+		next_arg = ARG_PNG_FILTER;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-C") == 0)
+	    {
+		next_arg = ARG_TIFF_COMPRESSION;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--tiff-compression") == 0)
+	    {
+		next_arg = ARG_TIFF_COMPRESSION;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-P") == 0)
+	    {
+		tiff_predictor = 1;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--tiff-predictor") == 0)
+	    {
+		tiff_predictor = 1;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-S") == 0)
+	    {
+		next_arg = ARG_PNG_STRATEGY;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--png-strategy") == 0)
+	    {
+		next_arg = ARG_PNG_STRATEGY;
+		continue;
+	    }
 	  if (strcmp (argv[i], "-e") == 0)
 	    {
 		next_arg = ARG_EPSG_CODE;
@@ -1656,6 +1888,18 @@ main (int argc, char *argv[])
 	  if (quality_factor > 90)
 	      quality_factor = 90;
       }
+    if (image_type == GAIA_PNG_BLOB)
+      {
+	  /* packing the PNG compression options */
+	  quality_factor =
+	      RASTERLITE_PNG_QUALITY (png_level, png_filters, png_strategy);
+      }
+    if (image_type == GAIA_TIFF_BLOB)
+      {
+	  /* packing the TIFF compression options */
+	  quality_factor =
+	      RASTERLITE_TIFF_QUALITY (tiff_compression, tiff_predictor);
+      }
     printf ("=====================================================\n");
     printf ("             Arguments Summary\n");
     printf ("=====================================================\n");
@@ -1681,16 +1925,21 @@ main (int argc, char *argv[])
     switch (image_type)
       {
       case GAIA_JPEG_BLOB:
-	  printf ("Tile image type: JPEG quality=%d\n", quality_factor);
+	  printf ("Tile image type: JPEG quality=%d profile=%s\n",
+		  quality_factor, jpeg_profile_name (jpeg_profile));
 	  break;
       case GAIA_PNG_BLOB:
-	  printf ("Tile image type: PNG\n");
+	  printf ("Tile image type: PNG level=%d filters=0x%02x strategy=%d\n",
+		  png_level, png_filters >> 1,
+		  png_strategy ? (png_strategy >> 9) - 1 : -1);
 	  break;
       case GAIA_GIF_BLOB:
 	  printf ("Tile image type: GIF\n");
 	  break;
       case GAIA_TIFF_BLOB:
-	  printf ("Tile image type: TIFF\n");
+	  printf ("Tile image type: TIFF compression=%s%s\n",
+		  tiff_compression_name (tiff_compression),
+		  tiff_predictor ? " predictor" : "");
 	  break;
       default:
 	  printf ("Tile image type: UNKNOWN\n");
@@ -1707,11 +1956,11 @@ main (int argc, char *argv[])
     if (dir_path)
 	cnt =
 	    load_dir (handle, dir_path, table, tile_size, test_mode, verbose,
-		      image_type, quality_factor, epsg_code);
+		      image_type, quality_factor, jpeg_profile, epsg_code);
     else
 	cnt =
 	    load_file (handle, file_path, table, tile_size, test_mode, verbose,
-		       image_type, quality_factor, epsg_code);
+		       image_type, quality_factor, jpeg_profile, epsg_code);
     if (!test_mode)
       {
 	  /* disconnecting DB */
@@ -0,0 +1,983 @@
+/*
+/ rasterlite_synth.c
+/
+/ a tool generating synthetic RasterLite datasources of any size
+/ [reproducible test and benchmark fixtures]
+/
+/ version 1.1a, 2011 November 12
+/
+/ Author: Sandro Furieri a.furieri@lqt.it
+/
+/ ------------------------------------------------------------------------------
+/
+/ Version: MPL 1.1/GPL 2.0/LGPL 2.1
+/
+/ The contents of this file are subject to the Mozilla Public License Version
+/ 1.1 (the "License"); you may not use this file except in compliance with
+/ the License. You may obtain a copy of the License at
+/ http://www.mozilla.org/MPL/
+/
+/ Software distributed under the License is distributed on an "AS IS" basis,
+/ WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+/ for the specific language governing rights and limitations under the
+/ License.
+/
+/ The Original Code is the RasterLite library
+/
+/ The Initial Developer of the Original Code is Alessandro Furieri
+/
+/ Portions created by the Initial Developer are Copyright (C) 2009
+/ the Initial Developer. All Rights Reserved.
+/
+/ Alternatively, the contents of this file may be used under the terms of
+/ either the GNU General Public License Version 2 or later (the "GPL"), or
+/ the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+/ in which case the provisions of the GPL or the LGPL are applicable instead
+/ of those above. If you wish to allow use of your version of this file only
+/ under the terms of either the GPL or the LGPL, and not to allow others to
+/ use your version of this file under the terms of the MPL, indicate your
+/ decision by deleting the provisions above and replace them with the notice
+/ and other provisions required by the GPL or the LGPL. If you do not delete
+/ the provisions above, a recipient may use your version of this file under
+/ the terms of any one of the MPL, the GPL or the LGPL.
+/
+*/
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+/* MSVC strictly requires this include [off_t] */
+#include <sys/types.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <tiffio.h>
+
+#ifdef SPATIALITE_AMALGAMATION
+#include <spatialite/sqlite3.h>
+#else
+#include <sqlite3.h>
+#endif
+
+#include <spatialite/gaiaexif.h>
+#include <spatialite/gaiageo.h>
+#include <spatialite.h>
+
+#include "rasterlite.h"
+#include "rasterlite_internals.h"
+
+#define ARG_NONE			0
+#define ARG_DB_PATH			1
+#define ARG_TABLE_NAME		2
+#define ARG_TILES			3
+#define ARG_TILE_SIZE		4
+#define ARG_CODECS			5
+#define ARG_SOURCES			6
+#define ARG_OVERLAP			7
+#define ARG_LEVELS			8
+#define ARG_SEED			9
+#define ARG_VARIANTS		10
+#define ARG_PIXEL_SIZE		11
+#define ARG_SRID			12
+#define ARG_QUALITY_FACTOR	13
+
+#define SYNTH_CODECS		4
+#define SYNTH_MAX_VARIANTS	256
+
+#ifdef _WIN32
+#define strcasecmp	_stricmp
+#endif /* not WIN32 */
+
+struct synth_codec
+{
+/* a tile codec, and its share of the generated tiles */
+    const char *name;
+    int image_type;
+    int weight;
+    unsigned char *pool[SYNTH_MAX_VARIANTS];	/* full size tiles, encoded once */
+    int pool_size[SYNTH_MAX_VARIANTS];
+    int count;
+};
+
+struct synth_source
+{
+/* a synthetic raster source, laid out as a grid of tiles */
+    char name[64];
+    int width;
+    int height;
+    double upper_left_x;
+    double upper_left_y;
+};
+
+struct synth_db
+{
+/* the datasource being generated */
+    sqlite3 *handle;
+    sqlite3_stmt *stmt_raster;
+    sqlite3_stmt *stmt_meta;
+    const char *table;
+    int srid;
+    int tile_size;
+    int variants;
+    int quality_factor;
+    unsigned int seed;
+    unsigned int state;
+    int total_weight;
+    struct synth_codec codecs[SYNTH_CODECS];
+    int tiles;
+};
+
+static unsigned int
+synth_random (unsigned int *state)
+{
+/*
+/ a deterministic xorshift generator: the same seed always
+/ generates the same datasource on every platform
+*/
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static int
+parse_codecs (struct synth_db *db, const char *mix)
+{
+/*
+/ parsing a codec mix such as "JPEG=60,PNG=20,GIF=10,TIFF=10";
+/ a codec without any explicit weight counts as 1
+*/
+    char name[32];
+    const char *p = mix;
+    int len;
+    int weight;
+    int i;
+    int found;
+    for (i = 0; i < SYNTH_CODECS; i++)
+	db->codecs[i].weight = 0;
+    db->total_weight = 0;
+    while (*p != '\0')
+      {
+	  len = 0;
+	  while (*p != '\0' && *p != '=' && *p != ',' && len < 31)
+	      name[len++] = *p++;
+	  name[len] = '\0';
+	  weight = 1;
+	  if (*p == '=')
+	    {
+		p++;
+		weight = atoi (p);
+		while (*p >= '0' && *p <= '9')
+		    p++;
+	    }
+	  if (*p == ',')
+	      p++;
+	  else if (*p != '\0')
+	      return 0;
+	  if (weight < 0)
+	      return 0;
+	  found = 0;
+	  for (i = 0; i < SYNTH_CODECS; i++)
+	    {
+		if (strcasecmp (name, db->codecs[i].name) == 0)
+		  {
+		      db->codecs[i].weight += weight;
+		      db->total_weight += weight;
+		      found = 1;
+		  }
+	    }
+	  if (!found)
+	      return 0;
+      }
+    return db->total_weight > 0;
+}
+
+static struct synth_codec *
+pick_codec (struct synth_db *db)
+{
+/* randomly choosing the codec of the next tile, according to the mix */
+    int i;
+    int w = synth_random (&(db->state)) % db->total_weight;
+    for (i = 0; i < SYNTH_CODECS; i++)
+      {
+	  if (w < db->codecs[i].weight)
+	      return db->codecs + i;
+	  w -= db->codecs[i].weight;
+      }
+    return db->codecs;
+}
+
+static rasterliteImagePtr
+synth_image (struct synth_db *db, struct synth_codec *codec, int variant,
+	     int width, int height)
+{
+/*
+/ painting a synthetic tile: smooth gradients plus some noise for the
+/ true-color codecs, a 16 colors pattern for GIF [at most 256 colors];
+/ every variant only depends on the seed, never on the generation order
+*/
+    int x;
+    int y;
+    int i;
+    int r;
+    int g;
+    int b;
+    int noise;
+    int palette[16];
+    unsigned int state =
+	(db->seed * 2654435761U) ^ ((unsigned int) variant * 40503U) ^
+	(unsigned int) (codec->image_type);
+    rasterliteImagePtr img = image_create (width, height);
+    if (!img)
+	return NULL;
+    if (state == 0)
+	state = 1;
+    if (codec->image_type == GAIA_GIF_BLOB)
+      {
+	  for (i = 0; i < 16; i++)
+	      palette[i] = synth_random (&state) & 0xffffff;
+	  for (y = 0; y < height; y++)
+	    {
+		for (x = 0; x < width; x++)
+		    img->pixels[y][x] =
+			palette[(((x >> 4) * 7) ^ ((y >> 4) * 13) ^ variant) &
+				15];
+	    }
+	  img->color_space = COLORSPACE_PALETTE;
+	  return img;
+      }
+    r = synth_random (&state) & 0x7f;
+    g = synth_random (&state) & 0x7f;
+    b = synth_random (&state) & 0x7f;
+    for (y = 0; y < height; y++)
+      {
+	  for (x = 0; x < width; x++)
+	    {
+		noise = synth_random (&state) & 0x0f;
+		img->pixels[y][x] =
+		    true_color (r + ((x * 96) / width) + noise,
+				g + ((y * 96) / height) + noise,
+				b + (((x + y) * 48) / (width + height)) +
+				noise);
+	    }
+      }
+    img->color_space = COLORSPACE_RGB;
+    return img;
+}
+
+static unsigned char *
+synth_encode (struct synth_db *db, struct synth_codec *codec, int variant,
+	      int width, int height, int *size)
+{
+/* painting and compressing a synthetic tile */
+    unsigned char *blob = NULL;
+    rasterliteImagePtr img = synth_image (db, codec, variant, width, height);
+    *size = 0;
+    if (!img)
+	return NULL;
+    if (codec->image_type == GAIA_JPEG_BLOB)
+	blob =
+	    image_to_jpeg (img, size, db->quality_factor,
+			   RASTERLITE_JPEG_PROFILE_DEFAULT);
+    else if (codec->image_type == GAIA_PNG_BLOB)
+	blob = image_to_png_rgb (img, size, db->quality_factor);
+    else if (codec->image_type == GAIA_GIF_BLOB)
+	blob = image_to_gif (img, size);
+    else
+	blob = image_to_tiff_rgb (img, size, db->quality_factor);
+    image_destroy (img);
+    return blob;
+}
+
+static int
+synth_exec (sqlite3 * handle, const char *sql, const char *what)
+{
+/* executing an SQL statement, reporting any error */
+    char *sql_err = NULL;
+    int ret = sqlite3_exec (handle, sql, NULL, NULL, &sql_err);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("%s error: %s\n", what, sql_err);
+	  sqlite3_free (sql_err);
+	  return 0;
+      }
+    return 1;
+}
+
+static int
+synth_db_connect (struct synth_db *db, const char *path)
+{
+/* opening [or creating] the SpatiaLite DB, initializing the Spatial Metadata if required */
+    int ret;
+    int metadata = 0;
+    sqlite3_stmt *stmt;
+    spatialite_init (0);
+    printf ("SQLite version: %s\n", sqlite3_libversion ());
+    printf ("SpatiaLite version: %s\n\n", spatialite_version ());
+    ret =
+	sqlite3_open_v2 (path, &(db->handle),
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("cannot open DB '%s': %s\n", path,
+		  sqlite3_errmsg (db->handle));
+	  sqlite3_close (db->handle);
+	  db->handle = NULL;
+	  return 0;
+      }
+    ret =
+	sqlite3_prepare_v2 (db->handle, "SELECT CheckSpatialMetaData()", -1,
+			    &stmt, NULL);
+    if (ret == SQLITE_OK)
+      {
+	  if (sqlite3_step (stmt) == SQLITE_ROW)
+	      metadata = sqlite3_column_int (stmt, 0);
+	  sqlite3_finalize (stmt);
+      }
+    if (metadata > 0)
+	return 1;
+    printf ("Initializing the Spatial Metadata\n");
+    if (synth_exec
+	(db->handle, "SELECT InitSpatialMetadata()", "InitSpatialMetadata"))
+	return 1;
+    sqlite3_close (db->handle);
+    db->handle = NULL;
+    return 0;
+}
+
+static int
+synth_create_tables (struct synth_db *db)
+{
+/* creating the RasterLite tables; an already existing datasource is never touched */
+    char sql[1024];
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    sprintf (sql,
+	     "SELECT f_geometry_column FROM geometry_columns WHERE "
+	     "Lower(f_table_name) = Lower('%s_metadata')", db->table);
+    ret = sqlite3_get_table (db->handle, sql, &results, &rows, &columns, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("SQL error: %s\n", sqlite3_errmsg (db->handle));
+	  return 0;
+      }
+    sqlite3_free_table (results);
+    if (rows > 0)
+      {
+	  printf ("table '%s_metadata' already exists\n", db->table);
+	  return 0;
+      }
+
+    sprintf (sql, "CREATE TABLE %s_metadata (\n", db->table);
+    strcat (sql, "id INTEGER NOT NULL PRIMARY KEY,\n");
+    strcat (sql, "source_name TEXT NOT NULL,\n");
+    strcat (sql, "tile_id INTEGER NOT NULL,\n");
+    strcat (sql, "width INTEGER NOT NULL,\n");
+    strcat (sql, "height INTEGER NOT NULL,\n");
+    strcat (sql, "pixel_x_size DOUBLE NOT NULL,\n");
+    strcat (sql, "pixel_y_size DOUBLE NOT NULL)\n");
+    if (!synth_exec (db->handle, sql, "CREATE TABLE metadata"))
+	return 0;
+    sprintf (sql,
+	     "SELECT AddGeometryColumn('%s_metadata', 'geometry', %d, 'POLYGON', 2)",
+	     db->table, db->srid);
+    if (!synth_exec (db->handle, sql, "AddGeometryColumn"))
+	return 0;
+    sprintf (sql, "SELECT CreateSpatialIndex('%s_metadata', 'geometry')",
+	     db->table);
+    if (!synth_exec (db->handle, sql, "CreateSpatialIndex"))
+	return 0;
+    sprintf (sql, "CREATE TABLE %s_rasters (\n", db->table);
+    strcat (sql, "id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,\n");
+    strcat (sql, "raster BLOB NOT NULL)\n");
+    if (!synth_exec (db->handle, sql, "CREATE TABLE rasters"))
+	return 0;
+
+/* the same priming row rasterlite_load inserts */
+    sprintf (sql, "INSERT INTO \"%s_metadata\" ", db->table);
+    strcat (sql,
+	    "(id, source_name, tile_id, width, height, pixel_x_size, pixel_y_size, geometry) VALUES (");
+    strcat (sql, "0, 'raster metadata', 0, 0, 0, 0, 0, NULL)");
+    if (!synth_exec (db->handle, sql, "INSERT INTO metadata"))
+	return 0;
+
+    sprintf (sql, "INSERT INTO \"%s_rasters\" (id, raster) VALUES (NULL, ?)",
+	     db->table);
+    ret =
+	sqlite3_prepare_v2 (db->handle, sql, strlen (sql), &(db->stmt_raster),
+			    NULL);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("SQL error: %s\n%s\n", sql, sqlite3_errmsg (db->handle));
+	  return 0;
+      }
+    sprintf (sql, "INSERT INTO \"%s_metadata\" ", db->table);
+    strcat (sql, "(id, source_name, tile_id, width, height, ");
+    strcat (sql, "pixel_x_size, pixel_y_size, geometry) ");
+    strcat (sql, " VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+    ret =
+	sqlite3_prepare_v2 (db->handle, sql, strlen (sql), &(db->stmt_meta),
+			    NULL);
+    if (ret != SQLITE_OK)
+      {
+	  printf ("SQL error: %s\n%s\n", sql, sqlite3_errmsg (db->handle));
+	  return 0;
+      }
+    return 1;
+}
+
+static int
+synth_update_pyramids (struct synth_db *db)
+{
+/* registering the generated levels, exactly as rasterlite_pyramid does */
+    char sql[1024];
+    char sql2[512];
+    strcpy (sql, "CREATE TABLE IF NOT EXISTS raster_pyramids (\n");
+    strcat (sql, "table_prefix TEXT NOT NULL,\n");
+    strcat (sql, "pixel_x_size DOUBLE NOT NULL,\n");
+    strcat (sql, "pixel_y_size DOUBLE NOT NULL,\n");
+    strcat (sql, "tile_count INTEGER NOT NULL)");
+    if (!synth_exec (db->handle, sql, "CREATE TABLE raster_pyramids"))
+	return 0;
+    sprintf (sql, "DELETE FROM raster_pyramids WHERE table_prefix LIKE '%s'",
+	     db->table);
+    if (!synth_exec (db->handle, sql, "DELETE FROM raster_pyramids"))
+	return 0;
+    strcpy (sql, "INSERT INTO raster_pyramids ");
+    strcat (sql, "(table_prefix, pixel_x_size, pixel_y_size, tile_count) ");
+    sprintf (sql2, "SELECT '%s', pixel_x_size, pixel_y_size, Count(*) ",
+	     db->table);
+    strcat (sql, sql2);
+    sprintf (sql2, "FROM \"%s_metadata\" ", db->table);
+    strcat (sql, sql2);
+    strcat (sql, "WHERE pixel_x_size > 0 AND pixel_y_size > 0 ");
+    strcat (sql, "GROUP BY pixel_x_size, pixel_y_size");
+    if (!synth_exec (db->handle, sql, "INSERT INTO raster_pyramids"))
+	return 0;
+    sprintf (sql, "CREATE INDEX idx_resolution ON \"%s_metadata\" ",
+	     db->table);
+    strcat (sql, " (pixel_x_size, pixel_y_size)");
+    return synth_exec (db->handle, sql, "CREATE INDEX idx_resolution");
+}
+
+static int
+synth_tile_insert (struct synth_db *db, struct synth_source *src,
+		   int tile_id, int base_x, int base_y, int width, int height,
+		   double pixel_size)
+{
+/* generating a single tile, then INSERTing it and its metadata into the DB */
+    int ret;
+    unsigned char *blob;
+    int blob_size;
+    unsigned char *geom_blob;
+    int geom_size;
+    double min_x;
+    double max_x;
+    double min_y;
+    double max_y;
+    sqlite3_int64 id_raster;
+    gaiaGeomCollPtr geom;
+    gaiaPolygonPtr polyg;
+    struct synth_codec *codec = pick_codec (db);
+    int variant = synth_random (&(db->state)) % db->variants;
+
+    sqlite3_reset (db->stmt_raster);
+    sqlite3_clear_bindings (db->stmt_raster);
+    if (width == db->tile_size && height == db->tile_size)
+      {
+	  /* full size tiles are encoded just once per variant */
+	  if (!(codec->pool[variant]))
+	      codec->pool[variant] =
+		  synth_encode (db, codec, variant, width, height,
+				&(codec->pool_size[variant]));
+	  blob = codec->pool[variant];
+	  blob_size = codec->pool_size[variant];
+	  if (!blob)
+	      goto encode_error;
+	  sqlite3_bind_blob (db->stmt_raster, 1, blob, blob_size,
+			     SQLITE_STATIC);
+      }
+    else
+      {
+	  /* border tiles */
+	  blob = synth_encode (db, codec, variant, width, height, &blob_size);
+	  if (!blob)
+	      goto encode_error;
+	  sqlite3_bind_blob (db->stmt_raster, 1, blob, blob_size, free);
+      }
+    ret = sqlite3_step (db->stmt_raster);
+    if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+      {
+	  printf ("sqlite3_step() error: %s\n", sqlite3_errmsg (db->handle));
+	  return 0;
+      }
+    id_raster = sqlite3_last_insert_rowid (db->handle);
+
+/* creating a Geometry corresponding to this raster */
+    min_x = src->upper_left_x + ((double) base_x * pixel_size);
+    max_x = src->upper_left_x + ((double) (base_x + width) * pixel_size);
+    max_y = src->upper_left_y - ((double) base_y * pixel_size);
+    min_y = src->upper_left_y - ((double) (base_y + height) * pixel_size);
+    geom = gaiaAllocGeomColl ();
+    geom->Srid = db->srid;
+    polyg = gaiaAddPolygonToGeomColl (geom, 5, 0);
+    gaiaSetPoint (polyg->Exterior->Coords, 0, min_x, max_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 1, max_x, max_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 2, max_x, min_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 3, min_x, min_y);
+    gaiaSetPoint (polyg->Exterior->Coords, 4, min_x, max_y);
+    gaiaToSpatiaLiteBlobWkb (geom, &geom_blob, &geom_size);
+    gaiaFreeGeomColl (geom);
+
+    sqlite3_reset (db->stmt_meta);
+    sqlite3_clear_bindings (db->stmt_meta);
+    sqlite3_bind_int64 (db->stmt_meta, 1, id_raster);
+    sqlite3_bind_text (db->stmt_meta, 2, src->name, strlen (src->name),
+		       SQLITE_STATIC);
+    sqlite3_bind_int (db->stmt_meta, 3, tile_id);
+    sqlite3_bind_int (db->stmt_meta, 4, width);
+    sqlite3_bind_int (db->stmt_meta, 5, height);
+    sqlite3_bind_double (db->stmt_meta, 6, pixel_size);
+    sqlite3_bind_double (db->stmt_meta, 7, pixel_size);
+    sqlite3_bind_blob (db->stmt_meta, 8, geom_blob, geom_size, free);
+    ret = sqlite3_step (db->stmt_meta);
+    if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+      {
+	  printf ("sqlite3_step() error: %s\n", sqlite3_errmsg (db->handle));
+	  return 0;
+      }
+    codec->count += 1;
+    db->tiles += 1;
+    if ((db->tiles % 10000) == 0)
+      {
+	  fprintf (stderr, "\t%d tiles generated\n", db->tiles);
+	  fflush (stderr);
+      }
+    return 1;
+
+  encode_error:
+    printf ("%s tile compression error [%dh x %dv]\n", codec->name, width,
+	    height);
+    return 0;
+}
+
+static int
+synth_level (struct synth_db *db, struct synth_source *src, int level,
+	     double base_pixel_size)
+{
+/*
+/ generating a whole Pyramid Level for some source: each level halves
+/ the resolution, so a level tile covers up to 2 x 2 tiles of the previous one
+*/
+    int scale = 1 << level;
+    double pixel_size = base_pixel_size * (double) scale;
+    int width = (src->width + scale - 1) / scale;
+    int height = (src->height + scale - 1) / scale;
+    int base_x;
+    int base_y;
+    int tile_w;
+    int tile_h;
+    int tile_id = 0;
+    for (base_y = 0; base_y < height; base_y += db->tile_size)
+      {
+	  tile_h = db->tile_size;
+	  if (base_y + tile_h > height)
+	      tile_h = height - base_y;
+	  for (base_x = 0; base_x < width; base_x += db->tile_size)
+	    {
+		tile_w = db->tile_size;
+		if (base_x + tile_w > width)
+		    tile_w = width - base_x;
+		if (!synth_tile_insert
+		    (db, src, tile_id, base_x, base_y, tile_w, tile_h,
+		     pixel_size))
+		    return 0;
+		tile_id++;
+	    }
+      }
+    return 1;
+}
+
+static void
+do_help ()
+{
+/* printing the argument list */
+    fprintf (stderr, "\n\nusage: rasterlite_synth ARGLIST\n");
+    fprintf (stderr,
+	     "==============================================================\n");
+    fprintf (stderr,
+	     "-? or --help                      print this help message\n");
+    fprintf (stderr,
+	     "-d or --db-path     pathname      the SpatiaLite db path\n");
+    fprintf (stderr, "-T or --table-name  name          DB table name\n");
+    fprintf (stderr,
+	     "-t or --tiles       num           base level tiles [default = 10000]\n");
+    fprintf (stderr,
+	     "-z or --tile-size   num           tile size [default = 256]\n");
+    fprintf (stderr,
+	     "-c or --codecs      mix           [default = JPEG]\n");
+    fprintf (stderr,
+	     "                                  e.g. JPEG=60,PNG=20,GIF=10,TIFF=10\n");
+    fprintf (stderr,
+	     "-S or --sources     num           raster sources [default = 1]\n");
+    fprintf (stderr,
+	     "-o or --overlap     num           sources overlap %% [default = 0]\n");
+    fprintf (stderr,
+	     "-p or --levels      num           pyramid levels [default = 0]\n");
+    fprintf (stderr, "-s or --seed        num           [default = 1]\n");
+    fprintf (stderr,
+	     "-v or --variants    num           distinct tiles per codec [default = 8]\n");
+    fprintf (stderr,
+	     "-x or --pixel-size  num           base pixel size [default = 0.0001]\n");
+    fprintf (stderr, "-r or --srid        num           [default = 4326]\n");
+    fprintf (stderr,
+	     "-q or --quality     num           [default = 75(JPEG)]\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+/* the MAIN function simply perform arguments checking */
+    int i;
+    int next_arg = ARG_NONE;
+    const char *path = NULL;
+    const char *codecs = "JPEG";
+    int tiles = 10000;
+    int sources = 1;
+    int overlap = 0;
+    int levels = 0;
+    double pixel_size = 0.0001;
+    int tiles_per_source;
+    int tile_cols;
+    int tile_rows;
+    int grid_cols;
+    double step_x;
+    double step_y;
+    int lvl;
+    int error = 0;
+    int ok = 1;
+    struct synth_db db;
+    struct synth_source *srcs;
+    struct synth_source *src;
+    memset (&db, 0, sizeof (struct synth_db));
+    db.codecs[0].name = "JPEG";
+    db.codecs[0].image_type = GAIA_JPEG_BLOB;
+    db.codecs[1].name = "PNG";
+    db.codecs[1].image_type = GAIA_PNG_BLOB;
+    db.codecs[2].name = "GIF";
+    db.codecs[2].image_type = GAIA_GIF_BLOB;
+    db.codecs[3].name = "TIFF";
+    db.codecs[3].image_type = GAIA_TIFF_BLOB;
+    db.srid = 4326;
+    db.tile_size = 256;
+    db.variants = 8;
+    db.quality_factor = 75;
+    db.seed = 1;
+    for (i = 1; i < argc; i++)
+      {
+	  /* parsing the invocation arguments */
+	  if (next_arg != ARG_NONE)
+	    {
+		switch (next_arg)
+		  {
+		  case ARG_DB_PATH:
+		      path = argv[i];
+		      break;
+		  case ARG_TABLE_NAME:
+		      db.table = argv[i];
+		      break;
+		  case ARG_TILES:
+		      tiles = atoi (argv[i]);
+		      break;
+		  case ARG_TILE_SIZE:
+		      db.tile_size = atoi (argv[i]);
+		      break;
+		  case ARG_CODECS:
+		      codecs = argv[i];
+		      break;
+		  case ARG_SOURCES:
+		      sources = atoi (argv[i]);
+		      break;
+		  case ARG_OVERLAP:
+		      overlap = atoi (argv[i]);
+		      break;
+		  case ARG_LEVELS:
+		      levels = atoi (argv[i]);
+		      break;
+		  case ARG_SEED:
+		      db.seed = (unsigned int) strtoul (argv[i], NULL, 10);
+		      break;
+		  case ARG_VARIANTS:
+		      db.variants = atoi (argv[i]);
+		      break;
+		  case ARG_PIXEL_SIZE:
+		      pixel_size = atof (argv[i]);
+		      break;
+		  case ARG_SRID:
+		      db.srid = atoi (argv[i]);
+		      break;
+		  case ARG_QUALITY_FACTOR:
+		      db.quality_factor = atoi (argv[i]);
+		      break;
+		  };
+		next_arg = ARG_NONE;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--help") == 0
+	      || strcmp (argv[i], "-?") == 0)
+	    {
+		do_help ();
+		return -1;
+	    }
+	  if (strcmp (argv[i], "-d") == 0
+	      || strcasecmp (argv[i], "--db-path") == 0)
+	    {
+		next_arg = ARG_DB_PATH;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-T") == 0
+	      || strcasecmp (argv[i], "--table-name") == 0)
+	    {
+		next_arg = ARG_TABLE_NAME;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-t") == 0
+	      || strcasecmp (argv[i], "--tiles") == 0)
+	    {
+		next_arg = ARG_TILES;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-z") == 0
+	      || strcasecmp (argv[i], "--tile-size") == 0)
+	    {
+		next_arg = ARG_TILE_SIZE;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-c") == 0
+	      || strcasecmp (argv[i], "--codecs") == 0)
+	    {
+		next_arg = ARG_CODECS;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-S") == 0
+	      || strcasecmp (argv[i], "--sources") == 0)
+	    {
+		next_arg = ARG_SOURCES;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-o") == 0
+	      || strcasecmp (argv[i], "--overlap") == 0)
+	    {
+		next_arg = ARG_OVERLAP;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-p") == 0
+	      || strcasecmp (argv[i], "--levels") == 0)
+	    {
+		next_arg = ARG_LEVELS;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-s") == 0
+	      || strcasecmp (argv[i], "--seed") == 0)
+	    {
+		next_arg = ARG_SEED;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-v") == 0
+	      || strcasecmp (argv[i], "--variants") == 0)
+	    {
+		next_arg = ARG_VARIANTS;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-x") == 0
+	      || strcasecmp (argv[i], "--pixel-size") == 0)
+	    {
+		next_arg = ARG_PIXEL_SIZE;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-r") == 0
+	      || strcasecmp (argv[i], "--srid") == 0)
+	    {
+		next_arg = ARG_SRID;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-q") == 0
+	      || strcasecmp (argv[i], "--quality") == 0)
+	    {
+		next_arg = ARG_QUALITY_FACTOR;
+		continue;
+	    }
+	  fprintf (stderr, "unknown argument: %s\n", argv[i]);
+	  error = 1;
+      }
+    if (error)
+      {
+	  do_help ();
+	  return -1;
+      }
+/* checking the arguments */
+    if (!path)
+      {
+	  fprintf (stderr, "did you forget setting the --db-path argument ?\n");
+	  error = 1;
+      }
+    if (!db.table)
+      {
+	  fprintf (stderr,
+		   "did you forget setting the --table-name argument ?\n");
+	  error = 1;
+      }
+    if (!parse_codecs (&db, codecs))
+      {
+	  fprintf (stderr, "invalid codec mix: %s\n", codecs);
+	  error = 1;
+      }
+    if (tiles < 1)
+      {
+	  fprintf (stderr, "invalid tiles count: %d\n", tiles);
+	  error = 1;
+      }
+    if (db.tile_size < 16 || db.tile_size > 8192)
+      {
+	  fprintf (stderr, "invalid tile size: %d\n", db.tile_size);
+	  error = 1;
+      }
+    if (sources < 1 || sources > tiles)
+      {
+	  fprintf (stderr, "invalid sources count: %d\n", sources);
+	  error = 1;
+      }
+    if (overlap < 0 || overlap > 90)
+      {
+	  fprintf (stderr, "invalid overlap: %d%%\n", overlap);
+	  error = 1;
+      }
+    if (levels < 0 || levels > 16)
+      {
+	  fprintf (stderr, "invalid pyramid levels: %d\n", levels);
+	  error = 1;
+      }
+    if (db.variants < 1 || db.variants > SYNTH_MAX_VARIANTS)
+      {
+	  fprintf (stderr, "invalid variants: %d\n", db.variants);
+	  error = 1;
+      }
+    if (pixel_size <= 0.0)
+      {
+	  fprintf (stderr, "invalid pixel size: %1.6f\n", pixel_size);
+	  error = 1;
+      }
+    if (error)
+      {
+	  do_help ();
+	  return -1;
+      }
+    if (db.quality_factor < 10)
+	db.quality_factor = 10;
+    if (db.quality_factor > 90)
+	db.quality_factor = 90;
+    if (db.seed == 0)
+	db.seed = 1;
+    db.state = db.seed;
+
+/* laying out the sources on a grid, each one being a grid of tiles */
+    tiles_per_source = (tiles + sources - 1) / sources;
+    tile_cols = (int) ceil (sqrt ((double) tiles_per_source));
+    tile_rows = (tiles_per_source + tile_cols - 1) / tile_cols;
+    grid_cols = (int) ceil (sqrt ((double) sources));
+    step_x =
+	(double) (tile_cols * db.tile_size) * pixel_size * (double) (100 -
+								     overlap) /
+	100.0;
+    step_y =
+	(double) (tile_rows * db.tile_size) * pixel_size * (double) (100 -
+								     overlap) /
+	100.0;
+    srcs = malloc (sizeof (struct synth_source) * sources);
+    for (i = 0; i < sources; i++)
+      {
+	  /* trimming the right and bottom tiles, so that some tiles are smaller */
+	  src = srcs + i;
+	  sprintf (src->name, "synth_%06d", i);
+	  src->width =
+	      (tile_cols * db.tile_size) -
+	      (int) (synth_random (&(db.state)) % (db.tile_size / 2));
+	  src->height =
+	      (tile_rows * db.tile_size) -
+	      (int) (synth_random (&(db.state)) % (db.tile_size / 2));
+	  src->upper_left_x = -180.0 + ((double) (i % grid_cols) * step_x);
+	  src->upper_left_y = 90.0 - ((double) (i / grid_cols) * step_y);
+      }
+
+    printf ("=====================================================\n");
+    printf ("             Arguments Summary\n");
+    printf ("=====================================================\n");
+    printf ("SpatiaLite DB path: '%s'\n", path);
+    printf ("Table prefix: '%s'\n", db.table);
+    printf ("Seed: %u\n", db.seed);
+    printf ("Sources: %d [%d x %d tiles each, %d%% overlap]\n", sources,
+	    tile_cols, tile_rows, overlap);
+    printf ("Tile size: %d [%d variants per codec]\n", db.tile_size,
+	    db.variants);
+    printf ("Codec mix: %s\n", codecs);
+    printf ("Pyramid levels: %d\n", levels);
+    printf ("Base pixel size: %1.8f [SRID=%d]\n", pixel_size, db.srid);
+    printf ("=====================================================\n\n");
+
+    if (!synth_db_connect (&db, path))
+      {
+	  free (srcs);
+	  return -1;
+      }
+/* the complete operation is handled as an unique SQL Transaction */
+    if (!synth_exec (db.handle, "BEGIN", "BEGIN TRANSACTION"))
+	ok = 0;
+    if (ok)
+	ok = synth_create_tables (&db);
+    for (lvl = 0; ok && lvl <= levels; lvl++)
+      {
+	  for (i = 0; ok && i < sources; i++)
+	      ok = synth_level (&db, srcs + i, lvl, pixel_size);
+	  if (ok)
+	      printf ("Level %d: %d tiles so far\n", lvl, db.tiles);
+      }
+    if (ok)
+	ok = synth_update_pyramids (&db);
+    if (db.stmt_raster)
+	sqlite3_finalize (db.stmt_raster);
+    if (db.stmt_meta)
+	sqlite3_finalize (db.stmt_meta);
+    if (ok)
+	ok = synth_exec (db.handle, "COMMIT", "COMMIT TRANSACTION");
+    else
+	sqlite3_exec (db.handle, "ROLLBACK", NULL, NULL, NULL);
+    if (ok)
+      {
+	  printf ("\n%d tiles generated:", db.tiles);
+	  for (i = 0; i < SYNTH_CODECS; i++)
+	    {
+		if (db.codecs[i].count > 0)
+		    printf (" %s=%d", db.codecs[i].name, db.codecs[i].count);
+	    }
+	  printf ("\n");
+      }
+    else
+	printf ("Sorry, cowardly quitting ...\n");
+    for (i = 0; i < SYNTH_CODECS; i++)
+      {
+	  for (lvl = 0; lvl < db.variants; lvl++)
+	    {
+		if (db.codecs[i].pool[lvl])
+		    free (db.codecs[i].pool[lvl]);
+	    }
+      }
+    sqlite3_close (db.handle);
+    free (srcs);
+    return ok ? 0 : 1;
+}
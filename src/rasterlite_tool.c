@@ -52,6 +52,16 @@
 #include <string.h>
 #include <float.h>
 
+#if defined(_WIN32) && !defined(__MINGW32__)
+#include <time.h>
+#else
+#include <sys/time.h>
+#endif
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 #include <tiffio.h>
 
 #ifdef SPATIALITE_AMALGAMATION
@@ -80,6 +90,9 @@
 #define ARG_QUALITY_FACTOR	10
 #define ARG_TRANSPARENT		11
 #define ARG_BACKGROUND		12
+#define ARG_BATCH			13
+#define ARG_THREADS			14
+#define ARG_JPEG_PROFILE	15
 
 #define WRONG_COLOR			-100
 
@@ -87,6 +100,51 @@
 #define strcasecmp	_stricmp
 #endif /* not WIN32 */
 
+struct batch_request
+{
+/* a single rendering request read from a batch file */
+    int line_no;
+    double cx;
+    double cy;
+    double pixel_ratio;
+    int width;
+    int height;
+    int image_type;
+    char *img_path;
+    int ok;
+    double elapsed;
+};
+
+struct batch_job
+{
+/* the whole batch, shared by all the worker threads */
+    struct batch_request *requests;
+    int count;
+    int next;
+    int quality_factor;
+#ifndef _WIN32
+    pthread_mutex_t mutex;
+#endif
+};
+
+struct batch_worker
+{
+/* a worker thread, owning its own RasterLite handle */
+    struct batch_job *job;
+    void *handle;
+#ifndef _WIN32
+    pthread_t thread;
+#endif
+};
+
+#ifdef _WIN32
+#define BATCH_LOCK(job)
+#define BATCH_UNLOCK(job)
+#else
+#define BATCH_LOCK(job)	pthread_mutex_lock (&((job)->mutex))
+#define BATCH_UNLOCK(job)	pthread_mutex_unlock (&((job)->mutex))
+#endif
+
 static int
 parse_hex (const char hi, const char lo)
 {
@@ -235,32 +293,21 @@ parse_hex_color (const char *hex_color)
     return true_color (red, green, blue);
 }
 
-static int
-build_raster (const char *img_path, const char *db_path, const char *table,
-	      double cx, double cy, double pixel_ratio, int width, int height,
-	      int image_type, int quality_factor, int transparent_color,
-	      int background_color)
+static void *
+open_datasource (const char *db_path, const char *table,
+		 int transparent_color, int background_color, int jpeg_profile)
 {
-/* trying to build the requested raster */
-    FILE *out;
+/* opening the RasterLite data-source and setting up the colors */
     void *handle;
-    void *raster;
-    int size;
-    int srid;
-    const char *auth_name;
-    int auth_srid;
-    const char *ref_sys_name;
-    const char *proj4text;
     int red;
     int green;
     int blue;
-/* trying to open the RasterLite data-source */
     handle = rasterliteOpen (db_path, table);
     if (rasterliteIsError (handle))
       {
 	  fprintf (stderr, "ERROR: %s\n", rasterliteGetLastError (handle));
 	  rasterliteClose (handle);
-	  return 1;
+	  return NULL;
       }
     if (transparent_color >= 0)
       {
@@ -275,52 +322,413 @@ build_raster (const char *img_path, const char *db_path, const char *table,
     green = true_color_get_green (background_color);
     blue = true_color_get_blue (background_color);
     rasterliteSetBackgroundColor (handle, red, green, blue);
-/* building the raster image */
+    rasterliteSetJpegProfile (handle, jpeg_profile);
+    return handle;
+}
+
+static int
+render_raster (void *handle, const char *img_path, double cx, double cy,
+	       double pixel_ratio, int width, int height, int image_type,
+	       int quality_factor)
+{
+/* building the requested raster and saving it to disk */
+    FILE *out;
+    void *raster;
+    int size;
+    int srid;
+    const char *auth_name;
+    int auth_srid;
+    const char *ref_sys_name;
+    const char *proj4text;
+    int ok = 1;
     if (rasterliteGetRaster
 	(handle, cx, cy, pixel_ratio, width, height, image_type, quality_factor,
 	 &raster, &size) != RASTERLITE_OK)
       {
 	  fprintf (stderr, "ERROR: %s\n", rasterliteGetLastError (handle));
-	  rasterliteClose (handle);
-	  return 1;
+	  return 0;
+      }
+    if (!raster)
+      {
+	  /* e.g. a true color image can't be compressed as GIF */
+	  fprintf (stderr, "ERROR: %s\n", rasterliteGetLastError (handle));
+	  return 0;
       }
-    if (raster)
+/* saving the image to disk */
+    if (image_type == GAIA_TIFF_BLOB)
       {
-	  /* saving the image to disk */
-	  if (image_type == GAIA_TIFF_BLOB)
-	    {
-		/* writing as a GeoTIFF  */
-		double xllcorner = cx - ((double) width * pixel_ratio / 2.0);
-		double yllcorner = cy + ((double) height * pixel_ratio / 2.0);
-		rasterliteGetSrid (handle, &srid, &auth_name, &auth_srid,
-				   &ref_sys_name, &proj4text);
-		if (!write_geotiff
-		    (img_path, raster, size, pixel_ratio, pixel_ratio,
-		     xllcorner, yllcorner, proj4text))
-		    fprintf (stderr, "GeoTIFF write error on \"%s\"\n",
-			     img_path);
+	  /* writing as a GeoTIFF  */
+	  double xllcorner = cx - ((double) width * pixel_ratio / 2.0);
+	  double yllcorner = cy + ((double) height * pixel_ratio / 2.0);
+	  rasterliteGetSrid (handle, &srid, &auth_name, &auth_srid,
+			     &ref_sys_name, &proj4text);
+	  if (!write_geotiff
+	      (img_path, raster, size, pixel_ratio, pixel_ratio,
+	       xllcorner, yllcorner, proj4text))
+	    {
+		fprintf (stderr, "GeoTIFF write error on \"%s\"\n",
+			 img_path);
+		ok = 0;
+	    }
+      }
+    else
+      {
+	  /* not a TIFF */
+	  out = fopen (img_path, "wb");
+	  if (!out)
+	    {
+		fprintf (stderr, "cannot open \"%s\"\n", img_path);
+		ok = 0;
 	    }
 	  else
 	    {
-		/* not a TIFF */
-		out = fopen (img_path, "wb");
-		if (!out)
-		    fprintf (stderr, "cannot open \"%s\"\n", img_path);
-		else
+		if ((int) fwrite (raster, 1, size, out) != size)
 		  {
-		      if ((int) fwrite (raster, 1, size, out) != size)
-			  fprintf (stderr, "write error on \"%s\"\n", img_path);
-		      fclose (out);
+		      fprintf (stderr, "write error on \"%s\"\n",
+			       img_path);
+		      ok = 0;
 		  }
+		fclose (out);
 	    }
-	  /* freeing the raster image */
-	  free (raster);
       }
+/* freeing the raster image */
+    free (raster);
+    return ok;
+}
+
+static int
+build_raster (const char *img_path, const char *db_path, const char *table,
+	      double cx, double cy, double pixel_ratio, int width, int height,
+	      int image_type, int quality_factor, int transparent_color,
+	      int background_color, int jpeg_profile)
+{
+/* trying to build the requested raster */
+    void *handle;
+    int ret = 0;
+/* trying to open the RasterLite data-source */
+    handle =
+	open_datasource (db_path, table, transparent_color, background_color,
+			 jpeg_profile);
+    if (!handle)
+	return 1;
+/* building the raster image */
+    if (!render_raster
+	(handle, img_path, cx, cy, pixel_ratio, width, height, image_type,
+	 quality_factor))
+	ret = 1;
 /* closing the RasterLite data-source */
     rasterliteClose (handle);
+    return ret;
+}
+
+static double
+batch_clock ()
+{
+/* a wall-clock timestamp, in seconds */
+#if defined(_WIN32) && !defined(__MINGW32__)
+/* MSVC's clock() measures the elapsed wall-clock time */
+    return (double) clock () / (double) CLOCKS_PER_SEC;
+#else
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (double) tv.tv_sec + ((double) tv.tv_usec / 1000000.0);
+#endif
+}
+
+static int
+parse_image_type (const char *name)
+{
+/* parsing an image type name */
+    if (strcasecmp (name, "JPEG") == 0)
+	return GAIA_JPEG_BLOB;
+    if (strcasecmp (name, "GIF") == 0)
+	return GAIA_GIF_BLOB;
+    if (strcasecmp (name, "PNG") == 0)
+	return GAIA_PNG_BLOB;
+    if (strcasecmp (name, "TIFF") == 0)
+	return GAIA_TIFF_BLOB;
+    return -1;
+}
+
+static int
+parse_batch_line (char *line, struct batch_request *req)
+{
+/* 
+/ parsing a batch request line:
+/ center-x center-y pixel-ratio width height [JPEG|GIF|PNG|TIFF] output-path
+*/
+    char type[32];
+    char *path;
+    char *end;
+    int consumed = 0;
+    if (sscanf
+	(line, "%lf %lf %lf %d %d %31s %n", &(req->cx), &(req->cy),
+	 &(req->pixel_ratio), &(req->width), &(req->height), type,
+	 &consumed) != 6 || consumed == 0)
+	return 0;
+    req->image_type = parse_image_type (type);
+    if (req->image_type < 0)
+	return 0;
+    if (req->width < 64 || req->width > 32768 || req->height < 64
+	|| req->height > 32768)
+	return 0;
+    path = line + consumed;
+    end = path + strlen (path);
+    while (end > path
+	   && (*(end - 1) == '\n' || *(end - 1) == '\r' || *(end - 1) == ' '
+	       || *(end - 1) == '\t'))
+	end--;
+    *end = '\0';
+    if (*path == '\0')
+	return 0;
+    req->img_path = malloc (strlen (path) + 1);
+    strcpy (req->img_path, path);
+    return 1;
+}
+
+static struct batch_request *
+read_batch (const char *batch_path, int *count, int *invalid)
+{
+/* loading all the requests from a batch file [- means stdin] */
+    FILE *in;
+    char line[8192];
+    char *p;
+    int line_no = 0;
+    int max = 1024;
+    struct batch_request *requests;
+    struct batch_request *req;
+    *count = 0;
+    *invalid = 0;
+    if (strcmp (batch_path, "-") == 0)
+	in = stdin;
+    else
+	in = fopen (batch_path, "rb");
+    if (!in)
+      {
+	  fprintf (stderr, "cannot open \"%s\"\n", batch_path);
+	  return NULL;
+      }
+    requests = malloc (sizeof (struct batch_request) * max);
+    while (fgets (line, sizeof (line), in))
+      {
+	  line_no++;
+	  p = line;
+	  while (*p == ' ' || *p == '\t')
+	      p++;
+	  if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+	    {
+		/* skipping comments and empty lines */
+		continue;
+	    }
+	  if (*count == max)
+	    {
+		max *= 2;
+		requests =
+		    realloc (requests, sizeof (struct batch_request) * max);
+	    }
+	  req = requests + *count;
+	  memset (req, 0, sizeof (struct batch_request));
+	  req->line_no = line_no;
+	  if (!parse_batch_line (p, req))
+	    {
+		fprintf (stderr, "batch line %d: invalid request\n", line_no);
+		*invalid += 1;
+		continue;
+	    }
+	  *count += 1;
+      }
+    if (in != stdin)
+	fclose (in);
+    return requests;
+}
+
+static void *
+batch_worker (void *arg)
+{
+/* a worker rendering batch requests on its own RasterLite handle */
+    struct batch_worker *worker = (struct batch_worker *) arg;
+    struct batch_job *job = worker->job;
+    struct batch_request *req;
+    double start;
+    int i;
+    while (1)
+      {
+	  /* fetching the next request */
+	  BATCH_LOCK (job);
+	  i = job->next;
+	  job->next += 1;
+	  BATCH_UNLOCK (job);
+	  if (i >= job->count)
+	      break;
+	  req = job->requests + i;
+	  start = batch_clock ();
+	  req->ok =
+	      render_raster (worker->handle, req->img_path, req->cx, req->cy,
+			     req->pixel_ratio, req->width, req->height,
+			     req->image_type, job->quality_factor);
+	  req->elapsed = batch_clock () - start;
+	  BATCH_LOCK (job);
+	  printf ("line %d: %s %1.3f ms \"%s\"\n", req->line_no,
+		  req->ok ? "OK" : "FAILED", req->elapsed * 1000.0,
+		  req->img_path);
+	  BATCH_UNLOCK (job);
+      }
+    return NULL;
+}
+
+static int
+cmp_elapsed (const void *p1, const void *p2)
+{
+/* compares two latencies [for qsort] */
+    double e1 = *((const double *) p1);
+    double e2 = *((const double *) p2);
+    if (e1 < e2)
+	return -1;
+    if (e1 > e2)
+	return 1;
     return 0;
 }
 
+static double
+percentile (double *sorted, int count, int pct)
+{
+/* the nearest-rank percentile of an already sorted array */
+    int rank = (count * pct + 99) / 100;
+    if (rank < 1)
+	rank = 1;
+    return sorted[rank - 1];
+}
+
+static void
+batch_report (struct batch_job *job, int invalid, double wall_clock)
+{
+/* printing the batch totals */
+    int i;
+    int ok = 0;
+    int done = 0;
+    double total = 0.0;
+    double *elapsed = malloc (sizeof (double) * (job->count + 1));
+    for (i = 0; i < job->count; i++)
+      {
+	  struct batch_request *req = job->requests + i;
+	  if (req->ok)
+	    {
+		elapsed[ok] = req->elapsed;
+		total += req->elapsed;
+		ok++;
+	    }
+	  done++;
+      }
+    printf ("=====================================================\n");
+    printf ("             Batch Summary\n");
+    printf ("=====================================================\n");
+    printf ("Requests:      %d rendered, %d failed, %d invalid\n", ok,
+	    done - ok, invalid);
+    printf ("Wall clock:    %1.3f s [%1.2f requests/s]\n", wall_clock,
+	    (wall_clock > 0.0) ? (double) ok / wall_clock : 0.0);
+    if (ok > 0)
+      {
+	  qsort (elapsed, ok, sizeof (double), cmp_elapsed);
+	  printf ("Latency:       min=%1.3f avg=%1.3f max=%1.3f ms\n",
+		  elapsed[0] * 1000.0, (total / (double) ok) * 1000.0,
+		  elapsed[ok - 1] * 1000.0);
+	  printf ("               p50=%1.3f p95=%1.3f ms\n",
+		  percentile (elapsed, ok, 50) * 1000.0,
+		  percentile (elapsed, ok, 95) * 1000.0);
+      }
+    printf ("=====================================================\n");
+    free (elapsed);
+}
+
+static int
+build_batch (const char *batch_path, const char *db_path, const char *table,
+	     int threads, int quality_factor, int transparent_color,
+	     int background_color, int jpeg_profile)
+{
+/* rendering all the requests of a batch file, reusing the open handles */
+    struct batch_job job;
+    struct batch_worker *workers;
+    int invalid;
+    int started = 0;
+    int failed = 0;
+    int i;
+    double start;
+    job.requests = read_batch (batch_path, &(job.count), &invalid);
+    if (!(job.requests))
+	return 1;
+    job.next = 0;
+    job.quality_factor = quality_factor;
+#ifdef _WIN32
+    threads = 1;
+#else
+    pthread_mutex_init (&(job.mutex), NULL);
+#endif
+    if (threads > job.count)
+	threads = job.count;
+    if (threads < 1)
+	threads = 1;
+    workers = malloc (sizeof (struct batch_worker) * threads);
+
+/* each worker owns its handle; opening them all up front */
+    for (i = 0; i < threads; i++)
+      {
+	  workers[i].job = &job;
+	  workers[i].handle =
+	      open_datasource (db_path, table, transparent_color,
+			       background_color, jpeg_profile);
+	  if (!(workers[i].handle))
+	    {
+		threads = i;
+		break;
+	    }
+      }
+/* the workers keep all the CPUs busy: each image is encoded serially */
+    if (threads > 1)
+	rasterliteSetEncoderThreads (1);
+    start = batch_clock ();
+    if (threads > 1)
+      {
+#ifndef _WIN32
+	  for (i = 0; i < threads; i++)
+	    {
+		if (pthread_create
+		    (&(workers[i].thread), NULL, batch_worker,
+		     workers + i) == 0)
+		    started++;
+		else
+		    break;
+	    }
+	  if (!started)
+	    {
+		/* falling back to serial rendering */
+		batch_worker (workers);
+	    }
+	  for (i = 0; i < started; i++)
+	      pthread_join (workers[i].thread, NULL);
+#endif
+      }
+    else if (threads == 1)
+	batch_worker (workers);
+    if (threads > 0)
+	batch_report (&job, invalid, batch_clock () - start);
+    for (i = 0; i < threads; i++)
+	rasterliteClose (workers[i].handle);
+    for (i = 0; i < job.count; i++)
+      {
+	  if (!(job.requests[i].ok))
+	      failed = 1;
+	  free (job.requests[i].img_path);
+      }
+    free (job.requests);
+    free (workers);
+#ifndef _WIN32
+    pthread_mutex_destroy (&(job.mutex));
+#endif
+    if (threads == 0 || invalid)
+	return 1;
+    return failed;
+}
+
 static void
 do_help ()
 {
@@ -346,9 +754,20 @@ do_help ()
 	     "-i or --image-type  type           [JPEG|GIF|PNG|TIFF]\n");
     fprintf (stderr,
 	     "-q or --quality     num            [default = 75(JPEG)]\n");
+    fprintf (stderr,
+	     "-J or --jpeg-profile type          [DEFAULT|SPEED|SIZE]\n");
     fprintf (stderr, "-c or --transparent-color 0xRRGGBB [default = NONE]\n");
     fprintf (stderr,
-	     "-b or --background-color  0xRRGGBB [default = 0x000000]\n");
+	     "-b or --background-color  0xRRGGBB [default = 0x000000]\n\n");
+    fprintf (stderr, "Batch mode [-x -y -r -w -h -i -o are then ignored]:\n");
+    fprintf (stderr, "-------------------------------------------------\n");
+    fprintf (stderr,
+	     "-B or --batch       pathname       request lines [- = stdin]\n");
+    fprintf (stderr,
+	     "-n or --threads     num            [default = 1]\n");
+    fprintf (stderr, "each request line is:\n");
+    fprintf (stderr,
+	     "   center-x center-y pixel-ratio width height [JPEG|GIF|PNG|TIFF] output-path\n");
 }
 
 int
@@ -360,12 +779,15 @@ main (int argc, char *argv[])
     const char *img_path = NULL;
     const char *db_path = NULL;
     const char *table = NULL;
+    const char *batch_path = NULL;
+    int threads = 1;
     double cx = DBL_MAX;
     double cy = DBL_MAX;
     double pixel_ratio = DBL_MAX;
     int width = -1;
     int height = -1;
     int quality_factor = -999999;
+    int jpeg_profile = RASTERLITE_JPEG_PROFILE_DEFAULT;
     int image_type = GAIA_JPEG_BLOB;
     int transparent_color = -1;
     int background_color = true_color (0, 0, 0);
@@ -416,6 +838,20 @@ main (int argc, char *argv[])
 		  case ARG_QUALITY_FACTOR:
 		      quality_factor = atoi (argv[i]);
 		      break;
+		  case ARG_JPEG_PROFILE:
+		      if (strcasecmp (argv[i], "DEFAULT") == 0)
+			  jpeg_profile = RASTERLITE_JPEG_PROFILE_DEFAULT;
+		      else if (strcasecmp (argv[i], "SPEED") == 0)
+			  jpeg_profile = RASTERLITE_JPEG_PROFILE_SPEED;
+		      else if (strcasecmp (argv[i], "SIZE") == 0)
+			  jpeg_profile = RASTERLITE_JPEG_PROFILE_SIZE;
+		      else
+			{
+			    fprintf (stderr, "unknown JPEG profile: %s\n",
+				     argv[i]);
+			    error = 1;
+			}
+		      break;
 		  case ARG_TRANSPARENT:
 		      transparent_color = parse_hex_color (argv[i]);
 		      if (transparent_color == WRONG_COLOR)
@@ -426,6 +862,16 @@ main (int argc, char *argv[])
 		      if (background_color == WRONG_COLOR)
 			  strcpy (error_back_color, argv[i]);
 		      break;
+		  case ARG_BATCH:
+		      batch_path = argv[i];
+		      break;
+		  case ARG_THREADS:
+		      threads = atoi (argv[i]);
+		      if (threads < 1)
+			  threads = 1;
+		      if (threads > 64)
+			  threads = 64;
+		      break;
 		  };
 		next_arg = ARG_NONE;
 		continue;
@@ -536,6 +982,16 @@ main (int argc, char *argv[])
 		next_arg = ARG_QUALITY_FACTOR;
 		continue;
 	    }
+	  if (strcmp (argv[i], "-J") == 0)
+	    {
+		next_arg = ARG_JPEG_PROFILE;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--jpeg-profile") == 0)
+	    {
+		next_arg = ARG_JPEG_PROFILE;
+		continue;
+	    }
 	  if (strcmp (argv[i], "-c") == 0)
 	    {
 		next_arg = ARG_TRANSPARENT;
@@ -556,6 +1012,26 @@ main (int argc, char *argv[])
 		next_arg = ARG_BACKGROUND;
 		continue;
 	    }
+	  if (strcmp (argv[i], "-B") == 0)
+	    {
+		next_arg = ARG_BATCH;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--batch") == 0)
+	    {
+		next_arg = ARG_BATCH;
+		continue;
+	    }
+	  if (strcmp (argv[i], "-n") == 0)
+	    {
+		next_arg = ARG_THREADS;
+		continue;
+	    }
+	  if (strcasecmp (argv[i], "--threads") == 0)
+	    {
+		next_arg = ARG_THREADS;
+		continue;
+	    }
 	  fprintf (stderr, "unknown argument: %s\n", argv[i]);
 	  error = 1;
       }
@@ -565,11 +1041,6 @@ main (int argc, char *argv[])
 	  return -1;
       }
 /* checking the arguments */
-    if (!img_path)
-      {
-	  fprintf (stderr, "did you forget setting the --output argument ?\n");
-	  error = 1;
-      }
     if (!db_path)
       {
 	  fprintf (stderr, "did you forget setting the --db-path argument ?\n");
@@ -580,35 +1051,46 @@ main (int argc, char *argv[])
 	  printf ("did you forget setting the --table-name argument ?\n");
 	  error = 1;
       }
-    if (cx == DBL_MAX)
-      {
-	  printf ("did you forget setting the --center-x argument ?\n");
-	  error = 1;
-      }
-    if (cy == DBL_MAX)
+    if (!batch_path)
       {
-	  printf ("did you forget setting the --center-y argument ?\n");
-	  error = 1;
-      }
-    if (pixel_ratio == DBL_MAX)
-      {
-	  printf ("did you forget setting the --pixel-ratio argument ?\n");
-	  error = 1;
-      }
-    if (width <= 0)
-      {
-	  printf ("did you forget setting the --width argument ?\n");
-	  error = 1;
-      }
-    if (height <= 0)
-      {
-	  printf ("did you forget setting the --height argument ?\n");
-	  error = 1;
-      }
-    if (width < 64 || width > 32768 || height < 64 || height > 32768)
-      {
-	  printf ("invalid raster dims [%dh X %dv]\n", width, height);
-	  error = 1;
+	  /* a single raster: all the request args are required */
+	  if (!img_path)
+	    {
+		fprintf (stderr,
+			 "did you forget setting the --output argument ?\n");
+		error = 1;
+	    }
+	  if (cx == DBL_MAX)
+	    {
+		printf ("did you forget setting the --center-x argument ?\n");
+		error = 1;
+	    }
+	  if (cy == DBL_MAX)
+	    {
+		printf ("did you forget setting the --center-y argument ?\n");
+		error = 1;
+	    }
+	  if (pixel_ratio == DBL_MAX)
+	    {
+		printf
+		    ("did you forget setting the --pixel-ratio argument ?\n");
+		error = 1;
+	    }
+	  if (width <= 0)
+	    {
+		printf ("did you forget setting the --width argument ?\n");
+		error = 1;
+	    }
+	  if (height <= 0)
+	    {
+		printf ("did you forget setting the --height argument ?\n");
+		error = 1;
+	    }
+	  if (width < 64 || width > 32768 || height < 64 || height > 32768)
+	    {
+		printf ("invalid raster dims [%dh X %dv]\n", width, height);
+		error = 1;
+	    }
       }
     if (transparent_color == WRONG_COLOR)
       {
@@ -625,7 +1107,7 @@ main (int argc, char *argv[])
 	  do_help ();
 	  return -1;
       }
-    if (image_type == GAIA_JPEG_BLOB)
+    if (image_type == GAIA_JPEG_BLOB || batch_path)
       {
 	  /* normalizing the quality factor */
 	  if (quality_factor == -999999)
@@ -635,7 +1117,11 @@ main (int argc, char *argv[])
 	  if (quality_factor > 90)
 	      quality_factor = 90;
       }
+    if (batch_path)
+	return build_batch (batch_path, db_path, table, threads,
+			    quality_factor, transparent_color,
+			    background_color, jpeg_profile);
     return build_raster (img_path, db_path, table, cx, cy, pixel_ratio, width,
 			 height, image_type, quality_factor, transparent_color,
-			 background_color);
+			 background_color, jpeg_profile);
 }
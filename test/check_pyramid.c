@@ -0,0 +1,309 @@
+/*
+
+ check_pyramid.c -- RasterLite Test Case
+
+ ------------------------------------------------------------------------------
+ 
+ Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ 
+ The contents of this file are subject to the Mozilla Public License Version
+ 1.1 (the "License"); you may not use this file except in compliance with
+ the License. You may obtain a copy of the License at
+ http://www.mozilla.org/MPL/
+ 
+Software distributed under the License is distributed on an "AS IS" basis,
+WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+for the specific language governing rights and limitations under the
+License.
+
+The Original Code is the SpatiaLite library
+
+The Initial Developer of the Original Code is Alessandro Furieri
+ 
+Portions created by the Initial Developer are Copyright (C) 2011
+the Initial Developer. All Rights Reserved.
+
+Contributor(s):
+Brad Hards <bradh@frogmouth.net>
+
+Alternatively, the contents of this file may be used under the terms of
+either the GNU General Public License Version 2 or later (the "GPL"), or
+the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+in which case the provisions of the GPL or the LGPL are applicable instead
+of those above. If you wish to allow use of your version of this file only
+under the terms of either the GPL or the LGPL, and not to allow others to
+use your version of this file under the terms of the MPL, indicate your
+decision by deleting the provisions above and replace them with the notice
+and other provisions required by the GPL or the LGPL. If you do not delete
+the provisions above, a recipient may use your version of this file under
+the terms of any one of the MPL, the GPL or the LGPL.
+ 
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#ifdef SPATIALITE_AMALGAMATION
+#include <spatialite/sqlite3.h>
+#else
+#include <sqlite3.h>
+#endif
+
+#include <spatialite/gaiaexif.h>
+
+#include "../headers/rasterlite.h"
+
+static int progress (const char *source_name, int level, int tiles_done, int tiles_total, void *user_data)
+{
+    int *calls = (int *) user_data;
+    if (source_name == NULL || level != 1 || tiles_done != 0 || tiles_total <= 0)
+	*calls = -1000;
+    else
+	*calls += 1;
+    return 0;
+}
+
+static int cancel_progress (const char *source_name, int level, int tiles_done, int tiles_total, void *user_data)
+{
+    /* cancelling as soon as the first tile of the first level has been stored */
+    int *calls = (int *) user_data;
+    *calls += 1;
+    return (tiles_done >= 1) ? 1 : 0;
+}
+
+static int copy_db (const char *from, const char *to)
+{
+    char buf[8192];
+    size_t n;
+    FILE *in = fopen (from, "rb");
+    FILE *out;
+    if (in == NULL)
+	return 0;
+    out = fopen (to, "wb");
+    if (out == NULL)
+    {
+	fclose (in);
+	return 0;
+    }
+    while ((n = fread (buf, 1, sizeof (buf), in)) > 0)
+	fwrite (buf, 1, n, out);
+    fclose (in);
+    fclose (out);
+    return 1;
+}
+
+static int pyramid_levels (const char *path, char *levels)
+{
+    /* listing the levels registered into raster_pyramids as "size:tiles;" */
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char level[64];
+    *levels = '\0';
+    if (sqlite3_open_v2 (path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+	return 0;
+    if (sqlite3_prepare_v2 (db, "SELECT pixel_x_size, tile_count FROM raster_pyramids WHERE table_prefix = 'globe' ORDER BY pixel_x_size", -1, &stmt, NULL) != SQLITE_OK)
+    {
+	sqlite3_close (db);
+	return 0;
+    }
+    while (sqlite3_step (stmt) == SQLITE_ROW)
+    {
+	sprintf (level, "%g:%d;", sqlite3_column_double (stmt, 0), sqlite3_column_int (stmt, 1));
+	strcat (levels, level);
+    }
+    sqlite3_finalize (stmt);
+    sqlite3_close (db);
+    return 1;
+}
+
+static unsigned long level_tiles_hash (const char *path, double x_size, int *tiles)
+{
+    /* hashing all the tiles of some level, in tile order */
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    unsigned long hash = 2166136261UL;
+    const unsigned char *blob;
+    int i;
+    int n;
+    *tiles = 0;
+    if (sqlite3_open_v2 (path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+	return 0;
+    if (sqlite3_prepare_v2 (db, "SELECT r.raster FROM globe_metadata AS m, globe_rasters AS r WHERE r.id = m.id AND m.pixel_x_size > ? AND m.pixel_x_size < ? ORDER BY m.source_name, m.tile_id", -1, &stmt, NULL) != SQLITE_OK)
+    {
+	sqlite3_close (db);
+	return 0;
+    }
+    sqlite3_bind_double (stmt, 1, x_size * 0.99);
+    sqlite3_bind_double (stmt, 2, x_size * 1.01);
+    while (sqlite3_step (stmt) == SQLITE_ROW)
+    {
+	blob = sqlite3_column_blob (stmt, 0);
+	n = sqlite3_column_bytes (stmt, 0);
+	for (i = 0; i < n; i++)
+	    hash = (hash ^ blob[i]) * 16777619UL;
+	*tiles += 1;
+    }
+    sqlite3_finalize (stmt);
+    sqlite3_close (db);
+    return hash;
+}
+
+static int build_copy (const char *path, int threads, int memory_limit, rasterlitePyramidProgress progress_cb, void *user_data, char *error)
+{
+    /* building all the pyramid levels on some DB copy */
+    void *handle;
+    int result;
+    rasterlitePyramidOptions options;
+    rasterliteInitPyramidOptions(&options);
+    options.threads = threads;
+    options.memory_limit = memory_limit;
+    handle = rasterliteOpen (path, "globe");
+    if (rasterliteIsError(handle))
+    {
+	strcpy (error, rasterliteGetLastError(handle));
+	rasterliteClose(handle);
+	return RASTERLITE_ERROR;
+    }
+    result = rasterliteBuildPyramids(handle, &options, progress_cb, user_data);
+    *error = '\0';
+    if (result != RASTERLITE_OK && rasterliteGetLastError(handle))
+	strcpy (error, rasterliteGetLastError(handle));
+    if (result == RASTERLITE_OK && rasterliteGetLevels(handle) != 4)
+    {
+	sprintf (error, "unexpected levels count: %i", rasterliteGetLevels(handle));
+	result = RASTERLITE_ERROR;
+    }
+    rasterliteClose(handle);
+    return result;
+}
+
+int main (void)
+{
+    void *handle = NULL;
+    int result;
+    int calls = 0;
+    int tiles;
+    unsigned long serial_hash;
+    char levels[1024];
+    char error[1024];
+    rasterlitePyramidOptions options;
+
+    rasterliteInitPyramidOptions(&options);
+    if (options.mode != RASTERLITE_PYRAMID_ALL || options.threads != 0)
+    {
+	printf("ERROR: unexpected default options\n");
+	return -1;
+    }
+
+    handle = rasterliteOpen ("no such file.sqlite", "globe");
+    result = rasterliteBuildPyramids(handle, &options, NULL, NULL);
+    if (result != RASTERLITE_ERROR)
+    {
+	printf("ERROR: BuildPyramids bad handle unexpected result: %i\n", result);
+	rasterliteClose(handle);
+	return -2;
+    }
+    rasterliteClose(handle);
+
+    handle = rasterliteOpen ("globe.sqlite", "globe");
+    if (rasterliteIsError(handle))
+    {
+	printf("ERROR: rasterliteOpen %s\n", rasterliteGetLastError(handle));
+	rasterliteClose(handle);
+	return -3;
+    }
+    /* test mode only reports the work to be done, leaving the DB untouched */
+    options.mode = RASTERLITE_PYRAMID_LEVELS;
+    options.test_mode = 1;
+    result = rasterliteBuildPyramids(handle, &options, progress, &calls);
+    if (result != RASTERLITE_OK)
+    {
+	printf("ERROR: BuildPyramids %s\n", rasterliteGetLastError(handle));
+	rasterliteClose(handle);
+	return -4;
+    }
+    if (calls <= 0)
+    {
+	printf("ERROR: unexpected progress callbacks: %i\n", calls);
+	rasterliteClose(handle);
+	return -5;
+    }
+    if (rasterliteGetLevels(handle) != 4)
+    {
+	printf("ERROR: unexpected levels count: %i\n", rasterliteGetLevels(handle));
+	rasterliteClose(handle);
+	return -6;
+    }
+
+    rasterliteClose(handle);
+
+    /* an actual build, on a copy of the DB: serial, and without any memory limit */
+    if (!copy_db ("globe.sqlite", "pyramid_copy.sqlite"))
+    {
+	printf("ERROR: cannot copy globe.sqlite\n");
+	return -7;
+    }
+    result = build_copy ("pyramid_copy.sqlite", 1, 0, NULL, NULL, error);
+    if (result != RASTERLITE_OK)
+    {
+	printf("ERROR: BuildPyramids [serial] %s\n", error);
+	return -8;
+    }
+    pyramid_levels ("pyramid_copy.sqlite", levels);
+    if (strcmp (levels, "0.18:16;0.36:4;0.72:1;1.44:1;") != 0)
+    {
+	printf("ERROR: unexpected pyramid levels [serial]: %s\n", levels);
+	return -9;
+    }
+    serial_hash = level_tiles_hash ("pyramid_copy.sqlite", 0.36, &tiles);
+    if (tiles != 4)
+    {
+	printf("ERROR: unexpected tiles count at level 0.36: %i\n", tiles);
+	return -10;
+    }
+
+    /* cancelling: the level being built is rolled back, the base one is kept */
+    calls = 0;
+    result = build_copy ("pyramid_copy.sqlite", 1, 0, cancel_progress, &calls, error);
+    if (result != RASTERLITE_ERROR || strstr (error, "cancelled") == NULL)
+    {
+	printf("ERROR: BuildPyramids [cancelled] unexpected result: %i %s\n", result, error);
+	return -11;
+    }
+    pyramid_levels ("pyramid_copy.sqlite", levels);
+    if (strcmp (levels, "0.18:16;") != 0)
+    {
+	printf("ERROR: unexpected pyramid levels [cancelled]: %s\n", levels);
+	return -12;
+    }
+    level_tiles_hash ("pyramid_copy.sqlite", 0.36, &tiles);
+    if (tiles != 0)
+    {
+	printf("ERROR: the cancelled level wasn't rolled back: %i tiles\n", tiles);
+	return -13;
+    }
+
+    /* many threads and a 1 MB budget [many batches]: the very same tiles */
+    result = build_copy ("pyramid_copy.sqlite", 4, 1, NULL, NULL, error);
+    if (result != RASTERLITE_OK)
+    {
+	printf("ERROR: BuildPyramids [threads] %s\n", error);
+	return -14;
+    }
+    pyramid_levels ("pyramid_copy.sqlite", levels);
+    if (strcmp (levels, "0.18:16;0.36:4;0.72:1;1.44:1;") != 0)
+    {
+	printf("ERROR: unexpected pyramid levels [threads]: %s\n", levels);
+	return -15;
+    }
+    if (level_tiles_hash ("pyramid_copy.sqlite", 0.36, &tiles) != serial_hash || tiles != 4)
+    {
+	printf("ERROR: threaded and serial builds differ\n");
+	return -16;
+    }
+    remove ("pyramid_copy.sqlite");
+
+    return 0;
+}
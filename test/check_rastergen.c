@@ -66,8 +66,16 @@ int main (void)
     int size;
     int sizeref = 4540;
     int sizemin = sizeref;
+    int default_size;
+    void *raw;
+    void *raw2;
+    int raw_width;
+    int raw_height;
     FILE *reffilestream;
     int i;
+    rasterliteStats stats;
+    double scan_cost = 0.0;
+    double rtree_cost = 0.0;
     
     handle = rasterliteOpen ("globe.sqlite", "globe");
     if (rasterliteIsError(handle))
@@ -117,6 +125,19 @@ int main (void)
     }
     free(raster);
     free(refraster);
+
+    /* the SIZE profile must shrink the very same raster */
+    default_size = size;
+    rasterliteSetJpegProfile(handle, RASTERLITE_JPEG_PROFILE_SIZE);
+    result = rasterliteGetRaster(handle, 133.0, -40.0, 0.36, 256, 256, GAIA_JPEG_BLOB, 50, (void**)&raster, &size);
+    rasterliteSetJpegProfile(handle, RASTERLITE_JPEG_PROFILE_DEFAULT);
+    if ((result != RASTERLITE_OK) || (size >= default_size))
+    {
+	printf("ERROR: GetRaster JPEG 50 [SIZE profile] %s, %i bytes\n", rasterliteGetLastError(handle), size);
+	rasterliteClose(handle);
+	return -26;
+    }
+    free(raster);
   
     /* TODO: we could generate reference images and do the comparison for each case */
     result = rasterliteGetRaster(handle, 133.0, -40.0, 0.36, 256, 256, GAIA_EXIF_BLOB, 50, (void**)&raster, &size);
@@ -144,6 +165,25 @@ int main (void)
 	rasterliteClose(handle);
 	return -7;
     }
+    /* handing the buffer back: the next encoder may well recycle it */
+    rasterliteReleaseBuffer(raster, size);
+
+    /* packed PNG options: the defaults must be unchanged, level 0 stores */
+    result = rasterliteGetRaster(handle, 133.0, -40.0, 0.36, 256, 256, GAIA_PNG_BLOB, RASTERLITE_PNG_QUALITY(-1, 0, 0), (void**)&raster, &size);
+    if ((result != RASTERLITE_OK) || (size != 43280))
+    {
+	printf("ERROR: GetRaster PNG [default options] %s, %i bytes\n", rasterliteGetLastError(handle), size);
+	rasterliteClose(handle);
+	return -24;
+    }
+    free(raster);
+    result = rasterliteGetRaster(handle, 133.0, -40.0, 0.36, 256, 256, GAIA_PNG_BLOB, RASTERLITE_PNG_QUALITY(0, RASTERLITE_PNG_FILTER_NONE, 0), (void**)&raster, &size);
+    if ((result != RASTERLITE_OK) || (size <= 43280))
+    {
+	printf("ERROR: GetRaster PNG [level 0] %s, %i bytes\n", rasterliteGetLastError(handle), size);
+	rasterliteClose(handle);
+	return -25;
+    }
     free(raster);
     
     /* very small blob */
@@ -232,7 +272,123 @@ int main (void)
 	rasterliteClose(handle);
 	return -15;
     }
+
+    /* a Deflate compressed TIFF must be smaller, yet decode to the very same pixels */
+    result = rasterliteGetRaster(handle, 133.0, -40.0, 0.36, 256, 256, GAIA_TIFF_BLOB, RASTERLITE_TIFF_QUALITY(RASTERLITE_TIFF_DEFLATE, 1), (void**)&refraster, &default_size);
+    if ((result != RASTERLITE_OK) || (default_size >= size))
+    {
+	printf("ERROR: GetRaster TIFF BLOB [Deflate] %s, %i bytes\n", rasterliteGetLastError(handle), default_size);
+	rasterliteClose(handle);
+	return -27;
+    }
+    result = rasterliteTiffBlobToRawImage(raster, size, GAIA_RGB_ARRAY, &raw, &raw_width, &raw_height);
+    if (result == RASTERLITE_OK)
+	result = rasterliteTiffBlobToRawImage(refraster, default_size, GAIA_RGB_ARRAY, &raw2, &raw_width, &raw_height);
+    if ((result != RASTERLITE_OK) || memcmp(raw, raw2, raw_width * raw_height * 3) != 0)
+    {
+	printf("ERROR: TIFF BLOB [Deflate] decodes to different pixels\n");
+	rasterliteClose(handle);
+	return -28;
+    }
+    free(raw);
+    free(raw2);
+    free(refraster);
+    free(raster);
+
+    result = rasterliteGetLastStats(handle, &stats);
+    if (result != RASTERLITE_OK)
+    {
+	printf("ERROR: GetLastStats\n");
+	rasterliteClose(handle);
+	return -16;
+    }
+    if (stats.level < 0 || stats.rows < 1 || stats.bytes <= 0)
+    {
+	printf("ERROR: GetLastStats level=%d rows=%d\n", stats.level, stats.rows);
+	rasterliteClose(handle);
+	return -17;
+    }
+    if ((stats.jpeg_tiles + stats.png_tiles + stats.gif_tiles + stats.tiff_tiles) < 1 ||
+        (stats.jpeg_tiles + stats.png_tiles + stats.gif_tiles + stats.tiff_tiles) > stats.rows)
+    {
+	printf("ERROR: GetLastStats unexpected decoded tiles count\n");
+	rasterliteClose(handle);
+	return -18;
+    }
+    if (stats.strategy != RASTERLITE_STRATEGY_RTREE && stats.strategy != RASTERLITE_STRATEGY_PLAIN)
+    {
+	printf("ERROR: GetLastStats unexpected strategy %d\n", stats.strategy);
+	rasterliteClose(handle);
+	return -19;
+    }
+
+    result = rasterliteGetAccessCosts(handle, &scan_cost, &rtree_cost);
+    if ((result != RASTERLITE_OK) || (scan_cost <= 0.0) || (rtree_cost <= 0.0))
+    {
+	printf("ERROR: GetAccessCosts scan=%g rtree=%g\n", scan_cost, rtree_cost);
+	rasterliteClose(handle);
+	return -20;
+    }
+    if (rasterliteSetAccessCosts(handle, 0.0, rtree_cost) != RASTERLITE_ERROR)
+    {
+	printf("ERROR: SetAccessCosts accepted a zero cost\n");
+	rasterliteClose(handle);
+	return -21;
+    }
+
+    /* both forced strategies must render the very same raster */
+    rasterliteSetAccessStrategy(handle, RASTERLITE_STRATEGY_PLAIN);
+    result = rasterliteGetRaster(handle, 133.0, -40.0, 0.36, 256, 256, GAIA_TIFF_BLOB, 50, (void**)&raster, &size);
+    rasterliteGetLastStats(handle, &stats);
+    if ((result != RASTERLITE_OK) || (size != 198901) || (stats.strategy != RASTERLITE_STRATEGY_PLAIN))
+    {
+	printf("ERROR: GetRaster TIFF BLOB [table scan] %s, %i bytes\n", rasterliteGetLastError(handle), size);
+	rasterliteClose(handle);
+	return -22;
+    }
     free(raster);
+    rasterliteSetAccessStrategy(handle, RASTERLITE_STRATEGY_RTREE);
+    result = rasterliteGetRaster(handle, 133.0, -40.0, 0.36, 256, 256, GAIA_TIFF_BLOB, 50, (void**)&raster, &size);
+    rasterliteGetLastStats(handle, &stats);
+    if ((result != RASTERLITE_OK) || (size != 198901) || (stats.strategy != RASTERLITE_STRATEGY_RTREE))
+    {
+	printf("ERROR: GetRaster TIFF BLOB [R*Tree] %s, %i bytes\n", rasterliteGetLastError(handle), size);
+	rasterliteClose(handle);
+	return -23;
+    }
+    free(raster);
+    rasterliteSetAccessStrategy(handle, RASTERLITE_STRATEGY_AUTO);
+    rasterliteClose(handle);
+
+    /* costs seeded before the first request must never be timed again */
+    handle = rasterliteOpen ("globe.sqlite", "globe");
+    if (rasterliteIsError(handle))
+    {
+	printf("ERROR: rasterliteOpen [seeded costs] %s\n", rasterliteGetLastError(handle));
+	rasterliteClose(handle);
+	return -29;
+    }
+    if (rasterliteSetAccessCosts(handle, 0.001, 0.002) != RASTERLITE_OK)
+    {
+	printf("ERROR: SetAccessCosts rejected valid costs\n");
+	rasterliteClose(handle);
+	return -30;
+    }
+    result = rasterliteGetRaster(handle, 133.0, -40.0, 0.36, 256, 256, GAIA_TIFF_BLOB, 50, (void**)&raster, &size);
+    if ((result != RASTERLITE_OK) || (size != 198901))
+    {
+	printf("ERROR: GetRaster TIFF BLOB [seeded costs] %s, %i bytes\n", rasterliteGetLastError(handle), size);
+	rasterliteClose(handle);
+	return -31;
+    }
+    free(raster);
+    result = rasterliteGetAccessCosts(handle, &scan_cost, &rtree_cost);
+    if ((result != RASTERLITE_OK) || (scan_cost != 0.001) || (rtree_cost != 0.002))
+    {
+	printf("ERROR: seeded costs replaced: scan=%g rtree=%g\n", scan_cost, rtree_cost);
+	rasterliteClose(handle);
+	return -32;
+    }
     rasterliteClose(handle);
     
     return 0;